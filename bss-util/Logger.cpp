@@ -4,29 +4,257 @@
 #include "bss-util/bss_util.h"
 #include "bss-util/Logger.h"
 #include "bss-util/stream.h"
+#include "bss-util/Thread.h"
 #include <fstream>
-#include <iomanip>
+#include <memory>
+#include <mutex>
+
+namespace bss {
+  namespace internal {
+    // Single-producer single-consumer ring of length-prefixed records. The owning thread formats each record into a private staging
+    // area, and only touches the ring when the stream is flushed, so a record is either submitted whole or not at all.
+    struct LogBuffer : std::streambuf
+    {
+      LogBuffer(LogAsync* async, uint64_t logger, size_t capacity) : owner(async), id(logger), stream(this), _ring(new char[capacity]), _mask(capacity - 1),
+        _stage(new char[64]), _stagecap(64), _head(0), _tail(0), _dropped(0)
+      {
+        setp(_stage.get(), _stage.get() + _stagecap);
+      }
+      // Copies out as many records as fit in out, returning the number of bytes written. Only called by the background thread.
+      size_t Drain(std::streambuf* out)
+      {
+        size_t head = _head.load(std::memory_order_acquire);
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t total = head - tail;
+        while(tail != head)
+        {
+          uint32_t len;
+          _read(tail, (char*)&len, sizeof(uint32_t));
+          tail += sizeof(uint32_t);
+          size_t i = tail & _mask;
+          size_t first = bssmin((size_t)len, _mask + 1 - i);
+          out->sputn(_ring.get() + i, first);
+          out->sputn(_ring.get(), len - first);
+          tail += len;
+        }
+        _tail.store(tail, std::memory_order_release);
+        return total;
+      }
+      inline bool Empty() const { return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_relaxed); }
+      inline uint64_t TakeDropped() { return _dropped.exchange(0, std::memory_order_relaxed); }
+
+      LogAsync* owner;
+      uint64_t id; // Identifies the Logger this buffer belongs to, because the address of a destroyed Logger can be reused
+      std::ostream stream;
+
+    protected:
+      virtual int_type overflow(int_type c) override;
+      virtual int sync() override;
+      inline void _read(size_t pos, char* dest, size_t len) const
+      {
+        for(size_t i = 0; i < len; ++i)
+          dest[i] = _ring[(pos + i) & _mask];
+      }
+      inline void _write(size_t pos, const char* src, size_t len)
+      {
+        size_t i = pos & _mask;
+        size_t first = bssmin((size_t)len, _mask + 1 - i);
+        memcpy(_ring.get() + i, src, first);
+        memcpy(_ring.get(), src + first, len - first);
+      }
+
+      std::unique_ptr<char[]> _ring;
+      size_t _mask;
+      std::unique_ptr<char[]> _stage;
+      size_t _stagecap;
+      BSS_ALIGN(64) std::atomic<size_t> _head; // Only written by the owning thread
+      BSS_ALIGN(64) std::atomic<size_t> _tail; // Only written by the background thread
+      std::atomic<uint64_t> _dropped;
+    };
+
+    struct LogAsync
+    {
+      LogAsync(StreamSplitter* target, size_t bytes, Logger::ASYNC_OVERFLOW policy, uint32_t flushms) : split(target), capacity(bytes),
+        overflow(policy), flushns(flushms * 1000000ULL), id(++_ids), dropped(0), _flushreq(0), _flushdone(0), _stop(false)
+      {
+        _thread = Thread([this]() { _run(); });
+      }
+      ~LogAsync()
+      {
+        _stop.store(true, std::memory_order_release);
+        sleeper.Wake();
+        _thread.join();
+      }
+      LogBuffer* Get();
+      void Flush()
+      {
+        uint64_t req = _flushreq.fetch_add(1, std::memory_order_acq_rel) + 1;
+        sleeper.Wake();
+        while(_flushdone.load(std::memory_order_acquire) < req)
+          std::this_thread::yield();
+      }
+
+      StreamSplitter* split;
+      size_t capacity;
+      Logger::ASYNC_OVERFLOW overflow;
+      uint64_t flushns;
+      uint64_t id;
+      std::atomic<uint64_t> dropped;
+      std::mutex lock; // Guards the buffer list and the targets, which the background thread holds while writing out a batch
+      Sleeper sleeper;
+
+    protected:
+      void _run();
+      bool _drain();
+
+      std::vector<std::shared_ptr<LogBuffer>> _buffers;
+      std::atomic<uint64_t> _flushreq;
+      std::atomic<uint64_t> _flushdone;
+      std::atomic<bool> _stop;
+      Thread _thread;
+      static std::atomic<uint64_t> _ids;
+    };
+  }
+}
 
 using namespace bss;
+using namespace bss::internal;
 using namespace std;
 
+std::atomic<uint64_t> LogAsync::_ids(0);
+// Each thread keeps its buffers alive, so a thread that exits while its Logger is still running leaves the buffer for the background thread
+// to drain and release, and a Logger destroyed before the thread leaves the buffer for the thread to release.
+static thread_local std::vector<std::shared_ptr<LogBuffer>> LOG_TLS;
+
+LogBuffer* LogAsync::Get()
+{
+  for(auto& p : LOG_TLS)
+    if(p->id == id)
+      return p.get();
+
+  for(size_t i = LOG_TLS.size(); i-- > 0;) // Release buffers whose loggers no longer exist
+    if(LOG_TLS[i].use_count() == 1)
+      LOG_TLS.erase(LOG_TLS.begin() + i);
+
+  std::shared_ptr<LogBuffer> p(new LogBuffer(this, id, capacity));
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    _buffers.push_back(p);
+  }
+  LOG_TLS.push_back(p);
+  return p.get();
+}
+LogBuffer::int_type LogBuffer::overflow(int_type c)
+{
+  size_t len = pptr() - pbase();
+  size_t max = _mask + 1 - sizeof(uint32_t);
+  if(len >= max) // Records that can't fit in the ring are truncated
+    return traits_type::not_eof(c);
+  if(len >= _stagecap)
+  {
+    size_t ncap = bssmin(_stagecap * 2, max);
+    char* n = new char[ncap];
+    memcpy(n, _stage.get(), len);
+    _stage.reset(n);
+    _stagecap = ncap;
+    setp(_stage.get(), _stage.get() + _stagecap);
+    pbump((int)len);
+  }
+  if(!traits_type::eq_int_type(c, traits_type::eof()))
+  {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+int LogBuffer::sync()
+{
+  uint32_t len = (uint32_t)(pptr() - pbase());
+  if(!len)
+    return 0;
+  setp(_stage.get(), _stage.get() + _stagecap);
+
+  size_t need = len + sizeof(uint32_t);
+  size_t cap = _mask + 1;
+  size_t head = _head.load(std::memory_order_relaxed);
+  size_t used = head - _tail.load(std::memory_order_acquire);
+  if(used + need > cap)
+  {
+    if(owner->overflow == Logger::ASYNC_DROP)
+    {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      owner->sleeper.Wake();
+      return 0;
+    }
+    owner->sleeper.Wake();
+    while((used = head - _tail.load(std::memory_order_acquire)) + need > cap)
+      std::this_thread::yield();
+  }
+
+  _write(head, (const char*)&len, sizeof(uint32_t));
+  _write(head + sizeof(uint32_t), _stage.get(), len);
+  _head.store(head + need, std::memory_order_release);
+  if(used <= cap / 2 && used + need > cap / 2) // Only wake the background thread once per half-buffer, so most records never make a syscall
+    owner->sleeper.Wake();
+  return 0;
+}
+bool LogAsync::_drain()
+{
+  bool any = false;
+  for(size_t i = _buffers.size(); i-- > 0;)
+  {
+    LogBuffer& b = *_buffers[i];
+    if(uint64_t n = b.TakeDropped())
+    {
+      dropped.fetch_add(n, std::memory_order_relaxed);
+      std::ostream o(split);
+      o << "[Logger dropped " << n << " records]" << '\n';
+      any = true;
+    }
+    any = (b.Drain(split) > 0) || any;
+    if(_buffers[i].use_count() == 1 && b.Empty()) // The thread that owned this buffer has exited
+      _buffers.erase(_buffers.begin() + i);
+  }
+  return any;
+}
+void LogAsync::_run()
+{
+  for(;;)
+  {
+    uint32_t token = sleeper.Prepare();
+    bool stop = _stop.load(std::memory_order_acquire);
+    uint64_t req = _flushreq.load(std::memory_order_acquire);
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if(_drain())
+        split->pubsync(); // One write and flush per target for the whole batch, instead of one per record
+    }
+    _flushdone.store(req, std::memory_order_release);
+    if(stop)
+      break;
+    if(req == _flushreq.load(std::memory_order_acquire))
+      sleeper.Sleep(token, flushns);
+  }
+}
+
 const char* Logger::DEFAULTFORMAT = "{4} [{0}] ({1}:{2}) {3}";
 const char* Logger::DEFAULTNULLFORMAT = "{4} ({1}:{2}) {3}";
 
 Logger::Logger(Logger&& mov) : _levels(std::move(mov._levels)), _split(mov._split), _tz(GetTimeZoneMinutes()), _files(std::move(mov._files)),
-  _backup(std::move(mov._backup)), _stream(_split), _maxlevel(mov._maxlevel), _format(mov._format), _nullformat(mov._nullformat)
+  _backup(std::move(mov._backup)), _stream(_split), _maxlevel(mov._maxlevel), _format(mov._format), _nullformat(mov._nullformat), _async(mov._async)
 {
   mov._split = 0;
+  mov._async = 0;
 }
 Logger::Logger(std::ostream* log) : _levels(6), _split(new StreamSplitter()), _tz(GetTimeZoneMinutes()), _stream(_split), _maxlevel(127),
-  _format(DEFAULTFORMAT), _nullformat(DEFAULTNULLFORMAT)
+  _format(DEFAULTFORMAT), _nullformat(DEFAULTNULLFORMAT), _async(0)
 {
   _levelDefaults();
   if(log != 0)
     AddTarget(*log);
 }
 Logger::Logger(const char* logfile, std::ostream* log) : _levels(6), _split(new StreamSplitter()), _tz(GetTimeZoneMinutes()), _stream(_split),
-  _maxlevel(127), _format(DEFAULTFORMAT), _nullformat(DEFAULTNULLFORMAT)
+  _maxlevel(127), _format(DEFAULTFORMAT), _nullformat(DEFAULTNULLFORMAT), _async(0)
 {
   _levelDefaults();
   AddTarget(logfile);
@@ -35,7 +263,7 @@ Logger::Logger(const char* logfile, std::ostream* log) : _levels(6), _split(new
 }
 #ifdef BSS_PLATFORM_WIN32
 Logger::Logger(const wchar_t* logfile, std::ostream* log) : _levels(6), _split(new StreamSplitter()), _tz(GetTimeZoneMinutes()), _stream(_split),
-  _maxlevel(127), _format(DEFAULTFORMAT), _nullformat(DEFAULTNULLFORMAT)
+  _maxlevel(127), _format(DEFAULTFORMAT), _nullformat(DEFAULTNULLFORMAT), _async(0)
 {
   _levelDefaults();
   AddTarget(logfile);
@@ -45,6 +273,7 @@ Logger::Logger(const wchar_t* logfile, std::ostream* log) : _levels(6), _split(n
 #endif
 Logger::~Logger()
 {
+  ClearAsync();
   ClearTargets();
   for(size_t i = 0; i < _backup.size(); ++i) //restore stream buffer backups so we don't blow up someone else's stream when destroying ourselves
     _backup[i].first.rdbuf(_backup[i].second);
@@ -57,7 +286,16 @@ void Logger::Assimilate(std::ostream& stream)
 }
 void Logger::AddTarget(std::ostream& stream)
 {
-  if(_split != 0) _split->AddTarget(&stream);
+  if(_split != 0)
+  {
+    if(_async)
+    {
+      std::lock_guard<std::mutex> guard(_async->lock);
+      _split->AddTarget(&stream);
+    }
+    else
+      _split->AddTarget(&stream);
+  }
 }
 void Logger::AddTarget(const char* file)
 {
@@ -81,6 +319,9 @@ void Logger::AddTarget(const wchar_t* file)
 
 void Logger::ClearTargets()
 {
+  std::unique_lock<std::mutex> guard;
+  if(_async)
+    guard = std::unique_lock<std::mutex>(_async->lock);
   if(_split != 0) _split->ClearTargets();
   for(size_t i = 0; i < _files.size(); ++i)
 #ifdef BSS_COMPILER_GCC 
@@ -91,6 +332,34 @@ void Logger::ClearTargets()
   _files.clear();
 }
 
+std::ostream& Logger::GetStream()
+{
+  return !_async ? _stream : _async->Get()->stream;
+}
+void Logger::SetAsync(size_t capacity, ASYNC_OVERFLOW overflow, uint32_t flushms)
+{
+  ClearAsync();
+  if(_split != 0)
+    _async = new LogAsync(_split, (size_t)NextPow2((uint64_t)bssmax(capacity, (size_t)64)), overflow, flushms);
+}
+void Logger::ClearAsync()
+{
+  if(_async)
+    delete _async; // Stopping the background thread writes out anything still in the buffers
+  _async = 0;
+}
+void Logger::Flush()
+{
+  if(_async)
+    _async->Flush();
+  else
+    _stream.flush();
+}
+uint64_t Logger::GetDropped() const
+{
+  return !_async ? 0 : _async->dropped.load(std::memory_order_relaxed);
+}
+
 void Logger::SetFormat(const char* format)
 {
   _format = format;
@@ -114,33 +383,39 @@ void Logger::SetMaxLevel(uint8_t level)
 
 bool Logger::_writeDateTime(long timez, std::ostream& log, bool timeonly)
 {
+  // Converting and formatting the time is most of the cost of a log header, so each thread keeps the last string it formatted
+  static thread_local struct { time_t raw; long tz; bool timeonly; char str[64]; } cache = { (time_t)-1, 0, false, { 0 } };
+
   time_t rawtime;
   TIME64(&rawtime);
-  tm stm;
-  tm* ptm = &stm;
-  if(GMTIMEFUNC(&rawtime, ptm) != 0)
-    return false;
-
-  long m = ptm->tm_hour * 60 + ptm->tm_min + 1440 + timez; //+1440 ensures this is never negative because % does not properly respond to negative numbers.
-  long h = ((m / 60) % 24);
-  m %= 60;
-
-  char logchar = log.fill();
-  std::streamsize logwidth = log.width();
-  log.fill('0');
-  //Write date if we need to
-  if(!timeonly) log << std::setw(4) << ptm->tm_year + 1900 << std::setw(1) << '-' << std::setw(2) << ptm->tm_mon + 1 << std::setw(1) << '-' << std::setw(2) << ptm->tm_mday << std::setw(1) << ' ';
-  //Write time and flush stream
-  log << std::setw(1) << h << std::setw(0) << ':' << std::setw(2) << m << std::setw(0) << ':' << std::setw(2) << ptm->tm_sec;
-
-  //Reset values of stream
-  log.width(logwidth);
-  log.fill(logchar);
+  if(rawtime != cache.raw || timez != cache.tz || timeonly != cache.timeonly)
+  {
+    tm stm;
+    tm* ptm = &stm;
+    if(GMTIMEFUNC(&rawtime, ptm) != 0)
+      return false;
+
+    long m = ptm->tm_hour * 60 + ptm->tm_min + 1440 + timez; //+1440 ensures this is never negative because % does not properly respond to negative numbers.
+    long h = ((m / 60) % 24);
+    m %= 60;
+
+    if(timeonly)
+      snprintf(cache.str, sizeof(cache.str), "%ld:%02ld:%02d", h, m, ptm->tm_sec);
+    else
+      snprintf(cache.str, sizeof(cache.str), "%04d-%02d-%02d %ld:%02ld:%02d", ptm->tm_year + 1900, ptm->tm_mon + 1, ptm->tm_mday, h, m, ptm->tm_sec);
+    cache.raw = rawtime;
+    cache.tz = timez;
+    cache.timeonly = timeonly;
+  }
 
+  log << cache.str;
   return true;
 }
 Logger& Logger::operator=(Logger&& right)
 {
+  ClearAsync();
+  _async = right._async;
+  right._async = 0;
   _tz = GetTimeZoneMinutes();
   _files = std::move(right._files);
   _backup = std::move(right._backup);
@@ -169,7 +444,7 @@ int Logger::PrintLogV(const char* source, const char* file, size_t line, int8_t
 {
   if(level >= _maxlevel)
     return 0;
-  LogHeader(source, file, line, level);
+  std::ostream& o = LogHeader(source, file, line, level);
 
   va_list vltemp;
   va_copy(vltemp, args);
@@ -177,7 +452,7 @@ int Logger::PrintLogV(const char* source, const char* file, size_t line, int8_t
   va_end(vltemp);
   VARARRAY(char, buf, _length);
   int r = internal::STR_CT<char>::VPF(buf, _length, format, args);
-  _stream << buf << std::endl;
+  o << buf << std::endl;
   return r;
 }
 void Logger::_header(std::ostream& o, int n, const char* source, const char* file, size_t line, const char* level, long tz)
@@ -196,6 +471,7 @@ void Logger::_header(std::ostream& o, int n, const char* source, const char* fil
 std::ostream& Logger::_logHeader(const char* source, const char* file, size_t line, const char* level)
 {
   file = _trimPath(file);
-  internal::__safeFormat<const char*, const char*, size_t, const char*, long>::F<&_header>(_stream, ((!source && _nullformat != 0) ? _nullformat : _format), source, file, line, level, _tz);
-  return _stream;
+  std::ostream& o = GetStream();
+  internal::__safeFormat<const char*, const char*, size_t, const char*, long>::F<&_header>(o, ((!source && _nullformat != 0) ? _nullformat : _format), source, file, line, level, _tz);
+  return o;
 }
\ No newline at end of file
@@ -82,6 +82,77 @@ struct bssCPUInfo bssGetCPUInfo()
   return r;
 }
 
+extern size_t bssGetProcessorCores(size_t* cores, size_t len)
+{
+#ifdef BSS_PLATFORM_WIN32
+  // GetLogicalProcessorInformation only sees the processor group of the calling thread, so machines with more than 64 logical
+  // processors need the Ex version. Logical processors are numbered by group, each group taking GetMaximumProcessorCount() numbers.
+  DWORD sz = 0;
+  size_t n = 0;
+  char* info;
+  GetLogicalProcessorInformationEx(RelationProcessorCore, 0, &sz);
+  info = (char*)malloc(sz);
+  for(size_t i = 0; i < len; ++i)
+    cores[i] = (size_t)~0; // Processors that aren't active don't belong to any core
+  if(info != 0 && GetLogicalProcessorInformationEx(RelationProcessorCore, (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)info, &sz))
+  {
+    size_t core = 0;
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX* e;
+    for(char* p = info; p < info + sz; p += e->Size)
+    {
+      e = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)p;
+      if(e->Relationship != RelationProcessorCore)
+        continue;
+      for(WORD g = 0; g < e->Processor.GroupCount; ++g)
+      {
+        size_t base = 0;
+        for(WORD k = 0; k < e->Processor.GroupMask[g].Group; ++k)
+          base += GetMaximumProcessorCount(k);
+        for(size_t bit = 0; bit < sizeof(KAFFINITY) * 8; ++bit)
+        {
+          if(!(e->Processor.GroupMask[g].Mask & ((KAFFINITY)1 << bit)))
+            continue;
+          if(base + bit < len)
+            cores[base + bit] = core;
+          if(base + bit >= n)
+            n = base + bit + 1;
+        }
+      }
+      ++core;
+    }
+  }
+  free(info);
+  return n;
+#else
+  char path[128];
+  FILE* fp;
+  long n = sysconf(_SC_NPROCESSORS_CONF);
+  if(n < 1)
+    n = 1;
+  for(long i = 0; i < n && (size_t)i < len; ++i)
+  {
+    long package = 0;
+    long core = i; // If the kernel doesn't expose the topology, treat each logical processor as its own core
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/topology/core_id", i);
+    if((fp = fopen(path, "r")) != 0)
+    {
+      if(fscanf(fp, "%ld", &core) != 1)
+        core = i;
+      fclose(fp);
+    }
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/topology/physical_package_id", i);
+    if((fp = fopen(path, "r")) != 0)
+    {
+      if(fscanf(fp, "%ld", &package) != 1)
+        package = 0;
+      fclose(fp);
+    }
+    cores[i] = ((size_t)package << 16) | (size_t)core; // core_id is only unique within a package
+  }
+  return (size_t)n;
+#endif
+}
+
 extern const char* GetProgramPath()
 {
 #ifdef BSS_PLATFORM_WIN32
@@ -3,10 +3,13 @@
 
 #include "bss-util/bss_util.h"
 #include "bss-util/Profiler.h"
+#include "bss-util/LockStats.h"
 #include "bss-util/Str.h"
 #include "bss-util/ArraySort.h"
 #include "bss-util/GreedyAlloc.h"
 #include <fstream>
+#include <mutex>
+#include <memory>
 
 namespace bss {
   namespace internal {
@@ -104,7 +107,10 @@ void Profiler::WriteToStream(std::ostream& stream, uint8_t output)
     _heatOut(root, _trie, 0, 0);
     stream << "BSS Profiler Heat Output: " << std::endl;
     _heatWrite(stream, root, -1, _heatFindMax(root));
+    stream << std::endl << std::endl;
   }
+  if(output & OUTPUT_LOCKS)
+    LockStats::WriteToStream(stream);
 }
 void Profiler::_treeOut(std::ostream& stream, PROF_TRIENODE* node, ProfilerInt id, size_t level, ProfilerInt idlevel)
 {
@@ -224,7 +230,7 @@ void Profiler::_timeFormat(std::ostream& stream, double avg, double variance, ui
   else if(avg >= 1000000000.0)
     stream << (avg / 1000000.0) << " ms";
   else if(avg >= 1000000.0)
-    stream << (avg / 1000.0) << L" \x039Cs";
+    stream << (avg / 1000.0) << " us";
   else
     stream << avg << " ns";
 }
@@ -235,4 +241,162 @@ Profiler::PROF_TRIENODE* Profiler::_allocNode()
   r->total = (uint64_t)-1;
   ++_totalnodes;
   return r;
-}
\ No newline at end of file
+}
+
+namespace bss {
+  namespace internal {
+    static std::mutex LOCKSTATS_MUTEX; // Guards the list of registered locks. Only taken when a lock is created, destroyed or queried.
+    static LockStats* LOCKSTATS_ROOT = 0;
+  }
+}
+
+LockStats::LockStats(const char* name) : _name(name), _prev(0)
+{
+  Clear();
+  std::lock_guard<std::mutex> guard(LOCKSTATS_MUTEX);
+  _next = LOCKSTATS_ROOT;
+  if(_next)
+    _next->_prev = this;
+  LOCKSTATS_ROOT = this;
+}
+LockStats::~LockStats()
+{
+  std::lock_guard<std::mutex> guard(LOCKSTATS_MUTEX);
+  if(_prev)
+    _prev->_next = _next;
+  else
+    LOCKSTATS_ROOT = _next;
+  if(_next)
+    _next->_prev = _prev;
+}
+void LockStats::_contend(const Wait& w)
+{
+  uint64_t ns = Now() - w.start;
+  _contended.fetch_add(1, std::memory_order_relaxed);
+  _spins.fetch_add(w.spins, std::memory_order_relaxed);
+  _waitns.fetch_add(ns, std::memory_order_relaxed);
+
+  uint64_t key = (((uint64_t)(size_t)w.file * 0x9E3779B97F4A7C15ULL) ^ w.line) | 1; // Never zero, which marks an empty slot
+  for(int i = 0; i < MAX_BLOCKERS; ++i)
+  {
+    Blocker& b = _blockers[i];
+    uint64_t cur = b.key.load(std::memory_order_acquire);
+    if(!cur && b.key.compare_exchange_strong(cur, key, std::memory_order_acq_rel))
+    {
+      b.file.store(w.file, std::memory_order_relaxed);
+      b.line.store(w.line, std::memory_order_relaxed);
+      cur = key;
+    }
+    if(cur == key)
+    {
+      b.waits.fetch_add(1, std::memory_order_relaxed);
+      b.waitns.fetch_add(ns, std::memory_order_relaxed);
+      return;
+    }
+  }
+  _otherns.fetch_add(ns, std::memory_order_relaxed);
+}
+void LockStats::Get(Report& report) const
+{
+  report.name = _name;
+  report.lock = this;
+  report.attempts = _attempts.load(std::memory_order_relaxed);
+  report.failed = _failed.load(std::memory_order_relaxed);
+  report.contended = _contended.load(std::memory_order_relaxed);
+  report.spins = _spins.load(std::memory_order_relaxed);
+  report.waitns = _waitns.load(std::memory_order_relaxed);
+  report.otherns = _otherns.load(std::memory_order_relaxed);
+  report.holder.file = _holderfile.load(std::memory_order_relaxed);
+  report.holder.line = _holderline.load(std::memory_order_relaxed);
+  report.holder.waits = 0;
+  report.holder.waitns = 0;
+  for(int i = 0; i < MAX_BLOCKERS; ++i)
+  {
+    report.blockers[i].file = _blockers[i].file.load(std::memory_order_relaxed);
+    report.blockers[i].line = _blockers[i].line.load(std::memory_order_relaxed);
+    report.blockers[i].waits = _blockers[i].waits.load(std::memory_order_relaxed);
+    report.blockers[i].waitns = _blockers[i].waitns.load(std::memory_order_relaxed);
+  }
+  std::sort(std::begin(report.blockers), std::end(report.blockers), [](const Site& l, const Site& r) -> bool { return l.waitns > r.waitns; });
+}
+void LockStats::Clear()
+{
+  _attempts.store(0, std::memory_order_relaxed);
+  _failed.store(0, std::memory_order_relaxed);
+  _contended.store(0, std::memory_order_relaxed);
+  _spins.store(0, std::memory_order_relaxed);
+  _waitns.store(0, std::memory_order_relaxed);
+  _otherns.store(0, std::memory_order_relaxed);
+  _holderfile.store(0, std::memory_order_relaxed);
+  _holderline.store(0, std::memory_order_relaxed);
+  for(int i = 0; i < MAX_BLOCKERS; ++i)
+  {
+    _blockers[i].file.store(0, std::memory_order_relaxed);
+    _blockers[i].line.store(0, std::memory_order_relaxed);
+    _blockers[i].waits.store(0, std::memory_order_relaxed);
+    _blockers[i].waitns.store(0, std::memory_order_relaxed);
+    _blockers[i].key.store(0, std::memory_order_release);
+  }
+}
+size_t LockStats::Query(Report* reports, size_t len)
+{
+  std::lock_guard<std::mutex> guard(LOCKSTATS_MUTEX);
+  size_t n = 0;
+  for(LockStats* cur = LOCKSTATS_ROOT; cur != 0; cur = cur->_next, ++n)
+  {
+    if(n < len)
+      cur->Get(reports[n]);
+    else if(len > 0) // Once the buffer is full, only keep a lock if it waited longer than the least contended lock we have
+    {
+      Report* min = std::min_element(reports, reports + len, [](const Report& l, const Report& r) -> bool { return l.waitns < r.waitns; });
+      if(cur->WaitNS() > min->waitns)
+        cur->Get(*min);
+    }
+  }
+  std::sort(reports, reports + bssmin(n, len), [](const Report& l, const Report& r) -> bool { return l.waitns > r.waitns; });
+  return n;
+}
+void LockStats::ClearAll()
+{
+  std::lock_guard<std::mutex> guard(LOCKSTATS_MUTEX);
+  for(LockStats* cur = LOCKSTATS_ROOT; cur != 0; cur = cur->_next)
+    cur->Clear();
+}
+void LockStats::WriteToStream(std::ostream& stream)
+{
+  size_t n = Query(0, 0);
+  if(!n)
+    return;
+  std::unique_ptr<Report[]> reports(new Report[n]);
+  n = bssmin(Query(reports.get(), n), n); // Locks may have been created or destroyed in between the two queries
+
+  stream << "BSS Lock Contention Output: " << std::endl;
+  for(size_t i = 0; i < n; ++i)
+  {
+    Report& r = reports[i];
+    if(!r.attempts)
+      continue;
+    stream << r.name << " (" << r.lock << "): " << r.attempts << " attempts, " << r.failed << " failed, " << r.contended << " contended (";
+    stream << ((r.contended * 100.0) / r.attempts) << "%), " << r.spins << " spins, ";
+    Profiler::_timeFormat(stream, (double)r.waitns, 0.0, r.contended);
+    stream << " waiting";
+    if(r.holder.file)
+      stream << ", last held by [" << Profiler::_trimPath(r.holder.file) << ':' << r.holder.line << ']';
+    stream << std::endl;
+    for(int j = 0; j < MAX_BLOCKERS; ++j)
+    {
+      if(!r.blockers[j].waits)
+        continue;
+      stream << "  blocked by [" << (r.blockers[j].file ? Profiler::_trimPath(r.blockers[j].file) : "unknown") << ':' << r.blockers[j].line << "]: ";
+      Profiler::_timeFormat(stream, (double)r.blockers[j].waitns, 0.0, r.blockers[j].waits);
+      stream << " over " << r.blockers[j].waits << " waits" << std::endl;
+    }
+    if(r.otherns > 0)
+    {
+      stream << "  blocked by other callsites: ";
+      Profiler::_timeFormat(stream, (double)r.otherns, 0.0, 0);
+      stream << std::endl;
+    }
+  }
+  stream << std::endl << std::endl;
+}
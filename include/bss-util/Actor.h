@@ -0,0 +1,68 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __ACTOR_H__BSS__
+#define __ACTOR_H__BSS__
+
+#include "ThreadPool.h"
+
+namespace bss {
+  // Actor that processes messages one at a time on a ThreadPool. Messages must derive from MailboxNode and are pushed onto the actor's
+  // intrusive Mailbox, so sending never allocates or locks. An actor with pending messages is scheduled onto the pool as a single task,
+  // which handles up to a batch of messages before giving the worker back, so the cost of scheduling is amortized over the batch. The
+  // handler is never called concurrently with itself and receives messages from a given sender in the order they were sent. The handler
+  // owns each message once it receives it. An actor must not be destroyed while it could still be scheduled, so call ThreadPool::Wait()
+  // after the last Send() first.
+  template<class M>
+  class Actor
+  {
+    Actor(const Actor&) = delete;
+    Actor& operator=(const Actor&) = delete;
+
+  public:
+    typedef Delegate<void, M*> HANDLER;
+
+    inline Actor(ThreadPool& pool, HANDLER handler, uint32_t batch = 64) : _pool(pool), _handler(handler), _batch(batch), _scheduled(false) { assert(batch > 0); }
+    inline ~Actor() { assert(!_scheduled.load(std::memory_order_acquire) && _mailbox.Empty()); }
+    // Pushes a message onto the mailbox and schedules the actor if it isn't already. Can be called from any thread, including the handler.
+    inline void Send(M* msg)
+    {
+      _mailbox.Push(msg);
+      if(!_scheduled.exchange(true, std::memory_order_seq_cst))
+        _pool.AddTask(&_run, this);
+    }
+    inline bool Idle() const { return !_scheduled.load(std::memory_order_acquire); }
+    inline uint32_t GetBatch() const { return _batch; }
+    inline void SetBatch(uint32_t batch) { assert(batch > 0); _batch = batch; }
+
+  protected:
+    static void _run(void* p)
+    {
+      Actor* self = reinterpret_cast<Actor*>(p);
+      uint32_t n = self->_batch;
+      while(n-- > 0)
+      {
+        M* msg = self->_mailbox.Pop();
+        if(!msg)
+          break;
+        self->_handler(msg);
+      }
+
+      // A sender that pushes after we clear the flag will schedule us itself. One that pushed before will be seen by Empty() or
+      // Untouched(), since both sides use sequentially consistent operations. Either way, exactly one of us wins the exchange. Once the
+      // flag is clear another worker may already be popping, so only Untouched() is safe to call after that point.
+      bool empty = self->_mailbox.Empty();
+      self->_scheduled.store(false, std::memory_order_seq_cst);
+      if((!empty || !self->_mailbox.Untouched()) && !self->_scheduled.exchange(true, std::memory_order_seq_cst))
+        self->_pool.AddTask(&_run, self);
+    }
+
+    Mailbox<M> _mailbox;
+    ThreadPool& _pool;
+    HANDLER _handler;
+    uint32_t _batch;
+    BSS_ALIGN(64) std::atomic<bool> _scheduled;
+  };
+}
+
+#endif
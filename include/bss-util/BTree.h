@@ -0,0 +1,719 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __BTREE_H__BSS__
+#define __BTREE_H__BSS__
+
+#include "algo.h"
+#include <algorithm>
+#include <iterator>
+#include <memory>
+
+namespace bss {
+  namespace internal {
+    // Finds where a key belongs in a node. Lower() is the number of keys that are less than k, and Upper() the number that aren't
+    // greater. Arithmetic keys using the default comparison count matches instead of searching.
+    template<class Key, char(*CFunc)(const Key&, const Key&), bool COUNT = UseKeyCount<Key, CFunc>>
+    struct BTreeSearch
+    {
+      BSS_FORCEINLINE static uint32_t Lower(const Key* keys, uint32_t n, const Key& k)
+      {
+        uint32_t lo = 0;
+        while(n > 0)
+        {
+          uint32_t half = n >> 1;
+          if(CFunc(keys[lo + half], k) < 0)
+          {
+            lo += half + 1;
+            n -= half + 1;
+          }
+          else
+            n = half;
+        }
+        return lo;
+      }
+      BSS_FORCEINLINE static uint32_t Upper(const Key* keys, uint32_t n, const Key& k)
+      {
+        uint32_t lo = 0;
+        while(n > 0)
+        {
+          uint32_t half = n >> 1;
+          if(CFunc(keys[lo + half], k) <= 0)
+          {
+            lo += half + 1;
+            n -= half + 1;
+          }
+          else
+            n = half;
+        }
+        return lo;
+      }
+    };
+    template<class Key, char(*CFunc)(const Key&, const Key&)>
+    struct BTreeSearch<Key, CFunc, true>
+    {
+      BSS_FORCEINLINE static uint32_t Lower(const Key* keys, uint32_t n, const Key& k) { return KeyCount<Key>::Less(keys, n, k); }
+      BSS_FORCEINLINE static uint32_t Upper(const Key* keys, uint32_t n, const Key& k) { return KeyCount<Key>::LessEq(keys, n, k); }
+    };
+  }
+
+  // B+tree map (or set, if Data is void) with nodes sized to a few cache lines. Every key lives in a leaf, leaves are linked in order
+  // so iterating or scanning a range never goes back up the tree, and inner nodes only hold separator keys, so a lookup touches one
+  // node per level instead of one per key like the binary trees do. Keys in each node are stored contiguously and searched by
+  // counting, with SSE for int, unsigned int, float and double keys (and 64-bit integers with SSE4.2). NodeSize is the target size
+  // of a node in bytes, which sets how many keys each one holds, and nodes are aligned to cache lines. Keys and values must be default constructible, and are moved around
+  // as nodes split and merge, so pointers and iterators into the tree are invalidated by any insertion or removal.
+  template<class Key, class Data = void, char(*CFunc)(const Key&, const Key&) = CompT<Key>, size_t NodeSize = 256, typename Alloc = StandardAllocator<char, 64>>
+  class BSS_COMPILER_DLLEXPORT BTree
+  {
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
+    static_assert(NodeSize >= 64, "Nodes should be at least one cache line");
+
+  public:
+    static constexpr bool IsMap = !std::is_void<Data>::value;
+    typedef std::conditional_t<IsMap, Data, Key> KeyGet;
+
+  protected:
+    typedef std::conditional_t<IsMap, Data, char> DataField;
+    typedef internal::BTreeSearch<Key, CFunc> Search;
+
+    static constexpr uint32_t _capacity(size_t header, size_t entry) { return (uint32_t)bssmax((NodeSize - bssmin(header, NodeSize - 1)) / entry, 4); }
+
+  public:
+    static constexpr uint32_t LEAF_SIZE = _capacity(sizeof(uint32_t) + sizeof(void*) * 2, sizeof(Key) + (IsMap ? sizeof(DataField) : 0));
+    static constexpr uint32_t INNER_SIZE = _capacity(sizeof(void*) * 2, sizeof(Key) + sizeof(void*));
+
+  protected:
+    static constexpr uint32_t LEAF_MIN = LEAF_SIZE / 2;
+    static constexpr uint32_t INNER_MIN = INNER_SIZE / 2;
+    static constexpr uint32_t MAX_HEIGHT = 40; // Inner nodes have at least 3 children, so this is more levels than memory can hold
+
+    struct Node
+    {
+      uint32_t count;
+    };
+    struct BSS_ALIGN(64) Inner : Node
+    {
+      Key keys[INNER_SIZE];
+      Node* children[INNER_SIZE + 1];
+    };
+    struct BSS_ALIGN(64) Leaf : Node
+    {
+      Leaf* prev;
+      Leaf* next;
+      Key keys[LEAF_SIZE];
+      DataField vals[IsMap ? LEAF_SIZE : 1];
+    };
+    struct Step
+    {
+      Inner* node;
+      uint32_t index; // Which child we went down
+    };
+
+    template<bool CONST>
+    class BSS_TEMPLATE_DLLEXPORT BTreeIter
+    {
+      typedef std::conditional_t<CONST, const DataField, DataField> DataRef;
+
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef std::conditional_t<IsMap, std::pair<const Key&, DataRef&>, const Key&> reference;
+      typedef std::remove_reference_t<reference> value_type;
+      typedef ptrdiff_t difference_type;
+      typedef value_type* pointer;
+
+      inline BTreeIter() : _leaf(0), _index(0) {}
+      inline BTreeIter(Leaf* leaf, uint32_t index) : _leaf(leaf), _index(index) {}
+      template<bool U = CONST, std::enable_if_t<U, int> = 0>
+      inline BTreeIter(const BTreeIter<false>& it) : _leaf(it._leaf), _index(it._index) {}
+      inline reference operator*() const
+      {
+        if constexpr(IsMap)
+          return reference(_leaf->keys[_index], _leaf->vals[_index]);
+        else
+          return _leaf->keys[_index];
+      }
+      inline BTreeIter& operator++()
+      {
+        if(++_index >= _leaf->count)
+        {
+          _leaf = _leaf->next;
+          _index = 0;
+        }
+        return *this;
+      }
+      inline BTreeIter operator++(int) { BTreeIter r(*this); ++*this; return r; }
+      inline bool operator==(const BTreeIter& r) const { return _leaf == r._leaf && _index == r._index; }
+      inline bool operator!=(const BTreeIter& r) const { return !operator==(r); }
+      inline const Key& GetKey() const { return _leaf->keys[_index]; }
+      template<bool U = IsMap, std::enable_if_t<U, int> = 0>
+      inline DataRef& GetData() const { return _leaf->vals[_index]; }
+
+    protected:
+      friend class BTree;
+      friend class BTreeIter<!CONST>;
+      Leaf* _leaf;
+      uint32_t _index;
+    };
+
+  public:
+    typedef BTreeIter<false> iterator;
+    typedef BTreeIter<true> const_iterator;
+
+    inline BTree() : _root(0), _first(0), _last(0), _size(0), _height(0) {}
+    inline BTree(BTree&& mov) : _root(mov._root), _first(mov._first), _last(mov._last), _size(mov._size), _height(mov._height)
+    {
+      mov._root = 0;
+      mov._first = 0;
+      mov._last = 0;
+      mov._size = 0;
+      mov._height = 0;
+    }
+    inline ~BTree() { Clear(); }
+    inline void Clear()
+    {
+      if(_root)
+        _clear(_root, _height);
+      _root = 0;
+      _first = 0;
+      _last = 0;
+      _size = 0;
+      _height = 0;
+    }
+    // Inserts a key, returning false without changing anything if it was already in the tree.
+    template<bool U = IsMap, std::enable_if_t<U, int> = 0>
+    BSS_FORCEINLINE bool Insert(const Key& key, const DataField& data) { return _insert(key, data); }
+    template<bool U = IsMap, std::enable_if_t<U, int> = 0>
+    BSS_FORCEINLINE bool Insert(const Key& key, DataField&& data) { return _insert(key, std::move(data)); }
+    BSS_FORCEINLINE bool Insert(const Key& key) { return _insert(key); }
+    inline KeyGet Get(const Key& key, const KeyGet& INVALID) const
+    {
+      KeyGet* r = GetRef(key);
+      return !r ? INVALID : *r;
+    }
+    inline KeyGet* GetRef(const Key& key) const
+    {
+      uint32_t i;
+      Leaf* leaf = _find(key, i);
+      if(!leaf)
+        return 0;
+      if constexpr(IsMap)
+        return &leaf->vals[i];
+      else
+        return &leaf->keys[i];
+    }
+    BSS_FORCEINLINE bool Exists(const Key& key) const { uint32_t i; return _find(key, i) != 0; }
+    inline bool Remove(const Key& key)
+    {
+      if(!_root)
+        return false;
+      Step path[MAX_HEIGHT];
+      Leaf* leaf = _findleaf(key, path);
+      uint32_t i = Search::Lower(leaf->keys, leaf->count, key);
+      if(i >= leaf->count || CFunc(leaf->keys[i], key) != 0)
+        return false;
+      _leaferase(leaf, i);
+      --_size;
+      if(!_height)
+      {
+        if(!leaf->count)
+        {
+          _freeleaf(leaf);
+          _root = 0;
+          _first = 0;
+          _last = 0;
+        }
+      }
+      else if(leaf->count < LEAF_MIN)
+        _fixleaf(leaf, path);
+      return true;
+    }
+    inline bool ReplaceKey(const Key& oldkey, const Key& newkey)
+    {
+      uint32_t i;
+      Leaf* leaf = _find(oldkey, i);
+      if(!leaf || Exists(newkey))
+        return false;
+      if constexpr(IsMap)
+      {
+        Data d(std::move(leaf->vals[i]));
+        Remove(oldkey);
+        return _insert(newkey, std::move(d));
+      }
+      else
+      {
+        Remove(oldkey);
+        return _insert(newkey);
+      }
+    }
+    // Builds the tree from keys that are already sorted, which takes linear time and packs every node as full as it can. Clears
+    // the tree first. Returns false, leaving the tree empty, if the keys aren't strictly increasing.
+    template<bool U = IsMap, std::enable_if_t<U, int> = 0>
+    inline bool BulkLoad(const Key* keys, const DataField* data, size_t n) { return _bulkload(keys, data, n); }
+    template<bool U = IsMap, std::enable_if_t<!U, int> = 0>
+    inline bool BulkLoad(const Key* keys, size_t n) { return _bulkload(keys, (const DataField*)0, n); }
+    // Calls f on every element in order, with a key for a set or a pair of key and data for a map.
+    template<typename F>
+    inline void Traverse(F && f)
+    {
+      for(auto&& e : *this)
+        f(e);
+    }
+    inline iterator Find(const Key& key) { uint32_t i; Leaf* leaf = _find(key, i); return !leaf ? end() : iterator(leaf, i); }
+    inline const_iterator Find(const Key& key) const { return const_cast<BTree*>(this)->Find(key); }
+    // Returns the first element that isn't less than key
+    inline iterator LowerBound(const Key& key) { return _bound<false>(key); }
+    inline const_iterator LowerBound(const Key& key) const { return const_cast<BTree*>(this)->LowerBound(key); }
+    // Returns the first element that's greater than key
+    inline iterator UpperBound(const Key& key) { return _bound<true>(key); }
+    inline const_iterator UpperBound(const Key& key) const { return const_cast<BTree*>(this)->UpperBound(key); }
+    inline iterator begin() { return iterator(_first, 0); }
+    inline iterator end() { return iterator(); }
+    inline const_iterator begin() const { return const_iterator(_first, 0); }
+    inline const_iterator end() const { return const_iterator(); }
+    inline const Key& Front() const { assert(_size > 0); return _first->keys[0]; }
+    inline const Key& Back() const { assert(_size > 0); return _last->keys[_last->count - 1]; }
+    inline size_t Length() const { return _size; }
+    inline bool Empty() const { return !_size; }
+    inline uint32_t Height() const { return _root ? _height + 1 : 0; }
+    // Checks that every node is in order, within its separators, and at least half full unless it's the root, and that the leaves
+    // are all linked in order.
+    inline bool DEBUGVERIFY() const
+    {
+      if(!_root)
+        return !_size && !_first && !_last;
+      const Leaf* prev = 0;
+      size_t count = 0;
+      if(!_verify(_root, _height, 0, 0, true, prev, count) || prev != _last || count != _size)
+        return false;
+      for(const Leaf* l = _first; l; l = l->next)
+        if((l->next && l->next->prev != l) || (l->next && CFunc(l->keys[l->count - 1], l->next->keys[0]) >= 0))
+          return false;
+      return true;
+    }
+
+    inline BTree& operator=(BTree&& mov)
+    {
+      Clear();
+      _root = mov._root;
+      _first = mov._first;
+      _last = mov._last;
+      _size = mov._size;
+      _height = mov._height;
+      mov._root = 0;
+      mov._first = 0;
+      mov._last = 0;
+      mov._size = 0;
+      mov._height = 0;
+      return *this;
+    }
+
+  protected:
+    BSS_FORCEINLINE Leaf* _findleaf(const Key& key, Step* path) const
+    {
+      Node* n = _root;
+      for(uint32_t h = 0; h < _height; ++h)
+      {
+        Inner* in = static_cast<Inner*>(n);
+        uint32_t i = Search::Upper(in->keys, in->count, key);
+        if(path)
+          path[h] = Step{ in, i };
+        n = in->children[i];
+      }
+      return static_cast<Leaf*>(n);
+    }
+    BSS_FORCEINLINE Leaf* _find(const Key& key, uint32_t& i) const
+    {
+      if(!_root)
+        return 0;
+      Leaf* leaf = _findleaf(key, 0);
+      i = Search::Lower(leaf->keys, leaf->count, key);
+      return (i < leaf->count && !CFunc(leaf->keys[i], key)) ? leaf : 0;
+    }
+    template<bool UPPER>
+    inline iterator _bound(const Key& key)
+    {
+      if(!_root)
+        return end();
+      Leaf* leaf = _findleaf(key, 0);
+      uint32_t i = UPPER ? Search::Upper(leaf->keys, leaf->count, key) : Search::Lower(leaf->keys, leaf->count, key);
+      if(i < leaf->count)
+        return iterator(leaf, i);
+      return iterator(leaf->next, 0);
+    }
+    template<class... D>
+    bool _insert(const Key& key, D&&... data)
+    {
+      if(!_root)
+        _root = _first = _last = _newleaf();
+      Step path[MAX_HEIGHT];
+      Leaf* leaf = _findleaf(key, path);
+      uint32_t i = Search::Lower(leaf->keys, leaf->count, key);
+      if(i < leaf->count && !CFunc(leaf->keys[i], key))
+        return false;
+
+      if(leaf->count < LEAF_SIZE)
+        _leafinsert(leaf, i, key, std::forward<D>(data)...);
+      else
+      {
+        const uint32_t h = (LEAF_SIZE + 1) / 2;
+        Leaf* right = _newleaf();
+        _leafmove(right, 0, leaf, h, LEAF_SIZE - h);
+        right->count = LEAF_SIZE - h;
+        leaf->count = h;
+        right->prev = leaf;
+        right->next = leaf->next;
+        if(leaf->next)
+          leaf->next->prev = right;
+        else
+          _last = right;
+        leaf->next = right;
+        if(i <= h)
+          _leafinsert(leaf, i, key, std::forward<D>(data)...);
+        else
+          _leafinsert(right, i - h, key, std::forward<D>(data)...);
+        _insertparent(path, _height, right->keys[0], right);
+      }
+      ++_size;
+      return true;
+    }
+    // Adds a separator and the node to its right to the parent of the node at the given depth, splitting parents as needed.
+    inline void _insertparent(Step* path, uint32_t depth, const Key& separator, Node* right)
+    {
+      Key sep(separator);
+      for(;;)
+      {
+        if(!depth)
+        {
+          Inner* r = _newinner();
+          r->keys[0] = std::move(sep);
+          r->children[0] = _root;
+          r->children[1] = right;
+          r->count = 1;
+          _root = r;
+          ++_height;
+          return;
+        }
+        Inner* p = path[depth - 1].node;
+        uint32_t pos = path[depth - 1].index;
+        if(p->count < INNER_SIZE)
+        {
+          std::move_backward(p->keys + pos, p->keys + p->count, p->keys + p->count + 1);
+          std::move_backward(p->children + pos + 1, p->children + p->count + 1, p->children + p->count + 2);
+          p->keys[pos] = std::move(sep);
+          p->children[pos + 1] = right;
+          ++p->count;
+          return;
+        }
+
+        Key keys[INNER_SIZE + 1];
+        Node* children[INNER_SIZE + 2];
+        std::move(p->keys, p->keys + pos, keys);
+        keys[pos] = std::move(sep);
+        std::move(p->keys + pos, p->keys + INNER_SIZE, keys + pos + 1);
+        std::copy(p->children, p->children + pos + 1, children);
+        children[pos + 1] = right;
+        std::copy(p->children + pos + 1, p->children + INNER_SIZE + 1, children + pos + 2);
+
+        const uint32_t m = (INNER_SIZE + 1) / 2;
+        Inner* r = _newinner();
+        std::move(keys, keys + m, p->keys);
+        std::copy(children, children + m + 1, p->children);
+        p->count = m;
+        std::move(keys + m + 1, keys + INNER_SIZE + 1, r->keys);
+        std::copy(children + m + 1, children + INNER_SIZE + 2, r->children);
+        r->count = INNER_SIZE - m;
+        sep = std::move(keys[m]);
+        right = r;
+        --depth;
+      }
+    }
+    // Rebalances a leaf that fell below half full by borrowing from a sibling, or merging with one if neither can spare a key.
+    inline void _fixleaf(Leaf* leaf, Step* path)
+    {
+      Inner* p = path[_height - 1].node;
+      uint32_t idx = path[_height - 1].index;
+      Leaf* left = idx > 0 ? static_cast<Leaf*>(p->children[idx - 1]) : 0;
+      Leaf* right = idx < p->count ? static_cast<Leaf*>(p->children[idx + 1]) : 0;
+      if(left && left->count > LEAF_MIN)
+      {
+        _leafshift(leaf, 0, 1);
+        _leafmove(leaf, 0, left, left->count - 1, 1);
+        --left->count;
+        ++leaf->count;
+        p->keys[idx - 1] = leaf->keys[0];
+        return;
+      }
+      if(right && right->count > LEAF_MIN)
+      {
+        _leafmove(leaf, leaf->count, right, 0, 1);
+        ++leaf->count;
+        _leafshift(right, 1, -1);
+        --right->count;
+        p->keys[idx] = right->keys[0];
+        return;
+      }
+      if(left)
+      {
+        _leafmerge(left, leaf);
+        _innererase(p, idx - 1);
+      }
+      else
+      {
+        _leafmerge(leaf, right);
+        _innererase(p, idx);
+      }
+      _fixinner(path, _height - 1);
+    }
+    // Same as _fixleaf for the inner node at the given depth, which rotates keys through the parent instead, then keeps going up.
+    inline void _fixinner(Step* path, uint32_t depth)
+    {
+      for(;; --depth)
+      {
+        Inner* node = path[depth].node;
+        if(!depth)
+        {
+          if(!node->count) // The root has a single child left, which becomes the new root
+          {
+            _root = node->children[0];
+            _freeinner(node);
+            --_height;
+          }
+          return;
+        }
+        if(node->count >= INNER_MIN)
+          return;
+        Inner* p = path[depth - 1].node;
+        uint32_t idx = path[depth - 1].index;
+        Inner* left = idx > 0 ? static_cast<Inner*>(p->children[idx - 1]) : 0;
+        Inner* right = idx < p->count ? static_cast<Inner*>(p->children[idx + 1]) : 0;
+        if(left && left->count > INNER_MIN)
+        {
+          std::move_backward(node->keys, node->keys + node->count, node->keys + node->count + 1);
+          std::move_backward(node->children, node->children + node->count + 1, node->children + node->count + 2);
+          node->keys[0] = std::move(p->keys[idx - 1]);
+          node->children[0] = left->children[left->count];
+          p->keys[idx - 1] = std::move(left->keys[left->count - 1]);
+          --left->count;
+          ++node->count;
+          return;
+        }
+        if(right && right->count > INNER_MIN)
+        {
+          node->keys[node->count] = std::move(p->keys[idx]);
+          node->children[node->count + 1] = right->children[0];
+          ++node->count;
+          p->keys[idx] = std::move(right->keys[0]);
+          std::move(right->keys + 1, right->keys + right->count, right->keys);
+          std::move(right->children + 1, right->children + right->count + 1, right->children);
+          --right->count;
+          return;
+        }
+        if(left)
+        {
+          _innermerge(left, std::move(p->keys[idx - 1]), node);
+          _innererase(p, idx - 1);
+        }
+        else
+        {
+          _innermerge(node, std::move(p->keys[idx]), right);
+          _innererase(p, idx);
+        }
+      }
+    }
+    // Moves n entries from src, starting at s, into dest starting at d. The ranges can't overlap.
+    BSS_FORCEINLINE static void _leafmove(Leaf* dest, uint32_t d, Leaf* src, uint32_t s, uint32_t n)
+    {
+      std::move(src->keys + s, src->keys + s + n, dest->keys + d);
+      if constexpr(IsMap)
+        std::move(src->vals + s, src->vals + s + n, dest->vals + d);
+    }
+    // Shifts the entries from index i onward by one slot in the given direction, leaving count untouched.
+    BSS_FORCEINLINE static void _leafshift(Leaf* leaf, uint32_t i, int dir)
+    {
+      if(dir > 0)
+      {
+        std::move_backward(leaf->keys + i, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        if constexpr(IsMap)
+          std::move_backward(leaf->vals + i, leaf->vals + leaf->count, leaf->vals + leaf->count + 1);
+      }
+      else
+      {
+        std::move(leaf->keys + i, leaf->keys + leaf->count, leaf->keys + i - 1);
+        if constexpr(IsMap)
+          std::move(leaf->vals + i, leaf->vals + leaf->count, leaf->vals + i - 1);
+      }
+    }
+    template<class... D>
+    BSS_FORCEINLINE static void _leafinsert(Leaf* leaf, uint32_t i, const Key& key, D&&... data)
+    {
+      _leafshift(leaf, i, 1);
+      leaf->keys[i] = key;
+      if constexpr(IsMap)
+      {
+        if constexpr(sizeof...(D) > 0)
+          ((leaf->vals[i] = std::forward<D>(data)), ...);
+        else
+          leaf->vals[i] = DataField();
+      }
+      ++leaf->count;
+    }
+    BSS_FORCEINLINE static void _leaferase(Leaf* leaf, uint32_t i)
+    {
+      _leafshift(leaf, i + 1, -1);
+      --leaf->count;
+      leaf->keys[leaf->count] = Key(); // Let go of anything the key or value owns
+      if constexpr(IsMap)
+        leaf->vals[leaf->count] = DataField();
+    }
+    // Appends right onto left and frees right
+    inline void _leafmerge(Leaf* left, Leaf* right)
+    {
+      _leafmove(left, left->count, right, 0, right->count);
+      left->count += right->count;
+      left->next = right->next;
+      if(right->next)
+        right->next->prev = left;
+      else
+        _last = left;
+      _freeleaf(right);
+    }
+    inline void _innermerge(Inner* left, Key&& sep, Inner* right)
+    {
+      left->keys[left->count] = std::move(sep);
+      std::move(right->keys, right->keys + right->count, left->keys + left->count + 1);
+      std::copy(right->children, right->children + right->count + 1, left->children + left->count + 1);
+      left->count += right->count + 1;
+      _freeinner(right);
+    }
+    // Removes key i and the child to its right
+    BSS_FORCEINLINE static void _innererase(Inner* p, uint32_t i)
+    {
+      std::move(p->keys + i + 1, p->keys + p->count, p->keys + i);
+      std::move(p->children + i + 2, p->children + p->count + 1, p->children + i + 1);
+      --p->count;
+    }
+    inline bool _bulkload(const Key* keys, const DataField* data, size_t n)
+    {
+      Clear();
+      for(size_t i = 1; i < n; ++i)
+        if(CFunc(keys[i - 1], keys[i]) >= 0)
+          return false;
+      if(!n)
+        return true;
+
+      size_t count = (n + LEAF_SIZE - 1) / LEAF_SIZE;
+      std::unique_ptr<Node*[]> nodes(new Node*[count]);
+      std::unique_ptr<Key[]> lows(new Key[count]); // Smallest key under each node
+      for(size_t l = 0, k = 0; l < count; ++l) // Spread the keys evenly so the last leaf isn't left nearly empty
+      {
+        Leaf* leaf = _newleaf();
+        leaf->count = (uint32_t)(n / count + (l < n % count));
+        std::copy(keys + k, keys + k + leaf->count, leaf->keys);
+        if constexpr(IsMap)
+          std::copy(data + k, data + k + leaf->count, leaf->vals);
+        k += leaf->count;
+        leaf->prev = _last;
+        if(_last)
+          _last->next = leaf;
+        else
+          _first = leaf;
+        _last = leaf;
+        nodes[l] = leaf;
+        lows[l] = leaf->keys[0];
+      }
+
+      while(count > 1)
+      {
+        size_t parents = (count + INNER_SIZE) / (INNER_SIZE + 1);
+        for(size_t p = 0, j = 0; p < parents; ++p)
+        {
+          size_t c = count / parents + (p < count % parents);
+          Inner* in = _newinner();
+          std::copy(nodes.get() + j, nodes.get() + j + c, in->children);
+          std::move(lows.get() + j + 1, lows.get() + j + c, in->keys);
+          in->count = (uint32_t)(c - 1);
+          nodes[p] = in;
+          lows[p] = std::move(lows[j]);
+          j += c;
+        }
+        count = parents;
+        ++_height;
+      }
+      _root = nodes[0];
+      _size = n;
+      return true;
+    }
+    inline bool _verify(const Node* n, uint32_t height, const Key* lo, const Key* hi, bool root, const Leaf*& prev, size_t& count) const
+    {
+      if(!height)
+      {
+        const Leaf* leaf = static_cast<const Leaf*>(n);
+        if(leaf->count > LEAF_SIZE || (!root && leaf->count < LEAF_MIN) || !leaf->count || leaf->prev != prev)
+          return false;
+        for(uint32_t i = 0; i < leaf->count; ++i)
+          if((i > 0 && CFunc(leaf->keys[i - 1], leaf->keys[i]) >= 0) || (lo && CFunc(leaf->keys[i], *lo) < 0) || (hi && CFunc(leaf->keys[i], *hi) >= 0))
+            return false;
+        if(prev && prev->next != leaf)
+          return false;
+        prev = leaf;
+        count += leaf->count;
+        return true;
+      }
+      const Inner* in = static_cast<const Inner*>(n);
+      if(in->count > INNER_SIZE || (!root && in->count < INNER_MIN) || !in->count)
+        return false;
+      for(uint32_t i = 0; i < in->count; ++i)
+        if((i > 0 && CFunc(in->keys[i - 1], in->keys[i]) >= 0) || (lo && CFunc(in->keys[i], *lo) < 0) || (hi && CFunc(in->keys[i], *hi) >= 0))
+          return false;
+      for(uint32_t i = 0; i <= in->count; ++i)
+        if(!_verify(in->children[i], height - 1, !i ? lo : &in->keys[i - 1], (i == in->count) ? hi : &in->keys[i], false, prev, count))
+          return false;
+      return true;
+    }
+    inline void _clear(Node* n, uint32_t height)
+    {
+      if(!height)
+        return _freeleaf(static_cast<Leaf*>(n));
+      Inner* in = static_cast<Inner*>(n);
+      for(uint32_t i = 0; i <= in->count; ++i)
+        _clear(in->children[i], height - 1);
+      _freeinner(in);
+    }
+    inline Leaf* _newleaf()
+    {
+      Leaf* leaf = new(_leafalloc.allocate(1)) Leaf();
+      leaf->count = 0;
+      leaf->prev = 0;
+      leaf->next = 0;
+      return leaf;
+    }
+    inline Inner* _newinner()
+    {
+      Inner* in = new(_inneralloc.allocate(1)) Inner();
+      in->count = 0;
+      return in;
+    }
+    inline void _freeleaf(Leaf* leaf)
+    {
+      leaf->~Leaf();
+      _leafalloc.deallocate(leaf, 1);
+    }
+    inline void _freeinner(Inner* in)
+    {
+      in->~Inner();
+      _inneralloc.deallocate(in, 1);
+    }
+
+    Node* _root;
+    Leaf* _first;
+    Leaf* _last;
+    size_t _size;
+    uint32_t _height; // Number of inner levels above the leaves
+    typename Alloc::template rebind<Leaf> _leafalloc;
+    typename Alloc::template rebind<Inner> _inneralloc;
+  };
+}
+
+#endif
@@ -0,0 +1,256 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __BARRIER_H__BSS__
+#define __BARRIER_H__BSS__
+
+#include "Thread.h"
+#include "lockless.h"
+#include "DynArray.h"
+#ifdef BSS_PLATFORM_WIN32
+#pragma comment(lib, "Synchronization.lib") // WaitOnAddress
+#elif defined(BSS_PLATFORM_LINUX)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+
+namespace bss {
+  namespace internal {
+#if !defined(BSS_PLATFORM_WIN32) && !defined(BSS_PLATFORM_LINUX)
+    // Without a way to sleep on an address, parked threads share a few condition variables picked by the address they wait on.
+    struct ParkingSlot
+    {
+      std::mutex lock;
+      std::condition_variable cond;
+    };
+    inline ParkingSlot& ParkingFor(const void* p)
+    {
+      static ParkingSlot slots[16];
+      return slots[(reinterpret_cast<size_t>(p) >> 6) & 15];
+    }
+#endif
+    // Blocks the calling thread while a still holds value. This can return early for no reason, so callers must loop.
+    BSS_FORCEINLINE void Park(std::atomic<uint32_t>& a, uint32_t value)
+    {
+#ifdef BSS_PLATFORM_WIN32
+      WaitOnAddress((volatile VOID*)&a, &value, sizeof(uint32_t), INFINITE);
+#elif defined(BSS_PLATFORM_LINUX)
+      syscall(SYS_futex, &a, FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+#else
+      ParkingSlot& slot = ParkingFor(&a);
+      std::unique_lock<std::mutex> lock(slot.lock);
+      if(a.load(std::memory_order_seq_cst) == value)
+        slot.cond.wait(lock);
+#endif
+    }
+    // Must be called after a has changed.
+    BSS_FORCEINLINE void UnparkAll(std::atomic<uint32_t>& a)
+    {
+#ifdef BSS_PLATFORM_WIN32
+      WakeByAddressAll((PVOID)&a);
+#elif defined(BSS_PLATFORM_LINUX)
+      syscall(SYS_futex, &a, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+      ParkingSlot& slot = ParkingFor(&a);
+      {
+        std::lock_guard<std::mutex> lock(slot.lock); // Anyone who saw the old value under the lock is now waiting, so they get the notify
+      }
+      slot.cond.notify_all();
+#endif
+    }
+    // Polls a up to spin times until done(value) returns true, then parks. parked counts the threads that are parked, or about to be,
+    // so wakers can skip the system call when nobody is asleep. A waker must change a before it checks parked, and both sides use
+    // sequentially consistent operations, so either the waker sees us or we see the new value. Returns the value that satisfied done.
+    template<class F>
+    inline uint32_t SpinPark(std::atomic<uint32_t>& a, std::atomic<uint32_t>& parked, uint32_t spin, F&& done)
+    {
+      uint32_t v;
+      for(uint32_t i = 0; i < spin;)
+      {
+        if(done(v = a.load(std::memory_order_acquire)))
+          return v;
+        SpinWait(i);
+      }
+      parked.fetch_add(1, std::memory_order_seq_cst);
+      while(!done(v = a.load(std::memory_order_seq_cst)))
+        Park(a, v);
+      parked.fetch_sub(1, std::memory_order_relaxed);
+      return v;
+    }
+    BSS_FORCEINLINE void Unpark(std::atomic<uint32_t>& a, std::atomic<uint32_t>& parked)
+    {
+      if(parked.load(std::memory_order_seq_cst) > 0)
+        UnparkAll(a);
+    }
+    // Spinning only helps if the thread we're waiting on can run at the same time.
+    inline uint32_t DefaultSpin() { return std::thread::hardware_concurrency() > 1 ? 4096 : 0; }
+  }
+
+  // Single-use countdown. Threads wait until CountDown() has been called enough times to bring the count to zero, after which Wait()
+  // returns immediately forever. Waiters spin for a while before going to sleep, and counting down only makes a system call if
+  // someone is actually asleep.
+  class Latch
+  {
+    Latch(const Latch&) = delete;
+    Latch& operator=(const Latch&) = delete;
+
+  public:
+    explicit Latch(uint32_t count, uint32_t spin = internal::DefaultSpin()) : _count(count), _parked(0), _spin(spin) {}
+    ~Latch() { assert(!_parked.load(std::memory_order_acquire)); }
+    inline void CountDown(uint32_t n = 1)
+    {
+      uint32_t prev = _count.fetch_sub(n, std::memory_order_seq_cst);
+      assert(prev >= n);
+      if(prev == n)
+        internal::Unpark(_count, _parked);
+    }
+    inline bool TryWait() const { return !_count.load(std::memory_order_acquire); }
+    inline void Wait() { internal::SpinPark(_count, _parked, _spin, [](uint32_t v) { return !v; }); }
+    inline void ArriveAndWait(uint32_t n = 1) { CountDown(n); Wait(); }
+    inline uint32_t Count() const { return _count.load(std::memory_order_relaxed); }
+
+  protected:
+    BSS_ALIGN(64) std::atomic<uint32_t> _count;
+    std::atomic<uint32_t> _parked;
+    uint32_t _spin;
+  };
+
+  // Reusable barrier for a fixed number of threads. It's sense-reversing: instead of watching the arrival count, which the next phase
+  // starts reusing as soon as the last thread arrives, waiters watch a phase counter that only the last thread advances, so every
+  // thread can leave and arrive again without anyone resetting anything. The counter's lowest bit is the classic sense flag. Waiters
+  // spin for a while before parking on the phase counter, so threads that arrive close together hand off in well under a microsecond.
+  class Barrier
+  {
+    Barrier(const Barrier&) = delete;
+    Barrier& operator=(const Barrier&) = delete;
+
+  public:
+    explicit Barrier(uint32_t count, uint32_t spin = internal::DefaultSpin()) : _count(count), _spin(spin), _remaining(count), _phase(0), _parked(0)
+    {
+      assert(count > 0);
+    }
+    ~Barrier() { assert(!_parked.load(std::memory_order_acquire)); }
+    // Waits for every thread to arrive. The last one to arrive calls completion before releasing the others, so it can inspect or
+    // reset shared state from the phase that just ended. Returns true on the thread that called completion.
+    template<class F>
+    inline bool Wait(F&& completion)
+    {
+      uint32_t phase = _phase.load(std::memory_order_acquire); // Can't advance until we arrive
+      if(_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+        completion();
+        _remaining.store(_count, std::memory_order_relaxed); // Published by the release below
+        _phase.store(phase + 1, std::memory_order_seq_cst);
+        internal::Unpark(_phase, _parked);
+        return true;
+      }
+      internal::SpinPark(_phase, _parked, _spin, [phase](uint32_t v) { return v != phase; });
+      return false;
+    }
+    inline bool Wait() { return Wait([]() {}); }
+    // Number of phases that have completed so far
+    inline uint32_t Phase() const { return _phase.load(std::memory_order_acquire); }
+    inline uint32_t Count() const { return _count; }
+
+  protected:
+    uint32_t _count;
+    uint32_t _spin;
+    BSS_ALIGN(64) std::atomic<uint32_t> _remaining;
+    BSS_ALIGN(64) std::atomic<uint32_t> _phase;
+    std::atomic<uint32_t> _parked;
+  };
+
+  // Keeps a team of threads alive so a sequence of parallel phases can run without going through a task queue. The thread calling
+  // Run() is member 0 and the others are workers that spin, then park, between runs. Inside a run, members separate phases with
+  // Sync(), which is a Barrier, so a phase transition costs one barrier instead of submitting a task per thread and waiting for the
+  // queue to drain. Every member must call Sync() the same number of times. Only one thread can call Run() at a time.
+  class ParallelRegion
+  {
+    ParallelRegion(const ParallelRegion&) = delete;
+    ParallelRegion& operator=(const ParallelRegion&) = delete;
+
+  public:
+    // size is the number of members, including the thread that calls Run().
+    explicit ParallelRegion(uint32_t size = bssmax(std::thread::hardware_concurrency(), 1u), uint32_t spin = internal::DefaultSpin()) :
+      _size(bssmax(size, 1u)), _spin(spin), _fn(0), _call(0), _barrier(_size, spin), _run(0), _parked(0), _stop(false)
+    {
+      for(uint32_t i = 1; i < _size; ++i)
+        _threads.AddConstruct(_worker, std::ref(*this), i);
+    }
+    ~ParallelRegion()
+    {
+      _stop.store(true, std::memory_order_relaxed);
+      _run.fetch_add(1, std::memory_order_seq_cst);
+      internal::Unpark(_run, _parked);
+      for(auto& t : _threads)
+        t.join();
+    }
+    // Calls f(index) on every member, with index going from 0 to Size() - 1, and returns once they've all finished.
+    template<class F>
+    void Run(F&& f)
+    {
+      _fn = (void*)&f;
+      _call = &_invoke<std::remove_reference_t<F>>;
+      _run.fetch_add(1, std::memory_order_seq_cst);
+      internal::Unpark(_run, _parked);
+      _call(_fn, 0);
+      _barrier.Wait();
+    }
+    // Waits for every member to finish the current phase. completion runs on the last member to arrive before anyone moves on. Returns
+    // true on the member that ran it.
+    template<class F>
+    BSS_FORCEINLINE bool Sync(F&& completion) { return _barrier.Wait(std::forward<F>(completion)); }
+    BSS_FORCEINLINE bool Sync() { return _barrier.Wait(); }
+    // Splits [begin, end) into contiguous chunks, calls f(i) for every i in this member's chunk, then calls Sync(). Every member must
+    // call it with the same range.
+    template<class F>
+    inline void For(uint32_t index, size_t begin, size_t end, F&& f)
+    {
+      size_t b, e;
+      Chunk(index, begin, end, b, e);
+      for(size_t i = b; i < e; ++i)
+        f(i);
+      Sync();
+    }
+    // Gets the part of [begin, end) that For() gives to the member at index.
+    inline void Chunk(uint32_t index, size_t begin, size_t end, size_t& b, size_t& e) const
+    {
+      size_t n = end - begin;
+      b = begin + (n * index) / _size;
+      e = begin + (n * (index + 1)) / _size;
+    }
+    inline uint32_t Size() const { return _size; }
+
+  protected:
+    template<class F>
+    static void _invoke(void* f, uint32_t index) { (*reinterpret_cast<F*>(f))(index); }
+    static void _worker(ParallelRegion& r, uint32_t index)
+    {
+      uint32_t run = 0;
+      for(;;)
+      {
+        run = internal::SpinPark(r._run, r._parked, r._spin, [run](uint32_t v) { return v != run; });
+        if(r._stop.load(std::memory_order_relaxed)) // Relaxed is fine because the acquire in SpinPark orders it
+          break;
+        r._call(r._fn, index);
+        r._barrier.Wait();
+      }
+    }
+
+    uint32_t _size;
+    uint32_t _spin;
+    void* _fn;
+    void(*_call)(void*, uint32_t);
+    Barrier _barrier;
+    BSS_ALIGN(64) std::atomic<uint32_t> _run; // Bumped to start each run
+    std::atomic<uint32_t> _parked;
+    std::atomic<bool> _stop;
+    DynArray<Thread, uint32_t, ARRAY_MOVE> _threads;
+  };
+}
+
+#endif
@@ -6,6 +6,7 @@
 
 #include "BlockAlloc.h"
 #include "lockless.h"
+#include "LockStats.h"
 
 namespace bss {
   /* Multi-producer multi-consumer lockless fixed size allocator */
@@ -14,14 +15,14 @@ namespace bss {
   {
     typedef BlockAlloc::Node Node;
   public:
-    inline LocklessBlockPolicy(LocklessBlockPolicy&& mov) : _root(mov._root)
+    inline LocklessBlockPolicy(LocklessBlockPolicy&& mov) : _root(mov._root), _stats(mov._stats)
     {
       _freelist.p = mov._freelist.p;
       _freelist.tag = mov._freelist.tag;
       mov._freelist.p = mov._root = 0;
       _flag.clear(std::memory_order_relaxed);
     }
-    inline explicit LocklessBlockPolicy(size_t init = 8) : _root(0)
+    inline explicit LocklessBlockPolicy(size_t init = 8) : _root(0), _stats(0)
     {
       _flag.clear(std::memory_order_relaxed);
       //contention=0;
@@ -50,6 +51,7 @@ namespace bss {
       bss_PTag<void> ret = { 0, 0 };
       bss_PTag<void> nval;
       asmcasr<bss_PTag<void>>(&_freelist, ret, ret, ret);
+      LockStats::Wait w(_stats);
 
       for(;;)
       {
@@ -61,6 +63,8 @@ namespace bss {
               _allocChunk(fbnext(_root->size / sizeof(T)) * sizeof(T));
             _flag.clear(std::memory_order_release);
           }
+          else
+            w.Spin();
           asmcasr<bss_PTag<void>>(&_freelist, ret, ret, ret); // we could put this in the while loop but then you have to set nval to ret and it's just as messy
           continue;
         }
@@ -70,7 +74,9 @@ namespace bss {
 
         if(asmcasr<bss_PTag<void>>(&_freelist, nval, ret, ret))
           break;
+        w.Spin();
       }
+      w.Acquire(__FILE__, __LINE__); // Every allocation goes through here, so the callsite only distinguishes allocate() from deallocate()
 
       //assert(_validPointer(ret));
       return (T*)ret.p;
@@ -96,11 +102,13 @@ namespace bss {
       _freelist.p = mov._freelist.p;
       _freelist.tag = mov._freelist.tag;
       mov._freelist.p = mov._root = 0;
+      _stats = mov._stats;
       _flag.clear(std::memory_order_relaxed);
       return *this;
     }
 
-    //size_t contention;
+    // Records failed compare-and-swaps on the freelist as spins. Not thread-safe, so call it before sharing the allocator.
+    inline void SetLockStats(LockStats* stats) { _stats = stats; }
 
   protected:
 #ifdef BSS_DEBUG
@@ -146,18 +154,23 @@ namespace bss {
       bss_PTag<void> prev = { 0, 0 };
       bss_PTag<void> nval = { p, 0 };
       asmcasr<bss_PTag<void>>(&_freelist, prev, prev, prev);
+      LockStats::Wait w(_stats);
 
-      do
+      for(;;)
       {
         nval.tag = prev.tag + 1;
         *((void**)(target)) = (void*)prev.p;
-        //atomic_xadd<size_t>(&contention); //DEBUG
-      } while(!asmcasr<bss_PTag<void>>(&_freelist, nval, prev, prev));
+        if(asmcasr<bss_PTag<void>>(&_freelist, nval, prev, prev))
+          break;
+        w.Spin();
+      }
+      w.Acquire(__FILE__, __LINE__);
     }
 
     BSS_ALIGN(16) volatile bss_PTag<void> _freelist;
     BSS_ALIGN(4) std::atomic_flag _flag;
     Node* _root;
+    LockStats* _stats;
   };
 }
 
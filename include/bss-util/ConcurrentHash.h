@@ -0,0 +1,453 @@
+// Copyright ©2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __CONCURRENT_HASH_H__BSS__
+#define __CONCURRENT_HASH_H__BSS__
+
+#include "Hash.h"
+#include <atomic>
+#include <thread>
+
+namespace bss {
+  // Concurrent hash map that keeps khash's open addressing and quadratic probing. Writers lock one of STRIPES seqlocks, picked by the
+  // key's hash, so writers on different stripes never contend. Readers never lock or write shared memory, they just retry if their
+  // stripe changed while they were probing. Resizing is cooperative: once a new table is published, every writer migrates a CHUNK of
+  // buckets before doing its own work, and lookups check both tables until the migration is done. Old tables are kept on a retired
+  // list until Reclaim() is called, because a reader could still be probing them. Readers copy slots optimistically, so keys and
+  // values must be trivially copyable. Pointer keys (like strings) must stay valid until no reader could possibly be looking at them.
+  template<class Key,
+    class Data = void,
+    khint_t(*HashFunc)(const Key&) = &KH_AUTO_HASH<Key, false>,
+    bool(*HashEqual)(const Key&, const Key&) = &KH_AUTO_EQUAL<Key, false>,
+    size_t STRIPES = 64,
+    typename Alloc = StandardAllocator<char>>
+  class BSS_COMPILER_DLLEXPORT ConcurrentHash : protected Alloc
+  {
+    ConcurrentHash(const ConcurrentHash&) = delete;
+    ConcurrentHash& operator=(const ConcurrentHash&) = delete;
+
+  public:
+    static constexpr bool IsMap = !std::is_void<Data>::value;
+    typedef Key KEY;
+    typedef Data DATA;
+    typedef typename std::conditional<IsMap, Data, char>::type FakeData;
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<FakeData>::value, "ConcurrentHash keys and values must be trivially copyable");
+    static_assert(ISPOW2(STRIPES) && STRIPES <= 65536, "STRIPES must be a power of two no larger than 65536");
+    static const khint_t CHUNK = 256; // Number of buckets a writer migrates each time it helps with a resize
+
+    template<bool U = std::is_void_v<typename Alloc::policy_type>, std::enable_if_t<!U, int> = 0>
+    ConcurrentHash(khint_t nbuckets, typename Alloc::policy_type* policy) : Alloc(policy), _retired(0) { _init(nbuckets); }
+    explicit ConcurrentHash(khint_t nbuckets = 0) : _retired(0) { _init(nbuckets); }
+    ~ConcurrentHash()
+    {
+      Table* cur = _cur.load(std::memory_order_acquire);
+      if(Table* next = cur->target.load())
+        _freeTable(next);
+      _freeTable(cur);
+      Reclaim();
+    }
+
+    // Inserts or overwrites a key. Returns true if the key was not already present.
+    template<bool U = IsMap>
+    inline typename std::enable_if<U, bool>::type Insert(const Key& key, const FakeData& value) { return _write(key, &value, true) > 0; }
+    template<bool U = IsMap>
+    inline typename std::enable_if<!U, bool>::type Insert(const Key& key) { return _write(key, nullptr, true) > 0; }
+    // Overwrites the value of an existing key. Returns false if the key doesn't exist.
+    template<bool U = IsMap>
+    inline typename std::enable_if<U, bool>::type Set(const Key& key, const FakeData& value) { return !_write(key, &value, false); }
+    inline bool Remove(const Key& key)
+    {
+      khint_t h = HashFunc(key);
+      Stripe& stripe = _stripes[_stripe(h)];
+      _help();
+      _lock(stripe);
+      Table* t = _settle(_cur.load(std::memory_order_acquire), key, h);
+      khint_t i = _probe(t, key, h, false);
+      bool found = i < t->n_buckets;
+      if(found)
+      {
+        t->meta[i].store(SLOT_DELETED, std::memory_order_release);
+        stripe.size.store(stripe.size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+      }
+      _unlock(stripe);
+      return found;
+    }
+    // Copies out the value of a key if it exists. Never blocks writers.
+    template<bool U = IsMap>
+    inline typename std::enable_if<U, bool>::type Get(const Key& key, FakeData& value) const { return _read(key, &value); }
+    template<bool U = IsMap>
+    inline typename std::enable_if<U, bool>::type operator()(const Key& key, FakeData& value) const { return _read(key, &value); }
+    inline bool Exists(const Key& key) const { return _read(key, nullptr); }
+    inline bool operator()(const Key& key) const { return _read(key, nullptr); }
+    // Number of keys in the table. This is only exact if no writers are active.
+    inline khint_t Length() const
+    {
+      khint_t n = 0;
+      for(size_t i = 0; i < STRIPES; ++i)
+        n += _stripes[i].size.load(std::memory_order_relaxed);
+      return n;
+    }
+    inline khint_t Capacity() const { return _cur.load(std::memory_order_acquire)->n_buckets; }
+    inline bool Resizing() const { return _cur.load(std::memory_order_acquire)->target.load() != nullptr; }
+    // Frees all tables retired by previous resizes. This must only be called when no other thread is accessing the hash.
+    void Reclaim()
+    {
+      Table* t = _retired.exchange(nullptr, std::memory_order_acquire);
+      while(t)
+      {
+        Table* next = t->retired;
+        _freeTable(t);
+        t = next;
+      }
+    }
+
+  protected:
+    enum : uint32_t { SLOT_EMPTY = 0, SLOT_BUSY = 1, SLOT_FULL = 2, SLOT_DELETED = 3, SLOT_MOVED = 4, SLOT_MASK = 7 };
+    static const khint_t NPOS = (khint_t)~0;
+
+    struct Table
+    {
+      khint_t n_buckets, upper_bound, n_chunks;
+      size_t bytes;
+      std::atomic<khint_t> n_occupied;
+      std::atomic<khint_t> claimed; // Migration chunks handed out to writers
+      std::atomic<khint_t> migrated; // Migration chunks finished
+      std::atomic<Table*> target; // Table this one is being migrated into
+      Table* retired;
+      std::atomic<uint32_t>* meta; // Upper 29 bits of the hash and the slot state, so probes rarely have to touch the keys
+      Key* keys;
+      FakeData* vals;
+    };
+
+    struct BSS_ALIGN(64) Stripe
+    {
+      std::atomic<uint32_t> seq; // Odd while a writer holds this stripe
+      std::atomic<khint_t> size;
+    };
+
+    void _init(khint_t nbuckets)
+    {
+      for(size_t i = 0; i < STRIPES; ++i)
+      {
+        _stripes[i].seq.store(0, std::memory_order_relaxed);
+        _stripes[i].size.store(0, std::memory_order_relaxed);
+      }
+      _cur.store(_allocTable(nbuckets), std::memory_order_release);
+    }
+    Table* _allocTable(khint_t n)
+    {
+      kroundup32(n);
+      if(n < 32) n = 32;
+      size_t keyoff = AlignSize(sizeof(Table) + n * sizeof(uint32_t), alignof(Key));
+      size_t valoff = AlignSize(keyoff + n * sizeof(Key), alignof(FakeData));
+      size_t bytes = IsMap ? (valoff + n * sizeof(FakeData)) : (keyoff + n * sizeof(Key));
+      char* p = Alloc::allocate(bytes);
+      Table* t = new(p) Table();
+      t->n_buckets = n;
+      t->upper_bound = (khint_t)(n * __ac_HASH_UPPER + 0.5);
+      t->n_chunks = (n + CHUNK - 1) / CHUNK;
+      t->bytes = bytes;
+      t->n_occupied.store(0, std::memory_order_relaxed);
+      t->claimed.store(0, std::memory_order_relaxed);
+      t->migrated.store(0, std::memory_order_relaxed);
+      t->target.store(nullptr, std::memory_order_relaxed);
+      t->retired = 0;
+      t->meta = reinterpret_cast<std::atomic<uint32_t>*>(t + 1);
+      memset(t->meta, 0, n * sizeof(uint32_t)); // SLOT_EMPTY
+      t->keys = reinterpret_cast<Key*>(p + keyoff);
+      t->vals = IsMap ? reinterpret_cast<FakeData*>(p + valoff) : nullptr;
+      return t;
+    }
+    inline void _freeTable(Table* t)
+    {
+      size_t bytes = t->bytes;
+      t->~Table();
+      Alloc::deallocate(reinterpret_cast<char*>(t), bytes);
+    }
+    BSS_FORCEINLINE static size_t _stripe(khint_t h) { return (((h & ~(khint_t)SLOT_MASK) * 2654435769u) >> 16) & (STRIPES - 1); }
+    BSS_FORCEINLINE static void _spin(size_t spins) { if(spins > 64) std::this_thread::yield(); }
+    BSS_FORCEINLINE static bool _finished(const Table* t) { return t->migrated.load(std::memory_order_acquire) == t->n_chunks; }
+    static void _lock(Stripe& s)
+    {
+      uint32_t seq = s.seq.load(std::memory_order_relaxed);
+      for(size_t spins = 0; (seq & 1) || !s.seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed); ++spins)
+      {
+        _spin(spins);
+        seq = s.seq.load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_release); // Readers must see the odd sequence before any of our bucket writes
+    }
+    BSS_FORCEINLINE static void _unlock(Stripe& s) { s.seq.fetch_add(1, std::memory_order_release); }
+
+    // Returns the bucket holding key, t->n_buckets if it isn't there, or NPOS if stopmoved is set and we hit a migrated bucket.
+    inline khint_t _probe(const Table* t, const Key& key, khint_t h, bool stopmoved) const
+    {
+      khint_t mask = t->n_buckets - 1, i = h & mask, last = i, step = 0;
+      uint32_t tag = (h & ~(khint_t)SLOT_MASK) | SLOT_FULL;
+      for(;;)
+      {
+        uint32_t m = t->meta[i].load(std::memory_order_acquire);
+        if(m == tag && HashEqual(t->keys[i], key))
+          return i;
+        if((m & SLOT_MASK) == SLOT_EMPTY)
+          return t->n_buckets;
+        if(stopmoved && (m & SLOT_MASK) == SLOT_MOVED)
+          return NPOS;
+        i = (i + (++step)) & mask;
+        if(i == last)
+          return t->n_buckets;
+      }
+    }
+
+    // Inserts or overwrites key in t. Returns 0 if the key was overwritten, 1 if it was inserted, or -1 if the caller has to retry,
+    // either because t is being migrated, or because inserting would push t over limit occupied buckets. Requires the stripe lock.
+    inline int _place(Table* t, const Key& key, khint_t h, const FakeData* value, khint_t limit)
+    {
+      khint_t mask = t->n_buckets - 1;
+      uint32_t tag = (h & ~(khint_t)SLOT_MASK) | SLOT_FULL;
+      for(;;)
+      {
+        khint_t i = h & mask, last = i, step = 0, site = t->n_buckets;
+        uint32_t m, sitem = SLOT_EMPTY;
+        for(;;)
+        {
+          m = t->meta[i].load(std::memory_order_acquire);
+          if(m == tag && HashEqual(t->keys[i], key))
+          {
+            if constexpr(IsMap)
+            {
+              if(value) t->vals[i] = *value;
+            }
+            return 0;
+          }
+          if((m & SLOT_MASK) == SLOT_MOVED)
+            return -1;
+          if((m & SLOT_MASK) == SLOT_EMPTY)
+            break;
+          if((m & SLOT_MASK) == SLOT_DELETED && site == t->n_buckets)
+          {
+            site = i;
+            sitem = m;
+          }
+          i = (i + (++step)) & mask;
+          if(i == last)
+          {
+            if(site == t->n_buckets)
+              return -1; // Table is completely full
+            break;
+          }
+        }
+
+        if(site != t->n_buckets) // Reuse the first deleted bucket we found
+        {
+          i = site;
+          m = sitem;
+        }
+        else if(t->n_occupied.fetch_add(1, std::memory_order_relaxed) >= limit)
+        {
+          t->n_occupied.fetch_sub(1, std::memory_order_relaxed);
+          return -1;
+        }
+
+        if(!t->meta[i].compare_exchange_strong(m, SLOT_BUSY, std::memory_order_acquire, std::memory_order_relaxed))
+        { // Another stripe claimed this bucket, or it was migrated, so start over
+          if(site == t->n_buckets)
+            t->n_occupied.fetch_sub(1, std::memory_order_relaxed);
+          continue;
+        }
+
+        new(t->keys + i) Key(key);
+        if constexpr(IsMap)
+          new(t->vals + i) Data(*value);
+        t->meta[i].store(tag, std::memory_order_release);
+        return 1;
+      }
+    }
+
+    // Moves bucket i of cur into next and marks it as migrated. The caller must hold the stripe lock for the key in bucket i.
+    inline void _move(Table* cur, Table* next, khint_t i)
+    {
+      [[maybe_unused]] int r = _place(next, cur->keys[i], HashFunc(cur->keys[i]), IsMap ? cur->vals + i : nullptr, next->n_buckets);
+      assert(r == 1);
+      cur->meta[i].store(SLOT_MOVED, std::memory_order_release);
+    }
+
+    // If cur is being migrated, moves key out of cur so that it only ever exists in one table, and returns the table writers should use.
+    inline Table* _settle(Table* cur, const Key& key, khint_t h)
+    {
+      Table* next = cur->target.load();
+      if(!next)
+        return cur;
+      if(!_finished(cur))
+      {
+        khint_t i = _probe(cur, key, h, false);
+        if(i < cur->n_buckets)
+          _move(cur, next, i);
+      }
+      return next;
+    }
+
+    // Returns 1 if a new key was inserted, 0 if an existing key was overwritten, or -1 if insert was false and the key didn't exist.
+    int _write(const Key& key, const FakeData* value, bool insert)
+    {
+      khint_t h = HashFunc(key);
+      Stripe& stripe = _stripes[_stripe(h)];
+      for(size_t spins = 0;; ++spins)
+      {
+        _help();
+        _lock(stripe);
+        Table* cur = _cur.load(std::memory_order_acquire);
+        Table* t = _settle(cur, key, h);
+        int r;
+        if(!insert)
+        {
+          khint_t i = _probe(t, key, h, false);
+          if(i >= t->n_buckets)
+            r = -1;
+          else
+          {
+            if constexpr(IsMap)
+              t->vals[i] = *value;
+            r = 0;
+          }
+          _unlock(stripe);
+          return r;
+        }
+
+        // While migrating, writers may only fill half the new table, which guarantees migrated buckets always have room.
+        r = _place(t, key, h, value, (t == cur) ? t->n_buckets : (t->n_buckets >> 1));
+        if(r > 0)
+          stripe.size.store(stripe.size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        _unlock(stripe);
+
+        if(r >= 0)
+        {
+          if(r > 0 && t == cur && t->n_occupied.load(std::memory_order_relaxed) >= t->upper_bound)
+            _resize(cur);
+          return r;
+        }
+        if(t == cur)
+          _resize(cur);
+        _spin(spins);
+      }
+    }
+
+    bool _read(const Key& key, FakeData* value) const
+    {
+      khint_t h = HashFunc(key);
+      const Stripe& stripe = _stripes[_stripe(h)];
+      for(size_t spins = 0;; ++spins)
+      {
+        uint32_t seq = stripe.seq.load(std::memory_order_acquire);
+        if(!(seq & 1))
+        {
+          const Table* cur = _cur.load(std::memory_order_acquire);
+          const Table* next = cur->target.load();
+          const Table* t = next ? next : cur;
+          khint_t i = _probe(t, key, h, true);
+          if(i == t->n_buckets && next != nullptr && !_finished(cur))
+          {
+            t = cur;
+            i = _probe(cur, key, h, false);
+          }
+          bool found = i < t->n_buckets;
+          FakeData v;
+          if constexpr(IsMap)
+          {
+            if(found && value) v = t->vals[i];
+          }
+          std::atomic_thread_fence(std::memory_order_acquire);
+          if(i != NPOS && stripe.seq.load(std::memory_order_relaxed) == seq)
+          {
+            if constexpr(IsMap)
+            {
+              if(found && value) *value = v;
+            }
+            return found;
+          }
+        }
+        _spin(spins);
+      }
+    }
+
+    // Publishes a new table for cur to be migrated into, unless another writer already did.
+    void _resize(Table* cur)
+    {
+      if(cur->target.load() != nullptr)
+        return;
+      // Writers can put at most Length() + STRIPES keys into cur, and may only fill half of the new table themselves, so sizing it to twice
+      // that guarantees every migrated bucket fits. This also shrinks the table if most of cur is tombstones.
+      Table* next = _allocTable((Length() + (khint_t)STRIPES) * 2 + 1);
+      Table* expected = nullptr;
+      if(!cur->target.compare_exchange_strong(expected, next))
+        _freeTable(next);
+    }
+
+    // If a resize is in progress, migrates one chunk of the old table, and finishes the resize if this was the last chunk.
+    void _help()
+    {
+      Table* cur = _cur.load(std::memory_order_acquire);
+      Table* next = cur->target.load();
+      if(!next)
+        return;
+      khint_t c = cur->claimed.fetch_add(1, std::memory_order_relaxed);
+      if(c >= cur->n_chunks)
+        return;
+      khint_t end = bssmin((c + 1) * CHUNK, cur->n_buckets);
+      for(khint_t i = c * CHUNK; i < end; ++i)
+        _evacuate(cur, next, i);
+
+      if(cur->migrated.fetch_add(1, std::memory_order_acq_rel) + 1 == cur->n_chunks)
+      {
+        _cur.store(next, std::memory_order_release);
+        Table* r = _retired.load(std::memory_order_relaxed);
+        do
+        {
+          cur->retired = r;
+        } while(!_retired.compare_exchange_weak(r, cur, std::memory_order_release, std::memory_order_relaxed));
+      }
+    }
+
+    void _evacuate(Table* cur, Table* next, khint_t i)
+    {
+      for(size_t spins = 0;; ++spins)
+      {
+        uint32_t m = cur->meta[i].load(std::memory_order_acquire);
+        switch(m & SLOT_MASK)
+        {
+        case SLOT_MOVED:
+          return;
+        case SLOT_EMPTY:
+        case SLOT_DELETED: // Seal empty buckets so writers that haven't noticed the resize can't fill them
+          if(cur->meta[i].compare_exchange_strong(m, SLOT_MOVED, std::memory_order_acq_rel, std::memory_order_relaxed))
+            return;
+          break;
+        case SLOT_FULL:
+        { // The stripe comes from the hash bits stored in meta, so once we hold it, nobody else can change this bucket
+          Stripe& stripe = _stripes[_stripe(m)];
+          _lock(stripe);
+          bool same = cur->meta[i].load(std::memory_order_acquire) == m;
+          if(same)
+            _move(cur, next, i);
+          _unlock(stripe);
+          if(same)
+            return;
+          break;
+        }
+        default: // SLOT_BUSY: another writer is still filling this bucket
+          break;
+        }
+        _spin(spins);
+      }
+    }
+
+    Stripe _stripes[STRIPES];
+#pragma warning(push)
+#pragma warning(disable:4251)
+    BSS_ALIGN(64) std::atomic<Table*> _cur;
+    std::atomic<Table*> _retired;
+#pragma warning(pop)
+  };
+}
+
+#endif
@@ -0,0 +1,372 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __CONCURRENT_SKIP_LIST_H__BSS__
+#define __CONCURRENT_SKIP_LIST_H__BSS__
+
+#include "Alloc.h"
+#include "compare.h"
+#include "XorshiftEngine.h"
+#include <atomic>
+#include <thread>
+#include <tuple>
+
+namespace bss {
+  // Lock-free ordered map implemented as a skip list (Herlihy & Shavit's variant of Fraser's algorithm). Insert, Remove, lookups and
+  // iteration can all be called concurrently and never lock. Removing a key first marks the next pointers of its node, and any thread
+  // that walks past a marked node unlinks it, so readers just skip over nodes that are being removed. Iteration and Scan() are weakly
+  // consistent: they never block writers and never see a key twice, but may or may not see keys inserted or removed while they run.
+  // Removed nodes are kept on a retired list until Reclaim() is called, because another thread could still be looking at them. Keys
+  // can't be changed once inserted. Values can be read concurrently, but writing to them is only safe if the writes are synchronized
+  // some other way.
+  template<class Key,
+    class Data,
+    char(*CFunc)(const Key&, const Key&) = CompT<Key>,
+    typename Alloc = StandardAllocator<char>,
+    int MAXHEIGHT = 24>
+  class BSS_COMPILER_DLLEXPORT ConcurrentSkipList : protected Alloc
+  {
+    ConcurrentSkipList(const ConcurrentSkipList&) = delete;
+    ConcurrentSkipList& operator=(const ConcurrentSkipList&) = delete;
+    static_assert(MAXHEIGHT > 1 && MAXHEIGHT <= 32, "MAXHEIGHT must be between 2 and 32");
+
+  protected:
+    struct Node
+    {
+      template<typename K, typename... Args>
+      Node(uint32_t h, K&& k, Args&&... args) : key(std::forward<K>(k)), value(std::forward<Args>(args)...), retired(0), height(h) {}
+      BSS_FORCEINLINE std::atomic<uintptr_t>* Next() { return reinterpret_cast<std::atomic<uintptr_t>*>(this + 1); }
+
+      const Key key;
+      Data value;
+      Node* retired;
+      uint32_t height;
+    };
+
+  public:
+    typedef Key KEY;
+    typedef Data DATA;
+
+    // Forward iterator over level 0 that skips nodes that are being removed.
+    struct BSS_TEMPLATE_DLLEXPORT iterator
+    {
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = std::tuple<Key, Data>;
+      using difference_type = ptrdiff_t;
+      using reference = std::tuple<const Key&, Data&>;
+      using pointer = std::tuple<const Key*, Data*>;
+
+      inline iterator() : cur(0) {}
+      inline explicit iterator(Node* node) : cur(_skip(node)) {}
+      inline std::tuple<const Key&, Data&> operator*() const { return { cur->key, cur->value }; }
+      inline const Key& GetKey() const { return cur->key; }
+      inline Data& GetValue() const { return cur->value; }
+      inline iterator& operator++() { cur = _skip(_ptr(cur->Next()[0].load(std::memory_order_acquire))); return *this; }
+      inline iterator operator++(int) { iterator r(*this); ++*this; return r; }
+      inline bool operator==(const iterator& r) const { return cur == r.cur; }
+      inline bool operator!=(const iterator& r) const { return cur != r.cur; }
+      inline bool IsValid() const { return cur != 0; }
+
+      Node* cur;
+    };
+
+    template<bool U = std::is_void_v<typename Alloc::policy_type>, std::enable_if_t<!U, int> = 0>
+    inline explicit ConcurrentSkipList(typename Alloc::policy_type* policy) : Alloc(policy) { _init(); }
+    inline ConcurrentSkipList() { _init(); }
+    inline ~ConcurrentSkipList() { Clear(); }
+
+    // Inserts a key if it isn't already present. Returns false without touching the existing value if it is.
+    template<typename... Args>
+    inline bool Insert(const Key& key, Args&&... args) { return _insert(key, std::forward<Args>(args)...); }
+    template<typename... Args>
+    inline bool Insert(Key&& key, Args&&... args) { return _insert(std::move(key), std::forward<Args>(args)...); }
+    // Removes a key, returning false if it wasn't there or another thread removed it first.
+    inline bool Remove(const Key& key)
+    {
+      std::atomic<uintptr_t>* preds[MAXHEIGHT];
+      Node* succs[MAXHEIGHT];
+      if(!_find(key, preds, succs))
+        return false;
+
+      Node* node = succs[0];
+      std::atomic<uintptr_t>* next = node->Next();
+      for(uint32_t l = node->height; l-- > 1;) // Mark from the top down, so the node leaves the upper levels first
+      {
+        uintptr_t succ = next[l].load(std::memory_order_acquire);
+        while(!_marked(succ) && !next[l].compare_exchange_weak(succ, succ | 1, std::memory_order_seq_cst, std::memory_order_acquire));
+      }
+
+      uintptr_t succ = next[0].load(std::memory_order_acquire);
+      while(!_marked(succ)) // Whoever marks level 0 owns the removal
+      {
+        if(next[0].compare_exchange_weak(succ, succ | 1, std::memory_order_seq_cst, std::memory_order_acquire))
+        {
+          _find(key, preds, succs); // Unlinks the node from every level
+          _length.fetch_sub(1, std::memory_order_relaxed);
+          _retire(node);
+          return true;
+        }
+      }
+      return false;
+    }
+    // Copies out the value of a key if it exists. Never blocks writers.
+    inline bool Get(const Key& key, Data& value) const
+    {
+      Node* node = _search(key);
+      if(!node)
+        return false;
+      value = node->value;
+      return true;
+    }
+    // Returns a pointer to the value of a key, or null if it doesn't exist. The pointer stays valid until the next Reclaim() even if the
+    // key is removed in the meantime.
+    inline Data* GetValue(const Key& key) const { Node* node = _search(key); return !node ? nullptr : &node->value; }
+    inline bool Exists(const Key& key) const { return _search(key) != 0; }
+    inline bool operator()(const Key& key) const { return _search(key) != 0; }
+    // Returns an iterator to the first key that isn't less than key
+    inline iterator LowerBound(const Key& key) const
+    {
+      std::atomic<uintptr_t>* pred = const_cast<std::atomic<uintptr_t>*>(_head);
+      Node* cur = 0;
+      for(int l = _top(); l >= 0; --l)
+      {
+        cur = _ptr(pred[l].load(std::memory_order_acquire));
+        while(cur)
+        {
+          uintptr_t succ = cur->Next()[l].load(std::memory_order_acquire);
+          if(!_marked(succ) && CFunc(cur->key, key) >= 0)
+            break;
+          if(!_marked(succ))
+            pred = cur->Next();
+          cur = _ptr(succ);
+        }
+      }
+      return iterator(cur);
+    }
+    // Calls f(key, value) on each key in [from, to) in order, stopping early if f returns false, and returns the number of keys visited.
+    // Writers are never blocked, so keys inserted or removed during the scan may or may not be visited.
+    template<typename F>
+    inline size_t Scan(const Key& from, const Key& to, F && f) const
+    {
+      size_t n = 0;
+      for(iterator i = LowerBound(from); i.IsValid() && CFunc(i.GetKey(), to) < 0; ++i)
+      {
+        ++n;
+        if constexpr(std::is_same_v<decltype(f(i.GetKey(), i.GetValue())), bool>)
+        {
+          if(!f(i.GetKey(), i.GetValue()))
+            break;
+        }
+        else
+          f(i.GetKey(), i.GetValue());
+      }
+      return n;
+    }
+    // Number of keys in the list. This is only exact if no writers are active.
+    inline size_t Length() const { return _length.load(std::memory_order_relaxed); }
+    inline bool Empty() const { return !begin().IsValid(); }
+    // Frees every node removed since the last call. This must only be called when no other thread is accessing the list.
+    inline void Reclaim()
+    {
+      Node* node = _retired.exchange(nullptr, std::memory_order_acquire);
+      while(node)
+      {
+        Node* next = node->retired;
+        _free(node);
+        node = next;
+      }
+    }
+    // Removes and frees everything. This must only be called when no other thread is accessing the list.
+    inline void Clear()
+    {
+      Node* node = _ptr(_head[0].load(std::memory_order_acquire));
+      while(node)
+      {
+        uintptr_t next = node->Next()[0].load(std::memory_order_relaxed);
+        if(!_marked(next)) // Marked nodes are already on the retired list
+          _free(node);
+        node = _ptr(next);
+      }
+      Reclaim();
+      _init();
+    }
+
+    inline iterator begin() const { return iterator(_ptr(_head[0].load(std::memory_order_acquire))); }
+    inline iterator end() const { return iterator(); }
+
+  protected:
+    BSS_FORCEINLINE static Node* _ptr(uintptr_t p) { return reinterpret_cast<Node*>(p & ~(uintptr_t)1); }
+    BSS_FORCEINLINE static bool _marked(uintptr_t p) { return (p & 1) != 0; }
+    static inline Node* _skip(Node* node)
+    {
+      uintptr_t next;
+      while(node && _marked(next = node->Next()[0].load(std::memory_order_acquire)))
+        node = _ptr(next);
+      return node;
+    }
+    inline void _init()
+    {
+      for(int l = 0; l < MAXHEIGHT; ++l)
+        _head[l].store(0, std::memory_order_relaxed);
+      _height.store(1, std::memory_order_relaxed);
+      _length.store(0, std::memory_order_relaxed);
+      _retired.store(0, std::memory_order_release);
+    }
+    BSS_FORCEINLINE int _top() const { return (int)_height.load(std::memory_order_acquire) - 1; }
+    // Each level holds a quarter of the nodes of the one below it, which keeps nodes small and searches short.
+    static inline uint32_t _randHeight()
+    {
+      static thread_local uint64_t state = 0;
+      if(!state)
+        state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+      uint64_t r = xorshift64star(state);
+      uint32_t h = 1;
+      while(h < MAXHEIGHT && !(r & 3))
+      {
+        ++h;
+        r >>= 2;
+      }
+      return h;
+    }
+    template<typename K, typename... Args>
+    inline Node* _alloc(uint32_t height, K&& key, Args&&... args)
+    {
+      Node* node = reinterpret_cast<Node*>(Alloc::allocate(sizeof(Node) + height * sizeof(std::atomic<uintptr_t>)));
+      new(node) Node(height, std::forward<K>(key), std::forward<Args>(args)...);
+      for(uint32_t l = 0; l < height; ++l)
+        new(node->Next() + l) std::atomic<uintptr_t>(0);
+      return node;
+    }
+    inline void _free(Node* node)
+    {
+      size_t bytes = sizeof(Node) + node->height * sizeof(std::atomic<uintptr_t>);
+      node->~Node();
+      Alloc::deallocate(reinterpret_cast<char*>(node), bytes);
+    }
+    inline void _retire(Node* node)
+    {
+      Node* r = _retired.load(std::memory_order_relaxed);
+      do
+      {
+        node->retired = r;
+      } while(!_retired.compare_exchange_weak(r, node, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Finds the predecessors and successors of key on every level, unlinking any marked nodes it walks past. A predecessor is
+    // represented by its array of next pointers, so the head doesn't need to be a node. Returns true if succs[0] holds key.
+    bool _find(const Key& key, std::atomic<uintptr_t>** preds, Node** succs)
+    {
+    retry:
+      std::atomic<uintptr_t>* pred = _head;
+      for(int l = MAXHEIGHT - 1; l >= 0; --l)
+      {
+        Node* cur = _ptr(pred[l].load(std::memory_order_acquire));
+        while(cur)
+        {
+          uintptr_t succ = cur->Next()[l].load(std::memory_order_acquire);
+          while(_marked(succ))
+          {
+            uintptr_t expected = reinterpret_cast<uintptr_t>(cur);
+            if(!pred[l].compare_exchange_strong(expected, succ & ~(uintptr_t)1, std::memory_order_seq_cst, std::memory_order_relaxed))
+              goto retry; // Our predecessor changed or is being removed itself
+            cur = _ptr(succ);
+            if(!cur)
+              break;
+            succ = cur->Next()[l].load(std::memory_order_acquire);
+          }
+          if(!cur || CFunc(cur->key, key) >= 0)
+            break;
+          pred = cur->Next();
+          cur = _ptr(succ);
+        }
+        preds[l] = pred;
+        succs[l] = cur;
+      }
+      return succs[0] != 0 && !CFunc(succs[0]->key, key);
+    }
+    // Read-only search that skips over marked nodes instead of unlinking them, so it never writes to shared memory.
+    Node* _search(const Key& key) const
+    {
+      const std::atomic<uintptr_t>* pred = _head;
+      Node* cur = 0;
+      for(int l = _top(); l >= 0; --l)
+      {
+        cur = _ptr(pred[l].load(std::memory_order_acquire));
+        while(cur)
+        {
+          uintptr_t succ = cur->Next()[l].load(std::memory_order_acquire);
+          if(!_marked(succ))
+          {
+            char c = CFunc(cur->key, key);
+            if(!c)
+              return cur;
+            if(c > 0)
+              break;
+            pred = cur->Next();
+          }
+          cur = _ptr(succ);
+        }
+      }
+      return 0;
+    }
+    template<typename K, typename... Args>
+    bool _insert(K&& key, Args&&... args)
+    {
+      std::atomic<uintptr_t>* preds[MAXHEIGHT];
+      Node* succs[MAXHEIGHT];
+      Node* node = 0;
+      uint32_t height = _randHeight();
+
+      for(;;)
+      {
+        if(_find(!node ? key : node->key, preds, succs)) // key may have been moved into the node
+        {
+          if(node)
+            _free(node);
+          return false;
+        }
+        if(!node)
+          node = _alloc(height, std::forward<K>(key), std::forward<Args>(args)...);
+        std::atomic<uintptr_t>* next = node->Next();
+        for(uint32_t l = 0; l < height; ++l)
+          next[l].store(reinterpret_cast<uintptr_t>(succs[l]), std::memory_order_relaxed);
+        uintptr_t expected = reinterpret_cast<uintptr_t>(succs[0]);
+        if(preds[0][0].compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(node), std::memory_order_seq_cst, std::memory_order_relaxed))
+          break; // The key is now in the list
+      }
+      _length.fetch_add(1, std::memory_order_relaxed);
+
+      uint32_t top = _height.load(std::memory_order_relaxed);
+      while(top < height && !_height.compare_exchange_weak(top, height, std::memory_order_release, std::memory_order_relaxed));
+
+      std::atomic<uintptr_t>* next = node->Next();
+      for(uint32_t l = 1; l < height; ++l)
+      {
+        for(;;)
+        {
+          // Point the node at its current successor first. If this fails, the node is being removed and we can stop.
+          uintptr_t cur = next[l].load(std::memory_order_acquire);
+          uintptr_t succ = reinterpret_cast<uintptr_t>(succs[l]);
+          if(_marked(cur) || (cur != succ && !next[l].compare_exchange_strong(cur, succ, std::memory_order_seq_cst, std::memory_order_acquire)))
+            goto done;
+          if(preds[l][l].compare_exchange_strong(succ, reinterpret_cast<uintptr_t>(node), std::memory_order_seq_cst, std::memory_order_relaxed))
+            break;
+          if(!_find(node->key, preds, succs) || succs[0] != node)
+            goto done; // Our node was removed, possibly replaced by another node with the same key
+        }
+      }
+    done:
+      // If a remover marked the node while we were still linking it, it may have missed the levels we linked afterwards.
+      if(_marked(next[0].load(std::memory_order_seq_cst)))
+        _find(node->key, preds, succs);
+      return true;
+    }
+
+    std::atomic<uintptr_t> _head[MAXHEIGHT];
+    BSS_ALIGN(64) std::atomic<uint32_t> _height; // Highest level any node has reached, which read-only searches start from
+    std::atomic<size_t> _length;
+    std::atomic<Node*> _retired;
+  };
+}
+
+#endif
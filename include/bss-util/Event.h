@@ -0,0 +1,212 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __EVENT_H__BSS__
+#define __EVENT_H__BSS__
+
+#include "Delegate.h"
+#include "Alloc.h"
+#include <atomic>
+#include <mutex>
+
+namespace bss {
+  // Multicast event that calls every subscribed delegate in the order they subscribed. Subscribers are kept in an immutable, contiguous
+  // snapshot that is swapped out whenever someone subscribes or unsubscribes, so dispatching never locks or allocates and can run on
+  // any number of threads at once. Subscribe and Unsubscribe take a lock and copy the snapshot, so they're meant to be rare compared to
+  // dispatches. Both are safe to call from any thread, including from inside a handler. Old snapshots are freed once no dispatch can
+  // still be reading them, which is tracked with a pair of reader counts flipped between two epochs, so a writer never waits on readers.
+  // A dispatch that is already running keeps calling the snapshot it started with, so a handler can still be called once after it
+  // unsubscribes, and one that subscribes during a dispatch won't be called until the next one.
+  template<typename... Args>
+  class BSS_COMPILER_DLLEXPORT Event
+  {
+    Event(const Event&) = delete;
+    Event& operator=(const Event&) = delete;
+
+  public:
+    typedef Delegate<void, Args...> FN;
+    typedef uint64_t ID;
+
+    inline Event() : _cur(0), _retired(0), _lastid(0), _epoch(0) { _readers[0].store(0, std::memory_order_relaxed); _readers[1].store(0, std::memory_order_relaxed); }
+    inline ~Event()
+    {
+      assert(!_readers[0].load(std::memory_order_acquire) && !_readers[1].load(std::memory_order_acquire));
+      _free(_cur.load(std::memory_order_relaxed));
+      while(_retired)
+      {
+        Snapshot* s = _retired;
+        _retired = s->next;
+        _free(s);
+      }
+    }
+    // Calls every subscriber with the given arguments.
+    void operator()(Args... args) const
+    {
+      size_t e = _enter();
+      if(const Snapshot* s = _cur.load(std::memory_order_acquire))
+        for(size_t i = 0; i < s->length; ++i)
+          s->items[i].fn(args...);
+      _readers[e & 1].fetch_sub(1, std::memory_order_release);
+    }
+    // Adds a subscriber and returns an ID that can be passed to Unsubscribe. The same delegate can subscribe more than once.
+    ID Subscribe(FN fn)
+    {
+      assert(fn.RawFunc() != 0);
+      std::lock_guard<std::mutex> lock(_lock);
+      Snapshot* old = _cur.load(std::memory_order_relaxed);
+      size_t len = !old ? 0 : old->length;
+      Snapshot* s = _alloc(len + 1);
+      for(size_t i = 0; i < len; ++i)
+        new(s->items + i) Entry(old->items[i]);
+      new(s->items + len) Entry{ fn, ++_lastid };
+      _publish(s, old);
+      return _lastid;
+    }
+    // Removes the subscriber with the given ID. Returns false if there wasn't one.
+    bool Unsubscribe(ID id)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      Snapshot* old = _cur.load(std::memory_order_relaxed);
+      size_t len = !old ? 0 : old->length;
+      size_t i = 0;
+      while(i < len && old->items[i].id != id) ++i;
+      return _remove(old, i);
+    }
+    // Removes the first subscription of the given delegate. Returns false if it wasn't subscribed.
+    bool Unsubscribe(FN fn)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      Snapshot* old = _cur.load(std::memory_order_relaxed);
+      size_t len = !old ? 0 : old->length;
+      size_t i = 0;
+      while(i < len && (old->items[i].fn.RawSource() != fn.RawSource() || old->items[i].fn.RawFunc() != fn.RawFunc())) ++i;
+      return _remove(old, i);
+    }
+    // Removes every subscriber.
+    void Clear()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(Snapshot* old = _cur.load(std::memory_order_relaxed))
+        _publish(0, old);
+    }
+    // Frees any old snapshots that dispatches have finished with. This also happens whenever a subscriber is added or removed.
+    void Reclaim()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      _collect();
+    }
+    inline size_t Length() const
+    {
+      size_t e = _enter();
+      const Snapshot* s = _cur.load(std::memory_order_acquire);
+      size_t len = !s ? 0 : s->length;
+      _readers[e & 1].fetch_sub(1, std::memory_order_release);
+      return len;
+    }
+    inline bool Empty() const { return !_cur.load(std::memory_order_relaxed); }
+
+  protected:
+    struct Entry
+    {
+      FN fn;
+      ID id;
+    };
+    struct Snapshot
+    {
+      Snapshot* next; // Links retired snapshots
+      size_t epoch; // Epoch this snapshot was retired in
+      size_t length;
+      Entry items[1];
+    };
+
+    inline bool _remove(Snapshot* old, size_t i)
+    {
+      size_t len = !old ? 0 : old->length;
+      if(i >= len)
+        return false;
+      Snapshot* s = 0;
+      if(len > 1)
+      {
+        s = _alloc(len - 1);
+        for(size_t j = 0; j < i; ++j)
+          new(s->items + j) Entry(old->items[j]);
+        for(size_t j = i + 1; j < len; ++j)
+          new(s->items + j - 1) Entry(old->items[j]);
+      }
+      _publish(s, old);
+      return true;
+    }
+    // Registers a dispatch with the current epoch. If the epoch flips between reading it and registering, the count we bumped may
+    // already have been checked, so we retry with the new one.
+    BSS_FORCEINLINE size_t _enter() const
+    {
+      for(;;)
+      {
+        size_t e = _epoch.load(std::memory_order_seq_cst);
+        _readers[e & 1].fetch_add(1, std::memory_order_seq_cst);
+        if(_epoch.load(std::memory_order_seq_cst) == e)
+          return e;
+        _readers[e & 1].fetch_sub(1, std::memory_order_relaxed);
+      }
+    }
+    inline void _publish(Snapshot* s, Snapshot* old)
+    {
+      _cur.store(s, std::memory_order_seq_cst);
+      if(old)
+      {
+        old->epoch = _epoch.load(std::memory_order_relaxed);
+        old->next = _retired;
+        _retired = old;
+      }
+      _collect();
+    }
+    // A snapshot retired in epoch e can only be held by dispatches registered in e or earlier, since later ones loaded the new
+    // snapshot. Moving to e + 1 requires everything registered in e - 1 to have finished, so once we reach e + 2 it's safe to free.
+    inline void _collect()
+    {
+      for(int n = 0; n < 2 && _retired; ++n)
+      {
+        size_t e = _epoch.load(std::memory_order_relaxed);
+        if(_readers[(e + 1) & 1].load(std::memory_order_seq_cst) != 0)
+          break;
+        _epoch.store(++e, std::memory_order_seq_cst);
+
+        Snapshot** prev = &_retired;
+        while(Snapshot* s = *prev)
+        {
+          if(s->epoch + 2 <= e)
+          {
+            *prev = s->next;
+            _free(s);
+          }
+          else
+            prev = &s->next;
+        }
+      }
+    }
+    inline static Snapshot* _alloc(size_t n)
+    {
+      static_assert(std::is_trivially_destructible<Entry>::value, "Entry must be trivially destructible");
+      Snapshot* s = reinterpret_cast<Snapshot*>(StandardAllocator<char>().allocate(_size(n)));
+      s->next = 0;
+      s->epoch = 0;
+      s->length = n;
+      return s;
+    }
+    inline static void _free(Snapshot* s)
+    {
+      if(s)
+        StandardAllocator<char>().deallocate(reinterpret_cast<char*>(s), _size(s->length));
+    }
+    BSS_FORCEINLINE static size_t _size(size_t n) { return sizeof(Snapshot) + (bssmax(n, 1) - 1) * sizeof(Entry); }
+
+    std::atomic<Snapshot*> _cur;
+    Snapshot* _retired; // Only touched while holding _lock
+    ID _lastid;
+    std::mutex _lock;
+    BSS_ALIGN(64) std::atomic<size_t> _epoch;
+    BSS_ALIGN(64) mutable std::atomic<size_t> _readers[2];
+  };
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include "Str.h"
 #include "Serializer.h"
 #include <wchar.h>
+#include <string_view>
 #include <utility>
 #include <iterator>
 
@@ -34,45 +35,165 @@ namespace bss {
       return static_cast<const khint_t>(key);
   }
 
-  // String hash function
-  template<class T, bool IgnoreCase>
-  inline khint_t KH_STR_HASH(const T* s) = delete;
-  template<>
-  inline khint_t KH_STR_HASH<char, false>(const char * s)
-  {
-    khint_t h = *s;
-    if(h)
-      for(++s; *s; ++s)
-        h = (h << 5) - h + *s;
-    return h;
-  }
-  template<>
-  inline khint_t KH_STR_HASH<char, true>(const char *s)
-  {
-    khint_t h = ((*s) > 64 && (*s) < 91) ? (*s) + 32 : *s;
-    if(h)
-      for(++s; *s; ++s)
-        h = (h << 5) - h + (((*s) > 64 && (*s) < 91) ? (*s) + 32 : *s);
-    return h;
-  }
-  template<>
-  inline khint_t KH_STR_HASH<wchar_t, false>(const wchar_t * s)
-  {
-    khint_t h = *s;
-    if(h)
-      for(++s; *s; ++s)
-        h = (h << 5) - h + *s;
-    return h;
+  namespace internal {
+    // Multiplies two 64-bit numbers into a 128-bit result, leaving the low half in a and the high half in b.
+    BSS_FORCEINLINE void HashMum(uint64_t& a, uint64_t& b)
+    {
+#if defined(BSS_COMPILER_MSC) && defined(BSS_64BIT)
+      a = _umul128(a, b, &b);
+#elif defined(__SIZEOF_INT128__)
+      unsigned __int128 r = (unsigned __int128)a * b;
+      a = (uint64_t)r;
+      b = (uint64_t)(r >> 64);
+#else
+      uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+      uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+      uint64_t lo = t + (rm1 << 32);
+      c += lo < t;
+      a = lo;
+      b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+    }
+    BSS_FORCEINLINE uint64_t HashMix(uint64_t a, uint64_t b) { HashMum(a, b); return a ^ b; }
+    BSS_FORCEINLINE uint64_t HashRead8(const unsigned char* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+    BSS_FORCEINLINE uint64_t HashRead4(const unsigned char* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+    // Hashes a block of memory 8 or 16 bytes at a time with full 64-bit multiplies. This is wyhash (final version 4), which is in
+    // the public domain. Keys of 16 bytes or less are read with a handful of overlapping loads and never loop.
+    inline uint64_t HashBytes(const void* data, size_t len, uint64_t seed = 0)
+    {
+      static const uint64_t P0 = 0xa0761d6478bd642full, P1 = 0xe7037ed1a0b428dbull, P2 = 0x8ebc6af09c88c6e3ull, P3 = 0x589965cc75374cc3ull;
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+      seed ^= HashMix(seed ^ P0, P1);
+      uint64_t a, b;
+      if(len <= 16)
+      {
+        if(len >= 4)
+        {
+          a = (HashRead4(p) << 32) | HashRead4(p + ((len >> 3) << 2));
+          b = (HashRead4(p + len - 4) << 32) | HashRead4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if(len > 0)
+        {
+          a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+          b = 0;
+        }
+        else
+          a = b = 0;
+      }
+      else
+      {
+        size_t i = len;
+        if(i > 48)
+        {
+          uint64_t s1 = seed, s2 = seed;
+          do
+          {
+            seed = HashMix(HashRead8(p) ^ P1, HashRead8(p + 8) ^ seed);
+            s1 = HashMix(HashRead8(p + 16) ^ P2, HashRead8(p + 24) ^ s1);
+            s2 = HashMix(HashRead8(p + 32) ^ P3, HashRead8(p + 40) ^ s2);
+            p += 48;
+            i -= 48;
+          } while(i > 48);
+          seed ^= s1 ^ s2;
+        }
+        while(i > 16)
+        {
+          seed = HashMix(HashRead8(p) ^ P1, HashRead8(p + 8) ^ seed);
+          i -= 16;
+          p += 16;
+        }
+        a = HashRead8(p + i - 16);
+        b = HashRead8(p + i - 8);
+      }
+      a ^= P1;
+      b ^= seed;
+      HashMum(a, b);
+      return HashMix(a ^ P0 ^ len, b ^ P1);
+    }
+    BSS_FORCEINLINE khint_t HashFold(uint64_t h) { return (khint_t)(h ^ (h >> 32)); }
+
+    // Lowercases the ASCII letters in 8 bytes at once. Adding to the low 7 bits of each byte sets its top bit if it's at least 'A', or
+    // greater than 'Z', without carrying into the next byte. Bytes that already had their top bit set aren't ASCII, so are skipped.
+    BSS_FORCEINLINE uint64_t HashLower8(uint64_t x)
+    {
+      const uint64_t ONES = 0x0101010101010101ull, HIGH = ONES * 0x80;
+      uint64_t low = x & ~HIGH;
+      uint64_t upper = ((low + ONES * (0x80 - 'A')) ^ (low + ONES * (0x80 - 'Z' - 1))) & ~x & HIGH;
+      return x | (upper >> 2);
+    }
+    // Copies len characters to out with ASCII uppercase letters made lowercase, 16 at a time with SSE2, or 8 at a time otherwise.
+    // Lowercasing is idempotent, so the last block simply overlaps the one before it instead of finishing one byte at a time, which
+    // would also stall HashBytes when it reads the bytes back in larger pieces.
+    inline void HashLower(const char* s, char* out, size_t len)
+    {
+      size_t i = 0;
+#ifdef BSS_SSE_ENABLED
+      if(len >= 16)
+      {
+        const __m128i before = _mm_set1_epi8('A' - 1), after = _mm_set1_epi8('Z' + 1), bit = _mm_set1_epi8(0x20);
+        auto lower = [&](size_t j) {
+          __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + j));
+          __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, before), _mm_cmplt_epi8(c, after)); // Signed, so bytes above 127 never match
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), _mm_or_si128(c, _mm_and_si128(upper, bit)));
+        };
+        for(; i + 16 <= len; i += 16)
+          lower(i);
+        if(i < len)
+          lower(len - 16);
+        return;
+      }
+#endif
+      if(len >= 8)
+      {
+        auto lower = [&](size_t j) {
+          uint64_t x;
+          memcpy(&x, s + j, 8);
+          x = HashLower8(x);
+          memcpy(out + j, &x, 8);
+        };
+        for(; i + 8 <= len; i += 8)
+          lower(i);
+        if(i < len)
+          lower(len - 8);
+        return;
+      }
+      for(; i < len; ++i)
+        out[i] = s[i] | (char)(((unsigned char)(s[i] - 'A') < 26) << 5);
+    }
+    inline void HashLower(const wchar_t* s, wchar_t* out, size_t len)
+    {
+      for(size_t i = 0; i < len; ++i)
+        out[i] = towlower(s[i]);
+    }
   }
-  template<>
-  inline khint_t KH_STR_HASH<wchar_t, true>(const wchar_t *s)
+
+  // String hash function. Case-insensitive hashes lowercase the string into a small buffer a block at a time and chain the hashes
+  // of each block together.
+  template<class T, bool IgnoreCase>
+  inline khint_t KH_STR_HASH(const T* s, size_t len)
   {
-    khint_t h = towlower(*s);
-    if(h)
-      for(++s; *s; ++s)
-        h = (h << 5) - h + towlower(*s);
-    return h;
+    static_assert(std::is_same_v<T, char> || std::is_same_v<T, wchar_t>, "T must be char or wchar_t");
+    if constexpr(!IgnoreCase)
+      return internal::HashFold(internal::HashBytes(s, len * sizeof(T)));
+    else
+    {
+      const size_t BLOCK = 256 / sizeof(T);
+      T buf[BLOCK];
+      uint64_t h = 0;
+      do
+      {
+        size_t n = bssmin(len, BLOCK);
+        internal::HashLower(s, buf, n);
+        h = internal::HashBytes(buf, n * sizeof(T), h);
+        s += n;
+        len -= n;
+      } while(len > 0);
+      return internal::HashFold(h);
+    }
   }
+  template<class T, bool IgnoreCase>
+  inline khint_t KH_STR_HASH(const T* s) { return KH_STR_HASH<T, IgnoreCase>(s, std::char_traits<T>::length(s)); }
 
   // String equality function
   template<class T, bool IgnoreCase>
@@ -81,6 +202,23 @@ namespace bss {
   template<> inline bool KH_STR_EQUAL<wchar_t, false>(const wchar_t* a, const wchar_t* b) { return wcscmp(a, b) == 0; }
   template<> inline bool KH_STR_EQUAL<char, true>(const char* a, const char* b) { return STRICMP(a, b) == 0; }
   template<> inline bool KH_STR_EQUAL<wchar_t, true>(const wchar_t* a, const wchar_t* b) { return WCSICMP(a, b) == 0; }
+  // Compares exactly len characters, including any embedded nulls, with the same ASCII case folding KH_STR_HASH uses.
+  template<class T, bool IgnoreCase>
+  inline bool KH_STR_EQUAL(const T* a, const T* b, size_t len)
+  {
+    if constexpr(!IgnoreCase)
+      return !memcmp(a, b, len * sizeof(T));
+    else
+    {
+      for(size_t i = 0; i < len; ++i)
+      {
+        T x = a[i], y = b[i];
+        if(x != y && ((x | 0x20) != (y | 0x20) || (x | 0x20) < 'a' || (x | 0x20) > 'z'))
+          return false;
+      }
+      return true;
+    }
+  }
 
   template<typename T, bool INS = false> // forward declaration for the multihash
   BSS_FORCEINLINE khint_t KH_AUTO_HASH(const T& k);
@@ -112,9 +250,9 @@ namespace bss {
     if constexpr(std::is_same<T, char*>::value || std::is_same<T, wchar_t*>::value || std::is_same<T, const char*>::value || std::is_same<T, const wchar_t*>::value)
       return KH_STR_HASH<std::remove_const_t<std::remove_pointer_t<T>>, INS>(k);
     else if constexpr(std::is_base_of<std::string, T>::value)
-      return KH_STR_HASH<char, INS>(k.c_str());
+      return KH_STR_HASH<char, INS>(k.c_str(), k.size());
     else if constexpr(std::is_base_of<std::basic_string<wchar_t>, T>::value)
-      return KH_STR_HASH<wchar_t, INS>(k.c_str());
+      return KH_STR_HASH<wchar_t, INS>(k.c_str(), k.size());
     else if constexpr(is_specialization_of<T, std::tuple>::value || is_specialization_of<T, std::pair>::value || is_specialization_of_array<T>::value)
       return KH_MULTI_HASH<T, std::tuple_size<T>::value - 1>(k);
     else
@@ -128,9 +266,9 @@ namespace bss {
     if constexpr(std::is_same<T, char*>::value || std::is_same<T, wchar_t*>::value || std::is_same<T, const char*>::value || std::is_same<T, const wchar_t*>::value)
       return KH_STR_EQUAL<std::remove_const_t<std::remove_pointer_t<T>>, INS>(a, b);
     else if constexpr(std::is_base_of<std::string, T>::value)
-      return KH_STR_EQUAL<char, INS>(a.c_str(), b.c_str());
+      return a.size() == b.size() && KH_STR_EQUAL<char, INS>(a.data(), b.data(), a.size());
     else if constexpr(std::is_base_of<std::basic_string<wchar_t>, T>::value)
-      return KH_STR_EQUAL<wchar_t, INS>(a.c_str(), b.c_str());
+      return a.size() == b.size() && KH_STR_EQUAL<wchar_t, INS>(a.data(), b.data(), a.size());
     else if constexpr(is_specialization_of<T, std::tuple>::value || is_specialization_of<T, std::pair>::value || is_specialization_of_array<T>::value)
       return KH_MULTI_EQUAL<T, std::tuple_size<T>::value - 1>(a, b);
     else
@@ -146,25 +284,121 @@ namespace bss {
     template<> struct _HashGET<StrW> { typedef const wchar_t* GET; static BSS_FORCEINLINE GET F(StrW& s) { return s.c_str(); } };
     template<> struct _HashGET<std::wstring> { typedef const wchar_t* GET; static BSS_FORCEINLINE GET F(std::wstring& s) { return s.c_str(); } };
 #endif
+
+    // One group of control bytes in a HASH_SWISS table, which are compared all at once. A control byte is either EMPTY, DELETED, or
+    // 7 bits of the hash of the key stored in that slot. Masks have one bit per slot, starting with the lowest bit.
+    struct HashGroup
+    {
+      static const khint_t WIDTH = 16;
+      static const khint8_t EMPTY = 0x80;
+      static const khint8_t DELETED = 0xFE;
+
+#ifdef BSS_SSE_ENABLED
+      BSS_FORCEINLINE explicit HashGroup(const khint8_t* p) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) {}
+      BSS_FORCEINLINE uint32_t Match(khint8_t h2) const { return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char)h2), ctrl)); }
+      BSS_FORCEINLINE uint32_t MatchFree() const { return (uint32_t)_mm_movemask_epi8(ctrl); } // Only EMPTY and DELETED have the top bit set
+
+      __m128i ctrl;
+#else
+      BSS_FORCEINLINE explicit HashGroup(const khint8_t* p) { memcpy(ctrl, p, WIDTH); }
+      BSS_FORCEINLINE uint32_t Match(khint8_t h2) const
+      {
+        uint32_t m = 0;
+        for(khint_t i = 0; i < WIDTH; ++i)
+          m |= uint32_t(ctrl[i] == h2) << i;
+        return m;
+      }
+      BSS_FORCEINLINE uint32_t MatchFree() const
+      {
+        uint32_t m = 0;
+        for(khint_t i = 0; i < WIDTH; ++i)
+          m |= uint32_t(ctrl[i] >> 7) << i;
+        return m;
+      }
+
+      khint8_t ctrl[WIDTH];
+#endif
+      BSS_FORCEINLINE uint32_t MatchEmpty() const { return Match(EMPTY); }
+      BSS_FORCEINLINE static khint_t Lowest(uint32_t m) { return bssLog2_p2(m & (~m + 1)); }
+    };
+
+    // A table of strings that uses the default hash and equality functions can be searched with a string_view of the same character
+    // type, because KH_AUTO_HASH hashes a string by its characters and length alone.
+    template<class Key, khint_t(*HashFunc)(const Key&), bool(*HashEqual)(const Key&, const Key&), bool IsString>
+    struct HashTransparent { static constexpr bool value = false; static constexpr bool INS = false; typedef char CHAR; };
+    template<class Key, khint_t(*HashFunc)(const Key&), bool(*HashEqual)(const Key&, const Key&)>
+    struct HashTransparent<Key, HashFunc, HashEqual, true>
+    {
+      typedef std::conditional_t<std::is_base_of<std::basic_string<wchar_t>, Key>::value, wchar_t, char> CHAR;
+      template<khint_t(*H)(const Key&), bool(*E)(const Key&, const Key&)>
+      struct Tag {};
+      // Comparing the pointers directly isn't a constant expression on every compiler, but comparing types always is
+      template<bool ins>
+      static constexpr bool Is = std::is_same<Tag<HashFunc, HashEqual>, Tag<&KH_AUTO_HASH<Key, ins>, &KH_AUTO_EQUAL<Key, ins>>>::value;
+      static constexpr bool INS = Is<true>;
+      static constexpr bool value = INS || Is<false>;
+    };
   }
 
-  // Template hash class based on the khash C implementation
+  enum HASH_ENGINE : uint8_t {
+    HASH_KHASH = 0, // khash's quadratic probing over a byte of flags per slot. Every probe compares a key.
+    HASH_SWISS = 1, // Stores 7 bits of each key's hash in a control byte and checks 16 slots at once with SSE2, so probes rarely touch a key that doesn't match.
+    HASH_ROBINHOOD = 2, // Linear probing that keeps keys close to their home slots and shifts the keys after a removed one back instead of leaving a tombstone, so heavy churn never lengthens probes. Inserting or removing a key can move other keys, which invalidates their iterators.
+  };
+
+  // Template hash class based on the khash C implementation. If CacheHash is true, every slot also stores its key's full hash, so
+  // resizing never rehashes a key and most unequal keys are rejected without calling HashEqual.
+  //
+  // If Incremental is true, growing the table doesn't rehash everything at once. The old buckets are kept next to the new ones and
+  // every insert or removal moves MIGRATE_STEP of them across, so no single operation does more than a bounded amount of work.
+  // Lookups check both tables, and one that finds its key in the old table moves that key across before returning, so iterators
+  // always refer to the new table. Because of this, lookups can modify an incremental table, so it can't be read from more than one
+  // thread at once. Iterating over or copying a table finishes any migration in progress.
   template<class Key, 
     class Data = void, 
     ARRAY_TYPE ArrayType = ARRAY_SIMPLE, 
     khint_t(*HashFunc)(const Key&) = &KH_AUTO_HASH<Key, false>,
     bool(*HashEqual)(const Key&, const Key&) = &KH_AUTO_EQUAL<Key, false>,
-    typename Alloc = StandardAllocator<char>>
+    typename Alloc = StandardAllocator<char>,
+    HASH_ENGINE HashEngine = HASH_KHASH,
+    bool CacheHash = false,
+    bool Incremental = false>
   class BSS_COMPILER_DLLEXPORT Hash : protected Alloc
   {
+    typedef internal::HashGroup GROUP;
+    typedef internal::HashTransparent<Key, HashFunc, HashEqual, std::is_base_of<std::string, Key>::value || std::is_base_of<std::basic_string<wchar_t>, Key>::value> TRANSPARENT;
+    static const size_t BATCH = 16; // Number of keys the batch functions hash and prefetch before resolving any of them
+    struct OldTable
+    {
+      khint_t n_buckets;
+      khint_t next; // Every bucket before this one has already been moved
+      khint8_t* flags;
+      Key* keys;
+      Data* vals;
+      khint_t* hashes;
+    };
+
   public:
     static constexpr bool IsMap = !std::is_void<Data>::value;
+    static constexpr bool IsIncremental = Incremental;
+    // True if inserting or removing one key never moves another, so iterators stay valid until the table resizes.
+    static constexpr bool StableIterators = !Incremental && HashEngine != HASH_ROBINHOOD;
+    static constexpr double MAX_LOAD = (HashEngine == HASH_KHASH) ? __ac_HASH_UPPER : 0.875;
+    // Number of old buckets moved by each insert or removal while an incremental table is resizing. When it grows, the new table is
+    // at least as big as the old one, so this finishes well before the new table fills up. If it doesn't, the next resize finishes it.
+    static const khint_t MIGRATE_STEP = 8;
+    static const khint8_t EMPTY_FLAG = (HashEngine == HASH_SWISS) ? internal::HashGroup::EMPTY : (HashEngine == HASH_ROBINHOOD) ? 0 : 2;
+    static const khint_t RH_SATURATED = 255;
     typedef Key KEY;
     typedef Data DATA;
     typedef typename std::conditional<IsMap, Data, char>::type FakeData;
     typedef std::conditional_t<std::is_integral_v<FakeData> || std::is_enum_v<FakeData> || std::is_pointer_v<FakeData> || std::is_member_pointer_v<FakeData>, FakeData, typename internal::_HashGET<FakeData>::GET> GET;
+    typedef std::basic_string_view<typename TRANSPARENT::CHAR> VIEW;
+    // True if K can be looked up directly in a table of strings, such as a const char* or string_view in a Hash<Str>.
+    template<class K>
+    static constexpr bool IsTransparent = TRANSPARENT::value && !std::is_same_v<std::decay_t<K>, Key> && std::is_convertible_v<const K&, VIEW>;
 
-    Hash(const Hash& copy) : Alloc(copy), n_buckets(0), flags(0), keys(0), vals(0), size(0), n_occupied(0), upper_bound(0)
+    Hash(const Hash& copy) : Alloc(copy), n_buckets(0), flags(0), keys(0), vals(0), hashes(0), size(0), n_occupied(0), upper_bound(0), min_load(copy.min_load), old()
     {
       if(copy.n_buckets > 0)
         _docopy(copy);
@@ -175,12 +409,12 @@ namespace bss {
       bssFill(mov, 0);
     }
     template<bool U = std::is_void_v<typename Alloc::policy_type>, std::enable_if_t<!U, int> = 0>
-    Hash(khint_t nbuckets, typename Alloc::policy_type* policy) : Alloc(policy), n_buckets(0), flags(0), keys(0), vals(0), size(0), n_occupied(0), upper_bound(0)
+    Hash(khint_t nbuckets, typename Alloc::policy_type* policy) : Alloc(policy), n_buckets(0), flags(0), keys(0), vals(0), hashes(0), size(0), n_occupied(0), upper_bound(0), min_load(0), old()
     {
       if(nbuckets > 0)
         _resize(nbuckets);
     }
-    explicit Hash(khint_t nbuckets = 0) : n_buckets(0), flags(0), keys(0), vals(0), size(0), n_occupied(0), upper_bound(0)
+    explicit Hash(khint_t nbuckets = 0) : n_buckets(0), flags(0), keys(0), vals(0), hashes(0), size(0), n_occupied(0), upper_bound(0), min_load(0), old()
     {
       if(nbuckets > 0)
         _resize(nbuckets);
@@ -200,17 +434,19 @@ namespace bss {
     template<bool U = IsMap>
     inline typename std::enable_if<U, khiter_t>::type Insert(Key&& key, FakeData&& value) { return _insert<Key&&, Data&&>(std::move(key), std::move(value)); }
     template<bool U = IsMap>
-    inline typename std::enable_if<!U, khiter_t>::type Insert(const Key& key) { int r; return _put<const Key&>(key, &r); }
+    inline typename std::enable_if<!U, khiter_t>::type Insert(const Key& key) { int r; return _put<const Key&>(key, HashFunc(key), &r); }
     template<bool U = IsMap>
-    inline typename std::enable_if<!U, khiter_t>::type Insert(Key&& key) { int r; return _put<Key&&>(std::move(key), &r); }
+    inline typename std::enable_if<!U, khiter_t>::type Insert(Key&& key) { int r; return _put<Key&&>(std::move(key), HashFunc(key), &r); }
 
     void Clear()
     {
+      if constexpr(Incremental)
+        _freeold();
       if(flags)
       {
         for(khint_t i = 0; i < n_buckets; ++i)
         {
-          if(!__ac_iseither(flags, i))
+          if(_exists(i))
           {
             keys[i].~Key();
 
@@ -218,11 +454,13 @@ namespace bss {
               vals[i].~Data();
           }
         }
-        memset(flags, 2, n_buckets);
+        memset(flags, EMPTY_FLAG, _ctrlsize());
         size = n_occupied = 0;
       }
     }
-    inline khiter_t Iterator(const Key& key) const { return _get(key); }
+    inline khiter_t Iterator(const Key& key) const { return _get(key, HashFunc(key)); }
+    template<class K, std::enable_if_t<IsTransparent<K>, int> = 0>
+    inline khiter_t Iterator(const K& key) const { VIEW v(key); return _get(v, _hashof(v)); }
     inline const Key& GetKey(khiter_t i) const { return keys[i]; }
     template<bool U = IsMap>
     inline typename std::enable_if<U, GET>::type GetValue(khiter_t i) const
@@ -245,6 +483,8 @@ namespace bss {
     }
     template<bool U = IsMap>
     inline typename std::enable_if<U, GET>::type Get(const Key& key) const { return GetValue(Iterator(key)); }
+    template<class K, std::enable_if_t<IsTransparent<K> && IsMap, int> = 0>
+    inline GET Get(const K& key) const { return GetValue(Iterator(key)); }
     template<bool U = IsMap>
     inline typename std::enable_if<U, const FakeData&>::type Value(khiter_t i) const { return vals[i]; }
     template<bool U = IsMap>
@@ -264,7 +504,12 @@ namespace bss {
     inline typename std::enable_if<U, bool>::type Set(const Key& key, const FakeData& newvalue) { return _setvalue<const Data&>(Iterator(key), newvalue); }
     template<bool U = IsMap>
     inline typename std::enable_if<U, bool>::type Set(const Key& key, FakeData&& newvalue) { return _setvalue<Data&&>(Iterator(key), std::move(newvalue)); }
-    inline void SetCapacity(khint_t capacity) { if(n_buckets < capacity) _resize(capacity); }
+    inline void SetCapacity(khint_t capacity) { _finish(); if(n_buckets < capacity) _resize(capacity); }
+    // Makes removals shrink the table once fewer than load * Capacity() buckets are in use. The table shrinks until it's about half
+    // of MAX_LOAD full, so it has to lose or gain about half its keys again before it resizes in either direction. load is capped at
+    // MAX_LOAD / 4, and 0, the default, never shrinks. Shrinking invalidates iterators like any other resize.
+    inline void SetMinLoad(float load) { min_load = bssmin(load, (float)(MAX_LOAD / 4)); }
+    inline float GetMinLoad() const { return min_load; }
     inline bool Remove(const Key& key)
     {
       khiter_t iterator = Iterator(key);
@@ -272,14 +517,20 @@ namespace bss {
         return false;
 
       _delete(iterator);
+      _step();
+      _shrink();
       return true;
     }
+    template<class K, std::enable_if_t<IsTransparent<K>, int> = 0>
+    inline bool Remove(const K& key) { return RemoveIter(Iterator(key)); }
     inline bool RemoveIter(khiter_t iterator)
     {
       if(!ExistsIter(iterator))
         return false;
 
       _delete(iterator);
+      _step();
+      _shrink();
       return true;
     }
     BSS_FORCEINLINE khint_t Length() const { return size; }
@@ -288,6 +539,49 @@ namespace bss {
     BSS_FORCEINLINE khiter_t Back() const { return n_buckets; }
     inline bool ExistsIter(khiter_t iterator) const { return (std::make_unsigned_t<khiter_t>(iterator) < std::make_unsigned_t<khiter_t>(n_buckets)) && _exists(iterator); }
     inline bool Exists(const Key& key) const { return ExistsIter(Iterator(key)); }
+    template<class K, std::enable_if_t<IsTransparent<K>, int> = 0>
+    inline bool Exists(const K& key) const { return ExistsIter(Iterator(key)); }
+
+    // The batch functions look up or insert n keys at once. Keys are hashed and their first probe slots prefetched in groups, so the
+    // cache misses of a whole group overlap instead of each lookup stalling on its own. K can be Key or any transparent key type.
+    template<class K = Key, std::enable_if_t<std::is_same_v<K, Key> || IsTransparent<K>, int> = 0>
+    inline void IteratorMany(const K* src, size_t n, khiter_t* out) const
+    {
+      _batch(src, n, false, [&](size_t i, const auto& key, khint_t h) { out[i] = _get(key, h); });
+    }
+    // Stores whether each key exists in out, if it isn't null, and returns how many did.
+    template<class K = Key, std::enable_if_t<std::is_same_v<K, Key> || IsTransparent<K>, int> = 0>
+    inline size_t ExistsMany(const K* src, size_t n, bool* out = 0) const
+    {
+      size_t found = 0;
+      _batch(src, n, false, [&](size_t i, const auto& key, khint_t h) {
+        bool e = ExistsIter(_get(key, h));
+        found += e;
+        if(out) out[i] = e;
+      });
+      return found;
+    }
+    template<class K = Key, std::enable_if_t<(std::is_same_v<K, Key> || IsTransparent<K>) && IsMap, int> = 0>
+    inline void GetMany(const K* src, size_t n, GET* out) const
+    {
+      _batch(src, n, true, [&](size_t i, const auto& key, khint_t h) { out[i] = GetValue(_get(key, h)); });
+    }
+    // Inserts every key, reserving room for all of them first. Keys that already exist have their values overwritten. Stores each
+    // key's iterator in out, if it isn't null, and returns how many keys were new. Incremental tables don't reserve, because that
+    // would rehash everything at once, so if one starts growing partway through, the iterators stored before that are invalid.
+    template<bool U = IsMap>
+    inline typename std::enable_if<U, size_t>::type InsertMany(const Key* src, const FakeData* values, size_t n, khiter_t* out = 0)
+    {
+      return _insertMany(src, n, out, [&](size_t i, khiter_t x, int r) {
+        if(!r) vals[x] = values[i];
+        else new(vals + x) Data(values[i]);
+      });
+    }
+    template<bool U = IsMap>
+    inline typename std::enable_if<!U, size_t>::type InsertMany(const Key* src, size_t n, khiter_t* out = 0)
+    {
+      return _insertMany(src, n, out, [](size_t, khiter_t, int) {});
+    }
     template<bool U = IsMap>
     inline typename std::enable_if<U, GET>::type operator[](const Key& key) const { return Get(key); }
     inline bool operator()(const Key& key) const { return Exists(key); }
@@ -310,9 +604,10 @@ namespace bss {
       {
         _freeall();
         bssFill(*this, 0);
-        return *this;
       }
-      _docopy(copy);
+      else
+        _docopy(copy);
+      min_load = copy.min_load;
       return *this;
     }
 
@@ -366,10 +661,13 @@ namespace bss {
       inline void _next() { while(cur < src->n_buckets && !src->_exists(cur)) ++cur; }
     };
 
-    BSS_FORCEINLINE HashIterator<const FakeData> begin() const { return HashIterator<const FakeData>(Front(), this); }
-    BSS_FORCEINLINE HashIterator<const FakeData> end() const { return HashIterator<const FakeData>(Back(), this); }
-    BSS_FORCEINLINE HashIterator<FakeData> begin() { return HashIterator<FakeData>(Front(), this); }
-    BSS_FORCEINLINE HashIterator<FakeData> end() { return HashIterator<FakeData>(Back(), this); }
+    BSS_FORCEINLINE HashIterator<const FakeData> begin() const { _finish(); return HashIterator<const FakeData>(Front(), this); }
+    BSS_FORCEINLINE HashIterator<const FakeData> end() const { _finish(); return HashIterator<const FakeData>(Back(), this); }
+    BSS_FORCEINLINE HashIterator<FakeData> begin() { _finish(); return HashIterator<FakeData>(Front(), this); }
+    BSS_FORCEINLINE HashIterator<FakeData> end() { _finish(); return HashIterator<FakeData>(Back(), this); }
+    // Moves every remaining bucket out of the old table, if an incremental resize is in progress. This doesn't change the contents.
+    inline void FinishResize() const { _finish(); }
+    BSS_FORCEINLINE bool Resizing() const { if constexpr(Incremental) return old.n_buckets != 0; else return false; }
 
     typedef std::conditional_t<IsMap, void, Key> SerializerArray;
     template<typename Engine>
@@ -397,28 +695,67 @@ namespace bss {
       Serializer<Engine>::template ActionBind<Engine, Key>::Parse(e, key, 0);
       obj.Insert(std::move(key));
     }
-    BSS_FORCEINLINE bool _exists(khiter_t iterator) const { return !__ac_iseither(flags, iterator); }
+    BSS_FORCEINLINE bool _exists(khiter_t iterator) const { return _exists(flags, iterator); }
+    BSS_FORCEINLINE static bool _exists(const khint8_t* f, khint_t i)
+    {
+      if constexpr(HashEngine == HASH_SWISS)
+        return !(f[i] & 0x80);
+      else if constexpr(HashEngine == HASH_ROBINHOOD)
+        return f[i] != 0;
+      else
+        return !__ac_iseither(f, i);
+    }
+    // Swiss tables repeat the first group of control bytes after the end, so a group can be loaded from any slot without wrapping.
+    BSS_FORCEINLINE static khint_t _ctrlsize(khint_t n) { return n + ((HashEngine == HASH_SWISS) ? GROUP::WIDTH : 0); }
+    BSS_FORCEINLINE khint_t _ctrlsize() const { return _ctrlsize(n_buckets); }
     inline void _freeall()
     {
-      if(flags) Alloc::deallocate((char*)flags, n_buckets);
-      if(keys) Alloc::deallocate((char*)keys, n_buckets * sizeof(Key));
+      _freetable(n_buckets, flags, keys, vals, hashes);
+      if constexpr(!IsMap)
+        assert(vals == 0);
+    }
+    inline void _freetable(khint_t n, khint8_t* f, Key* k, Data* v, khint_t* h)
+    {
+      if(f) Alloc::deallocate((char*)f, _ctrlsize(n));
+      if(k) Alloc::deallocate((char*)k, n * sizeof(Key));
+      if(h) Alloc::deallocate((char*)h, n * sizeof(khint_t));
       if constexpr(IsMap)
       {
-        if(vals) Alloc::deallocate((char*)vals, n_buckets * sizeof(Data));
+        if(v) Alloc::deallocate((char*)v, n * sizeof(Data));
       }
-      else
-        assert(vals == 0);
+    }
+    // Allocates the arrays for a table with n buckets and marks every bucket as empty.
+    inline bool _alloctable(khint_t n, khint8_t*& f, Key*& k, Data*& v, khint_t*& h)
+    {
+      f = (khint8_t*)Alloc::allocate(_ctrlsize(n));
+      k = (Key*)Alloc::allocate(n * sizeof(Key));
+      v = 0;
+      h = 0;
+      if constexpr(IsMap)
+        v = (Data*)Alloc::allocate(n * sizeof(Data));
+      if constexpr(CacheHash)
+        h = (khint_t*)Alloc::allocate(n * sizeof(khint_t));
+      if(!f || !k || (IsMap && !v) || (CacheHash && !h))
+      {
+        _freetable(n, f, k, v, h);
+        return false;
+      }
+      memset(f, EMPTY_FLAG, _ctrlsize(n));
+      return true;
     }
     inline void _docopy(const Hash& copy)
     {
       if constexpr(ArrayType != ARRAY_MOVE)
       {
+        copy._finish();
         _resize(copy.n_buckets);
         assert(n_buckets == copy.n_buckets);
-        memcpy(flags, copy.flags, n_buckets);
+        memcpy(flags, copy.flags, _ctrlsize());
+        if constexpr(CacheHash)
+          memcpy(hashes, copy.hashes, n_buckets * sizeof(khint_t));
         for(khint_t i = 0; i < n_buckets; ++i)
         {
-          if(!__ac_iseither(copy.flags, i))
+          if(copy._exists(i))
           {
             new(keys + i) Key((const Key&)copy.keys[i]);
 
@@ -439,7 +776,7 @@ namespace bss {
     inline khiter_t _insert(U && key, V && value)
     {
       int r;
-      khiter_t i = _put<const Key&>(std::forward<U>(key), &r);
+      khiter_t i = _put<const Key&>(std::forward<U>(key), HashFunc(key), &r);
       if(!r) // If r is 0, this key was already present, so we need to assign, not initialize
         vals[i] = std::forward<V>(value);
       else
@@ -455,6 +792,10 @@ namespace bss {
       {
         kroundup32(new_n_buckets);
         if(new_n_buckets < 4) new_n_buckets = 32;
+        if constexpr(HashEngine != HASH_KHASH)
+          return _rehash(new_n_buckets);
+        if(new_n_buckets < n_buckets) // Kicking keys out in place only works when the arrays don't get smaller
+          return _rehash(new_n_buckets);
         if(size >= (khint_t)(new_n_buckets * __ac_HASH_UPPER + 0.5)) j = 0;	/* requested size is too small */
         else
         { /* hash table size to be changed (shrink or expand); rehash */
@@ -472,7 +813,13 @@ namespace bss {
               if(!new_vals) { Alloc::deallocate((char*)new_flags, new_n_buckets); return -1; }
               vals = new_vals;
             }
-          } /* otherwise shrink */
+            if constexpr(CacheHash)
+            {
+              khint_t *new_hashes = _realloc<khint_t>(hashes, new_n_buckets);
+              if(!new_hashes) { Alloc::deallocate((char*)new_flags, new_n_buckets); return -1; }
+              hashes = new_hashes;
+            }
+          }
         }
       }
       if(j)
@@ -483,14 +830,15 @@ namespace bss {
           {
             Key key(std::move(keys[j]));
             [[maybe_unused]] FakeData val;
-            khint_t new_mask;
+            khint_t new_mask, k = 0;
             new_mask = new_n_buckets - 1;
             if constexpr(IsMap)val = std::move(vals[j]);
+            if constexpr(CacheHash) k = hashes[j];
             __ac_set_isdel_true(flags, j);
             while(1)
             { /* kick-out process; sort of like in Cuckoo hashing */
-              khint_t k, i, step = 0;
-              k = HashFunc(key);
+              khint_t i, step = 0;
+              if constexpr(!CacheHash) k = HashFunc(key);
               i = k & new_mask;
               while(!__ac_isempty(new_flags, i)) i = (i + (++step)) & new_mask;
               __ac_set_isempty_false(new_flags, i);
@@ -498,23 +846,19 @@ namespace bss {
               { /* kick out the existing element */
                 std::swap(keys[i], key);
                 if constexpr(IsMap)std::swap(vals[i], val);
+                if constexpr(CacheHash) std::swap(hashes[i], k);
                 __ac_set_isdel_true(flags, i); /* mark it as deleted in the old hash table */
               }
               else // this code only runs if this bucket doesn't exist, so initialize
               {
                 new(keys + i) Key(std::move(key));
                 if constexpr(IsMap) new(vals + i) Data(std::move(val));
+                if constexpr(CacheHash) hashes[i] = k;
                 break;
               }
             }
           }
         }
-        if(n_buckets > new_n_buckets)
-        { /* shrink the hash table */
-          keys = _realloc<Key>(keys, new_n_buckets);
-          if constexpr(IsMap)
-            vals = _realloc<Data>(vals, new_n_buckets);
-        }
         if(flags)
           Alloc::deallocate((char*)flags, n_buckets); /* free the working space */
         flags = new_flags;
@@ -526,10 +870,30 @@ namespace bss {
     }
 
     template<typename U>
-    khint_t _put(U && key, int* ret)
+    khint_t _put(U && key, khint_t k, int* ret)
     {
       khint_t x;
-      if(n_occupied >= upper_bound)
+      if constexpr(Incremental)
+      {
+        if(n_occupied >= upper_bound && _grow((n_buckets > (size << 1)) ? n_buckets : (n_buckets << 1)) < 0)
+        {
+          *ret = -1; return n_buckets;
+        }
+        if(old.n_buckets)
+        {
+          _step();
+          if(old.n_buckets)
+          {
+            khint_t j = _probe(old.flags, old.keys, old.hashes, old.n_buckets, key, k);
+            if(j != old.n_buckets)
+            {
+              *ret = 0;
+              return _move(j);
+            }
+          }
+        }
+      }
+      else if(n_occupied >= upper_bound)
       { /* update the hash table */
         if(n_buckets > (size << 1))
         {
@@ -543,15 +907,19 @@ namespace bss {
         { /* expand the hash table */
           *ret = -1; return n_buckets;
         }
-      } /* TODO: to implement automatically shrinking; resize() already support shrinking */
+      } /* shrinking happens after removals, in _shrink() */
+      if constexpr(HashEngine == HASH_SWISS)
+        return _putSwiss(std::forward<U>(key), k, ret);
+      if constexpr(HashEngine == HASH_ROBINHOOD)
+        return _putRH(std::forward<U>(key), k, ret);
       {
-        khint_t k, i, site, last, mask = n_buckets - 1, step = 0;
-        x = site = n_buckets; k = HashFunc(key); i = k & mask;
+        khint_t i, site, last, mask = n_buckets - 1, step = 0;
+        x = site = n_buckets; i = k & mask;
         if(__ac_isempty(flags, i)) x = i; /* for speed up */
         else
         {
           last = i;
-          while(!__ac_isempty(flags, i) && (__ac_isdel(flags, i) || !HashEqual(keys[i], key)))
+          while(!__ac_isempty(flags, i) && (__ac_isdel(flags, i) || !_equal(keys, hashes, i, k, key)))
           {
             if(__ac_isdel(flags, i)) site = i;
             i = (i + (++step)) & mask;
@@ -567,6 +935,7 @@ namespace bss {
       if(__ac_isempty(flags, x))
       { /* not present at all */
         new(keys + x) Key(std::move(key));
+        if constexpr(CacheHash) hashes[x] = k;
         __ac_set_isboth_false(flags, x);
         ++size; ++n_occupied;
         *ret = 1;
@@ -574,6 +943,7 @@ namespace bss {
       else if(__ac_isdel(flags, x))
       { /* deleted */
         new(keys + x) Key(std::move(key));
+        if constexpr(CacheHash) hashes[x] = k;
         __ac_set_isboth_false(flags, x);
         ++size;
         *ret = 2;
@@ -581,33 +951,478 @@ namespace bss {
       else *ret = 0; /* Don't touch keys[x] if present and not deleted */
       return x;
     }
-    khint_t _get(const Key& key) const
+    // K is either Key or VIEW, and k is its hash.
+    template<class K>
+    inline khint_t _get(const K& key, khint_t k) const
     {
-      if(n_buckets)
+      khint_t i = _probe(flags, keys, hashes, n_buckets, key, k);
+      if constexpr(Incremental)
       {
-        khint_t k, i, last, mask, step = 0;
-        mask = n_buckets - 1;
-        k = HashFunc(key); i = k & mask;
-        last = i;
-        while(!__ac_isempty(flags, i) && (__ac_isdel(flags, i) || !HashEqual(keys[i], key)))
+        if(i == n_buckets && old.n_buckets)
         {
-          i = (i + (++step)) & mask;
-          if(i == last) return n_buckets;
+          khint_t j = _probe(old.flags, old.keys, old.hashes, old.n_buckets, key, k);
+          if(j != old.n_buckets) // Moving a key doesn't change the table's contents, so this is still logically const
+            return const_cast<Hash*>(this)->_move(j);
         }
-        return __ac_iseither(flags, i) ? n_buckets : i;
       }
-      else return 0;
+      return i;
+    }
+    // Finds key in the table made of the given arrays, returning n if it isn't there.
+    template<class K>
+    static khint_t _probe(const khint8_t* f, const Key* ks, const khint_t* hs, khint_t n, const K& key, khint_t k)
+    {
+      if(!n)
+        return 0;
+      if constexpr(HashEngine == HASH_SWISS)
+        return _find(f, ks, hs, n, key, k);
+      if constexpr(HashEngine == HASH_ROBINHOOD)
+        return _rhfind(f, ks, hs, n, key, k);
+      khint_t i, last, mask, step = 0;
+      mask = n - 1;
+      i = k & mask;
+      last = i;
+      while(!__ac_isempty(f, i) && (__ac_isdel(f, i) || !_equal(ks, hs, i, k, key)))
+      {
+        i = (i + (++step)) & mask;
+        if(i == last) return n;
+      }
+      return __ac_iseither(f, i) ? n : i;
     }
     inline void _delete(khint_t x)
     {
-      if(x != n_buckets && !__ac_iseither(flags, x))
+      if(x != n_buckets && _exists(x))
       {
         keys[x].~Key();
         if constexpr(IsMap)
           vals[x].~Data();
-        __ac_set_isdel_true(flags, x);
         --size;
+        if constexpr(HashEngine == HASH_SWISS)
+        {
+          // A probe only moves past a group with no empty slots, so if every run of full slots through x is shorter than a group,
+          // no probe could have skipped over x and it can go straight back to being empty instead of leaving a tombstone.
+          khint_t mask = n_buckets - 1;
+          uint32_t before = GROUP(flags + ((x - GROUP::WIDTH) & mask)).MatchEmpty();
+          uint32_t after = GROUP(flags + x).MatchEmpty();
+          if(before && after && (GROUP::WIDTH - 1 - bssLog2(before)) + GROUP::Lowest(after) < GROUP::WIDTH)
+          {
+            _setctrl(flags, n_buckets, x, GROUP::EMPTY);
+            --n_occupied;
+          }
+          else
+            _setctrl(flags, n_buckets, x, GROUP::DELETED);
+        }
+        else if constexpr(HashEngine == HASH_ROBINHOOD)
+        {
+          _rhshiftback(flags, keys, vals, hashes, n_buckets, x);
+          --n_occupied;
+        }
+        else
+          __ac_set_isdel_true(flags, x);
+      }
+    }
+    inline void _shrink()
+    {
+      if(min_load > 0 && n_buckets > 32 && size < (khint_t)(n_buckets * min_load) && !Resizing())
+      {
+        khint_t n = (khint_t)(size / (MAX_LOAD / 2)) + 1;
+        if constexpr(Incremental)
+          _grow(n);
+        else
+          _resize(n);
+      }
+    }
+    template<class K>
+    BSS_FORCEINLINE static bool _equal(const Key* ks, const khint_t* hs, khint_t i, khint_t h, const K& key)
+    {
+      if constexpr(CacheHash)
+        if(hs[i] != h)
+          return false;
+      if constexpr(std::is_same_v<K, Key>)
+        return HashEqual(ks[i], key);
+      else if(ks[i].size() != key.size())
+        return false;
+      else if constexpr(!TRANSPARENT::INS)
+        return !memcmp(ks[i].data(), key.data(), key.size() * sizeof(typename TRANSPARENT::CHAR));
+      else if constexpr(std::is_same_v<typename TRANSPARENT::CHAR, char>)
+        return !STRNICMP(ks[i].data(), key.data(), key.size());
+      else
+        return !WCSNICMP(ks[i].data(), key.data(), key.size());
+    }
+    BSS_FORCEINLINE static khint_t _hashof(VIEW v) { return KH_STR_HASH<typename TRANSPARENT::CHAR, TRANSPARENT::INS>(v.data(), v.size()); }
+    template<class K>
+    BSS_FORCEINLINE static std::conditional_t<std::is_same_v<K, Key>, const Key&, VIEW> _lookup(const K& key) { return key; }
+    BSS_FORCEINLINE void _prefetch(khint_t h, bool values) const
+    {
+      khint_t i = h & (n_buckets - 1);
+      BSS_PREFETCH(flags + i);
+      BSS_PREFETCH(keys + i);
+      if constexpr(CacheHash)
+        BSS_PREFETCH(hashes + i);
+      if constexpr(IsMap)
+        if(values)
+          BSS_PREFETCH(vals + i);
+    }
+    // Hashes up to BATCH keys and prefetches their home slots before calling f(index, key, hash) on each one. A key's first probe is
+    // usually its last, so by the time f runs most of what it reads is already on its way into the cache.
+    template<class K, class F>
+    inline void _batch(const K* src, size_t n, bool values, F && f) const
+    {
+      khint_t h[BATCH];
+      for(size_t b = 0; b < n; b += BATCH)
+      {
+        size_t m = bssmin(n - b, BATCH);
+        for(size_t j = 0; j < m; ++j)
+        {
+          if constexpr(std::is_same_v<K, Key>)
+            h[j] = HashFunc(src[b + j]);
+          else
+            h[j] = _hashof(VIEW(src[b + j]));
+          if(n_buckets)
+            _prefetch(h[j], values);
+        }
+        for(size_t j = 0; j < m; ++j)
+          f(b + j, _lookup(src[b + j]), h[j]);
+      }
+    }
+    template<class F>
+    inline size_t _insertMany(const Key* src, size_t n, khiter_t* out, F && f)
+    {
+      if(!Incremental && size + n >= upper_bound && _resize((khint_t)((size + n) / MAX_LOAD) + 1) < 0)
+        return 0; // An incremental table grows as it goes instead, so reserving doesn't cause a stall
+      size_t added = 0;
+      _batch(src, n, IsMap, [&](size_t i, const Key& key, khint_t h) {
+        int r;
+        khiter_t x = _put<const Key&>(key, h, &r);
+        if(r >= 0)
+        {
+          f(i, x, r);
+          added += (r != 0);
+        }
+        if(out) out[i] = x;
+      });
+      return added;
+    }
+    BSS_FORCEINLINE static khint8_t _h2(khint_t h) { return (khint8_t)((h * 0x9E3779B1u) >> 25); } // Mixes in every bit, unlike the position
+    BSS_FORCEINLINE static void _setctrl(khint8_t* ctrl, khint_t n, khint_t i, khint8_t v)
+    {
+      ctrl[i] = v;
+      if(i < GROUP::WIDTH)
+        ctrl[n + i] = v;
+    }
+    // Swiss probing visits groups at triangular offsets from the home slot, which covers the whole table because it's a power of two.
+    template<class K>
+    static khint_t _find(const khint8_t* f, const Key* ks, const khint_t* hs, khint_t n, const K& key, khint_t h)
+    {
+      khint_t mask = n - 1, pos = h & mask;
+      khint8_t h2 = _h2(h);
+      for(khint_t step = 0;; pos = (pos + GROUP::WIDTH * ++step) & mask)
+      {
+        GROUP g(f + pos);
+        for(uint32_t m = g.Match(h2); m; m &= m - 1)
+        {
+          khint_t i = (pos + GROUP::Lowest(m)) & mask;
+          if(_equal(ks, hs, i, h, key))
+            return i;
+        }
+        if(g.MatchEmpty() || step > mask / GROUP::WIDTH)
+          return n;
+      }
+    }
+    // Finds the first empty or deleted slot along h's probe sequence.
+    BSS_FORCEINLINE static khint_t _findFree(const khint8_t* ctrl, khint_t mask, khint_t h)
+    {
+      khint_t pos = h & mask;
+      for(khint_t step = 0;; pos = (pos + GROUP::WIDTH * ++step) & mask)
+        if(uint32_t m = GROUP(ctrl + pos).MatchFree())
+          return (pos + GROUP::Lowest(m)) & mask;
+    }
+    template<typename U>
+    inline khint_t _putSwiss(U && key, khint_t h, int* ret)
+    {
+      khint_t x = _find(flags, keys, hashes, n_buckets, key, h);
+      if(x != n_buckets)
+      {
+        *ret = 0;
+        return x;
+      }
+      x = _findFree(flags, n_buckets - 1, h);
+      if(flags[x] == GROUP::EMPTY)
+      {
+        ++n_occupied;
+        *ret = 1;
+      }
+      else
+        *ret = 2;
+      _setctrl(flags, n_buckets, x, _h2(h));
+      new(keys + x) Key(std::move(key));
+      if constexpr(CacheHash)
+        hashes[x] = h;
+      ++size;
+      return x;
+    }
+    // Robin Hood tables store each key's distance from its home slot, plus one, in its flag, so 0 means empty. Any distance of
+    // RH_SATURATED - 1 or more is stored as RH_SATURATED and worked out from the key's hash, which only very long probes ever need.
+    BSS_FORCEINLINE static khint_t _rhdist(const khint8_t* f, const Key* ks, const khint_t* hs, khint_t mask, khint_t i)
+    {
+      if(f[i] != RH_SATURATED)
+        return f[i] - 1;
+      return (i - (CacheHash ? hs[i] : HashFunc(ks[i]))) & mask;
+    }
+    BSS_FORCEINLINE static khint8_t _rhflag(khint_t d) { return (khint8_t)((d < RH_SATURATED - 1) ? d + 1 : RH_SATURATED); }
+    // A key is always exactly as far from its home slot as the probe that finds it, and keys are ordered so that the probe can stop
+    // as soon as it reaches a key closer to home than it is.
+    template<class K>
+    static khint_t _rhfind(const khint8_t* f, const Key* ks, const khint_t* hs, khint_t n, const K& key, khint_t h)
+    {
+      khint_t mask = n - 1;
+      for(khint_t i = h & mask, d = 0;; i = (i + 1) & mask, ++d)
+      {
+        if(!f[i])
+          return n;
+        if(f[i] != RH_SATURATED || d >= RH_SATURATED - 1) // Otherwise this key is further from home than we are, so keep going
+        {
+          khint_t e = _rhdist(f, ks, hs, mask, i);
+          if(e < d)
+            return n;
+          if(e == d && _equal(ks, hs, i, h, key))
+            return i;
+        }
+      }
+    }
+    BSS_FORCEINLINE static void _rhshift(Key* ks, Data* vs, khint_t* hs, khint_t dst, khint_t src)
+    {
+      new(ks + dst) Key(std::move(ks[src]));
+      ks[src].~Key();
+      if constexpr(IsMap)
+      {
+        new(vs + dst) Data(std::move(vs[src]));
+        vs[src].~Data();
+      }
+      if constexpr(CacheHash)
+        hs[dst] = hs[src];
+    }
+    // Finds where a key with hash h belongs, which is the first slot holding a key closer to its home than h would be, and moves that
+    // key and everything after it up to the next empty slot forward by one. Returns the slot, which is left uninitialized.
+    static khint_t _rhplace(khint8_t* f, Key* ks, Data* vs, khint_t* hs, khint_t n, khint_t h)
+    {
+      khint_t mask = n - 1, i = h & mask, d = 0;
+      for(; f[i] && _rhdist(f, ks, hs, mask, i) >= d; i = (i + 1) & mask)
+        ++d;
+      if(f[i])
+      {
+        khint_t e = i;
+        while(f[e])
+          e = (e + 1) & mask;
+        for(khint_t j = e; j != i;)
+        {
+          khint_t p = (j - 1) & mask;
+          f[j] = _rhflag(_rhdist(f, ks, hs, mask, p) + 1);
+          _rhshift(ks, vs, hs, j, p);
+          j = p;
+        }
+      }
+      f[i] = _rhflag(d);
+      return i;
+    }
+    // Fills the hole left at x, whose key has already been destroyed, by moving every following key that isn't in its home slot
+    // back by one.
+    static void _rhshiftback(khint8_t* f, Key* ks, Data* vs, khint_t* hs, khint_t n, khint_t x)
+    {
+      khint_t mask = n - 1;
+      for(khint_t j = (x + 1) & mask; f[j] > 1; x = j, j = (j + 1) & mask)
+      {
+        f[x] = _rhflag(_rhdist(f, ks, hs, mask, j) - 1);
+        _rhshift(ks, vs, hs, x, j);
+      }
+      f[x] = 0;
+    }
+    template<typename U>
+    inline khint_t _putRH(U && key, khint_t h, int* ret)
+    {
+      khint_t x = _rhfind(flags, keys, hashes, n_buckets, key, h);
+      if(x != n_buckets)
+      {
+        *ret = 0;
+        return x;
+      }
+      x = _rhplace(flags, keys, vals, hashes, n_buckets, h);
+      new(keys + x) Key(std::move(key));
+      if constexpr(CacheHash)
+        hashes[x] = h;
+      ++size;
+      ++n_occupied;
+      *ret = 1;
+      return x;
+    }
+    // Swiss and Robin Hood tables rebuild into new arrays instead of kicking keys out in place, because where a key goes depends on
+    // the keys around it. khash tables also rebuild when they shrink, because the keys being kicked out would land past the end of
+    // the smaller arrays.
+    char _rehash(khint_t new_n_buckets)
+    {
+      if(new_n_buckets < GROUP::WIDTH) new_n_buckets = GROUP::WIDTH;
+      if(size >= (khint_t)(new_n_buckets * MAX_LOAD + 0.5))
+        return 0; /* requested size is too small */
+      khint8_t* new_flags;
+      Key* new_keys;
+      Data* new_vals;
+      khint_t* new_hashes;
+      if(!_alloctable(new_n_buckets, new_flags, new_keys, new_vals, new_hashes))
+        return -1;
+
+      for(khint_t j = 0; j < n_buckets; ++j)
+      {
+        if(_exists(j))
+        {
+          khint_t h = CacheHash ? hashes[j] : HashFunc(keys[j]);
+          khint_t i;
+          if constexpr(HashEngine == HASH_ROBINHOOD)
+            i = _rhplace(new_flags, new_keys, new_vals, new_hashes, new_n_buckets, h);
+          else if constexpr(HashEngine == HASH_KHASH)
+          {
+            khint_t step = 0;
+            for(i = h & (new_n_buckets - 1); !__ac_isempty(new_flags, i); i = (i + (++step)) & (new_n_buckets - 1));
+            __ac_set_isempty_false(new_flags, i);
+          }
+          else
+          {
+            i = _findFree(new_flags, new_n_buckets - 1, h);
+            _setctrl(new_flags, new_n_buckets, i, _h2(h));
+          }
+          if constexpr(CacheHash)
+            new_hashes[i] = h;
+          new(new_keys + i) Key(std::move(keys[j]));
+          keys[j].~Key();
+          if constexpr(IsMap)
+          {
+            new(new_vals + i) Data(std::move(vals[j]));
+            vals[j].~Data();
+          }
+        }
+      }
+      _freeall();
+      flags = new_flags;
+      keys = new_keys;
+      vals = new_vals;
+      hashes = new_hashes;
+      n_buckets = new_n_buckets;
+      n_occupied = size;
+      upper_bound = (khint_t)(n_buckets * MAX_LOAD + 0.5);
+      return 0;
+    }
+    // Starts an incremental resize by swapping in a new, empty table with new_n_buckets buckets and keeping the current one as the
+    // old table, which _migrate then drains.
+    char _grow(khint_t new_n_buckets)
+    {
+      _finish();
+      kroundup32(new_n_buckets);
+      if(new_n_buckets < 32) new_n_buckets = 32;
+      OldTable t = { n_buckets, 0, flags, keys, vals, hashes };
+      if(!_alloctable(new_n_buckets, flags, keys, vals, hashes))
+      {
+        flags = t.flags;
+        keys = t.keys;
+        vals = t.vals;
+        hashes = t.hashes;
+        return -1;
       }
+      n_buckets = new_n_buckets;
+      n_occupied = 0;
+      upper_bound = (khint_t)(n_buckets * MAX_LOAD + 0.5);
+      if(t.n_buckets)
+        old = t;
+      return 0;
+    }
+    // Does one operation's share of an incremental resize. A table that's shrinking moves proportionally more buckets, so it finishes
+    // in as few operations as a table that's growing.
+    BSS_FORCEINLINE void _step()
+    {
+      if constexpr(Incremental)
+        if(old.n_buckets)
+          _migrate(MIGRATE_STEP * bssmax(old.n_buckets / n_buckets, 1));
+    }
+    // Moves up to count buckets from the old table into the new one, and frees the old table once it's empty.
+    inline void _migrate(khint_t count)
+    {
+      if constexpr(Incremental)
+      {
+        if(!old.n_buckets)
+          return;
+        khint_t end = (old.n_buckets - old.next > count) ? old.next + count : old.n_buckets;
+        for(; old.next < end; ++old.next)
+          while(_exists(old.flags, old.next)) // Robin Hood tables shift the next key back into the slot we just emptied
+            _move(old.next);
+        if(old.next == old.n_buckets)
+          _freeold();
+      }
+    }
+    inline void _finish() const
+    {
+      if constexpr(Incremental) // Like _get, this only moves keys around, so the table is logically unchanged
+        if(old.n_buckets)
+          const_cast<Hash*>(this)->_migrate(old.n_buckets);
+    }
+    // Destroys whatever is left in the old table and frees it. Only Clear() calls this while the old table still has keys in it.
+    inline void _freeold()
+    {
+      if constexpr(Incremental)
+      {
+        for(khint_t i = old.next; i < old.n_buckets; ++i)
+        {
+          if(_exists(old.flags, i))
+          {
+            old.keys[i].~Key();
+            if constexpr(IsMap)
+              old.vals[i].~Data();
+          }
+        }
+        _freetable(old.n_buckets, old.flags, old.keys, old.vals, old.hashes);
+        old = OldTable();
+      }
+    }
+    // Moves bucket j of the old table into a free slot of the new one, which can't already hold its key, and returns the new slot.
+    inline khint_t _move(khint_t j)
+    {
+      if constexpr(Incremental)
+      {
+        khint_t h = CacheHash ? old.hashes[j] : HashFunc(old.keys[j]);
+        khint_t mask = n_buckets - 1, x;
+        if constexpr(HashEngine == HASH_SWISS)
+        {
+          x = _findFree(flags, mask, h);
+          if(flags[x] == GROUP::EMPTY)
+            ++n_occupied;
+          _setctrl(flags, n_buckets, x, _h2(h));
+          _setctrl(old.flags, old.n_buckets, j, GROUP::DELETED); // Other keys in the old table may have probed past this one
+        }
+        else if constexpr(HashEngine == HASH_ROBINHOOD)
+        {
+          x = _rhplace(flags, keys, vals, hashes, n_buckets, h);
+          ++n_occupied;
+        }
+        else
+        {
+          khint_t step = 0;
+          for(x = h & mask; !__ac_iseither(flags, x); x = (x + (++step)) & mask);
+          if(__ac_isempty(flags, x))
+            ++n_occupied;
+          __ac_set_isboth_false(flags, x);
+          __ac_set_isdel_true(old.flags, j);
+        }
+        new(keys + x) Key(std::move(old.keys[j]));
+        old.keys[j].~Key();
+        if constexpr(IsMap)
+        {
+          new(vals + x) Data(std::move(old.vals[j]));
+          old.vals[j].~Data();
+        }
+        if constexpr(CacheHash)
+          hashes[x] = h;
+        if constexpr(HashEngine == HASH_ROBINHOOD)
+          _rhshiftback(old.flags, old.keys, old.vals, old.hashes, old.n_buckets, j);
+        return x;
+      }
+      else
+        return j;
     }
     template<typename T>
     inline T* _realloc(T* src, khint_t new_n_buckets) noexcept
@@ -634,17 +1449,20 @@ namespace bss {
     }
 
     khint_t n_buckets, size, n_occupied, upper_bound;
+    float min_load; // Removals shrink the table below this load, unless it's 0
     khint8_t* flags;
     Key* keys;
     Data* vals;
+    khint_t* hashes; // Only allocated if CacheHash is true
+    std::conditional_t<Incremental, OldTable, char> old; // The table being drained by an incremental resize
   };
 
   // Case-insensitive hash definition
-  template<typename K, typename T, ARRAY_TYPE ArrayType = ARRAY_SIMPLE, typename Alloc = StandardAllocator<char>>
-  class BSS_COMPILER_DLLEXPORT HashIns : public Hash<K, T, ArrayType, &KH_AUTO_HASH<K, true>, &KH_AUTO_EQUAL<K, true>, Alloc>
+  template<typename K, typename T, ARRAY_TYPE ArrayType = ARRAY_SIMPLE, typename Alloc = StandardAllocator<char>, HASH_ENGINE HashEngine = HASH_KHASH, bool CacheHash = false, bool Incremental = false>
+  class BSS_COMPILER_DLLEXPORT HashIns : public Hash<K, T, ArrayType, &KH_AUTO_HASH<K, true>, &KH_AUTO_EQUAL<K, true>, Alloc, HashEngine, CacheHash, Incremental>
   {
   public:
-    typedef Hash<K, T, ArrayType, &KH_AUTO_HASH<K, true>, &KH_AUTO_EQUAL<K, true>, Alloc> BASE;
+    typedef Hash<K, T, ArrayType, &KH_AUTO_HASH<K, true>, &KH_AUTO_EQUAL<K, true>, Alloc, HashEngine, CacheHash, Incremental> BASE;
 
     inline HashIns(const HashIns& copy) = default;
     inline HashIns(HashIns&& mov) = default;
@@ -0,0 +1,152 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __LOCK_STATS_H__BSS__
+#define __LOCK_STATS_H__BSS__
+
+#include "compiler.h"
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+#if defined(BSS_COMPILER_GCC) || defined(BSS_COMPILER_CLANG) || (defined(BSS_COMPILER_MSC) && _MSC_VER >= 1926)
+#define BSS_CALLSITE_FILE __builtin_FILE()
+#define BSS_CALLSITE_LINE __builtin_LINE()
+#else
+#define BSS_CALLSITE_FILE "?"
+#define BSS_CALLSITE_LINE 0
+#endif
+
+namespace bss {
+  // Contention counters for one or more lock instances. Tracking is opt-in: RWLock, MicroLockQueue, RingAllocVoid and LocklessBlockPolicy
+  // only record anything after SetLockStats() points them at a LockStats, which must outlive the lock. Every LockStats registers itself in
+  // a global list, so the whole process can be queried at runtime with Query() or printed with WriteToStream(), which Profiler::WriteToStream
+  // calls for OUTPUT_LOCKS. Counters use relaxed atomics and the holder is a best-effort snapshot, so they are approximate while threads are running.
+  class BSS_DLLEXPORT LockStats
+  {
+    LockStats(const LockStats&) = delete;
+    LockStats& operator=(const LockStats&) = delete;
+
+  public:
+    static const int MAX_BLOCKERS = 4; // Number of distinct holder callsites tracked per lock. Anything past this is lumped together.
+
+    struct Site
+    {
+      const char* file;
+      uint32_t line;
+      uint64_t waits; // Number of waiters that found this callsite holding the lock
+      uint64_t waitns; // Total time those waiters spent spinning
+    };
+    struct Report
+    {
+      const char* name;
+      const void* lock; // Address of the LockStats, which tells apart locks with the same name
+      uint64_t attempts; // Includes failed try-locks
+      uint64_t failed;
+      uint64_t contended; // Acquires that had to spin at least once
+      uint64_t spins;
+      uint64_t waitns;
+      Site holder; // Callsite that most recently acquired the lock
+      Site blockers[MAX_BLOCKERS]; // Holder callsites that waiters were blocked on, sorted by waitns
+      uint64_t otherns; // Wait time that didn't fit in blockers
+    };
+
+    // Tracks a single acquisition attempt on a lock that may or may not have stats attached. Spin() must be called once per failed
+    // iteration of the spin loop, and Acquire() once the lock is held. Both do nothing but count when stats is null.
+    struct Wait
+    {
+      BSS_FORCEINLINE explicit Wait(LockStats* stats) : spins(0), start(0), file(0), line(0), _stats(stats) {}
+      BSS_FORCEINLINE void Spin()
+      {
+        if(!spins++ && _stats)
+        {
+          start = Now();
+          file = _stats->_holderfile.load(std::memory_order_relaxed);
+          line = _stats->_holderline.load(std::memory_order_relaxed);
+        }
+      }
+      BSS_FORCEINLINE void Acquire(const char* f, uint32_t l)
+      {
+        if(_stats)
+          _stats->_acquire(*this, f, l);
+      }
+
+      uint64_t spins;
+      uint64_t start;
+      const char* file;
+      uint32_t line;
+
+    private:
+      LockStats* _stats;
+    };
+
+    explicit LockStats(const char* name);
+    ~LockStats();
+    // Records a failed try-lock on stats, if it isn't null
+    static BSS_FORCEINLINE void Fail(LockStats* stats)
+    {
+      if(stats)
+      {
+        stats->_attempts.fetch_add(1, std::memory_order_relaxed);
+        stats->_failed.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    inline void SetName(const char* name) { _name = name; }
+    inline const char* GetName() const { return _name; }
+    inline uint64_t Attempts() const { return _attempts.load(std::memory_order_relaxed); }
+    inline uint64_t Failed() const { return _failed.load(std::memory_order_relaxed); }
+    inline uint64_t Contended() const { return _contended.load(std::memory_order_relaxed); }
+    inline uint64_t Spins() const { return _spins.load(std::memory_order_relaxed); }
+    inline uint64_t WaitNS() const { return _waitns.load(std::memory_order_relaxed); }
+    // Fills out a snapshot of this lock's counters
+    void Get(Report& report) const;
+    // Zeroes all counters on this lock
+    void Clear();
+
+    // Copies out reports for up to len registered locks, sorted by total wait time, and returns the total number of registered locks.
+    static size_t Query(Report* reports, size_t len);
+    // Zeroes the counters of every registered lock
+    static void ClearAll();
+    // Writes every lock that has been acquired at least once, sorted by total wait time. Writes nothing if no locks are registered.
+    static void WriteToStream(std::ostream& stream);
+    static BSS_FORCEINLINE uint64_t Now() { return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+  protected:
+    struct Blocker
+    {
+      std::atomic<uint64_t> key; // Hash of the callsite, which is claimed with a CAS before file and line are written
+      std::atomic<const char*> file;
+      std::atomic<uint32_t> line;
+      std::atomic<uint64_t> waits;
+      std::atomic<uint64_t> waitns;
+    };
+
+    BSS_FORCEINLINE void _acquire(const Wait& w, const char* file, uint32_t line)
+    {
+      _attempts.fetch_add(1, std::memory_order_relaxed);
+      if(w.spins)
+        _contend(w);
+      _holderfile.store(file, std::memory_order_relaxed);
+      _holderline.store(line, std::memory_order_relaxed);
+    }
+    void _contend(const Wait& w);
+
+    const char* _name;
+    LockStats* _prev;
+    LockStats* _next;
+#pragma warning(push)
+#pragma warning(disable:4251)
+    std::atomic<uint64_t> _attempts;
+    std::atomic<uint64_t> _failed;
+    std::atomic<uint64_t> _contended;
+    std::atomic<uint64_t> _spins;
+    std::atomic<uint64_t> _waitns;
+    std::atomic<uint64_t> _otherns;
+    std::atomic<const char*> _holderfile;
+    std::atomic<uint32_t> _holderline;
+    Blocker _blockers[MAX_BLOCKERS];
+#pragma warning(pop)
+  };
+}
+
+#endif
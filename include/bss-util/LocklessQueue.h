@@ -13,7 +13,7 @@ namespace bss {
       inline LQ_QNode() : next(0) {} // This lets item have a proper default constructor
       template<typename U>
       inline LQ_QNode(U && Item) : next(0), item(std::forward<U>(Item)) {}
-      LQ_QNode* next;
+      std::atomic<LQ_QNode*> next; // Written with release and read with acquire, so whoever sees a node also sees its item
       T item;
     };
 
@@ -38,6 +38,13 @@ namespace bss {
       BSS_FORCEINLINE static void _incLength() {}
       BSS_FORCEINLINE static void _decLength() {}
     };
+
+    template<typename T>
+    struct BQ_Slot
+    {
+      std::atomic<size_t> seq; // Equal to the position a producer can fill next, or one past the position a consumer can take next
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type item;
+    };
   }
 
   // Single-producer single-consumer lockless queue implemented in such a way that it can use a normal single-threaded allocator
@@ -66,7 +73,7 @@ namespace bss {
     {
       while(QNODE* tmp = _first)
       {
-        _first = _first->next;
+        _first = _first->next.load(std::memory_order_relaxed);
         tmp->~QNODE();
         Alloc::deallocate(tmp, 1);
       }
@@ -77,10 +84,11 @@ namespace bss {
     {
       QNODE* div = _div.load(std::memory_order_acquire);
 
-      if(div != _last.load(std::memory_order_relaxed))
+      if(div != _last.load(std::memory_order_acquire))
       {
-        result = std::move(div->next->item); 	// try to use move semantics if possible
-        _div.store(div->next, std::memory_order_release); // publish it
+        QNODE* next = div->next.load(std::memory_order_acquire);
+        result = std::move(next->item); 	// try to use move semantics if possible
+        _div.store(next, std::memory_order_release); // publish it
         internal::LocklessQueue_Length<LENGTH>::_decLength(); // Decrement length if we're tracking it
         return true;
       }
@@ -104,17 +112,17 @@ namespace bss {
     template<typename U>
     void _produce(U && item)
     {
-      QNODE* last = _last.load(std::memory_order_acquire);
-      last->next = Alloc::allocate(1);
-      new((QNODE*)last->next) QNODE(std::forward<U>(item));
-      _last.store(last->next, std::memory_order_release); // publish it
+      QNODE* nval = Alloc::allocate(1);
+      new(nval) QNODE(std::forward<U>(item));
+      _last.load(std::memory_order_acquire)->next.store(nval, std::memory_order_release);
+      _last.store(nval, std::memory_order_release); // publish it
       internal::LocklessQueue_Length<LENGTH>::_incLength(); // If we are tracking length, atomically increment it
 
       QNODE* tmp; // collect garbage
-      while(_first != _div.load(std::memory_order_relaxed))
+      while(_first != _div.load(std::memory_order_acquire)) // The consumer is done with every node before the one it published
       {
         tmp = _first;
-        _first = _first->next;
+        _first = _first->next.load(std::memory_order_relaxed);
         tmp->~QNODE(); // We have to let item clean itself up
         Alloc::deallocate(tmp, 1);
       }
@@ -125,8 +133,10 @@ namespace bss {
     BSS_ALIGN(64) std::atomic<QNODE*> _last;
   };
 
-  // Multi-producer Multi-consumer microlock queue using a multithreaded allocator
-  template<typename T, typename LENGTH = void, typename Alloc = PolymorphicAllocator<internal::LQ_QNode<T>, LocklessBlockPolicy>>
+  // Multi-producer Multi-consumer microlock queue using a multithreaded allocator. Producers and consumers each have their own lock,
+  // which can be a SpinLock, TicketLock or MCSLock. The fair locks are slower when uncontended, but hand off much more evenly when
+  // many threads are hammering the queue.
+  template<typename T, typename LENGTH = void, typename Alloc = PolymorphicAllocator<internal::LQ_QNode<T>, LocklessBlockPolicy>, typename LOCK = SpinLock>
   class MicroLockQueue : public internal::LocklessQueue_Length<LENGTH>, Alloc
   {
     typedef internal::LQ_QNode<T> QNODE;
@@ -134,89 +144,316 @@ namespace bss {
     MicroLockQueue& operator=(const MicroLockQueue&) = delete;
 
   public:
-    MicroLockQueue(MicroLockQueue&& mov) : Alloc(std::move(mov)), internal::LocklessQueue_Length<LENGTH>(std::move(mov)), _div(mov._div), _last(mov._last)
+    MicroLockQueue(MicroLockQueue&& mov) : Alloc(std::move(mov)), internal::LocklessQueue_Length<LENGTH>(std::move(mov)), _div(mov._div.load(std::memory_order_relaxed)),
+      _last(mov._last), _cstats(mov._cstats), _pstats(mov._pstats)
     {
       mov._div = mov._last = 0;
-      _cflag.clear(std::memory_order_relaxed);
-      _pflag.clear(std::memory_order_relaxed);
     }
     template<bool U = std::is_void_v<typename Alloc::policy_type>, std::enable_if_t<!U, int> = 0>
-    inline explicit MicroLockQueue(typename Alloc::policy_type* policy) : Alloc(policy)
+    inline explicit MicroLockQueue(typename Alloc::policy_type* policy) : Alloc(policy), _cstats(0), _pstats(0)
     {
-      _last = _div = Alloc::allocate(1);
-      new(_div)QNODE();
-      _cflag.clear(std::memory_order_relaxed);
-      _pflag.clear(std::memory_order_relaxed);
+      _last = Alloc::allocate(1);
+      new(_last)QNODE();
+      _div = _last;
     }
-    inline MicroLockQueue()
+    inline MicroLockQueue() : _cstats(0), _pstats(0)
     {
-      _last = _div = Alloc::allocate(1);
-      new(_div)QNODE();
-      _cflag.clear(std::memory_order_relaxed);
-      _pflag.clear(std::memory_order_relaxed);
+      _last = Alloc::allocate(1);
+      new(_last)QNODE();
+      _div = _last;
     }
     inline ~MicroLockQueue()
     {
-      while(QNODE* tmp = _div)
+      while(QNODE* tmp = _div.load(std::memory_order_relaxed))
       {
-        _div = _div->next;
+        _div = tmp->next.load(std::memory_order_relaxed);
         tmp->~QNODE();
         Alloc::deallocate(tmp, 1);
       }
     }
-    BSS_FORCEINLINE void Push(const T& item) { _produce<const T&>(item); }
-    BSS_FORCEINLINE void Push(T&& item) { _produce<T&&>(std::move(item)); }
-    inline bool Pop(T& result)
+    BSS_FORCEINLINE void Push(const T& item, const char* file = BSS_CALLSITE_FILE, uint32_t line = BSS_CALLSITE_LINE) { _produce<const T&>(item, file, line); }
+    BSS_FORCEINLINE void Push(T&& item, const char* file = BSS_CALLSITE_FILE, uint32_t line = BSS_CALLSITE_LINE) { _produce<T&&>(std::move(item), file, line); }
+    inline bool Pop(T& result, const char* file = BSS_CALLSITE_FILE, uint32_t line = BSS_CALLSITE_LINE)
     {
-      if(!_div->next) return false; // Remove some contending pressure
+      // Remove some contending pressure. These reads race with the lock holders, so they have to be atomic, or once Pop() is inlined
+      // into a retry loop the compiler is free to hoist them out of it and spin forever.
+      if(!_div.load(std::memory_order_relaxed)->next.load(std::memory_order_acquire)) return false;
 
-      while(_cflag.test_and_set(std::memory_order_acquire));
-      QNODE* ref = _div;
-      QNODE* n = _div->next;
+      LockStats::Wait w(_cstats);
+      _clock.Lock([&w]() { w.Spin(); });
+      w.Acquire(file, line);
+      QNODE* ref = _div.load(std::memory_order_relaxed); // Only changed by whoever holds the consumer lock
+      QNODE* n = ref->next.load(std::memory_order_acquire);
 
       if(n != 0)
       {
         result = std::move(n->item); 	// try to use move semantics if possible
-        _div = n;
-        _cflag.clear(std::memory_order_release);
+        _div.store(n, std::memory_order_relaxed);
+        _clock.Unlock();
         ref->~QNODE(); // We have to let item clean itself up
         Alloc::deallocate(ref, 1);
         internal::LocklessQueue_Length<LENGTH>::_decLength(); // If we are tracking length, atomically decrement it
         return true;
       }
 
-      _cflag.clear(std::memory_order_release);
+      _clock.Unlock();
       return false;
     }
-    inline bool Peek() { return _div->next != 0; }
+    inline bool Peek() { return _div.load(std::memory_order_relaxed)->next.load(std::memory_order_acquire) != 0; }
+    // Records contention on the consumer and producer locks. Either can be null, and both can point to the same LockStats.
+    inline void SetLockStats(LockStats* consumer, LockStats* producer) { _cstats = consumer; _pstats = producer; }
     inline MicroLockQueue& operator=(MicroLockQueue&& mov)
     {
       Alloc::operator=(std::move(mov));
-      _div = mov._div;
+      _div = mov._div.load(std::memory_order_relaxed);
       _last = mov._last;
-      _cflag.clear(std::memory_order_release);
+      _cstats = mov._cstats;
+      _pstats = mov._pstats;
       mov._div = mov._last = 0;
       internal::LocklessQueue_Length<LENGTH>::operator=(std::move(mov));
       return *this;
     }
   protected:
     template<typename U>
-    void _produce(U && item)
+    void _produce(U && item, const char* file, uint32_t line)
     {
       QNODE* nval = Alloc::allocate(1);
       new(nval) QNODE(std::forward<U>(item));
 
-      while(_pflag.test_and_set(std::memory_order_acquire));
-      _last->next = nval;
+      LockStats::Wait w(_pstats);
+      _plock.Lock([&w]() { w.Spin(); });
+      w.Acquire(file, line);
+      _last->next.store(nval, std::memory_order_release); // Consumers only ever see the node through this store
       _last = nval; // This can happen before or after modifying _last->next because no other function uses _last
-      _pflag.clear(std::memory_order_release);
+      _plock.Unlock();
       internal::LocklessQueue_Length<LENGTH>::_incLength(); // If we are tracking length, atomically increment it
     }
 
-    BSS_ALIGN(64) QNODE* _div; // Align to try and get them on different cache lines
+    BSS_ALIGN(64) std::atomic<QNODE*> _div; // Align to try and get them on different cache lines
     BSS_ALIGN(64) QNODE* _last;
-    BSS_ALIGN(64) std::atomic_flag _cflag;
-    BSS_ALIGN(64) std::atomic_flag _pflag;
+    BSS_ALIGN(64) LOCK _clock;
+    BSS_ALIGN(64) LOCK _plock;
+    LockStats* _cstats;
+    LockStats* _pstats;
+  };
+
+  // Base class for anything that can be pushed onto a Mailbox
+  struct MailboxNode
+  {
+    std::atomic<MailboxNode*> next;
+  };
+
+  // Intrusive multi-producer single-consumer queue (Dmitry Vyukov's algorithm). Nodes are linked through the MailboxNode they derive
+  // from, so nothing is allocated and pushing is a single atomic exchange, which makes it wait-free. A node belongs to the queue from the
+  // moment it is pushed until it is popped, so it can only be in one mailbox at a time. Pop() can return null even though Empty() is
+  // false, if a producer has been preempted halfway through a push. The consumer should simply try again later.
+  template<class T = MailboxNode>
+  class Mailbox
+  {
+    static_assert(std::is_base_of<MailboxNode, T>::value, "T must derive from MailboxNode");
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+
+  public:
+    inline Mailbox() : _head(&_stub), _tail(&_stub) { _stub.next.store(0, std::memory_order_relaxed); }
+    // Can be called by any number of threads
+    BSS_FORCEINLINE void Push(T* node) { _push(node); }
+    // Can only be called by the consumer
+    inline T* Pop()
+    {
+      MailboxNode* tail = _tail;
+      MailboxNode* next = tail->next.load(std::memory_order_acquire);
+      if(tail == &_stub)
+      {
+        if(!next)
+          return 0;
+        _tail = tail = next;
+        next = next->next.load(std::memory_order_acquire);
+      }
+      if(next)
+      {
+        _tail = next;
+        return static_cast<T*>(tail);
+      }
+      if(tail != _head.load(std::memory_order_acquire))
+        return 0; // A producer is in the middle of linking in a node
+      _push(&_stub); // tail is the last node, so the stub goes behind it to let us take it out
+      next = tail->next.load(std::memory_order_acquire);
+      if(next)
+      {
+        _tail = next;
+        return static_cast<T*>(tail);
+      }
+      return 0;
+    }
+    // Can only be called by the consumer
+    inline bool Empty() const { return _head.load(std::memory_order_seq_cst) == _tail && _tail == &_stub; }
+    // Can be called by any thread, because it never reads the tail. If Empty() was true, returns false once anything has been pushed since.
+    inline bool Untouched() const { return _head.load(std::memory_order_seq_cst) == &_stub; }
+
+  protected:
+    BSS_FORCEINLINE void _push(MailboxNode* node)
+    {
+      node->next.store(0, std::memory_order_relaxed);
+      MailboxNode* prev = _head.exchange(node, std::memory_order_seq_cst);
+      prev->next.store(node, std::memory_order_release);
+    }
+
+    BSS_ALIGN(64) std::atomic<MailboxNode*> _head; // Producers push here
+    BSS_ALIGN(64) MailboxNode* _tail; // The consumer pops from here
+    MailboxNode _stub;
+  };
+
+  // Bounded multi-producer multi-consumer queue using Dmitry Vyukov's sequenced ring. Every slot carries a sequence number that tells
+  // producers and consumers which lap of the ring it is ready for, so each side only contends on one CAS of its own index and nothing
+  // is ever allocated after construction. Push() and Pop() never block: they return false if the queue is full or looks empty. A
+  // batch push claims a whole run of slots with a single CAS. Pop() can report the queue as empty while a producer that got in ahead
+  // of later ones hasn't finished writing its item yet.
+  template<typename T, typename Alloc = StandardAllocator<internal::BQ_Slot<T>>>
+  class BoundedQueue : Alloc
+  {
+    typedef internal::BQ_Slot<T> SLOT;
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  public:
+    BoundedQueue(BoundedQueue&& mov) : Alloc(std::move(mov)), _slots(mov._slots), _mask(mov._mask),
+      _enqueue(mov._enqueue.load(std::memory_order_relaxed)), _dequeue(mov._dequeue.load(std::memory_order_relaxed))
+    {
+      mov._slots = 0;
+      mov._mask = 0;
+      mov._enqueue.store(0, std::memory_order_relaxed);
+      mov._dequeue.store(0, std::memory_order_relaxed);
+    }
+    template<bool U = std::is_void_v<typename Alloc::policy_type>, std::enable_if_t<!U, int> = 0>
+    inline BoundedQueue(size_t capacity, typename Alloc::policy_type* policy) : Alloc(policy) { _init(capacity); }
+    // Capacity is rounded up to a power of two.
+    inline explicit BoundedQueue(size_t capacity) { _init(capacity); }
+    inline ~BoundedQueue()
+    {
+      if(!_slots)
+        return;
+      for(size_t i = _dequeue.load(std::memory_order_relaxed); i != _enqueue.load(std::memory_order_relaxed); ++i)
+        reinterpret_cast<T*>(&_slots[i & _mask].item)->~T();
+      Alloc::deallocate(_slots, _mask + 1);
+    }
+    BSS_FORCEINLINE bool Push(const T& item) { return _push<const T&>(item); }
+    BSS_FORCEINLINE bool Push(T&& item) { return _push<T&&>(std::move(item)); }
+    // Moves as many of the items as will fit into the queue, in order, and returns how many were pushed. Each run of free slots is
+    // claimed with one CAS, so a batch that fits costs about as much as a single push.
+    size_t Push(T* items, size_t count)
+    {
+      size_t total = 0;
+      while(total < count)
+      {
+        size_t pos;
+        size_t n = _claim(count - total, pos);
+        if(!n)
+          break;
+        for(size_t i = 0; i < n; ++i)
+        {
+          SLOT& slot = _slots[(pos + i) & _mask];
+          // The consumer that took this slot's last item has already claimed it, but might not be done moving it out.
+          for(uint32_t spins = 0; slot.seq.load(std::memory_order_acquire) != pos + i;)
+            internal::SpinWait(spins);
+          new(&slot.item) T(std::move(items[total + i]));
+          slot.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        total += n;
+      }
+      return total;
+    }
+    inline bool Pop(T& result)
+    {
+      size_t pos = _dequeue.load(std::memory_order_relaxed);
+      for(;;)
+      {
+        SLOT& slot = _slots[pos & _mask];
+        intptr_t dif = (intptr_t)slot.seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+        if(!dif)
+        {
+          if(_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          {
+            T* item = reinterpret_cast<T*>(&slot.item);
+            result = std::move(*item);
+            item->~T();
+            slot.seq.store(pos + _mask + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if(dif < 0)
+          return false;
+        else
+          pos = _dequeue.load(std::memory_order_relaxed);
+      }
+    }
+    inline size_t Capacity() const { return _mask + 1; }
+    // Number of items in the queue. This is only exact if no other thread is pushing or popping.
+    inline size_t Length() const
+    {
+      size_t d = _dequeue.load(std::memory_order_relaxed);
+      size_t e = _enqueue.load(std::memory_order_relaxed);
+      return e > d ? e - d : 0;
+    }
+
+  protected:
+    inline void _init(size_t capacity)
+    {
+      assert(capacity > 0);
+      size_t n = 1;
+      while(n < capacity)
+        n <<= 1;
+      _slots = Alloc::allocate(n);
+      _mask = n - 1;
+      for(size_t i = 0; i < n; ++i)
+        new(&_slots[i].seq) std::atomic<size_t>(i);
+      _enqueue.store(0, std::memory_order_relaxed);
+      _dequeue.store(0, std::memory_order_relaxed);
+    }
+    template<typename U>
+    inline bool _push(U && item)
+    {
+      size_t pos;
+      if(!_claim(1, pos))
+        return false;
+      SLOT& slot = _slots[pos & _mask];
+      new(&slot.item) T(std::forward<U>(item));
+      slot.seq.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+    // Claims up to count slots starting at pos and returns how many it got. If the last slot of a run is free for this lap, every slot
+    // before it has at least been claimed by a consumer, so we only need to check the last one, halving the run until it fits.
+    inline size_t _claim(size_t count, size_t& pos)
+    {
+      pos = _enqueue.load(std::memory_order_relaxed);
+      size_t n = bssmin(count, _mask + 1);
+      for(;;)
+      {
+        intptr_t dif = (intptr_t)_slots[(pos + n - 1) & _mask].seq.load(std::memory_order_acquire) - (intptr_t)(pos + n - 1);
+        if(!dif)
+        {
+          if(_enqueue.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+            return n;
+          n = bssmin(count, _mask + 1);
+        }
+        else if(dif < 0)
+        {
+          if(n == 1)
+            return 0;
+          n >>= 1;
+        }
+        else
+        {
+          pos = _enqueue.load(std::memory_order_relaxed);
+          n = bssmin(count, _mask + 1);
+        }
+      }
+    }
+
+    SLOT* _slots;
+    size_t _mask;
+    BSS_ALIGN(64) std::atomic<size_t> _enqueue;
+    BSS_ALIGN(64) std::atomic<size_t> _dequeue;
   };
 
   // Multi-producer Multi-consumer lockless queue using a multithreaded allocator
@@ -14,6 +14,7 @@
 
 namespace bss {
   class StreamSplitter;
+  namespace internal { struct LogAsync; }
 
   // Log class that can be converted into a stream and redirected to various different stream targets
   class BSS_DLLEXPORT Logger
@@ -22,6 +23,9 @@ namespace bss {
     Logger& operator=(const Logger& right) = delete;
 
   public:
+    // What happens when a thread's async buffer is full: either discard the record and count it, or wait for the background thread to make room.
+    enum ASYNC_OVERFLOW : uint8_t { ASYNC_DROP = 0, ASYNC_BLOCK = 1 };
+
     // Move semantics only
     Logger(Logger&& mov);
     // Constructor - takes a stream and adds it
@@ -48,15 +52,26 @@ namespace bss {
     void SetNullFormat(const char* format);
     // Clears all targets and closes all files
     void ClearTargets();
-    // Gets the stream for this log
-    inline std::ostream& GetStream() { return _stream; }
+    // Gets the stream for this log. In async mode this is the calling thread's buffer, which is only submitted when the stream is flushed.
+    std::ostream& GetStream();
+    // Switches to async mode, which makes logging thread-safe. Each thread formats records into its own lock-free buffer of capacity bytes,
+    // and a background thread writes them out to the targets in batches, flushing them every flushms milliseconds or when a buffer is half full.
+    // Streams redirected with Assimilate() still write directly to the targets, and must not be used while async mode is active.
+    void SetAsync(size_t capacity = (1 << 16), ASYNC_OVERFLOW overflow = ASYNC_DROP, uint32_t flushms = 10);
+    // Writes out any pending records, stops the background thread and returns to synchronous mode.
+    void ClearAsync();
+    inline bool IsAsync() const { return _async != 0; }
+    // In async mode, blocks until every record submitted before this call has been written to the targets. Otherwise, flushes the targets.
+    void Flush();
+    // Gets the number of records discarded by ASYNC_DROP since async mode was enabled
+    uint64_t GetDropped() const;
     // Sets a level string (which should be a constant, not something that will get deallocated)
     void SetLevel(uint8_t level, const char* str);
     // Sets the maximum level that will be logged. Useful for excluding unnecessary debug logs from release builds
     void SetMaxLevel(uint8_t level);
 
     Logger& operator=(Logger&& right);
-    inline operator std::ostream&() { return _stream; }
+    inline operator std::ostream&() { return GetStream(); }
 
     inline int PrintLog(const char* source, const char* file, size_t line, int8_t level, const char* format, ...)
     {
@@ -81,8 +96,9 @@ namespace bss {
       if(level >= _maxlevel)
         return;
 
-      SafeFormat<Args...>(LogHeader(source, file, line, level), format, args...);
-      _stream << std::endl;
+      std::ostream& o = LogHeader(source, file, line, level);
+      SafeFormat<Args...>(o, format, args...);
+      o << std::endl;
     }
     BSS_FORCEINLINE std::ostream& LogHeader(const char* source, const char* file, size_t line, int8_t level)
     {
@@ -113,6 +129,7 @@ namespace bss {
 #pragma warning(disable:4251)
     std::vector<std::pair<std::ostream&, std::streambuf*>> _backup;
     std::ostream _stream;
+    internal::LogAsync* _async;
 
 #ifdef BSS_COMPILER_GCC // Until GCC fixes its fucking broken standard implementation, we're going to have to do this the hard way.
     std::vector<std::unique_ptr<std::ofstream>> _files;
@@ -0,0 +1,370 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __PERFECT_HASH_H__BSS__
+#define __PERFECT_HASH_H__BSS__
+
+#include "defines.h"
+#include <stdint.h>
+#include <string.h>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <type_traits>
+
+namespace bss {
+  namespace internal {
+    static constexpr uint64_t PH_P1 = 0x9E3779B185EBCA87ULL;
+    static constexpr uint64_t PH_P2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr uint32_t PH_DIRECT = 0x80000000; // Set on the pilot of a bucket holding a single key, which stores that key's slot
+    static constexpr uint32_t PH_MAXPILOT = 1 << 20; // Gives up on a seed if a bucket needs more tries than this
+    static constexpr uint32_t PH_SEEDS = 16; // Number of seeds to try before deciding the keys can't be told apart
+    static constexpr uint64_t PH_MAXKEYS = PH_DIRECT - 1;
+
+    BSS_FORCEINLINE constexpr uint64_t PHMix(uint64_t x)
+    {
+      x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+      return x ^ (x >> 31);
+    }
+    BSS_FORCEINLINE constexpr uint64_t PHRotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+    // Assembles the word out of single bytes so it works in a constant expression. GCC and Clang fold this back into one load.
+    BSS_FORCEINLINE constexpr uint64_t PHRead8(const char* p)
+    {
+      return (uint64_t)(uint8_t)p[0] | ((uint64_t)(uint8_t)p[1] << 8) | ((uint64_t)(uint8_t)p[2] << 16) | ((uint64_t)(uint8_t)p[3] << 24) |
+        ((uint64_t)(uint8_t)p[4] << 32) | ((uint64_t)(uint8_t)p[5] << 40) | ((uint64_t)(uint8_t)p[6] << 48) | ((uint64_t)(uint8_t)p[7] << 56);
+    }
+    inline constexpr uint64_t PHString(const char* s, size_t len, uint64_t seed)
+    {
+      uint64_t h = seed ^ (len * PH_P1);
+      size_t i = 0;
+      for(; i + 8 <= len; i += 8)
+        h = PHRotl(h ^ (PHRead8(s + i) * PH_P2), 31) * PH_P1;
+      uint64_t tail = 0;
+      for(size_t j = 0; i + j < len; ++j)
+        tail |= (uint64_t)(uint8_t)s[i + j] << (j * 8);
+      return PHMix(h ^ (tail * PH_P2));
+    }
+    // Maps x from [0, 2^32) onto [0, n) with a multiply instead of a division.
+    BSS_FORCEINLINE constexpr uint32_t PHReduce(uint32_t x, uint32_t n) { return (uint32_t)(((uint64_t)x * n) >> 32); }
+    BSS_FORCEINLINE constexpr uint32_t PHBuckets(uint64_t n) { return (uint32_t)(n / 4) + 1; } // About 4 keys per bucket, or 8 bits per key
+    BSS_FORCEINLINE constexpr uint32_t PHBucket(uint64_t h, uint32_t nbuckets) { return PHReduce((uint32_t)(h >> 32), nbuckets); }
+    BSS_FORCEINLINE constexpr uint32_t PHPosition(uint64_t h, uint32_t pilot, uint32_t n) { return PHReduce((uint32_t)(PHMix(h ^ (pilot * PH_P1)) >> 32), n); }
+    BSS_FORCEINLINE constexpr uint32_t PHSlot(uint64_t h, const uint32_t* pilots, uint32_t nbuckets, uint32_t n)
+    {
+      uint32_t p = pilots[PHBucket(h, nbuckets)];
+      return (p & PH_DIRECT) ? (p ^ PH_DIRECT) : PHPosition(h, p, n);
+    }
+
+    // Hash-and-displace: keys are split into buckets by the top of their hash, then each bucket, largest first, searches for a pilot
+    // value that sends all of its keys to free slots. Buckets with only one key are left for last and simply given whichever slots are
+    // still free, which is what keeps the search short even though there are exactly as many slots as keys. order needs n entries,
+    // start needs nbuckets + 1, and taken needs n. Returns false if two keys have the same hash or a bucket couldn't be placed.
+    inline constexpr bool PHBuild(const uint64_t* hashes, uint32_t n, uint32_t nbuckets, uint32_t* pilots, uint32_t* order, uint32_t* start, uint8_t* taken)
+    {
+      for(uint32_t b = 0; b <= nbuckets; ++b)
+        start[b] = 0;
+      for(uint32_t i = 0; i < n; ++i)
+      {
+        ++start[PHBucket(hashes[i], nbuckets) + 1];
+        taken[i] = 0;
+      }
+      uint32_t largest = 0;
+      for(uint32_t b = 0; b < nbuckets; ++b)
+      {
+        largest = (start[b + 1] > largest) ? start[b + 1] : largest;
+        start[b + 1] += start[b];
+      }
+      for(uint32_t b = 0; b < nbuckets; ++b) // The pilots double as insertion cursors while we sort keys into buckets
+        pilots[b] = start[b];
+      for(uint32_t i = 0; i < n; ++i)
+        order[pilots[PHBucket(hashes[i], nbuckets)]++] = i;
+      for(uint32_t b = 0; b < nbuckets; ++b)
+        pilots[b] = 0;
+
+      for(uint32_t size = largest; size > 1; --size)
+        for(uint32_t b = 0; b < nbuckets; ++b)
+        {
+          if(start[b + 1] - start[b] != size)
+            continue;
+          const uint32_t* keys = order + start[b];
+          for(uint32_t j = 1; j < size; ++j)
+            for(uint32_t k = 0; k < j; ++k)
+              if(hashes[keys[j]] == hashes[keys[k]])
+                return false;
+
+          uint32_t p = 0;
+          for(;; ++p)
+          {
+            if(p >= PH_MAXPILOT)
+              return false;
+            uint32_t j = 0;
+            for(; j < size; ++j)
+            {
+              uint32_t s = PHPosition(hashes[keys[j]], p, n);
+              if(taken[s])
+                break;
+              taken[s] = 1;
+            }
+            if(j == size)
+              break;
+            while(j-- > 0)
+              taken[PHPosition(hashes[keys[j]], p, n)] = 0;
+          }
+          pilots[b] = p;
+        }
+
+      uint32_t slot = 0;
+      for(uint32_t b = 0; b < nbuckets; ++b)
+        if(start[b + 1] - start[b] == 1)
+        {
+          while(taken[slot])
+            ++slot;
+          taken[slot] = 1;
+          pilots[b] = PH_DIRECT | slot;
+        }
+      return true;
+    }
+  }
+
+  // Hashes a key the way PerfectHash and StaticPerfectHash do. Integers and enums go through a bijective mix, so distinct integer
+  // keys never collide. Anything else must convert to std::string_view. The result is the same on every platform and in constant
+  // expressions, which is what lets a serialized PerfectHash be loaded by another process.
+  template<class K>
+  inline constexpr uint64_t PerfectHashKey(const K& key, uint64_t seed)
+  {
+    if constexpr(std::is_integral<K>::value || std::is_enum<K>::value)
+      return internal::PHMix((uint64_t)key ^ internal::PHMix(seed));
+    else
+    {
+      std::string_view s(key);
+      return internal::PHString(s.data(), s.size(), seed);
+    }
+  }
+
+  // Minimal perfect hash over a fixed set of keys known at compile time. It maps each of the N keys to a distinct slot in [0, N) with
+  // one lookup into a small pilot table, then stores the keys in slot order so Find() can check that a key really belongs to the set.
+  // Both construction and lookup can run in a constant expression, which keeps the search to sets of at most a few hundred keys
+  // before compilers hit their evaluation limits. Keys are copied, so string_views must point at storage that outlives the table,
+  // like string literals. Valid() is false if the keys couldn't be placed, which only happens if the same key appears twice.
+  template<class Key, size_t N>
+  class StaticPerfectHash
+  {
+    static_assert(N <= internal::PH_MAXKEYS, "Too many keys");
+    static constexpr size_t SIZE = N ? N : 1;
+
+  public:
+    static constexpr uint32_t BUCKETS = internal::PHBuckets(N);
+
+    constexpr StaticPerfectHash(const Key(&keys)[SIZE], uint64_t seed = 0) : _seed(0), _valid(false), _pilots{}, _entries{}
+    {
+      uint64_t hashes[SIZE] = {};
+      uint32_t order[SIZE] = {};
+      uint32_t start[BUCKETS + 1] = {};
+      uint8_t taken[SIZE] = {};
+      for(uint32_t t = 0; t < internal::PH_SEEDS && !_valid; ++t)
+      {
+        _seed = seed + t;
+        for(size_t i = 0; i < N; ++i)
+          hashes[i] = PerfectHashKey(keys[i], _seed);
+        _valid = internal::PHBuild(hashes, (uint32_t)N, BUCKETS, _pilots, order, start, taken);
+      }
+      if(_valid)
+        for(size_t i = 0; i < N; ++i)
+        {
+          Entry& e = _entries[internal::PHSlot(hashes[i], _pilots, BUCKETS, (uint32_t)N)];
+          e.key = keys[i];
+          e.index = i;
+        }
+    }
+    // Returns the position of key in the array the table was built from, or -1 if it isn't one of the keys.
+    inline constexpr size_t Find(const Key& key) const
+    {
+      if(!N || !_valid)
+        return (size_t)~0;
+      const Entry& e = _entries[Slot(key)];
+      return (e.key == key) ? e.index : (size_t)~0;
+    }
+    // Returns the slot key maps to without checking that it's one of the keys.
+    BSS_FORCEINLINE constexpr uint32_t Slot(const Key& key) const { return internal::PHSlot(PerfectHashKey(key, _seed), _pilots, BUCKETS, (uint32_t)N); }
+    // Gets the key stored in a slot
+    BSS_FORCEINLINE constexpr const Key& operator[](uint32_t slot) const { return _entries[slot].key; }
+    BSS_FORCEINLINE constexpr bool Valid() const { return _valid; }
+    BSS_FORCEINLINE static constexpr size_t Length() { return N; }
+
+  protected:
+    struct Entry
+    {
+      Key key;
+      size_t index;
+    };
+
+    uint64_t _seed;
+    bool _valid;
+    uint32_t _pilots[BUCKETS];
+    Entry _entries[SIZE];
+  };
+
+  // Deduces the number of keys, so a table can be declared as constexpr auto t = MakePerfectHash<std::string_view>({ "a", "b" });
+  template<class Key, size_t N>
+  inline constexpr StaticPerfectHash<Key, N> MakePerfectHash(const Key(&keys)[N], uint64_t seed = 0) { return StaticPerfectHash<Key, N>(keys, seed); }
+
+  // Minimal perfect hash for large key sets built at runtime. It maps each of n keys to a distinct index in [0, n) with about 8 bits
+  // of storage per key, and a lookup hashes the key, reads one 32-bit pilot and mixes it in, so the only memory access is the pilot and
+  // there's no probing. Keys that weren't in the set map to some arbitrary index, so callers that can see unknown keys should store
+  // each key (or a fingerprint of it) at its index and compare.
+  //
+  // The table is one flat block, a header followed by the pilots, with no pointers in it. Save() writes that block out, and the
+  // constructor that takes a pointer uses a block in place without copying it, so a file written by Save() can be memory mapped and
+  // used directly. The block is stored in native byte order, and a block from a machine with the other byte order is rejected.
+  class PerfectHash
+  {
+  public:
+    struct Header
+    {
+      uint32_t magic;
+      uint32_t version;
+      uint64_t seed;
+      uint64_t length;
+      uint64_t buckets;
+    };
+    static constexpr uint32_t MAGIC = 0x48505342; // "BSPH" when stored little-endian
+    static constexpr uint32_t VERSION = 1;
+
+    inline PerfectHash() : _header(0), _pilots(0), _size(0) {}
+    inline PerfectHash(const PerfectHash& copy) : _header(0), _pilots(0), _size(0) { operator=(copy); }
+    inline PerfectHash(PerfectHash&& mov) : _owned(std::move(mov._owned)), _header(mov._header), _pilots(mov._pilots), _size(mov._size)
+    {
+      mov._header = 0;
+      mov._pilots = 0;
+      mov._size = 0;
+    }
+    // Uses a block written by Save() in place, which must stay alive and unchanged for as long as this table uses it, and must be 8
+    // byte aligned, like the start of a memory mapped file. If the block isn't valid, the table is left empty.
+    inline PerfectHash(const void* data, size_t size) : _header(0), _pilots(0), _size(0) { _view(data, size); }
+    inline ~PerfectHash() {}
+    // Builds a perfect hash over n distinct keys. Returns false if the keys couldn't be told apart, which means there was a duplicate
+    // or, for strings, an astronomically unlikely 64-bit hash collision on every seed.
+    template<class K>
+    bool Build(const K* keys, size_t n, uint64_t seed = 0)
+    {
+      if(n > internal::PH_MAXKEYS)
+        return false;
+      uint32_t nbuckets = internal::PHBuckets(n);
+      size_t size = _blocksize(nbuckets);
+      std::unique_ptr<uint64_t[]> block(new uint64_t[size / sizeof(uint64_t)]);
+      Header* h = reinterpret_cast<Header*>(block.get());
+      uint32_t* pilots = reinterpret_cast<uint32_t*>(h + 1);
+      std::unique_ptr<uint64_t[]> hashes(new uint64_t[n + 1]);
+      std::unique_ptr<uint32_t[]> order(new uint32_t[n + 1]);
+      std::unique_ptr<uint32_t[]> start(new uint32_t[nbuckets + 1]);
+      std::unique_ptr<uint8_t[]> taken(new uint8_t[n + 1]);
+
+      for(uint32_t t = 0; t < internal::PH_SEEDS; ++t)
+      {
+        for(size_t i = 0; i < n; ++i)
+          hashes[i] = PerfectHashKey(keys[i], seed + t);
+        if(internal::PHBuild(hashes.get(), (uint32_t)n, nbuckets, pilots, order.get(), start.get(), taken.get()))
+        {
+          *h = Header{ MAGIC, VERSION, seed + t, n, nbuckets };
+          _owned = std::move(block);
+          _header = h;
+          _pilots = pilots;
+          _size = size;
+          return true;
+        }
+      }
+      return false;
+    }
+    // Returns the index of key, which is in [0, Length()) as long as the table isn't empty. An empty table, including one that was
+    // never built or was given an invalid block, returns 0 for every key.
+    template<class K>
+    BSS_FORCEINLINE uint32_t Get(const K& key) const { return !_header ? 0 : _slot(PerfectHashKey(key, _header->seed)); }
+    template<class K>
+    BSS_FORCEINLINE uint32_t operator[](const K& key) const { return Get(key); }
+    inline size_t Length() const { return !_header ? 0 : (size_t)_header->length; }
+    inline bool Empty() const { return !Length(); }
+    // Gets the block Save() writes, so it can be stored some other way.
+    inline const void* Data() const { return _header; }
+    inline size_t DataSize() const { return _size; }
+    inline bool Save(std::ostream& s) const
+    {
+      if(!_header)
+        return false;
+      s.write(reinterpret_cast<const char*>(_header), _size);
+      return !s.fail();
+    }
+    // Reads a block written by Save() into memory this table owns.
+    inline bool Load(std::istream& s)
+    {
+      Header h;
+      if(!s.read(reinterpret_cast<char*>(&h), sizeof(Header)) || !_check(h, ~(size_t)0))
+        return false;
+      size_t size = _blocksize((uint32_t)h.buckets);
+      std::unique_ptr<uint64_t[]> block(new uint64_t[size / sizeof(uint64_t)]);
+      memcpy(block.get(), &h, sizeof(Header));
+      if(!s.read(reinterpret_cast<char*>(block.get()) + sizeof(Header), size - sizeof(Header)))
+        return false;
+      _owned = std::move(block);
+      _header = reinterpret_cast<const Header*>(_owned.get());
+      _pilots = reinterpret_cast<const uint32_t*>(_header + 1);
+      _size = size;
+      return true;
+    }
+
+    inline PerfectHash& operator=(const PerfectHash& copy)
+    {
+      if(this == &copy)
+        return *this;
+      _owned.reset();
+      _header = copy._header;
+      _pilots = copy._pilots;
+      _size = copy._size;
+      if(copy._owned) // A view keeps pointing at the same block, but an owned block has to be duplicated
+      {
+        _owned.reset(new uint64_t[_size / sizeof(uint64_t)]);
+        memcpy(_owned.get(), copy._owned.get(), _size);
+        _header = reinterpret_cast<const Header*>(_owned.get());
+        _pilots = reinterpret_cast<const uint32_t*>(_header + 1);
+      }
+      return *this;
+    }
+    inline PerfectHash& operator=(PerfectHash&& mov)
+    {
+      _owned = std::move(mov._owned);
+      _header = mov._header;
+      _pilots = mov._pilots;
+      _size = mov._size;
+      mov._header = 0;
+      mov._pilots = 0;
+      mov._size = 0;
+      return *this;
+    }
+
+  protected:
+    BSS_FORCEINLINE uint32_t _slot(uint64_t h) const { return internal::PHSlot(h, _pilots, (uint32_t)_header->buckets, (uint32_t)_header->length); }
+    BSS_FORCEINLINE static size_t _blocksize(uint32_t nbuckets) { return sizeof(Header) + ((nbuckets * sizeof(uint32_t) + 7) & ~(size_t)7); }
+    inline static bool _check(const Header& h, size_t size)
+    {
+      return h.magic == MAGIC && h.version == VERSION && h.length <= internal::PH_MAXKEYS && h.buckets == internal::PHBuckets(h.length) &&
+        size >= _blocksize((uint32_t)h.buckets);
+    }
+    inline void _view(const void* data, size_t size)
+    {
+      const Header* h = reinterpret_cast<const Header*>(data);
+      if(!data || ((size_t)data & 7) || size < sizeof(Header) || !_check(*h, size))
+        return;
+      _header = h;
+      _pilots = reinterpret_cast<const uint32_t*>(h + 1);
+      _size = _blocksize((uint32_t)h->buckets);
+    }
+
+    std::unique_ptr<uint64_t[]> _owned;
+    const Header* _header;
+    const uint32_t* _pilots;
+    size_t _size;
+  };
+}
+
+#endif
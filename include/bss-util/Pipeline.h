@@ -0,0 +1,212 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __PIPELINE_H__BSS__
+#define __PIPELINE_H__BSS__
+
+#include "ThreadPool.h"
+
+namespace bss {
+  enum PIPE_MODE : uint8_t {
+    PIPE_SERIAL = 0, // Processes one item at a time, in the order the source produced them
+    PIPE_PARALLEL = 1, // Processes up to the stage's parallelism items at once, in any order
+  };
+
+  // Runs items through a chain of stages on a ThreadPool, without spawning any threads of its own. Each item travels in one of a fixed
+  // number of tokens, so at most that many items are ever in flight: once every token is taken, the source isn't called again until
+  // the last stage finishes an item, which is what applies backpressure. Stages hand tokens to each other through bounded queues
+  // that can hold every token, so passing one along never blocks or allocates. Serial stages run like an Actor, one task at a time,
+  // and put tokens back in source order with a reorder window, so a serial stage after a parallel one still sees items in order.
+  // Tokens are reused, so the source must overwrite whatever the last item left in T. The source and stages are delegates, so
+  // whatever they point to must outlive the pipeline. Don't add stages or destroy the pipeline while it is running.
+  template<class T>
+  class Pipeline
+  {
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+  public:
+    typedef Delegate<bool, T&> SOURCE; // Fills in the next item, or returns false if there aren't any more
+    typedef Delegate<void, T&> STAGE;
+
+    // tokens is rounded up to a power of two.
+    Pipeline(ThreadPool& pool, SOURCE source, size_t tokens = 64) : _pool(pool), _source(source), _free(tokens), _seq(0), _ended(true),
+      _scheduled(false), _inflight(0)
+    {
+      _mask = _free.Capacity() - 1;
+      _tokens.reset(new Token[_mask + 1]);
+      for(size_t i = 0; i <= _mask; ++i)
+        _free.Push(&_tokens[i]);
+    }
+    ~Pipeline() { assert(!Running()); }
+    // Appends a stage. parallelism caps how many items a parallel stage works on at once, with 0 meaning one per token. Serial stages
+    // always have a parallelism of 1.
+    void AddStage(STAGE fn, PIPE_MODE mode, uint32_t parallelism = 0)
+    {
+      assert(!Running());
+      _stages.AddConstruct(new Stage(*this, fn, mode, (mode == PIPE_SERIAL) ? 1 : !parallelism ? (uint32_t)(_mask + 1) : parallelism, _stages.Length()));
+    }
+    // Starts pulling items from the source and returns immediately.
+    void Start()
+    {
+      assert(!Running());
+      _ended.store(false, std::memory_order_seq_cst);
+      _wakeSource();
+    }
+    // Waits until the source runs dry and every item has left the last stage. This calls ThreadPool::Wait(), so it also waits on
+    // anything else running on the pool, and the calling thread helps process tasks.
+    inline void Wait() { _pool.Wait(); assert(!Running()); }
+    // Starts the pipeline and waits for it to finish.
+    inline void Run() { Start(); Wait(); }
+    inline bool Running() const { return !_ended.load(std::memory_order_acquire) || _inflight.load(std::memory_order_acquire) > 0 || _scheduled.load(std::memory_order_acquire); }
+    inline size_t Tokens() const { return _mask + 1; }
+    inline size_t Stages() const { return _stages.Length(); }
+    // Number of items the source has produced so far
+    inline size_t Produced() const { return _seq; }
+
+  protected:
+    struct Token
+    {
+      T item;
+      size_t seq;
+    };
+
+    struct Stage
+    {
+      Stage(Pipeline& p, STAGE f, PIPE_MODE m, uint32_t par, size_t i) : pipe(p), fn(f), mode(m), parallelism(par), index(i), next(0),
+        queue(m == PIPE_SERIAL ? 1 : p._mask + 1), active(0), scheduled(false)
+      {
+        if(mode == PIPE_SERIAL)
+        {
+          window.reset(new std::atomic<Token*>[pipe._mask + 1]);
+          for(size_t j = 0; j <= pipe._mask; ++j)
+            window[j].store(0, std::memory_order_relaxed);
+        }
+      }
+
+      Pipeline& pipe;
+      STAGE fn;
+      PIPE_MODE mode;
+      uint32_t parallelism;
+      size_t index;
+      size_t next; // Sequence number of the next token a serial stage has to process
+      std::unique_ptr<std::atomic<Token*>[]> window; // Reorder window for serial stages, indexed by sequence number
+      BoundedQueue<Token*> queue; // Input queue for parallel stages
+      BSS_ALIGN(64) std::atomic<uint32_t> active; // Number of tasks a parallel stage has on the pool
+      BSS_ALIGN(64) std::atomic<bool> scheduled; // Whether a serial stage has a task on the pool
+    };
+
+    inline void _forward(size_t index, Token* t)
+    {
+      if(index >= _stages.Length())
+        return _finish(t);
+
+      Stage& stage = *_stages[index];
+      if(stage.mode == PIPE_SERIAL)
+      {
+        // At most Tokens() items are in flight, so nothing else can be sitting in this token's slot.
+        stage.window[t->seq & _mask].store(t, std::memory_order_seq_cst);
+        if(!stage.scheduled.exchange(true, std::memory_order_seq_cst))
+          _pool.AddTask(&_runSerial, &stage);
+      }
+      else
+      {
+        stage.queue.Push(t); // Can't fail, because the queue can hold every token
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        _spawn(stage);
+      }
+    }
+    inline void _spawn(Stage& stage)
+    {
+      uint32_t a = stage.active.load(std::memory_order_relaxed);
+      while(a < stage.parallelism)
+        if(stage.active.compare_exchange_weak(a, a + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+          return _pool.AddTask(&_runParallel, &stage);
+    }
+    inline void _finish(Token* t)
+    {
+      _free.Push(t);
+      _inflight.fetch_sub(1, std::memory_order_seq_cst);
+      _wakeSource();
+    }
+    inline void _wakeSource()
+    {
+      if(!_ended.load(std::memory_order_seq_cst) && !_scheduled.exchange(true, std::memory_order_seq_cst))
+        _pool.AddTask(&_produce, this);
+    }
+
+    static void _produce(void* p)
+    {
+      Pipeline& self = *reinterpret_cast<Pipeline*>(p);
+      Token* t;
+      while(self._free.Pop(t))
+      {
+        if(!self._source(t->item))
+        {
+          self._free.Push(t);
+          self._ended.store(true, std::memory_order_seq_cst);
+          break;
+        }
+        t->seq = self._seq++;
+        self._inflight.fetch_add(1, std::memory_order_seq_cst);
+        self._forward(0, t);
+      }
+
+      // Same handoff as Actor: a token freed after we clear the flag reschedules us itself, and one freed before is seen here.
+      self._scheduled.store(false, std::memory_order_seq_cst);
+      if(!self._ended.load(std::memory_order_seq_cst) && self._inflight.load(std::memory_order_seq_cst) <= self._mask)
+        self._wakeSource();
+    }
+    static void _runSerial(void* p)
+    {
+      Stage& stage = *reinterpret_cast<Stage*>(p);
+      Pipeline& self = stage.pipe;
+      for(size_t n = 0; n <= self._mask; ++n)
+      {
+        std::atomic<Token*>& slot = stage.window[stage.next & self._mask];
+        Token* t = slot.load(std::memory_order_acquire);
+        if(!t)
+          break;
+        slot.store(0, std::memory_order_relaxed);
+        ++stage.next;
+        stage.fn(t->item);
+        self._forward(stage.index + 1, t);
+      }
+
+      // Once the flag is cleared another task can take over the stage, so stage.next must be read before that.
+      size_t next = stage.next;
+      stage.scheduled.store(false, std::memory_order_seq_cst);
+      if(stage.window[next & self._mask].load(std::memory_order_seq_cst) && !stage.scheduled.exchange(true, std::memory_order_seq_cst))
+        self._pool.AddTask(&_runSerial, &stage);
+    }
+    static void _runParallel(void* p)
+    {
+      Stage& stage = *reinterpret_cast<Stage*>(p);
+      Pipeline& self = stage.pipe;
+      Token* t;
+      while(stage.queue.Pop(t))
+      {
+        stage.fn(t->item);
+        self._forward(stage.index + 1, t);
+      }
+
+      stage.active.fetch_sub(1, std::memory_order_seq_cst);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if(stage.queue.Length() > 0) // Anything pushed after our last Pop() while every task was busy is ours to pick up
+        self._spawn(stage);
+    }
+
+    ThreadPool& _pool;
+    SOURCE _source;
+    size_t _mask;
+    std::unique_ptr<Token[]> _tokens;
+    BoundedQueue<Token*> _free;
+    DynArray<std::unique_ptr<Stage>, size_t, ARRAY_MOVE> _stages;
+    size_t _seq; // Only touched by the source task
+    BSS_ALIGN(64) std::atomic<bool> _ended;
+    std::atomic<bool> _scheduled;
+    BSS_ALIGN(64) std::atomic<size_t> _inflight;
+  };
+}
+
+#endif
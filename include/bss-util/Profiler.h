@@ -88,7 +88,7 @@ namespace bss {
     BSS_FORCEINLINE PROF_TRIENODE* GetRoot() { return _trie; }
     BSS_FORCEINLINE PROF_TRIENODE* GetCur() { return _cur; }
     void AddData(ProfilerInt id, ProfilerData* p);
-    enum OUTPUT_DATA : uint8_t { OUTPUT_FLAT = 1, OUTPUT_TREE = 2, OUTPUT_HEATMAP = 4, OUTPUT_ALL = 1 | 2 | 4 };
+    enum OUTPUT_DATA : uint8_t { OUTPUT_FLAT = 1, OUTPUT_TREE = 2, OUTPUT_HEATMAP = 4, OUTPUT_LOCKS = 8, OUTPUT_ALL = 1 | 2 | 4 | 8 };
     void WriteToFile(const char* s, uint8_t output);
     void WriteToStream(std::ostream& stream, uint8_t output);
 
@@ -96,6 +96,7 @@ namespace bss {
     static const ProfilerInt BUFSIZE = 4096;
 
   private:
+    friend class LockStats;
     Profiler();
     PROF_TRIENODE* _allocNode();
     void _treeOut(std::ostream& stream, PROF_TRIENODE* node, ProfilerInt id, size_t level, ProfilerInt idlevel);
@@ -6,6 +6,7 @@
 
 #include "compiler.h"
 #include "lockless.h"
+#include "LockStats.h"
 #include <atomic>
 #include <assert.h>
 #ifdef BSS_DEBUG
@@ -18,7 +19,7 @@ namespace bss {
   class BSS_COMPILER_DLLEXPORT RWLock {
   public:
     static_assert(ATOMIC_POINTER_LOCK_FREE == 2, "This lock does not function properly on this architecture!");
-    inline RWLock() : l(0) // Note: if required, the fetch_or behavior can be emulated by checking a write lock, incrementing the read lock, then checking the write lock again.
+    inline RWLock() : l(0), _stats(0) // Note: if required, the fetch_or behavior can be emulated by checking a write lock, incrementing the read lock, then checking the write lock again.
     {
       assert(std::atomic_is_lock_free(&l));
       assert(l.load(std::memory_order_relaxed) == 0);
@@ -29,31 +30,41 @@ namespace bss {
     inline ~RWLock() {}
 
     // Acquire write lock
-    BSS_FORCEINLINE void Lock() noexcept
+    BSS_FORCEINLINE void Lock(const char* file = BSS_CALLSITE_FILE, uint32_t line = BSS_CALLSITE_LINE) noexcept
     {
       //assert(debugEmplace());
-
-      while(asmbts<size_t>((size_t*)&l, WBIT)); // While the returned value includes the flag bit, another writer is performing an operation
-      while((l.load(std::memory_order_relaxed)&WMASK) > 0); // Wait for any remaining readers to flush
+      LockStats::Wait w(_stats);
+      while(asmbts<size_t>((size_t*)&l, WBIT)) w.Spin(); // While the returned value includes the flag bit, another writer is performing an operation
+      while((l.load(std::memory_order_relaxed)&WMASK) > 0) w.Spin(); // Wait for any remaining readers to flush
+      w.Acquire(file, line);
     }
 
     // Attempts to acquire the lock, but if another writer already got the lock, aborts the attempt.
-    BSS_FORCEINLINE bool AttemptLock() noexcept
+    BSS_FORCEINLINE bool AttemptLock(const char* file = BSS_CALLSITE_FILE, uint32_t line = BSS_CALLSITE_LINE) noexcept
     {
       if(asmbts<size_t>((size_t*)&l, WBIT)) // If another writer already has the lock, give up
+      {
+        LockStats::Fail(_stats);
         return false;
+      }
 
       //assert(debugEmplace());
-      while((l.load(std::memory_order_relaxed)&WMASK) > 0); // Wait for any remaining readers to flush
+      LockStats::Wait w(_stats);
+      while((l.load(std::memory_order_relaxed)&WMASK) > 0) w.Spin(); // Wait for any remaining readers to flush
+      w.Acquire(file, line);
       return true;
     }
 
     // Attempts to acquire a write lock, but fails if there are any readers or writers
-    BSS_FORCEINLINE bool AttemptStrictLock() noexcept
+    BSS_FORCEINLINE bool AttemptStrictLock(const char* file = BSS_CALLSITE_FILE, uint32_t line = BSS_CALLSITE_LINE) noexcept
     {
       size_t prev = 0;
       bool r = l.compare_exchange_strong(prev, WFLAG, std::memory_order_release);
       //if(r) assert(debugEmplace());
+      if(r)
+        LockStats::Wait(_stats).Acquire(file, line);
+      else
+        LockStats::Fail(_stats);
       return r;
     }
 
@@ -66,26 +77,31 @@ namespace bss {
     }
 
     // Acquire read lock
-    BSS_FORCEINLINE void RLock() noexcept
+    BSS_FORCEINLINE void RLock(const char* file = BSS_CALLSITE_FILE, uint32_t line = BSS_CALLSITE_LINE) noexcept
     {
       //assert(debugEmplace());
+      LockStats::Wait w(_stats);
       while(l.fetch_add(ONE_READER, std::memory_order_acquire)&WFLAG) // Oppurtunistically acquire a read lock and check to see if the writer flag is set
       {
+        w.Spin();
         if(l.fetch_sub(ONE_READER, std::memory_order_release)&WFLAG) // If the writer flag is set, release our lock to let the writer through
-          while(l.load(std::memory_order_relaxed)&WFLAG); // Wait until the writer flag is no longer set before looping for another attempt
+          while(l.load(std::memory_order_relaxed)&WFLAG) w.Spin(); // Wait until the writer flag is no longer set before looping for another attempt
       }
+      w.Acquire(file, line);
     }
 
     // Attempt to acquire read lock, but abort if a writer has locked it.
-    BSS_FORCEINLINE bool AttemptRLock() noexcept
+    BSS_FORCEINLINE bool AttemptRLock(const char* file = BSS_CALLSITE_FILE, uint32_t line = BSS_CALLSITE_LINE) noexcept
     {
       if(l.fetch_add(ONE_READER, std::memory_order_acquire)&WFLAG) // Oppurtunistically acquire a read lock and check to see if the writer flag is set
       {
         l.fetch_sub(ONE_READER, std::memory_order_release);
+        LockStats::Fail(_stats);
         return false;
       }
 
       //assert(debugEmplace());
+      LockStats::Wait(_stats).Acquire(file, line);
       return true;
     }
     BSS_FORCEINLINE size_t RUnlock() noexcept
@@ -96,28 +112,36 @@ namespace bss {
     }
 
     // Upgrades a read lock to a write lock without releasing the read lock. You CANNOT release this write lock using Unlock(), you have to use Downgrade() followed by RUnlock().
-    BSS_FORCEINLINE void Upgrade() noexcept
+    BSS_FORCEINLINE void Upgrade(const char* file = BSS_CALLSITE_FILE, uint32_t line = BSS_CALLSITE_LINE) noexcept
     {
       //assert(debugCount() == 1);
       assert((l.load(std::memory_order_relaxed)&WMASK) > 0);
+      LockStats::Wait w(_stats);
       while(asmbts<size_t>((size_t*)&l, WBIT)) // Attempt to acquire the write lock
       {
+        w.Spin();
         RUnlock(); // if we fail, we MUST release our own read lock so the other writer can proceed.
-        while(l.load(std::memory_order_relaxed)&WFLAG); // Wait until the writer flag is no longer set before looping for another attempt
+        while(l.load(std::memory_order_relaxed)&WFLAG) w.Spin(); // Wait until the writer flag is no longer set before looping for another attempt
         l.fetch_add(ONE_READER, std::memory_order_acquire); // Acquire a read lock before our next upgrade attempt - if the attempt fails, we'll release this.
       }
-      while((l.load(std::memory_order_relaxed)&WMASK) > ONE_READER); // Only flush to a single read lock, which will be our own
+      while((l.load(std::memory_order_relaxed)&WMASK) > ONE_READER) w.Spin(); // Only flush to a single read lock, which will be our own
+      w.Acquire(file, line);
     }
 
     // Attempts to upgrade a read lock to a write lock, but aborts if an existing writer has already locked it.
-    BSS_FORCEINLINE bool AttemptUpgrade() noexcept
+    BSS_FORCEINLINE bool AttemptUpgrade(const char* file = BSS_CALLSITE_FILE, uint32_t line = BSS_CALLSITE_LINE) noexcept
     {
       assert((l.load(std::memory_order_relaxed)&WMASK) > 0);
       if(asmbts<size_t>((size_t*)&l, WBIT))
+      {
+        LockStats::Fail(_stats);
         return false;
+      }
 
       //assert(debugCount() == 1);
-      while((l.load(std::memory_order_relaxed)&WMASK) > ONE_READER); // Only flush to a single read lock, which will be our own
+      LockStats::Wait w(_stats);
+      while((l.load(std::memory_order_relaxed)&WMASK) > ONE_READER) w.Spin(); // Only flush to a single read lock, which will be our own
+      w.Acquire(file, line);
       return true;
     }
 
@@ -140,11 +164,15 @@ namespace bss {
     static const size_t ONE_READER = 1;
 
     bool IsFree() const { return !l.load(std::memory_order_relaxed); }
+    // Starts recording contention on this lock into stats, or stops if stats is null. Not thread-safe, so call it before sharing the lock.
+    inline void SetLockStats(LockStats* stats) { _stats = stats; }
+    inline LockStats* GetLockStats() const { return _stats; }
 
   protected:
 #pragma warning(push)
 #pragma warning(disable:4251)
     std::atomic<size_t> l;
+    LockStats* _stats;
 
 #ifdef BSS_DEBUG
     bool debugEmplace() { while(_debuglock.test_and_set(std::memory_order_acquire)); bool r = _debug.emplace(std::this_thread::get_id(), 0).second; _debuglock.clear(std::memory_order_release); return r; }
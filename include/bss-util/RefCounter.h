@@ -6,6 +6,7 @@
 
 #include "compiler.h"
 #include <assert.h>
+#include <atomic>
 
 namespace bss {
   // A reference counter class that is entirely inline
@@ -85,6 +86,221 @@ namespace bss {
   protected:
     T* _p;
   };
+
+  class RefCollector;
+
+  namespace internal {
+    // Common base of the thread-safe reference counters, which lets RefCollector batch their destruction.
+    class BSS_COMPILER_DLLEXPORT RefCounterBase
+    {
+      friend class bss::RefCollector;
+
+    public:
+      // Once the last reference is dropped, queue this object on collector instead of destroying it right away. Passing null undoes this.
+      inline void SetCollector(RefCollector* collector) noexcept { _collector = collector; }
+      inline RefCollector* GetCollector() const noexcept { return _collector; }
+
+    protected:
+      inline RefCounterBase() : _collector(0), _next(0) {}
+      inline RefCounterBase(const RefCounterBase& copy) : _collector(copy._collector), _next(0) {}
+      virtual ~RefCounterBase() {}
+      // Destroys this object - made a seperate virtual function so it is overridable to ensure it is deleted in the proper DLL
+      virtual void DestroyThis() { delete this; }
+      inline void _destroy();
+
+      inline RefCounterBase& operator=(const RefCounterBase& right) { return *this; }
+
+      RefCollector* _collector;
+      RefCounterBase* _next; // Links this object into a RefCollector or the merge queue of its owning thread
+    };
+
+    struct RefOwner
+    {
+      inline RefOwner() : queue(0) {}
+      std::atomic<RefCounterBase*> queue;
+    };
+    // Each thread's merge queue, whose address also identifies the thread
+    inline RefOwner* GetRefOwner() noexcept { static thread_local RefOwner owner; return &owner; }
+  }
+
+  // Collects thread-safe reference counted objects whose last reference was dropped, so they can be destroyed in a batch somewhere
+  // off the hot path, like once a frame. The thread that drops the last reference only pays for a push. Objects opt in by calling
+  // SetCollector(). Collect() can be called from any thread, and anything queued while it runs is picked up by the same call.
+  class BSS_COMPILER_DLLEXPORT RefCollector
+  {
+    friend class internal::RefCounterBase;
+    RefCollector(const RefCollector&) = delete;
+    RefCollector& operator=(const RefCollector&) = delete;
+
+  public:
+    inline RefCollector() : _head(0) {}
+    inline ~RefCollector() { Collect(); }
+    // Destroys every queued object and returns how many there were
+    inline size_t Collect()
+    {
+      size_t n = 0;
+      while(internal::RefCounterBase* p = _head.exchange(0, std::memory_order_acquire))
+      {
+        while(p)
+        {
+          internal::RefCounterBase* next = p->_next;
+          p->DestroyThis();
+          p = next;
+          ++n;
+        }
+      }
+      return n;
+    }
+    inline bool Empty() const { return !_head.load(std::memory_order_relaxed); }
+
+  protected:
+    inline void _push(internal::RefCounterBase* p)
+    {
+      internal::RefCounterBase* head = _head.load(std::memory_order_relaxed);
+      do
+      {
+        p->_next = head;
+      } while(!_head.compare_exchange_weak(head, p, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    std::atomic<internal::RefCounterBase*> _head;
+  };
+
+  inline void internal::RefCounterBase::_destroy()
+  {
+    if(_collector)
+      _collector->_push(this);
+    else
+      DestroyThis();
+  }
+
+  // Reference counter that can be grabbed and dropped from any thread. Drops release everything the dropping thread did to the object,
+  // and the thread that drops the last reference acquires all of it before destroying the object. Works with ref_ptr.
+  class BSS_COMPILER_DLLEXPORT AtomicRefCounter : public internal::RefCounterBase
+  {
+  public:
+    // Increments and returns the reference counter. Taking a new reference only needs an existing one, so there's nothing to order.
+    BSS_FORCEINLINE int Grab() noexcept { return _refs.fetch_add(1, std::memory_order_relaxed) + 1; }
+    BSS_FORCEINLINE int Grab(int num) noexcept { return _refs.fetch_add(num, std::memory_order_relaxed) + num; }
+    // Decrements the reference counter and destroys the object, or hands it to its collector, once it reaches 0.
+    BSS_FORCEINLINE int Drop()
+    {
+      int refs = _refs.fetch_sub(1, std::memory_order_release) - 1;
+      assert(refs >= 0);
+      if(refs > 0)
+        return refs;
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      _destroy();
+      return 0;
+    }
+    inline int Count() const noexcept { return _refs.load(std::memory_order_relaxed); }
+
+  protected:
+    inline AtomicRefCounter() : _refs(0) {}
+    inline AtomicRefCounter(const AtomicRefCounter& copy) : internal::RefCounterBase(copy), _refs(0) {}
+    inline AtomicRefCounter& operator=(const AtomicRefCounter& right) { return *this; } // This does not actually change the reference count
+
+    std::atomic<int> _refs;
+  };
+
+  // Biased reference counter, for objects that are mostly grabbed and dropped by the thread that created them. That thread counts its
+  // references with plain increments, and every other thread uses an atomic shared count, which can go negative when a reference made
+  // by the owner is dropped somewhere else. When the owner drops its last reference, it merges its count into the shared count and
+  // from then on the object behaves like an AtomicRefCounter. If another thread drops the shared count to zero or below before that,
+  // it queues the object on the owner, which merges it the next time it calls Merge(). The owning thread must therefore call Merge()
+  // regularly, like once a frame, and must outlive every object it created. Grab() and Drop() return only the caller's side of the count.
+  class BSS_COMPILER_DLLEXPORT BiasedRefCounter : public internal::RefCounterBase
+  {
+  public:
+    BSS_FORCEINLINE int Grab() noexcept { return Grab(1); }
+    BSS_FORCEINLINE int Grab(int num) noexcept
+    {
+      if(_owned())
+        return _local += num;
+      return (_shared.fetch_add(num * ONE, std::memory_order_relaxed) >> SHIFT) + num;
+    }
+    BSS_FORCEINLINE int Drop()
+    {
+      if(_owned())
+        return (--_local > 0) ? _local : _merge(false);
+
+      int32_t old = _shared.load(std::memory_order_relaxed);
+      int32_t val;
+      do
+      {
+        val = old - ONE;
+        if(!(old & MERGED) && (val >> SHIFT) <= 0) // The owner has to reconcile this with its own count
+          val |= QUEUED;
+      } while(!_shared.compare_exchange_weak(old, val, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+      if((val & QUEUED) && !(old & QUEUED))
+        _queue();
+      else if((val & (MERGED | QUEUED)) == MERGED && !(val >> SHIFT))
+        _destroy();
+      return val >> SHIFT;
+    }
+    // Merges every object on the calling thread's queue, destroying those with no references left, and returns how many there were.
+    static inline size_t Merge()
+    {
+      size_t n = 0;
+      internal::RefCounterBase* p = internal::GetRefOwner()->queue.exchange(0, std::memory_order_acquire);
+      while(p)
+      {
+        BiasedRefCounter* cur = static_cast<BiasedRefCounter*>(p);
+        p = cur->_next;
+        cur->_merge(true);
+        ++n;
+      }
+      return n;
+    }
+    // True if the calling thread owns this object and hasn't merged its count yet
+    BSS_FORCEINLINE bool IsBiased() const noexcept { return _owned(); }
+
+  protected:
+    static const int32_t MERGED = 1;
+    static const int32_t QUEUED = 2;
+    static const int SHIFT = 2;
+    static const int32_t ONE = (1 << SHIFT);
+
+    inline BiasedRefCounter() : _home(internal::GetRefOwner()), _merged(false), _local(0), _shared(0) {}
+    inline BiasedRefCounter(const BiasedRefCounter& copy) : internal::RefCounterBase(copy), _home(internal::GetRefOwner()), _merged(false), _local(0), _shared(0) {}
+    inline BiasedRefCounter& operator=(const BiasedRefCounter& right) { return *this; } // This does not actually change the reference count
+
+    BSS_FORCEINLINE bool _owned() const noexcept { return _home == internal::GetRefOwner() && !_merged; }
+    // Only called on the owning thread. Folds the local count into the shared count the first time, and takes the object off the queue
+    // if it was on it. Whoever sees the count at zero with nothing queued destroys the object.
+    inline int _merge(bool dequeue)
+    {
+      int32_t add = dequeue ? -QUEUED : 0;
+      if(!_merged)
+      {
+        add += _local * ONE + MERGED;
+        _merged = true;
+        _local = 0;
+      }
+      int32_t val = _shared.fetch_add(add, std::memory_order_acq_rel) + add;
+      if(!(val >> SHIFT) && !(val & QUEUED))
+      {
+        _destroy();
+        return 0;
+      }
+      return val >> SHIFT;
+    }
+    inline void _queue()
+    {
+      internal::RefCounterBase* head = _home->queue.load(std::memory_order_relaxed);
+      do
+      {
+        _next = head;
+      } while(!_home->queue.compare_exchange_weak(head, this, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    internal::RefOwner* const _home;
+    bool _merged; // Only touched by the owning thread, like _local
+    int _local;
+    std::atomic<int32_t> _shared; // Shared count shifted up by SHIFT, plus the MERGED and QUEUED flags
+  };
 }
 
 #endif
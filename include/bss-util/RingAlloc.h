@@ -29,13 +29,14 @@ namespace bss {
     };
 
   public:
-    RingAllocVoid(RingAllocVoid&& mov) : _gc(mov._gc), _lastsize(mov._lastsize), _list(mov._list)
+    RingAllocVoid(RingAllocVoid&& mov) : _gc(mov._gc), _lastsize(mov._lastsize), _list(mov._list), _bucketstats(mov._bucketstats)
     {
       _cur.store(mov._cur.load(std::memory_order_acquire), std::memory_order_release);
       mov._cur.store(0, std::memory_order_release);
       mov._list = 0;
+      _lock.SetLockStats(mov._lock.GetLockStats());
     }
-    explicit RingAllocVoid(size_t sz) : _lastsize(sz), _list(0)
+    explicit RingAllocVoid(size_t sz) : _lastsize(sz), _list(0), _bucketstats(0)
     {
       _gc.p = 0;
       _gc.tag = 0;
@@ -117,12 +118,24 @@ namespace bss {
       _lock.Unlock();
     }
 
+    // Records contention on the lock guarding the current bucket and on the per-bucket locks, which are all merged into one LockStats.
+    // Either can be null. Not thread-safe, so call it before sharing the allocator.
+    inline void SetLockStats(LockStats* stats, LockStats* buckets)
+    {
+      _lock.SetLockStats(stats);
+      _bucketstats = buckets;
+      for(Bucket* b = _list; b != 0; b = b->list.next)
+        b->lock.SetLockStats(buckets);
+    }
+
     RingAllocVoid& operator=(RingAllocVoid&& mov) noexcept
     {
       _clear();
       _gc = mov._gc;
       _lastsize = mov._lastsize;
       _list = mov._list;
+      _bucketstats = mov._bucketstats;
+      _lock.SetLockStats(mov._lock.GetLockStats());
       _cur.store(mov._cur.load(std::memory_order_acquire), std::memory_order_release);
       mov._cur.store(0, std::memory_order_release);
       mov._list = 0;
@@ -185,6 +198,7 @@ namespace bss {
         _lastsize = T_FBNEXT(_lastsize);
         hold = (Bucket*)calloc(1, sizeof(Bucket) + _lastsize);
         new (&hold->lock) RWLock();
+        hold->lock.SetLockStats(_bucketstats);
         hold->sz = _lastsize;
         AltLLAdd<Bucket, &_getBucket>(hold, _list);
 #ifdef BSS_DEBUG
@@ -245,6 +259,7 @@ namespace bss {
 #pragma warning(pop)
     size_t _lastsize; // Last size used for a bucket.
     Bucket* _list; // root of permanent list of all buckets.
+    LockStats* _bucketstats;
   };
 
   template<class T>
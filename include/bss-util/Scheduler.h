@@ -6,9 +6,13 @@
 
 #include "HighPrecisionTimer.h"
 #include "BinaryHeap.h"
+#include "Thread.h"
+#include <mutex>
+#include <limits>
 
 namespace bss {
   // Scheduler object that lets you schedule events that happen x milliseconds into the future. If the event returns a number greater than 0,it will be rescheduled. 
+  // Events can either be fired by polling Update(), or by calling Run(), which sleeps until the next event is due.
   template<typename F, typename ST = size_t, typename Alloc = StandardAllocator<std::pair<double, F>>> //std::function<double(void)>
   class BSS_COMPILER_DLLEXPORT Scheduler : protected HighPrecisionTimer, protected BinaryHeap<std::pair<double, F>, ST, CompTFirst<double, F, CompTInv<double>>, ARRAY_SAFE, Alloc>
   {
@@ -16,24 +20,69 @@ namespace bss {
   public:
     // Constructor
     template<bool U = std::is_void_v<typename Alloc::policy_type>, std::enable_if_t<!U, int> = 0>
-    inline explicit Scheduler(typename Alloc::policy_type* policy) : BASE(policy) {}
-    inline Scheduler() {}
-    inline Scheduler(const Scheduler& copy) : BASE(copy), HighPrecisionTimer(copy) {}
-    inline Scheduler(Scheduler&& mov) : BASE(std::move(mov)), HighPrecisionTimer(mov) {}
-    inline Scheduler(double t, const F& f) { Add(t, f); }
-    inline Scheduler(double t, F&& f) { Add(t, std::move(f)); }
+    inline explicit Scheduler(typename Alloc::policy_type* policy) : BASE(policy), _hasposted(false), _stop(false) {}
+    inline Scheduler() : _hasposted(false), _stop(false) {}
+    inline Scheduler(const Scheduler& copy) : BASE(copy), HighPrecisionTimer(copy), _hasposted(false), _stop(false) { _copyposted(copy); }
+    inline Scheduler(Scheduler&& mov) : BASE(std::move(mov)), HighPrecisionTimer(mov), _hasposted(false), _stop(false) { _moveposted(mov); }
+    inline Scheduler(double t, const F& f) : _hasposted(false), _stop(false) { Add(t, f); }
+    inline Scheduler(double t, F&& f) : _hasposted(false), _stop(false) { Add(t, std::move(f)); }
     inline ~Scheduler() {}
     // Gets number of events
     BSS_FORCEINLINE ST Length() const { return BASE::_length; }
     // Adds an event that will happen t milliseconds in the future, starting from the current time
     BSS_FORCEINLINE void Add(double t, const F& f) { BASE::Insert(std::pair<double, F>(t + _time, f)); }
     BSS_FORCEINLINE void Add(double t, F&& f) { BASE::Insert(std::pair<double, F>(t + _time, std::move(f))); }
+    // Adds an event from any thread. It will happen t milliseconds after the scheduler next updates, and wakes up Run() if it's sleeping.
+    inline void Post(double t, const F& f) { Post(t, F(f)); }
+    inline void Post(double t, F&& f)
+    {
+      {
+        std::lock_guard<std::mutex> lock(_postlock);
+        _posted.Add(std::pair<double, F>(t, std::move(f)));
+        _hasposted.store(true, std::memory_order_release);
+      }
+      _sleeper.Wake();
+    }
+    // Gets the number of milliseconds until the next event, as of the last update, or infinity if there are no events.
+    inline double NextEvent() const
+    {
+      if(!BASE::_length)
+        return std::numeric_limits<double>::infinity();
+      return bssmax(BASE::_array[0].first - _time, 0.0);
+    }
+    // Fires events until Stop() is called. Between events, the thread sleeps until the next one is due, or until Post() adds a new one.
+    inline void Run()
+    {
+      while(!_stop.load(std::memory_order_acquire))
+      {
+        uint32_t token = _sleeper.Prepare();
+        Update();
+        double next = NextEvent();
+        _sleeper.Sleep(token, (next == std::numeric_limits<double>::infinity()) ? Sleeper::FOREVER : (uint64_t)(next * 1000000.0));
+      }
+      _stop.store(false, std::memory_order_release);
+    }
+    // Makes Run() return after it finishes any events it's currently firing. Can be called from any thread.
+    inline void Stop()
+    {
+      _stop.store(true, std::memory_order_release);
+      _sleeper.Wake();
+    }
     // Updates the scheduler, setting off any events that need to be set off
     inline void Update()
     {
       HighPrecisionTimer::Update();
 
-      while(BASE::Peek().first <= _time)
+      if(_hasposted.load(std::memory_order_acquire))
+      {
+        std::lock_guard<std::mutex> lock(_postlock);
+        _hasposted.store(false, std::memory_order_relaxed);
+        for(auto& e : _posted)
+          Add(e.first, std::move(e.second));
+        _posted.Clear();
+      }
+
+      while(!BASE::Empty() && BASE::Peek().first <= _time)
       {
         double r = BASE::Peek().second();
 
@@ -43,6 +92,47 @@ namespace bss {
           BASE::Set(0, std::pair<double, F>(r + _time, BASE::Peek().second)); // This is why we don't use the actual priority queue data structure
       }
     }
+
+    inline Scheduler& operator=(const Scheduler& copy)
+    {
+      if(&copy == this)
+        return *this;
+      BASE::operator=(copy);
+      HighPrecisionTimer::operator=(copy);
+      _copyposted(copy);
+      return *this;
+    }
+    inline Scheduler& operator=(Scheduler&& mov)
+    {
+      if(&mov == this)
+        return *this;
+      BASE::operator=(std::move(mov));
+      HighPrecisionTimer::operator=(mov);
+      _moveposted(mov);
+      return *this;
+    }
+
+  protected:
+    // Events posted to the other scheduler that it hasn't picked up yet have to come along, or they'd never fire
+    inline void _copyposted(const Scheduler& copy)
+    {
+      std::scoped_lock<std::mutex, std::mutex> lock(_postlock, copy._postlock);
+      _posted = copy._posted;
+      _hasposted.store(!_posted.Empty(), std::memory_order_release);
+    }
+    inline void _moveposted(Scheduler& mov)
+    {
+      std::scoped_lock<std::mutex, std::mutex> lock(_postlock, mov._postlock);
+      _posted = std::move(mov._posted);
+      _hasposted.store(!_posted.Empty(), std::memory_order_release);
+      mov._hasposted.store(false, std::memory_order_relaxed);
+    }
+
+    DynArray<std::pair<double, F>, ST, ARRAY_SAFE> _posted;
+    mutable std::mutex _postlock;
+    std::atomic<bool> _hasposted;
+    std::atomic<bool> _stop;
+    Sleeper _sleeper;
   };
 }
 
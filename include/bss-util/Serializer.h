@@ -9,6 +9,7 @@
 #include <array>
 #include <vector>
 #include <type_traits>
+#include "PerfectHash.h"
 #include "Trie.h"
 #include "Variant.h"
 #include "BitField.h"
@@ -269,7 +270,7 @@ namespace bss {
     template<typename T, typename... Args>
     inline void EvaluateType(std::pair<const char*, Args&>... args)
     {
-      static Trie<uint16_t> trie(sizeof...(Args), (args.first)...);
+      static StaticPerfectHash<std::string_view, sizeof...(Args)> fields({ std::string_view(args.first)... });
 
       if(out) // Serializing
         (ActionBind<Args>::Serialize(*this, args.second, args.first), ...);
@@ -281,7 +282,7 @@ namespace bss {
         else
         {
           auto tmp = std::make_tuple<std::pair<const char*, Args&>...>(std::move(args)...);
-          Engine::template ParseMany(*this, [&](Serializer<Engine>& e, const char* id) { Serializer<Engine>::template FindParse<Args...>(e, id, trie, tmp); });
+          Engine::template ParseMany(*this, [&](Serializer<Engine>& e, const char* id) { Serializer<Engine>::template FindParse<Args...>(e, id, fields, tmp); });
         }
       }
     }
@@ -352,9 +353,9 @@ namespace bss {
         r_findparse<I - 1, Args...>(e, index, args);
     }*/
     template<typename... Args> // This function must be static due to some corner cases on certain parsers
-    inline static void FindParse(Serializer<Engine>& e, const char* key, const Trie<uint16_t>& trie, const std::tuple<std::pair<const char*, Args&>...>& args)
+    inline static void FindParse(Serializer<Engine>& e, const char* key, const StaticPerfectHash<std::string_view, sizeof...(Args)>& fields, const std::tuple<std::pair<const char*, Args&>...>& args)
     {
-      _findparse<sizeof...(Args)-1, Args...>::F(e, trie[key], args);
+      _findparse<sizeof...(Args)-1, Args...>::F(e, (uint16_t)fields.Find(key), args);
       //r_findparse<sizeof...(Args)-1, Args...>(e, trie[key], args);
     }
 
@@ -0,0 +1,444 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __SHARED_RING_H__BSS__
+#define __SHARED_RING_H__BSS__
+
+#include "bss_util.h"
+#include <atomic>
+#include <chrono>
+#include <limits.h>
+#include <string.h>
+#ifdef BSS_PLATFORM_WIN32
+#include "win32_includes.h"
+#include <string>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef BSS_PLATFORM_LINUX
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
+#include <thread>
+#endif
+#endif
+
+namespace bss {
+  // Ring buffer of variable-length messages that lives in a named shared memory segment, so separate processes can pass messages
+  // without copying them through the kernel. A producer reserves space, writes the message in place and commits it; the consumer
+  // peeks at it where it lies and releases it. Neither side makes a syscall unless the other is asleep: a consumer with nothing to
+  // read or a producer with no room can block on a futex (named events on Windows), and the other side only wakes it if it sees the
+  // waiting flag. Other POSIX platforms have no portable way to sleep on shared memory, so waiters there poll with a short sleep. If MULTIPRODUCER is true, any number of producers can reserve at once by racing on the head, and messages are
+  // delivered in the order they were reserved, once committed. There is only ever one consumer. Released space is zeroed, so a record
+  // header that hasn't been committed yet always reads as zero. Everything in the segment is placed with lock-free atomics, so all
+  // processes mapping the ring must be the same bitness.
+  template<bool MULTIPRODUCER = false>
+  class SharedRing
+  {
+    SharedRing(const SharedRing&) = delete;
+    SharedRing& operator=(const SharedRing&) = delete;
+
+  public:
+    static const uint64_t FOREVER = (uint64_t)~0;
+    static const uint32_t MAGIC = 0x474E5242; // "BRNG"
+    static const size_t ALIGN = 8; // Every record starts on this boundary
+
+    inline SharedRing() : _header(0), _data(0), _size(0), _mask(0), _cachedtail(0), _peeked(0) { _init(); }
+    inline ~SharedRing() { Close(); }
+    // Creates a new segment with room for capacity bytes of records, rounded up to a power of two. Fails if a segment with that name
+    // already exists, since it may still be in use; call Unlink() first to replace a stale one.
+    bool Create(const char* name, size_t capacity)
+    {
+      Close();
+      size_t c = 256;
+      while(c < capacity)
+        c <<= 1;
+      capacity = c;
+      if(!_map(name, sizeof(Header) + capacity, true))
+        return false;
+
+      Header* h = new(_header) Header();
+      h->mode = MULTIPRODUCER;
+      h->capacity = capacity;
+      _setup();
+      h->magic.store(MAGIC, std::memory_order_release);
+      return true;
+    }
+    // Opens a segment that another process created. Fails if it doesn't exist, hasn't been set up yet or was created with a different mode.
+    bool Open(const char* name)
+    {
+      Close();
+      if(!_map(name, 0, false))
+        return false;
+      if(_size < sizeof(Header) || _header->magic.load(std::memory_order_acquire) != MAGIC || _header->mode != MULTIPRODUCER ||
+        _header->capacity + sizeof(Header) > _size)
+      {
+        Close();
+        return false;
+      }
+      _setup();
+      return true;
+    }
+    void Close()
+    {
+      if(!_header)
+        return;
+#ifdef BSS_PLATFORM_WIN32
+      UnmapViewOfFile(_header);
+      CloseHandle(_mapping);
+      CloseHandle(_dataevent);
+      CloseHandle(_spacesem);
+#else
+      munmap(_header, _size);
+#endif
+      _header = 0;
+      _data = 0;
+      _size = 0;
+      _mask = 0;
+      _peeked = 0;
+      _init();
+    }
+    // Removes the segment's name. Processes that already have it mapped keep using it. On Windows the segment goes away by itself
+    // once every process closes it, so this does nothing.
+    static bool Unlink(const char* name)
+    {
+#ifdef BSS_PLATFORM_WIN32
+      return true;
+#else
+      return !shm_unlink(name);
+#endif
+    }
+
+    // Reserves room for a message of up to len bytes and returns where to write it, or NULL if the ring is full.
+    void* Reserve(size_t len)
+    {
+      assert(_header != 0 && len <= MaxMessage());
+      size_t need = _stride(len);
+      uint64_t head = _header->head.load(std::memory_order_relaxed);
+      size_t pad;
+      do
+      {
+        size_t off = (size_t)(head & _mask);
+        pad = (need > _mask + 1 - off) ? _mask + 1 - off : 0;
+        if(head + pad + need - _cachedtail > _mask + 1)
+        {
+          uint64_t tail = _header->tail.load(std::memory_order_acquire);
+          if constexpr(!MULTIPRODUCER) // With several producers sharing this object the cache would be a race, so they always reload
+            _cachedtail = tail;
+          if(head + pad + need - tail > _mask + 1)
+            return 0;
+        }
+        if constexpr(!MULTIPRODUCER)
+        {
+          _header->head.store(head + pad + need, std::memory_order_relaxed);
+          break;
+        }
+      } while(!_header->head.compare_exchange_weak(head, head + pad + need, std::memory_order_relaxed, std::memory_order_relaxed));
+
+      if(pad) // The message doesn't fit before the end, so we skip to the start with a padding record the consumer throws away.
+      {
+        Record* r = _record(head);
+        r->stride = (uint32_t)pad;
+        r->word.store(PADDING | COMMITTED, std::memory_order_release);
+        head += pad;
+      }
+      Record* r = _record(head);
+      r->stride = (uint32_t)need;
+      return r + 1;
+    }
+    // Same as Reserve(len), but if the ring is full, waits up to ns nanoseconds for the consumer to release enough room.
+    void* Reserve(size_t len, uint64_t ns)
+    {
+      void* p = Reserve(len);
+      if(p || !ns)
+        return p;
+      auto start = std::chrono::steady_clock::now();
+      for(;;)
+      {
+        uint32_t token = _header->spaceseq.load(std::memory_order_acquire);
+        _header->producerswaiting.fetch_add(1, std::memory_order_seq_cst);
+        if(!(p = Reserve(len)))
+        {
+          uint64_t elapsed = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+          if(ns != FOREVER && elapsed >= ns)
+          {
+            _header->producerswaiting.fetch_sub(1, std::memory_order_relaxed);
+            return 0;
+          }
+          _wait(_header->spaceseq, token, (ns == FOREVER) ? FOREVER : ns - elapsed, false);
+        }
+        _header->producerswaiting.fetch_sub(1, std::memory_order_relaxed);
+        if(p || (p = Reserve(len)))
+          return p;
+      }
+    }
+    // Publishes a message returned by Reserve(). len can be smaller than what was reserved, but not larger.
+    void Commit(void* p, size_t len)
+    {
+      Record* r = reinterpret_cast<Record*>(p) - 1;
+      assert(_stride(len) <= r->stride);
+      r->word.store((uint32_t)(len << 2) | COMMITTED, std::memory_order_release);
+      std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with the fence in Wait()
+      if(_header->consumerwaiting.load(std::memory_order_relaxed))
+      {
+        _header->dataseq.fetch_add(1, std::memory_order_release);
+        _wake(_header->dataseq, 1, false);
+      }
+    }
+    // Copies a message into the ring, waiting up to ns nanoseconds for room. Returns false if it timed out.
+    inline bool Push(const void* data, size_t len, uint64_t ns = 0)
+    {
+      void* p = Reserve(len, ns);
+      if(!p)
+        return false;
+      memcpy(p, data, len);
+      Commit(p, len);
+      return true;
+    }
+
+    // Returns the next committed message and sets len to its length, or returns NULL if there isn't one. The message stays in the ring
+    // until Release() is called. Only the consumer may call this.
+    const void* Peek(size_t& len)
+    {
+      assert(_header != 0);
+      for(;;)
+      {
+        uint64_t tail = _header->tail.load(std::memory_order_relaxed);
+        Record* r = _record(tail);
+        uint32_t word = r->word.load(std::memory_order_acquire);
+        if(!word)
+          return 0;
+        if(word & PADDING)
+        {
+          _release(tail, r->stride);
+          continue;
+        }
+        _peeked = r->stride;
+        len = word >> 2;
+        return r + 1;
+      }
+    }
+    // Frees the message returned by the last Peek().
+    inline void Release()
+    {
+      assert(_peeked != 0);
+      _release(_header->tail.load(std::memory_order_relaxed), _peeked);
+      _peeked = 0;
+    }
+    // Calls f(const void* data, size_t len) on up to max messages in order, then releases all of them at once. Returns how many
+    // messages were consumed.
+    template<class F>
+    size_t Consume(F&& f, size_t max = (size_t)~0)
+    {
+      assert(_header != 0 && !_peeked);
+      uint64_t tail = _header->tail.load(std::memory_order_relaxed);
+      uint64_t end = tail;
+      size_t n = 0;
+      while(n < max && end - tail <= _mask) // A full ring wraps back around to records we haven't released yet
+      {
+        Record* r = _record(end);
+        uint32_t word = r->word.load(std::memory_order_acquire);
+        if(!word)
+          break;
+        if(!(word & PADDING))
+        {
+          f((const void*)(r + 1), (size_t)(word >> 2));
+          ++n;
+        }
+        end += r->stride;
+      }
+      if(end != tail)
+        _release(tail, (size_t)(end - tail));
+      return n;
+    }
+    // Waits up to ns nanoseconds for a message to be committed. Returns true if one is ready. Only the consumer may call this.
+    bool Wait(uint64_t ns = FOREVER)
+    {
+      if(_ready())
+        return true;
+      auto start = std::chrono::steady_clock::now();
+      for(;;)
+      {
+        uint32_t token = _header->dataseq.load(std::memory_order_acquire);
+        _header->consumerwaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with the fence in Commit()
+        if(_ready())
+          break;
+        uint64_t elapsed = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if(ns != FOREVER && elapsed >= ns)
+          break;
+        _wait(_header->dataseq, token, (ns == FOREVER) ? FOREVER : ns - elapsed, true);
+      }
+      _header->consumerwaiting.store(0, std::memory_order_relaxed);
+      return _ready();
+    }
+
+    inline size_t Capacity() const { return _mask + 1; }
+    // The largest message that's guaranteed to fit, even when it has to wrap around.
+    inline size_t MaxMessage() const { return bssmin(((_mask + 1) / 2) - sizeof(Record), (size_t)(UINT32_MAX >> 2)); }
+    inline bool IsOpen() const { return _header != 0; }
+    // Bytes reserved but not yet released, including record headers and padding.
+    inline size_t Used() const { return (size_t)(_header->head.load(std::memory_order_acquire) - _header->tail.load(std::memory_order_acquire)); }
+
+  protected:
+    enum : uint32_t { COMMITTED = 1, PADDING = 2 };
+
+    struct Record
+    {
+      std::atomic<uint32_t> word; // Message length << 2 | flags, or 0 if it hasn't been committed yet
+      uint32_t stride; // Total bytes taken up by the record, including this header
+    };
+
+    struct Header
+    {
+      Header() : magic(0), mode(0), capacity(0), head(0), tail(0), dataseq(0), consumerwaiting(0), spaceseq(0), producerswaiting(0) {}
+
+      std::atomic<uint32_t> magic; // Set last, once everything else is initialized
+      uint32_t mode;
+      uint64_t capacity;
+      BSS_ALIGN(64) std::atomic<uint64_t> head; // Only written by producers
+      BSS_ALIGN(64) std::atomic<uint64_t> tail; // Only written by the consumer
+      BSS_ALIGN(64) std::atomic<uint32_t> dataseq; // Futex the consumer sleeps on, or polls on platforms without one
+      std::atomic<uint32_t> consumerwaiting;
+      BSS_ALIGN(64) std::atomic<uint32_t> spaceseq; // Futex producers sleep on, or poll
+      std::atomic<uint32_t> producerswaiting;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free, "Shared atomics must be lock-free");
+    static_assert(sizeof(Record) == ALIGN, "Record header must be exactly one alignment unit");
+
+    BSS_FORCEINLINE static size_t _stride(size_t len) { return (sizeof(Record) + len + ALIGN - 1) & ~(ALIGN - 1); }
+    BSS_FORCEINLINE Record* _record(uint64_t pos) const { return reinterpret_cast<Record*>(_data + (size_t)(pos & _mask)); }
+    BSS_FORCEINLINE bool _ready() const { return _record(_header->tail.load(std::memory_order_relaxed))->word.load(std::memory_order_acquire) != 0; }
+    inline void _release(uint64_t tail, size_t len)
+    {
+      // Records never wrap, so a span of them is contiguous unless it crosses the end of the ring.
+      size_t off = (size_t)(tail & _mask);
+      size_t first = bssmin(len, _mask + 1 - off);
+      memset(_data + off, 0, first);
+      if(first < len)
+        memset(_data, 0, len - first);
+      _header->tail.store(tail + len, std::memory_order_release);
+      std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with the increment of producerswaiting in Reserve()
+      if(_header->producerswaiting.load(std::memory_order_relaxed))
+      {
+        _header->spaceseq.fetch_add(1, std::memory_order_release);
+        _wake(_header->spaceseq, INT_MAX, true);
+      }
+    }
+    inline void _setup()
+    {
+      _data = reinterpret_cast<uint8_t*>(_header) + sizeof(Header);
+      _mask = (size_t)_header->capacity - 1;
+      _cachedtail = MULTIPRODUCER ? 0 : _header->tail.load(std::memory_order_acquire);
+    }
+
+#ifdef BSS_PLATFORM_WIN32
+    inline void _init() { _mapping = NULL; _dataevent = NULL; _spacesem = NULL; }
+    bool _map(const char* name, size_t size, bool create)
+    {
+      std::string n("Local\\");
+      n += name;
+      if(create)
+      {
+        _mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, n.c_str());
+        if(_mapping != NULL && GetLastError() == ERROR_ALREADY_EXISTS)
+        {
+          CloseHandle(_mapping);
+          _mapping = NULL;
+        }
+      }
+      else
+        _mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, n.c_str());
+      if(_mapping == NULL)
+        return false;
+      _header = reinterpret_cast<Header*>(MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+      MEMORY_BASIC_INFORMATION info;
+      if(!_header || !VirtualQuery(_header, &info, sizeof(info)))
+      {
+        if(_header)
+          UnmapViewOfFile(_header);
+        CloseHandle(_mapping);
+        _header = 0;
+        _init();
+        return false;
+      }
+      _size = create ? size : info.RegionSize;
+      _dataevent = CreateEventA(NULL, FALSE, FALSE, (n + ".data").c_str());
+      _spacesem = CreateSemaphoreA(NULL, 0, LONG_MAX, (n + ".space").c_str());
+      return true;
+    }
+    // Both events are only signaled when someone is waiting, so a stale signal just causes one spurious wakeup.
+    inline void _wait(std::atomic<uint32_t>& seq, uint32_t token, uint64_t ns, bool consumer)
+    {
+      if(seq.load(std::memory_order_acquire) == token)
+        WaitForSingleObject(consumer ? _dataevent : _spacesem, (ns == FOREVER) ? INFINITE : (DWORD)bssmax(ns / 1000000, (uint64_t)1));
+    }
+    inline void _wake(std::atomic<uint32_t>& seq, int count, bool producers)
+    {
+      if(producers)
+        ReleaseSemaphore(_spacesem, bssmin(count, (int)_header->producerswaiting.load(std::memory_order_relaxed)), NULL);
+      else
+        SetEvent(_dataevent);
+    }
+
+    HANDLE _mapping;
+    HANDLE _dataevent;
+    HANDLE _spacesem;
+#else
+    inline void _init() {}
+    bool _map(const char* name, size_t size, bool create)
+    {
+      int fd = shm_open(name, create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0600);
+      if(fd < 0)
+        return false;
+      struct stat st;
+      if((create && ftruncate(fd, (off_t)size) != 0) || (!create && fstat(fd, &st) != 0))
+      {
+        close(fd);
+        if(create)
+          shm_unlink(name);
+        return false;
+      }
+      if(!create)
+        size = (size_t)st.st_size;
+      void* p = !size ? MAP_FAILED : mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if(p == MAP_FAILED)
+        return false;
+      _header = reinterpret_cast<Header*>(p);
+      _size = size;
+      return true;
+    }
+#ifdef BSS_PLATFORM_LINUX
+    // The futexes live in a shared mapping, so these can't use the _PRIVATE variants.
+    inline void _wait(std::atomic<uint32_t>& seq, uint32_t token, uint64_t ns, bool)
+    {
+      struct timespec ts = { (time_t)(ns / 1000000000), (long)(ns % 1000000000) };
+      syscall(SYS_futex, &seq, FUTEX_WAIT, token, (ns == FOREVER) ? nullptr : &ts, nullptr, 0);
+    }
+    inline void _wake(std::atomic<uint32_t>& seq, int count, bool) { syscall(SYS_futex, &seq, FUTEX_WAKE, count, nullptr, nullptr, 0); }
+#else
+    // Callers already loop until the sequence changes or they time out, so a wait is just one short sleep and a wake does nothing
+    // beyond the sequence bump the caller made.
+    inline void _wait(std::atomic<uint32_t>& seq, uint32_t token, uint64_t ns, bool)
+    {
+      if(seq.load(std::memory_order_acquire) == token)
+        std::this_thread::sleep_for(std::chrono::nanoseconds(bssmin(ns, (uint64_t)100000)));
+    }
+    inline void _wake(std::atomic<uint32_t>&, int, bool) {}
+#endif
+#endif
+
+    Header* _header;
+    uint8_t* _data;
+    size_t _size;
+    size_t _mask;
+    uint64_t _cachedtail; // A single producer's last view of the tail, which only ever moves forward. Always 0 for MULTIPRODUCER.
+    size_t _peeked; // Stride of the record returned by the last Peek()
+  };
+}
+
+#endif
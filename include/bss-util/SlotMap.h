@@ -0,0 +1,298 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __SLOT_MAP_H__BSS__
+#define __SLOT_MAP_H__BSS__
+
+#include "DynArray.h"
+#include <atomic>
+#include <cstddef>
+
+namespace bss {
+  namespace internal {
+    template<typename ID>
+    struct SlotMapSlot
+    {
+      ID index; // Position in the dense array while occupied, or the next free slot (with the FREE bit set) while free
+      ID gen;
+    };
+    template<typename ID>
+    struct ConcurrentSlotMapSlot
+    {
+      std::atomic<ID> index;
+      ID gen;
+    };
+  }
+
+  // Stores values contiguously and hands out handles to them that can be checked for staleness. A handle packs a slot index into the
+  // low INDEXBITS bits and that slot's generation into the rest. Removing a value increments its slot's generation, so every handle to it
+  // becomes invalid, and moves the last value into the hole, so the values always form a dense array that can be iterated in memory order.
+  // A slot whose generation runs out is retired instead of reused, so a handle is never reissued. Handle 0 is never valid.
+  template<class T, typename ID = uint32_t, ARRAY_TYPE ArrayType = ARRAY_SIMPLE, typename Alloc = StandardAllocator<T>, int INDEXBITS = (sizeof(ID) > 4) ? 32 : 20>
+  class BSS_COMPILER_DLLEXPORT SlotMap
+  {
+  public:
+    static_assert(std::is_unsigned<ID>::value && sizeof(ID) >= 4, "ID must be a 32-bit or 64-bit unsigned integer");
+    static_assert(INDEXBITS > 0 && INDEXBITS < (int)(sizeof(ID) << 3) - 1, "INDEXBITS must leave room for the generation");
+    typedef internal::SlotMapSlot<ID> SLOT;
+    typedef T value_type;
+    static constexpr ID INDEX_MASK = (ID(1) << INDEXBITS) - 1;
+    static constexpr ID GEN_MAX = ID(~ID(0)) >> INDEXBITS;
+    static constexpr ID NIL = INDEX_MASK; // Also the maximum number of slots
+    static constexpr ID FREE = ID(1) << ((sizeof(ID) << 3) - 1);
+
+    inline SlotMap() : _freelist(NIL) {}
+    inline explicit SlotMap(ID capacity) : _values(capacity), _owners(capacity), _slots(capacity), _freelist(NIL) {}
+    template<bool U = std::is_void_v<typename Alloc::policy_type>, std::enable_if_t<!U, int> = 0>
+    inline SlotMap(ID capacity, typename Alloc::policy_type* policy) : _values(capacity, policy), _owners(capacity), _slots(capacity), _freelist(NIL) {}
+    inline SlotMap(const SlotMap& copy) = default;
+    inline SlotMap(SlotMap&& mov) : _values(std::move(mov._values)), _owners(std::move(mov._owners)), _slots(std::move(mov._slots)), _freelist(mov._freelist) { mov._freelist = NIL; }
+    inline ~SlotMap() {}
+    BSS_FORCEINLINE ID Insert(const T& item) { return Emplace(item); }
+    BSS_FORCEINLINE ID Insert(T&& item) { return Emplace(std::move(item)); }
+    // Constructs a new value at the end of the dense array and returns its handle, or 0 if every slot is in use or retired.
+    template<typename... Args>
+    inline ID Emplace(Args&&... args)
+    {
+      ID s = _freelist;
+      if(s != NIL)
+        _freelist = _slots[s].index & ~FREE;
+      else if(_slots.Length() < NIL)
+        s = _slots.Add(SLOT{ 0, 1 });
+      else
+        return 0;
+      _slots[s].index = _values.AddConstruct(std::forward<Args>(args)...);
+      _owners.Add(s);
+      return (_slots[s].gen << INDEXBITS) | s;
+    }
+    // Removes a value by moving the last value into its place, which invalidates that value's pointers but not its handle.
+    inline bool Remove(ID id)
+    {
+      ID s = _slot(id);
+      if(s == NIL)
+        return false;
+      ID i = _slots[s].index;
+      ID last = _values.Length() - 1;
+      if(i != last)
+      {
+        _values[i] = std::move(_values[last]);
+        _owners[i] = _owners[last];
+        _slots[_owners[i]].index = i;
+      }
+      _values.RemoveLast();
+      _owners.RemoveLast();
+      _free(s);
+      return true;
+    }
+    inline void Clear()
+    {
+      for(ID i = 0; i < _owners.Length(); ++i)
+        _free(_owners[i]);
+      _values.Clear();
+      _owners.Clear();
+    }
+    BSS_FORCEINLINE bool Exists(ID id) const { return _slot(id) != NIL; }
+    // Returns a pointer to the value, or null if the handle is stale
+    BSS_FORCEINLINE T* Get(ID id) { ID s = _slot(id); return (s != NIL) ? (_values.begin() + _slots[s].index) : nullptr; }
+    BSS_FORCEINLINE const T* Get(ID id) const { ID s = _slot(id); return (s != NIL) ? (_values.begin() + _slots[s].index) : nullptr; }
+    // Returns the position of the value in the dense array, or NIL if the handle is stale
+    BSS_FORCEINLINE ID IndexOf(ID id) const { ID s = _slot(id); return (s != NIL) ? _slots[s].index : NIL; }
+    // Returns the handle of the value at a position in the dense array
+    BSS_FORCEINLINE ID GetID(ID index) const { ID s = _owners[index]; return (_slots[s].gen << INDEXBITS) | s; }
+    BSS_FORCEINLINE ID Length() const { return _values.Length(); }
+    BSS_FORCEINLINE ID Capacity() const { return _values.Capacity(); }
+    BSS_FORCEINLINE bool Empty() const { return _values.Empty(); }
+    inline void Reserve(ID capacity)
+    {
+      _values.SetCapacity(capacity);
+      _owners.SetCapacity(capacity);
+      _slots.SetCapacity(capacity);
+    }
+    BSS_FORCEINLINE const T* begin() const noexcept { return _values.begin(); }
+    BSS_FORCEINLINE const T* end() const noexcept { return _values.end(); }
+    BSS_FORCEINLINE T* begin() noexcept { return _values.begin(); }
+    BSS_FORCEINLINE T* end() noexcept { return _values.end(); }
+    BSS_FORCEINLINE Slice<T, ID> GetSlice() const noexcept { return _values.GetSlice(); }
+    BSS_FORCEINLINE T& operator[](ID id) { assert(Exists(id)); return _values[_slots[id & INDEX_MASK].index]; }
+    BSS_FORCEINLINE const T& operator[](ID id) const { assert(Exists(id)); return _values[_slots[id & INDEX_MASK].index]; }
+
+    inline SlotMap& operator=(const SlotMap& copy) = default;
+    inline SlotMap& operator=(SlotMap&& mov)
+    {
+      _values = std::move(mov._values);
+      _owners = std::move(mov._owners);
+      _slots = std::move(mov._slots);
+      _freelist = mov._freelist;
+      mov._freelist = NIL;
+      return *this;
+    }
+
+  protected:
+    BSS_FORCEINLINE ID _slot(ID id) const
+    {
+      ID s = id & INDEX_MASK;
+      return (s < _slots.Length() && _slots[s].gen == (id >> INDEXBITS) && !(_slots[s].index & FREE)) ? s : NIL;
+    }
+    inline void _free(ID s)
+    {
+      if(_slots[s].gen == GEN_MAX) // Retire the slot by leaving it off the freelist
+        _slots[s].index = FREE | NIL;
+      else
+      {
+        ++_slots[s].gen;
+        _slots[s].index = FREE | _freelist;
+        _freelist = s;
+      }
+    }
+
+    DynArray<T, ID, ArrayType, Alloc> _values;
+    DynArray<ID, ID> _owners; // Slot that owns each value
+    DynArray<SLOT, ID> _slots;
+    ID _freelist;
+  };
+
+  // SlotMap with a fixed capacity that lets any number of threads call Insert(), Emplace(), Get() and Exists() at the same time.
+  // Remove(), Clear() and iteration need exclusive access, so they should happen at a sync point (like the end of a frame) where no
+  // other thread is touching the map. Because nothing is freed while inserts are running, inserting threads can pop slots off the
+  // freelist with a plain CAS without any ABA problem, and every slot they get is guaranteed a place in the dense array.
+  template<class T, typename ID = uint32_t, typename Alloc = StandardAllocator<char>, int INDEXBITS = (sizeof(ID) > 4) ? 32 : 20>
+  class BSS_COMPILER_DLLEXPORT ConcurrentSlotMap : protected Alloc
+  {
+    ConcurrentSlotMap(const ConcurrentSlotMap&) = delete;
+    ConcurrentSlotMap& operator=(const ConcurrentSlotMap&) = delete;
+
+  public:
+    static_assert(std::is_unsigned<ID>::value && sizeof(ID) >= 4, "ID must be a 32-bit or 64-bit unsigned integer");
+    static_assert(INDEXBITS > 0 && INDEXBITS < (int)(sizeof(ID) << 3) - 1, "INDEXBITS must leave room for the generation");
+    static_assert(alignof(T) <= alignof(std::max_align_t), "ConcurrentSlotMap can't overalign values");
+    typedef internal::ConcurrentSlotMapSlot<ID> SLOT;
+    typedef T value_type;
+    static constexpr ID INDEX_MASK = (ID(1) << INDEXBITS) - 1;
+    static constexpr ID GEN_MAX = ID(~ID(0)) >> INDEXBITS;
+    static constexpr ID NIL = INDEX_MASK;
+    static constexpr ID FREE = ID(1) << ((sizeof(ID) << 3) - 1);
+
+    template<bool U = std::is_void_v<typename Alloc::policy_type>, std::enable_if_t<!U, int> = 0>
+    inline ConcurrentSlotMap(ID capacity, typename Alloc::policy_type* policy) : Alloc(policy) { _init(capacity); }
+    inline explicit ConcurrentSlotMap(ID capacity) { _init(capacity); }
+    inline ~ConcurrentSlotMap()
+    {
+      Clear();
+      Alloc::deallocate(reinterpret_cast<char*>(_slots), _bytes(_capacity));
+    }
+    BSS_FORCEINLINE ID Insert(const T& item) { return Emplace(item); }
+    BSS_FORCEINLINE ID Insert(T&& item) { return Emplace(std::move(item)); }
+    // Constructs a new value and returns its handle, or 0 if the map is full. Safe to call from any number of threads.
+    template<typename... Args>
+    inline ID Emplace(Args&&... args)
+    {
+      ID s = _freelist.load(std::memory_order_acquire);
+      while(s != NIL && !_freelist.compare_exchange_weak(s, _slots[s].index.load(std::memory_order_relaxed) & ~FREE, std::memory_order_acquire, std::memory_order_acquire));
+      if(s == NIL)
+      {
+        if(_fresh.load(std::memory_order_relaxed) >= _capacity) // Checked first so failed inserts can't overflow _fresh
+          return 0;
+        s = _fresh.fetch_add(1, std::memory_order_relaxed);
+        if(s >= _capacity)
+          return 0;
+      }
+      ID i = _length.fetch_add(1, std::memory_order_relaxed);
+      assert(i < _capacity);
+      new(_values + i) T(std::forward<Args>(args)...);
+      _owners[i] = s;
+      _slots[s].index.store(i, std::memory_order_release);
+      return (_slots[s].gen << INDEXBITS) | s;
+    }
+    // Removes a value by moving the last value into its place. Requires exclusive access.
+    inline bool Remove(ID id)
+    {
+      ID s = _slot(id);
+      if(s == NIL)
+        return false;
+      ID i = _slots[s].index.load(std::memory_order_relaxed);
+      ID last = _length.load(std::memory_order_relaxed) - 1;
+      if(i != last)
+      {
+        _values[i] = std::move(_values[last]);
+        _owners[i] = _owners[last];
+        _slots[_owners[i]].index.store(i, std::memory_order_relaxed);
+      }
+      _values[last].~T();
+      _length.store(last, std::memory_order_relaxed);
+      _free(s);
+      return true;
+    }
+    // Requires exclusive access
+    inline void Clear()
+    {
+      ID n = _length.load(std::memory_order_relaxed);
+      for(ID i = 0; i < n; ++i)
+      {
+        _values[i].~T();
+        _free(_owners[i]);
+      }
+      _length.store(0, std::memory_order_relaxed);
+    }
+    BSS_FORCEINLINE bool Exists(ID id) const { return _slot(id) != NIL; }
+    // Returns a pointer to the value, or null if the handle is stale. Safe to call while other threads are inserting.
+    BSS_FORCEINLINE T* Get(ID id) const { ID s = _slot(id); return (s != NIL) ? (_values + (_slots[s].index.load(std::memory_order_relaxed) & ~FREE)) : nullptr; }
+    BSS_FORCEINLINE ID GetID(ID index) const { ID s = _owners[index]; return (_slots[s].gen << INDEXBITS) | s; }
+    BSS_FORCEINLINE ID Length() const { return _length.load(std::memory_order_acquire); }
+    BSS_FORCEINLINE ID Capacity() const { return _capacity; }
+    // Iteration requires exclusive access, because values can be half-constructed while other threads are inserting
+    BSS_FORCEINLINE T* begin() const noexcept { return _values; }
+    BSS_FORCEINLINE T* end() const noexcept { return _values + _length.load(std::memory_order_relaxed); }
+    BSS_FORCEINLINE T& operator[](ID id) const { assert(Exists(id)); return _values[_slots[id & INDEX_MASK].index.load(std::memory_order_relaxed)]; }
+
+  protected:
+    static BSS_FORCEINLINE size_t _valueOffset(ID capacity) { return AlignSize((sizeof(SLOT) + sizeof(ID)) * capacity, alignof(T)); }
+    static BSS_FORCEINLINE size_t _bytes(ID capacity) { return _valueOffset(capacity) + sizeof(T) * capacity; }
+    inline void _init(ID capacity)
+    {
+      assert(capacity > 0 && capacity <= NIL);
+      _capacity = capacity;
+      char* p = Alloc::allocate(_bytes(capacity));
+      _slots = reinterpret_cast<SLOT*>(p);
+      _owners = reinterpret_cast<ID*>(p + sizeof(SLOT) * capacity);
+      _values = reinterpret_cast<T*>(p + _valueOffset(capacity));
+      for(ID i = 0; i < capacity; ++i)
+      {
+        new(_slots + i) SLOT();
+        _slots[i].index.store(FREE | NIL, std::memory_order_relaxed);
+        _slots[i].gen = 1;
+      }
+      _freelist.store(NIL, std::memory_order_relaxed);
+      _fresh.store(0, std::memory_order_relaxed);
+      _length.store(0, std::memory_order_release);
+    }
+    BSS_FORCEINLINE ID _slot(ID id) const
+    {
+      ID s = id & INDEX_MASK;
+      return (s < _capacity && _slots[s].gen == (id >> INDEXBITS) && !(_slots[s].index.load(std::memory_order_acquire) & FREE)) ? s : NIL;
+    }
+    inline void _free(ID s)
+    {
+      if(_slots[s].gen == GEN_MAX)
+        _slots[s].index.store(FREE | NIL, std::memory_order_relaxed);
+      else
+      {
+        ++_slots[s].gen;
+        _slots[s].index.store(FREE | _freelist.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        _freelist.store(s, std::memory_order_release);
+      }
+    }
+
+    SLOT* _slots;
+    ID* _owners;
+    T* _values;
+    ID _capacity;
+#pragma warning(push)
+#pragma warning(disable:4251)
+    std::atomic<ID> _freelist;
+    std::atomic<ID> _fresh; // Number of slots that have ever been handed out, up to _capacity
+    std::atomic<ID> _length;
+#pragma warning(pop)
+  };
+}
+
+#endif
@@ -0,0 +1,274 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __STATICMAP_H__BSS__
+#define __STATICMAP_H__BSS__
+
+#include "algo.h"
+#include <initializer_list>
+#include <memory>
+
+namespace bss {
+  namespace internal {
+    // Where StaticMap puts its keys. Slots are positions in the key array, and every layout has one slot value that means nothing
+    // was found. This one is the Eytzinger layout, which works with any comparison.
+    template<class Key, char(*CFunc)(const Key&, const Key&), typename CType, bool KARY = UseKeyCount<Key, CFunc>>
+    struct StaticLayout
+    {
+      BSS_FORCEINLINE static CType Size(CType n) { return n + 1; }
+      BSS_FORCEINLINE static CType Invalid(CType) { return 0; }
+      template<class T>
+      BSS_FORCEINLINE static void Layout(const T* sorted, T* out, CType n) { EytzingerLayout<T, CType>(sorted, out, n); }
+      BSS_FORCEINLINE static CType Lower(const Key* keys, CType n, const Key& key) { return EytzingerSearch<Key, Key, CType, CFunc>(keys, n, key); }
+      inline static CType First(CType n)
+      {
+        CType k = !n ? 0 : 1;
+        while(k && k * 2 <= n)
+          k *= 2;
+        return k;
+      }
+      inline static CType Next(CType k, CType n)
+      {
+        if(k * 2 + 1 <= n) // Leftmost element of the right subtree
+        {
+          k = k * 2 + 1;
+          while(k * 2 <= n)
+            k *= 2;
+          return k;
+        }
+        while(k & 1) // Go up until we come from a left child
+          k >>= 1;
+        return k >> 1;
+      }
+    };
+
+    // The k-ary layout, for arithmetic keys using the default comparison, which compares a whole node at once with SSE.
+    template<class Key, char(*CFunc)(const Key&, const Key&), typename CType>
+    struct StaticLayout<Key, CFunc, CType, true>
+    {
+      static constexpr CType B = (CType)KaryBlock<Key>;
+
+      BSS_FORCEINLINE static CType Size(CType n) { return KaryLength<Key, CType>(n); }
+      BSS_FORCEINLINE static CType Invalid(CType n) { return Size(n); }
+      template<class T>
+      BSS_FORCEINLINE static void Layout(const T* sorted, T* out, CType n) { KaryLayout<T, CType, B>(sorted, out, n); }
+      BSS_FORCEINLINE static CType Lower(const Key* keys, CType n, const Key& key) { return KarySearch<Key, CType>(keys, n, key); }
+      inline static CType First(CType n)
+      {
+        CType blocks = Size(n) / B;
+        if(!blocks)
+          return Invalid(n);
+        CType k = 0;
+        while(k * (B + 1) + 1 < blocks)
+          k = k * (B + 1) + 1;
+        return k * B;
+      }
+      inline static CType Next(CType slot, CType n)
+      {
+        CType blocks = Size(n) / B;
+        CType k = slot / B;
+        CType j = slot % B;
+        CType c = k * (B + 1) + j + 2; // Child to the right of key j
+        if(c < blocks)
+        {
+          while(c * (B + 1) + 1 < blocks)
+            c = c * (B + 1) + 1;
+          return c * B;
+        }
+        if(j + 1 < B)
+          return slot + 1;
+        while(k > 0) // Go up until there's a key to the right of the child we came from
+        {
+          c = (k - 1) % (B + 1);
+          k = (k - 1) / (B + 1);
+          if(c < B)
+            return k * B + c;
+        }
+        return Invalid(n);
+      }
+    };
+  }
+
+  // Read-only sorted map (or set, if Data is void) that's built once and then only searched, for lookup tables. Instead of sorting
+  // the keys into a flat array, it stores them in an order that's faster to search: arithmetic keys using the default comparison go
+  // into a k-ary layout with one cache line per node, which is searched with SSE, and everything else goes into an Eytzinger layout
+  // with prefetching (see algo.h). The values are stored in the same order as the keys. Iterating goes through the elements in
+  // sorted order, but costs a bit more than walking an array.
+  template<class Key, class Data = void, char(*CFunc)(const Key&, const Key&) = CompT<Key>, typename CType = size_t>
+  class BSS_COMPILER_DLLEXPORT StaticMap
+  {
+  public:
+    static constexpr bool IsMap = !std::is_void<Data>::value;
+    typedef std::conditional_t<IsMap, Data, Key> KeyGet;
+
+  protected:
+    typedef std::conditional_t<IsMap, Data, char> DataField;
+    typedef internal::StaticLayout<Key, CFunc, CType> LAYOUT;
+    // Rounds the key array up to a whole number of cache lines
+    static constexpr CType LINE = (CType)(64 / bssmin(sizeof(Key) & (~sizeof(Key) + 1), 64));
+
+    class BSS_TEMPLATE_DLLEXPORT StaticMapIter
+    {
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef std::conditional_t<IsMap, std::pair<const Key&, const DataField&>, const Key&> reference;
+      typedef std::remove_reference_t<reference> value_type;
+      typedef ptrdiff_t difference_type;
+      typedef value_type* pointer;
+
+      inline StaticMapIter(const StaticMap* map, CType slot) : _map(map), _slot(slot) {}
+      inline reference operator*() const
+      {
+        if constexpr(IsMap)
+          return reference(_map->_keys[_slot], _map->_data[_slot]);
+        else
+          return _map->_keys[_slot];
+      }
+      inline StaticMapIter& operator++()
+      {
+        _slot = (_slot == _map->_last) ? LAYOUT::Invalid(_map->_length) : LAYOUT::Next(_slot, _map->_length);
+        return *this;
+      }
+      inline StaticMapIter operator++(int) { StaticMapIter r(*this); ++*this; return r; }
+      inline bool operator==(const StaticMapIter& r) const { return _slot == r._slot; }
+      inline bool operator!=(const StaticMapIter& r) const { return _slot != r._slot; }
+      inline const Key& GetKey() const { return _map->_keys[_slot]; }
+
+    protected:
+      const StaticMap* _map;
+      CType _slot;
+    };
+
+  public:
+    typedef StaticMapIter const_iterator;
+
+    inline StaticMap() : _length(0), _last(LAYOUT::Invalid(0)) {}
+    inline StaticMap(const StaticMap& copy) = default;
+    inline StaticMap(StaticMap&& mov) : _keys(std::move(mov._keys)), _data(std::move(mov._data)), _length(mov._length), _last(mov._last)
+    {
+      mov._length = 0;
+      mov._last = LAYOUT::Invalid(0);
+    }
+    template<bool U = IsMap, std::enable_if_t<U, int> = 0>
+    inline StaticMap(const Key* keys, const DataField* data, CType n) : _length(0), _last(LAYOUT::Invalid(0)) { Build(keys, data, n); }
+    template<bool U = IsMap, std::enable_if_t<!U, int> = 0>
+    inline StaticMap(const Key* keys, CType n) : _length(0), _last(LAYOUT::Invalid(0)) { Build(keys, n); }
+    template<bool U = IsMap, std::enable_if_t<U, int> = 0>
+    inline StaticMap(std::initializer_list<std::pair<Key, DataField>> list) : _length(0), _last(LAYOUT::Invalid(0))
+    {
+      std::unique_ptr<Key[]> keys(new Key[list.size()]);
+      std::unique_ptr<DataField[]> data(new DataField[list.size()]);
+      CType n = 0;
+      for(auto& e : list)
+      {
+        keys[n] = e.first;
+        data[n++] = e.second;
+      }
+      Build(keys.get(), data.get(), n);
+    }
+    template<bool U = IsMap, std::enable_if_t<!U, int> = 0>
+    inline StaticMap(std::initializer_list<Key> list) : _length(0), _last(LAYOUT::Invalid(0)) { Build(list.begin(), (CType)list.size()); }
+    // Builds the map from n keys and their values, which don't have to be sorted. Returns false and leaves the map empty if a key
+    // shows up more than once.
+    template<bool U = IsMap, std::enable_if_t<U, int> = 0>
+    inline bool Build(const Key* keys, const DataField* data, CType n) { return _build(keys, data, n); }
+    template<bool U = IsMap, std::enable_if_t<!U, int> = 0>
+    inline bool Build(const Key* keys, CType n) { return _build(keys, (const DataField*)0, n); }
+    inline void Clear()
+    {
+      _keys.Clear();
+      _data.Clear();
+      _length = 0;
+      _last = LAYOUT::Invalid(0);
+    }
+    inline KeyGet Get(const Key& key, const KeyGet& INVALID) const
+    {
+      const KeyGet* r = GetRef(key);
+      return !r ? INVALID : *r;
+    }
+    inline const KeyGet* GetRef(const Key& key) const
+    {
+      CType slot = _find(key);
+      if(slot == LAYOUT::Invalid(_length))
+        return 0;
+      if constexpr(IsMap)
+        return &_data[slot];
+      else
+        return &_keys[slot];
+    }
+    BSS_FORCEINLINE bool Exists(const Key& key) const { return _find(key) != LAYOUT::Invalid(_length); }
+    inline const_iterator Find(const Key& key) const { return const_iterator(this, _find(key)); }
+    // Returns the first element that isn't less than key
+    inline const_iterator LowerBound(const Key& key) const { return const_iterator(this, !_length ? LAYOUT::Invalid(0) : LAYOUT::Lower(_keys, _length, key)); }
+    inline const_iterator begin() const { return const_iterator(this, LAYOUT::First(_length)); }
+    inline const_iterator end() const { return const_iterator(this, LAYOUT::Invalid(_length)); }
+    inline const Key& Front() const { assert(_length > 0); return _keys[LAYOUT::First(_length)]; }
+    inline const Key& Back() const { assert(_length > 0); return _keys[_last]; }
+    inline CType Length() const { return _length; }
+    inline bool Empty() const { return !_length; }
+    // Keys in the order they're stored, which isn't sorted
+    inline const Key* Keys() const { return _keys; }
+
+    inline StaticMap& operator=(const StaticMap& copy) = default;
+    inline StaticMap& operator=(StaticMap&& mov)
+    {
+      _keys = std::move(mov._keys);
+      _data = std::move(mov._data);
+      _length = mov._length;
+      _last = mov._last;
+      mov._length = 0;
+      mov._last = LAYOUT::Invalid(0);
+      return *this;
+    }
+
+  protected:
+    BSS_FORCEINLINE CType _find(const Key& key) const
+    {
+      if(!_length)
+        return LAYOUT::Invalid(0);
+      CType slot = LAYOUT::Lower(_keys, _length, key);
+      return (slot != LAYOUT::Invalid(_length) && !CFunc(key, _keys[slot])) ? slot : LAYOUT::Invalid(_length);
+    }
+    inline bool _build(const Key* keys, const DataField* data, CType n)
+    {
+      Clear();
+      if(!n)
+        return true;
+
+      // Sort indices instead of the keys, then lay the indices out so we know where each key and value goes.
+      std::unique_ptr<CType[]> order(new CType[n]);
+      for(CType i = 0; i < n; ++i)
+        order[i] = i;
+      std::sort(order.get(), order.get() + n, [keys](CType l, CType r) { return CFunc(keys[l], keys[r]) < 0; });
+      for(CType i = 1; i < n; ++i)
+        if(!CFunc(keys[order[i - 1]], keys[order[i]]))
+          return false;
+
+      CType size = LAYOUT::Size(n);
+      std::unique_ptr<CType[]> slots(new CType[size]);
+      for(CType i = 0; i < size; ++i)
+        slots[i] = order[n - 1]; // The k-ary layout pads with the largest key
+      LAYOUT::Layout(order.get(), slots.get(), n);
+
+      _keys.SetCapacityDiscard(((size + LINE - 1) / LINE) * LINE);
+      if constexpr(IsMap)
+        _data.SetCapacityDiscard(size);
+      for(CType i = LAYOUT::Invalid(n) == 0 ? 1 : 0; i < size; ++i)
+      {
+        _keys[i] = keys[slots[i]];
+        if constexpr(IsMap)
+          _data[i] = data[slots[i]];
+      }
+      _length = n;
+      _last = _find(keys[order[n - 1]]);
+      return true;
+    }
+
+    Array<Key, CType, ARRAY_SAFE, StandardAllocator<Key, 64>> _keys;
+    Array<DataField, CType, ARRAY_SAFE> _data;
+    CType _length;
+    CType _last; // Slot of the largest key, so iteration knows where to stop
+  };
+}
+
+#endif
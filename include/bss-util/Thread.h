@@ -13,9 +13,23 @@
 #else // Assume BSS_PLATFORM_POSIX
 #include <pthread.h>
 #include <semaphore.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef BSS_PLATFORM_LINUX
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#endif
 #endif
+#include <atomic>
 
 namespace bss {
+  enum THREAD_PRIORITY : int8_t { PRIORITY_IDLE = -3, PRIORITY_LOWEST = -2, PRIORITY_LOW = -1, PRIORITY_NORMAL = 0, PRIORITY_HIGH = 1, PRIORITY_HIGHEST = 2, PRIORITY_REALTIME = 3 };
+
 #pragma warning(push)
 #pragma warning(disable:4275)
   // Cross-platform implementation of a semaphore, initialized to 0 (locked).
@@ -54,6 +68,95 @@ namespace bss {
     sem_t _sem;
 #endif
   };
+  // Lets one thread sleep for a precise amount of time while other threads can wake it up early. Call Prepare() before checking for
+  // work and pass the token it returns to Sleep(), so that a Wake() that happens in between isn't lost.
+  class Sleeper
+  {
+    Sleeper(const Sleeper&) = delete;
+    Sleeper& operator=(const Sleeper&) = delete;
+
+  public:
+    static const uint64_t FOREVER = (uint64_t)~0;
+
+#ifdef BSS_PLATFORM_WIN32
+    inline Sleeper() : _seq(0), _event(CreateEvent(NULL, FALSE, FALSE, NULL)),
+      _timer(CreateWaitableTimerExW(NULL, NULL, 0x00000002, TIMER_ALL_ACCESS)) // CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+    {
+      if(_timer == NULL) // High resolution timers require Windows 10 1803
+        _timer = CreateWaitableTimer(NULL, TRUE, NULL);
+    }
+    inline ~Sleeper() { CloseHandle(_event); CloseHandle(_timer); }
+    // Sleeps for up to ns nanoseconds, or until Wake() is called. Returns true if Wake() was called after Prepare() returned token.
+    inline bool Sleep(uint32_t token, uint64_t ns)
+    {
+      if(_seq.load(std::memory_order_acquire) != token)
+        return true;
+      if(ns == FOREVER)
+        WaitForSingleObject(_event, INFINITE);
+      else
+      {
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)(ns / 100); // Negative values are relative, in 100 ns units
+        SetWaitableTimer(_timer, &due, 0, NULL, NULL, FALSE);
+        HANDLE handles[2] = { _event, _timer };
+        WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+        CancelWaitableTimer(_timer);
+      }
+      return _seq.load(std::memory_order_acquire) != token;
+    }
+    inline void Wake()
+    {
+      _seq.fetch_add(1, std::memory_order_release);
+      SetEvent(_event);
+    }
+#else
+    inline Sleeper() : _seq(0) {}
+    inline ~Sleeper() {}
+    // Sleeps for up to ns nanoseconds, or until Wake() is called. Returns true if Wake() was called after Prepare() returned token.
+    inline bool Sleep(uint32_t token, uint64_t ns)
+    {
+      if(_seq.load(std::memory_order_acquire) != token)
+        return true;
+#ifdef BSS_PLATFORM_LINUX
+      struct timespec ts = { (time_t)(ns / 1000000000), (long)(ns % 1000000000) };
+      syscall(SYS_futex, &_seq, FUTEX_WAIT_PRIVATE, token, (ns == FOREVER) ? nullptr : &ts, nullptr, 0); // Relative timeouts use CLOCK_MONOTONIC
+#else
+      std::unique_lock<std::mutex> lock(_lock);
+      auto woken = [this, token]() { return _seq.load(std::memory_order_acquire) != token; };
+      if(ns == FOREVER)
+        _cond.wait(lock, woken);
+      else
+        _cond.wait_for(lock, std::chrono::nanoseconds(ns), woken);
+#endif
+      return _seq.load(std::memory_order_acquire) != token;
+    }
+    inline void Wake()
+    {
+#ifdef BSS_PLATFORM_LINUX
+      _seq.fetch_add(1, std::memory_order_release);
+      syscall(SYS_futex, &_seq, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+      {
+        std::lock_guard<std::mutex> lock(_lock); // Otherwise the sleeper could check _seq, then miss this notify before it waits
+        _seq.fetch_add(1, std::memory_order_release);
+      }
+      _cond.notify_one();
+#endif
+    }
+#endif
+    BSS_FORCEINLINE uint32_t Prepare() const { return _seq.load(std::memory_order_acquire); }
+
+  protected:
+    std::atomic<uint32_t> _seq;
+#ifdef BSS_PLATFORM_WIN32
+    HANDLE _event;
+    HANDLE _timer;
+#elif !defined(BSS_PLATFORM_LINUX)
+    std::mutex _lock;
+    std::condition_variable _cond;
+#endif
+  };
+
   // This extends std::thread and adds support for joining with a timeout
   class BSS_COMPILER_DLLEXPORT Thread : public std::thread
   {
@@ -104,6 +207,95 @@ namespace bss {
       return ret;
     }
     BSS_FORCEINLINE void join() { std::thread::join(); }
+    // Restricts this thread to the given logical processors, numbered the same way as bssGetProcessorCores. Returns false if the OS
+    // rejected the request, or doesn't support it (only Windows and Linux do). A thread on Windows can only run in one processor
+    // group, so processors outside the group of the first one are ignored.
+    inline bool SetAffinity(const size_t* cpus, size_t count)
+    {
+#ifdef BSS_PLATFORM_WIN32
+      GROUP_AFFINITY affinity = { 0 };
+      WORD groups = GetMaximumProcessorGroupCount();
+      bool found = false;
+      for(size_t i = 0; i < count; ++i)
+      {
+        size_t cpu = cpus[i];
+        WORD g = 0;
+        for(; g < groups && cpu >= GetMaximumProcessorCount(g); ++g)
+          cpu -= GetMaximumProcessorCount(g);
+        if(g >= groups || cpu >= sizeof(KAFFINITY) * 8 || (found && g != affinity.Group))
+          continue;
+        found = true;
+        affinity.Group = g;
+        affinity.Mask |= ((KAFFINITY)1 << cpu);
+      }
+      return affinity.Mask != 0 && SetThreadGroupAffinity((HANDLE)native_handle(), &affinity, 0) != 0;
+#elif defined(BSS_PLATFORM_LINUX)
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for(size_t i = 0; i < count; ++i)
+        if(cpus[i] < CPU_SETSIZE)
+          CPU_SET(cpus[i], &set);
+      return CPU_COUNT(&set) > 0 && !pthread_setaffinity_np(native_handle(), sizeof(cpu_set_t), &set);
+#else
+      return false;
+#endif
+    }
+    BSS_FORCEINLINE bool SetAffinity(size_t cpu) { return SetAffinity(&cpu, 1); }
+    // Sets the name that debuggers and profilers display for this thread. Linux truncates names to 15 characters. Apple platforms can
+    // only name the calling thread, so this returns false when called from any other thread there, and on other POSIX platforms.
+    inline bool SetName(const char* name)
+    {
+#ifdef BSS_PLATFORM_WIN32
+      wchar_t buf[64];
+      if(!MultiByteToWideChar(CP_UTF8, 0, name, -1, buf, 64))
+        return false;
+      buf[63] = 0;
+      return SUCCEEDED(SetThreadDescription((HANDLE)native_handle(), buf));
+#elif defined(BSS_PLATFORM_LINUX)
+      char buf[16];
+      size_t len = strnlen(name, sizeof(buf) - 1);
+      memcpy(buf, name, len);
+      buf[len] = 0;
+      return !pthread_setname_np(native_handle(), buf);
+#elif defined(BSS_PLATFORM_APPLE)
+      return pthread_equal(pthread_self(), native_handle()) && !pthread_setname_np(name);
+#else
+      return false;
+#endif
+    }
+    // On POSIX, priorities above normal use the realtime schedulers, which usually require elevated privileges.
+    inline bool SetPriority(THREAD_PRIORITY priority)
+    {
+#ifdef BSS_PLATFORM_WIN32
+      static const int PRIORITIES[] = { THREAD_PRIORITY_IDLE, THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL,
+        THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_HIGHEST, THREAD_PRIORITY_TIME_CRITICAL };
+      return SetThreadPriority((HANDLE)native_handle(), PRIORITIES[priority - PRIORITY_IDLE]) != 0;
+#else
+      struct sched_param param = { 0 };
+      int policy = SCHED_OTHER;
+      switch(priority)
+      {
+#ifdef SCHED_IDLE
+      case PRIORITY_IDLE: policy = SCHED_IDLE; break;
+#endif
+#ifdef SCHED_BATCH
+      case PRIORITY_LOWEST:
+      case PRIORITY_LOW: policy = SCHED_BATCH; break;
+#endif
+      case PRIORITY_HIGH:
+      case PRIORITY_HIGHEST:
+        policy = SCHED_RR;
+        param.sched_priority = sched_get_priority_min(SCHED_RR) + (priority - PRIORITY_NORMAL);
+        break;
+      case PRIORITY_REALTIME:
+        policy = SCHED_FIFO;
+        param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+        break;
+      default: break;
+      }
+      return !pthread_setschedparam(native_handle(), policy, &param);
+#endif
+    }
 
     Thread& operator=(Thread&& mov) { std::thread::operator=(std::move((std::thread&&)mov)); return *this; }
   };
@@ -9,32 +9,135 @@
 #include "RingAlloc.h"
 #include "DynArray.h"
 #include "Delegate.h"
+#include "bss_util_c.h"
+#include <memory>
+#include <stdio.h>
 #include <condition_variable>
 #include <mutex>
 
 namespace bss {
-  // Stores a pool of threads that execute tasks.
-  class ThreadPool
+  // Move-only type-erased void() callable. Anything up to INLINE bytes that can be moved without throwing is stored inside the task
+  // itself, so creating, queuing and running small closures never allocates. Larger callables fall back to the heap.
+  class Task
   {
-    typedef void(*FN)(void*);
-    typedef std::pair<FN, void*> TASK;
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+  public:
+    static const size_t INLINE = 48;
+
+    inline Task() : _ops(0) {}
+    inline Task(void(*f)(void*), void* arg) : Task([f, arg]() { f(arg); }) {}
+    template<class F, std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>, int> = 0>
+    inline Task(F&& f)
+    {
+      typedef std::decay_t<F> FN;
+      if constexpr(_inline<FN>())
+      {
+        new(_storage) FN(std::forward<F>(f));
+        _ops = &_inlineOps<FN>;
+      }
+      else
+      {
+        *reinterpret_cast<FN**>(_storage) = new FN(std::forward<F>(f));
+        _ops = &_heapOps<FN>;
+      }
+    }
+    inline Task(Task&& mov) : _ops(mov._ops) { _take(mov); }
+    inline ~Task() { _destroy(); }
+    inline void operator()() { _ops->call(_storage); }
+    inline explicit operator bool() const { return _ops != 0; }
+    inline Task& operator=(Task&& mov)
+    {
+      if(this != &mov)
+      {
+        _destroy();
+        _ops = mov._ops;
+        _take(mov);
+      }
+      return *this;
+    }
 
+  protected:
+    struct Ops
+    {
+      void(*call)(void*);
+      void(*move)(void*, void*); // Null if the storage can just be copied
+      void(*destroy)(void*); // Null if there's nothing to destroy
+    };
+
+    template<class F>
+    static constexpr bool _inline() { return sizeof(F) <= INLINE && alignof(F) <= alignof(void*) && std::is_nothrow_move_constructible_v<F>; }
+    template<class F>
+    static constexpr bool _trivial() { return std::is_trivially_copyable_v<F> && std::is_trivially_destructible_v<F>; }
+    BSS_FORCEINLINE void _take(Task& mov)
+    {
+      if(_ops && _ops->move)
+        _ops->move(_storage, mov._storage);
+      else
+        memcpy(_storage, mov._storage, INLINE);
+      mov._ops = 0;
+    }
+    BSS_FORCEINLINE void _destroy()
+    {
+      if(_ops && _ops->destroy)
+        _ops->destroy(_storage);
+      _ops = 0;
+    }
+
+    template<class F>
+    static void _call(void* p) { (*reinterpret_cast<F*>(p))(); }
+    template<class F>
+    static void _move(void* dst, void* src) { new(dst) F(std::move(*reinterpret_cast<F*>(src))); reinterpret_cast<F*>(src)->~F(); }
+    template<class F>
+    static void _free(void* p) { reinterpret_cast<F*>(p)->~F(); }
+    template<class F>
+    static void _callHeap(void* p) { (**reinterpret_cast<F**>(p))(); }
+    template<class F>
+    static void _freeHeap(void* p) { delete *reinterpret_cast<F**>(p); }
+
+    template<class F>
+    static constexpr Ops _inlineOps = { &_call<F>, _trivial<F>() ? nullptr : &_move<F>, _trivial<F>() ? nullptr : &_free<F> };
+    template<class F>
+    static constexpr Ops _heapOps = { &_callHeap<F>, nullptr, &_freeHeap<F> };
+
+    alignas(void*) unsigned char _storage[INLINE];
+    const Ops* _ops;
+  };
+
+  // Stores a pool of threads that execute tasks. Tasks go into a BoundedQueue, so queuing them doesn't allocate. When it fills up, a
+  // new one at least twice as big is added and new tasks go there, so after the first few batches the pool has room for the largest
+  // batch and never allocates again. The old queues are drained before the new ones, so tasks still run in the order they were
+  // queued, but stay allocated until the pool is destroyed, because another thread could still be pushing to them. A pool that has
+  // been moved from has no queue left, so it can only be destroyed.
+  class ThreadPool
+  {
     ThreadPool(const ThreadPool&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
 
   public:
-    ThreadPool(ThreadPool&& mov) : _falloc(std::move(mov._falloc)), _run(mov._run.load(std::memory_order_relaxed)),
-      _tasks(mov._tasks.load(std::memory_order_relaxed)),
-      _tasklist(std::move(mov._tasklist)), _threads(std::move(mov._threads))
+    typedef void(*FN)(void*);
+    static const size_t DEFAULT_CAPACITY = 4096;
+
+    ThreadPool(ThreadPool&& mov) : _run(mov._run.load(std::memory_order_relaxed)),
+      _tasks(mov._tasks.load(std::memory_order_relaxed)), _nrings(mov._nrings.load(std::memory_order_relaxed)), _threads(std::move(mov._threads))
     {
+      for(size_t i = 0; i < MAX_RINGS; ++i)
+        _rings[i].store(mov._rings[i].exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+      mov._nrings.store(0, std::memory_order_relaxed);
+      mov._tasks.store(0, std::memory_order_relaxed);
       mov._run.store(0, std::memory_order_release);
     }
-    explicit ThreadPool(size_t count) : _falloc(sizeof(TASK) * 20), _run(0), _tasks(0)
+    // capacity is the number of tasks that can be queued before the pool has to allocate more room. It only needs to cover the largest
+    // batch to avoid allocating after the first one.
+    explicit ThreadPool(size_t count, size_t capacity = DEFAULT_CAPACITY) : _run(0), _tasks(0)
     {
+      _init(capacity);
       AddThreads(count);
     }
-    ThreadPool() : _falloc(sizeof(TASK) * 20), _run(0), _tasks(0)
+    ThreadPool() : _run(0), _tasks(0)
     {
+      _init(DEFAULT_CAPACITY);
       AddThreads(IdealWorkerCount());
     }
     ~ThreadPool()
@@ -43,28 +146,49 @@ namespace bss {
       _run.store(-_run.load(std::memory_order_acquire), std::memory_order_release); // Negate the stop count, then wait for it to reach 0
       _lock.Notify(_threads.Length());
       while(_run.load(std::memory_order_acquire) < 0);
+      for(size_t i = 0; i < _nrings.load(std::memory_order_relaxed); ++i)
+        delete _rings[i].load(std::memory_order_relaxed);
     }
     void AddTask(FN f, void* arg, size_t instances = 1)
     {
       if(!instances)
         instances = (size_t)_threads.Length();
 
-      TASK task(f, arg);
       _tasks.fetch_add(instances, std::memory_order_release);
 
       for(size_t i = 0; i < instances; ++i)
-        _tasklist.Push(task);
+        _push(Task(f, arg));
 
       _lock.Notify(instances);
     }
+    void AddTask(Task&& task)
+    {
+      _tasks.fetch_add(1, std::memory_order_release);
+      _push(std::move(task));
+      _lock.Notify(1);
+    }
+    // Moves a batch of tasks into the queue with a single claim on the queue and a single wakeup, leaving the slice full of empty tasks.
+    void AddTasks(Slice<Task> tasks)
+    {
+      if(!tasks.length)
+        return;
+      _tasks.fetch_add(tasks.length, std::memory_order_release);
+      size_t n = 0;
+      for(;;)
+      {
+        BoundedQueue<Task>* ring = _ring();
+        n += ring->Push(tasks.start + n, tasks.length - n);
+        if(n == tasks.length)
+          break;
+        _grow(ring, tasks.length - n);
+      }
+      _lock.Notify(bssmin(tasks.length, (size_t)_threads.Length())); // Each worker that wakes up keeps going until the queue is empty
+    }
 
     template<typename R, typename ...Args>
     void AddFunc(R(*f)(Args...), Args... args)
     {
-      std::pair<StoreFunction<R, Args...>, RingAllocVoid*>* fn = _falloc.AllocT<std::pair<StoreFunction<R, Args...>, RingAllocVoid*>>();
-      new (&fn->first) StoreFunction<R, Args...>(f, std::forward<Args>(args)...);
-      fn->second = &_falloc; // This could just be a pointer to this thread pool, but it's easier if it's a direct pointer to the allocator we need.
-      AddTask(_callfn<R, Args...>, fn);
+      AddTask(Task([fn = StoreFunction<R, Args...>(f, std::forward<Args>(args)...)]() { fn.Call(); }));
     }
 
     void AddThreads(size_t num = 1)
@@ -77,16 +201,50 @@ namespace bss {
     }
     void Wait()
     {
-      TASK task; // It is absolutely crucial that the main thread also process tasks to avoid the issue of orphaned tasks
-      while(_run.load(std::memory_order_acquire) > 0 && _tasklist.Pop(task))
+      Task task; // It is absolutely crucial that the main thread also process tasks to avoid the issue of orphaned tasks
+      while(_run.load(std::memory_order_acquire) > 0 && _pop(task))
       {
-        (*task.first)(task.second);
+        task();
         _tasks.fetch_sub(1, std::memory_order_release);
       }
 
-      while(_tasks.load(std::memory_order_relaxed) > 0); // Wait until all tasks actually stop processing
+      while(_tasks.load(std::memory_order_acquire) > 0); // Wait until all tasks actually stop processing
     }
     inline size_t Busy() const { return _tasks.load(std::memory_order_relaxed); }
+    // Number of tasks that can be queued at once without allocating
+    inline size_t Capacity() const { return _nrings.load(std::memory_order_acquire) > 0 ? _ring()->Capacity() : 0; }
+    // Pins each worker to a different physical core, so workers never migrate between cores or share one with an SMT sibling. Any core
+    // containing one of the reserved logical processors is skipped. Workers beyond the number of free cores are left alone. Returns the
+    // number of workers that were pinned. Threads added afterwards aren't pinned until this is called again.
+    size_t PinWorkers(const size_t* reserved = 0, size_t nreserved = 0)
+    {
+      size_t n = bssGetProcessorCores(0, 0);
+      std::unique_ptr<size_t[]> cores(new size_t[n]);
+      n = bssGetProcessorCores(cores.get(), n);
+      std::unique_ptr<size_t[]> used(new size_t[_threads.Length()]); // Cores a worker was actually pinned to
+      size_t pinned = 0;
+      for(size_t i = 0; i < n && pinned < _threads.Length(); ++i)
+      {
+        bool skip = (cores[i] == (size_t)~0);
+        for(size_t j = 0; j < pinned && !skip; ++j) // Only one logical processor of each core is used
+          skip = (used[j] == cores[i]);
+        for(size_t j = 0; j < nreserved && !skip; ++j)
+          skip = (reserved[j] < n && cores[reserved[j]] == cores[i]);
+        if(!skip && _threads[pinned].SetAffinity(i))
+          used[pinned++] = cores[i];
+      }
+      return pinned;
+    }
+    // Sets the name of every worker to the prefix followed by the worker's index
+    void NameWorkers(const char* prefix)
+    {
+      char buf[64];
+      for(size_t i = 0; i < _threads.Length(); ++i)
+      {
+        snprintf(buf, 64, "%s%zu", prefix, i);
+        _threads[i].SetName(buf);
+      }
+    }
 
     static size_t IdealWorkerCount()
     {
@@ -100,32 +258,63 @@ namespace bss {
       while(pool._run.load(std::memory_order_acquire) > 0)
       {
         pool._lock.Wait();
-        TASK task;
-        while(pool._tasklist.Pop(task))
+        Task task;
+        while(pool._pop(task))
         {
-          (*task.first)(task.second);
+          task();
           pool._tasks.fetch_sub(1, std::memory_order_release);
         }
       }
 
       pool._run.fetch_add(1, std::memory_order_release);
     }
-
-    template<typename R, typename ...Args>
-    static void _callfn(void* p)
+    inline void _init(size_t capacity)
+    {
+      _rings[0].store(new BoundedQueue<Task>(capacity), std::memory_order_relaxed);
+      for(size_t i = 1; i < MAX_RINGS; ++i)
+        _rings[i].store(0, std::memory_order_relaxed);
+      _nrings.store(1, std::memory_order_release);
+    }
+    // The queue new tasks go into
+    BSS_FORCEINLINE BoundedQueue<Task>* _ring() const
+    {
+      size_t n = _nrings.load(std::memory_order_acquire);
+      assert(n > 0); // Only a moved-from pool has no queue
+      return _rings[n - 1].load(std::memory_order_relaxed);
+    }
+    // Adds a queue with room for at least count more tasks than the full one had, unless another thread already replaced it.
+    inline void _grow(BoundedQueue<Task>* full, size_t count)
     {
-      std::pair<StoreFunction<R, Args...>, RingAllocVoid*>* fn = (std::pair<StoreFunction<R, Args...>, RingAllocVoid*>*)p;
-      fn->first.Call();
-      fn->first.~StoreFunction();
-      fn->second->Dealloc(fn);
+      std::lock_guard<std::mutex> lock(_growlock);
+      size_t n = _nrings.load(std::memory_order_relaxed);
+      if(_rings[n - 1].load(std::memory_order_relaxed) != full)
+        return;
+      assert(n < MAX_RINGS);
+      _rings[n].store(new BoundedQueue<Task>(bssmax(full->Capacity() * 2, full->Capacity() + count)), std::memory_order_relaxed);
+      _nrings.store(n + 1, std::memory_order_release);
+    }
+    BSS_FORCEINLINE void _push(Task&& task)
+    {
+      for(BoundedQueue<Task>* ring = _ring(); !ring->Push(std::move(task)); ring = _ring())
+        _grow(ring, 1);
+    }
+    BSS_FORCEINLINE bool _pop(Task& task)
+    {
+      for(size_t i = 0, n = _nrings.load(std::memory_order_acquire); i < n; ++i) // Oldest queue first, since it holds the oldest tasks
+        if(_rings[i].load(std::memory_order_relaxed)->Pop(task))
+          return true;
+      return false;
     }
 
-    MicroLockQueue<TASK, size_t> _tasklist;
+    static const size_t MAX_RINGS = sizeof(size_t) * 8; // Every queue is twice as big as the last, so this can't run out
+
+    std::atomic<int32_t> _run;
     std::atomic<size_t> _tasks; // Count of tasks still being processed (this includes tasks that have been removed from the queue, but haven't finished yet)
+    std::atomic<BoundedQueue<Task>*> _rings[MAX_RINGS];
+    std::atomic<size_t> _nrings;
+    std::mutex _growlock;
     DynArray<Thread, size_t, ARRAY_MOVE> _threads;
-    std::atomic<int32_t> _run;
     Semaphore _lock;
-    RingAllocVoid _falloc;
   };
 
   template<typename R, typename ...Args>
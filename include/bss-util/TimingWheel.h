@@ -0,0 +1,277 @@
+// Copyright ©2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#ifndef __TIMING_WHEEL_H__BSS__
+#define __TIMING_WHEEL_H__BSS__
+
+#include "HighPrecisionTimer.h"
+#include "DynArray.h"
+#include "ThreadPool.h"
+#include <math.h>
+
+namespace bss {
+  namespace internal {
+    template<typename F>
+    struct TimingWheelNode
+    {
+      TimingWheelNode() : deadline(0), next(0), prev(0), gen(1), slot(0) {}
+      F f;
+      uint64_t deadline; // in ticks
+      uint32_t next;
+      uint32_t prev;
+      uint32_t gen; // Incremented whenever this node is freed, which invalidates any outstanding handles to it
+      uint32_t slot; // Which list this node is on
+    };
+  }
+
+  // Hierarchical timing wheel that schedules events x milliseconds into the future, rounded up to the wheel's resolution. Like Scheduler,
+  // events return the number of milliseconds until they should run again, or 0 to stop. Adding, cancelling and rescheduling are all O(1),
+  // and events are identified by 64-bit handles that become invalid once the event finishes or is cancelled. If a ThreadPool is given,
+  // expired events are moved onto it instead of being run inside Update(), and their return values are ignored.
+  template<typename F, typename Alloc = StandardAllocator<internal::TimingWheelNode<F>>>
+  class BSS_COMPILER_DLLEXPORT TimingWheel : protected HighPrecisionTimer
+  {
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+  public:
+    typedef uint64_t ID;
+    typedef internal::TimingWheelNode<F> NODE;
+    static const uint32_t BITS = 8;
+    static const uint32_t SLOTS = (1 << BITS);
+    static const uint32_t MASK = SLOTS - 1;
+    static const uint32_t LEVELS = 4; // Covers 2^32 ticks, or about 49 days at the default 1 ms resolution. Longer delays are clamped.
+
+    template<bool U = std::is_void_v<typename Alloc::policy_type>, std::enable_if_t<!U, int> = 0>
+    inline TimingWheel(typename Alloc::policy_type* policy, double resolution = 1.0, ThreadPool* pool = 0) : _nodes(0, policy) { _init(resolution, pool); }
+    inline explicit TimingWheel(double resolution = 1.0, ThreadPool* pool = 0) { _init(resolution, pool); }
+    inline ~TimingWheel() {}
+    // Gets number of pending events
+    BSS_FORCEINLINE uint32_t Length() const { return _count; }
+    BSS_FORCEINLINE double Resolution() const { return _resolution; }
+    // Adds an event that will happen t milliseconds in the future, starting from the current time
+    BSS_FORCEINLINE ID Add(double t, const F& f) { return _add(t, F(f)); }
+    BSS_FORCEINLINE ID Add(double t, F&& f) { return _add(t, std::move(f)); }
+    // Cancels a pending event. Returns false if the handle is no longer valid. An event may cancel itself while it is running.
+    inline bool Cancel(ID id)
+    {
+      uint32_t i = _get(id);
+      if(i == NIL)
+        return false;
+      if(_nodes[i].slot == RUNNING)
+        _nodes[i].slot = CANCELLED;
+      else
+      {
+        _unlink(i);
+        _free(i);
+      }
+      return true;
+    }
+    // Moves a pending event so that it happens t milliseconds from now. Returns false if the handle is invalid or the event is running.
+    inline bool Reschedule(ID id, double t)
+    {
+      uint32_t i = _get(id);
+      if(i == NIL || _nodes[i].slot >= RUNNING)
+        return false;
+      _unlink(i);
+      _nodes[i].deadline = _deadline(t);
+      _place(i);
+      return true;
+    }
+    inline bool Exists(ID id) const { return _get(id) != NIL; }
+    // Updates the wheel, setting off any events that need to be set off
+    inline void Update()
+    {
+      HighPrecisionTimer::Update();
+      uint64_t now = (uint64_t)(_time / _resolution);
+      for(uint64_t n; (n = _next()) <= now;)
+        _process(n);
+      if(_tick <= now)
+        _tick = now + 1;
+    }
+
+  protected:
+    enum : uint32_t { FIRING = LEVELS * SLOTS, RUNNING, CANCELLED, FREE };
+    static const uint32_t NIL = (uint32_t)~0;
+
+    inline void _init(double resolution, ThreadPool* pool)
+    {
+      _resolution = resolution;
+      _pool = pool;
+      _tick = (uint64_t)(_time / _resolution);
+      _count = 0;
+      _freelist = NIL;
+      for(uint32_t i = 0; i <= FIRING; ++i)
+        _heads[i] = NIL;
+      memset(_bits, 0, sizeof(_bits));
+    }
+    BSS_FORCEINLINE uint64_t _deadline(double t) const { return (uint64_t)ceil((_time + bssmax(t, 0.0)) / _resolution); }
+    inline uint32_t _get(ID id) const
+    {
+      uint32_t i = (uint32_t)id;
+      return (i < _nodes.Length() && _nodes[i].gen == (uint32_t)(id >> 32) && _nodes[i].slot < CANCELLED) ? i : NIL;
+    }
+    inline ID _add(double t, F&& f)
+    {
+      uint32_t i = _freelist;
+      if(i != NIL)
+        _freelist = _nodes[i].next;
+      else
+        i = (uint32_t)_nodes.AddConstruct();
+      ++_count;
+      _nodes[i].f = std::move(f);
+      _nodes[i].deadline = _deadline(t);
+      _place(i);
+      return ((uint64_t)_nodes[i].gen << 32) | i;
+    }
+    inline void _free(uint32_t i)
+    {
+      --_count;
+      _nodes[i].f = F();
+      ++_nodes[i].gen;
+      _nodes[i].slot = FREE;
+      _nodes[i].next = _freelist;
+      _freelist = i;
+    }
+    inline void _link(uint32_t i, uint32_t slot)
+    {
+      NODE& n = _nodes[i];
+      n.slot = slot;
+      n.prev = NIL;
+      n.next = _heads[slot];
+      if(n.next != NIL)
+        _nodes[n.next].prev = i;
+      else if(slot < FIRING)
+        _bits[slot >> 6] |= (uint64_t(1) << (slot & 63));
+      _heads[slot] = i;
+    }
+    inline void _unlink(uint32_t i)
+    {
+      NODE& n = _nodes[i];
+      if(n.prev != NIL)
+        _nodes[n.prev].next = n.next;
+      else
+        _heads[n.slot] = n.next;
+      if(n.next != NIL)
+        _nodes[n.next].prev = n.prev;
+      else if(n.prev == NIL && n.slot < FIRING)
+        _bits[n.slot >> 6] &= ~(uint64_t(1) << (n.slot & 63));
+    }
+    // Picks the level whose range covers the time remaining, so each event is cascaded at most LEVELS - 1 times.
+    inline void _place(uint32_t i)
+    {
+      NODE& n = _nodes[i];
+      if(n.deadline < _tick)
+        n.deadline = _tick;
+      uint64_t delta = n.deadline - _tick;
+      if(delta >= (uint64_t(1) << (BITS * LEVELS)))
+        n.deadline = _tick + (uint64_t(1) << (BITS * LEVELS)) - 1;
+      uint32_t l = 0;
+      while(l + 1 < LEVELS && delta >= (uint64_t(1) << (BITS * (l + 1))))
+        ++l;
+      _link(i, l * SLOTS + (uint32_t)((n.deadline >> (BITS * l)) & MASK));
+    }
+    // Finds the first occupied slot in [begin, end) of a level, or SLOTS if there isn't one
+    inline uint32_t _scan(uint32_t level, uint32_t begin, uint32_t end) const
+    {
+      const uint64_t* bits = _bits + ((level * SLOTS) >> 6);
+      while(begin < end)
+      {
+        uint64_t w = bits[begin >> 6] & (~uint64_t(0) << (begin & 63));
+        if(w)
+        {
+          uint32_t j = (begin & ~63u) + bssLog2(w & (~w + 1));
+          return j < end ? j : SLOTS;
+        }
+        begin = (begin & ~63u) + 64;
+      }
+      return SLOTS;
+    }
+    // Returns the next tick at which an event expires or a slot has to be cascaded, or ~0 if the wheel is empty.
+    inline uint64_t _next() const
+    {
+      uint64_t best = ~uint64_t(0);
+      if(!_count)
+        return best;
+      for(uint32_t l = 0; l < LEVELS; ++l)
+      {
+        uint32_t shift = BITS * l;
+        uint32_t pos = (uint32_t)((_tick >> shift) & MASK);
+        uint32_t begin = pos + ((_tick & ((uint64_t(1) << shift) - 1)) != 0); // A higher slot under the current tick was already cascaded, unless we're exactly on its boundary
+        uint64_t rotation = (_tick >> (shift + BITS)) << (shift + BITS);
+        uint32_t j = _scan(l, begin, SLOTS);
+        if(j == SLOTS)
+        {
+          j = _scan(l, 0, begin);
+          rotation += (uint64_t(1) << (shift + BITS));
+        }
+        if(j != SLOTS)
+          best = bssmin(best, rotation + ((uint64_t)j << shift));
+      }
+      return best;
+    }
+    inline void _process(uint64_t n)
+    {
+      _tick = n;
+      uint32_t top = 0;
+      while(top + 1 < LEVELS && !(n & ((uint64_t(1) << (BITS * (top + 1))) - 1)))
+        ++top;
+      for(uint32_t l = top; l > 0; --l) // Cascade higher levels first so their events can land in the lower slots we're about to cascade
+      {
+        uint32_t slot = l * SLOTS + (uint32_t)((n >> (BITS * l)) & MASK);
+        for(uint32_t i; (i = _heads[slot]) != NIL;)
+        {
+          _unlink(i);
+          _place(i);
+        }
+      }
+
+      // Move expired events to a separate list, so events added by callbacks can't land in the slot we're firing
+      _tick = n + 1;
+      uint32_t slot = (uint32_t)(n & MASK);
+      for(uint32_t i; (i = _heads[slot]) != NIL;)
+      {
+        _unlink(i);
+        _link(i, FIRING);
+      }
+      for(uint32_t i; (i = _heads[FIRING]) != NIL;)
+      {
+        _unlink(i);
+        if(_pool)
+        {
+          _pool->AddTask(&_dispatch, new F(std::move(_nodes[i].f)));
+          _free(i);
+          continue;
+        }
+        _nodes[i].slot = RUNNING;
+        F f(std::move(_nodes[i].f)); // The callback might add events, which can reallocate _nodes
+        double r = f();
+        if(r > 0.0 && _nodes[i].slot == RUNNING)
+        {
+          _nodes[i].f = std::move(f);
+          _nodes[i].deadline = _deadline(r);
+          _place(i);
+        }
+        else
+          _free(i);
+      }
+    }
+    static void _dispatch(void* p)
+    {
+      F* f = reinterpret_cast<F*>(p);
+      (*f)();
+      delete f;
+    }
+
+    DynArray<NODE, uint32_t, ARRAY_MOVE, Alloc> _nodes;
+    uint32_t _heads[FIRING + 1];
+    uint64_t _bits[(LEVELS * SLOTS) >> 6]; // Marks which slots are occupied, so Update() can skip straight to the next event
+    uint64_t _tick; // Next tick that hasn't been processed yet
+    uint32_t _count;
+    uint32_t _freelist;
+    double _resolution; // Milliseconds per tick
+    ThreadPool* _pool;
+  };
+}
+
+#endif
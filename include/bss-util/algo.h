@@ -15,9 +15,41 @@
 #ifdef BSS_COMPILER_GCC
 #include <alloca.h>
 #endif
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
 
 namespace bss {
   namespace internal {
+    template<auto F>
+    struct KeyCompTag {};
+    // True when CompF is the default comparison on an arithmetic type, so it can be replaced by comparing the keys directly, or by
+    // KeyCount and KarySearch. The compiler can't always see through the -1/0/1 that CompT returns and ends up branching on it,
+    // which defeats a branchless search.
+    template<class T, auto CompF, bool = std::is_arithmetic<T>::value>
+    constexpr bool UseKeyCount = false; // Taking the address of CompT would instantiate it, so only do that for arithmetic types
+    template<class T, auto CompF>
+    constexpr bool UseKeyCount<T, CompF, true> = std::is_same<KeyCompTag<CompF>, KeyCompTag<&CompT<T>>>::value;
+
+    // Returns CompF(l, r) < 0
+    template<auto CompF, typename L, typename R>
+    BSS_FORCEINLINE bool KeyLess(const L& l, const R& r)
+    {
+      if constexpr(std::is_same<L, R>::value && UseKeyCount<L, CompF>)
+        return l < r;
+      else
+        return (*CompF)(l, r) < 0;
+    }
+    // Returns CompF(l, r) > 0
+    template<auto CompF, typename L, typename R>
+    BSS_FORCEINLINE bool KeyGreater(const L& l, const R& r)
+    {
+      if constexpr(std::is_same<L, R>::value && UseKeyCount<L, CompF>)
+        return r < l;
+      else
+        return (*CompF)(l, r) > 0;
+    }
+
   // A generalization of the binary search that allows for auxiliary arguments to be passed into the comparison function
     template<typename T, typename D, typename CT_, bool(*CompEQ)(const char&, const char&), char CompValue, typename... Args>
     struct binsearch_aux_t
@@ -26,25 +58,32 @@ namespace bss {
       inline static CT_ BinarySearchNear(const T* arr, const D& data, CT_ first, CT_ last, Args... args)
       {
         typename std::make_signed<CT_>::type c = last - first; // Must be a signed version of whatever CT_ is
-        CT_ c2; //No possible operation can make this negative so we leave it as possibly unsigned.
-        CT_ m;
+        if(c <= 0)
+          return first;
 
-        while(c > 0)
+        // The range shrinks by the same amount whichever half we keep, so the comparison becomes a conditional move instead of a
+        // branch that mispredicts half the time. Prefetching both possible midpoints of the next step hides the latency of large arrays.
+        while(c > 1)
         {
-          c2 = (c >> 1); // >> 1 is valid here because we check to see that c > 0 beforehand.
-          m = first + c2;
-
-          //if(!(_Val < *_Mid))
-          if((*CompEQ)((*CompF)(data, arr[m], args...), CompValue))
-          {	// try top half
-            first = m + 1;
-            c -= c2 + 1;
-          }
-          else
-            c = c2;
+          CT_ c2 = (CT_)(c >> 1);
+          BSS_PREFETCH(arr + first + (c2 >> 1));
+          BSS_PREFETCH(arr + first + c2 + (c2 >> 1));
+          first = _top<CompF>(data, arr[first + c2], args...) ? first + c2 : first;
+          c -= c2;
         }
 
-        return first;
+        return first + (CT_)_top<CompF>(data, arr[first], args...);
+      }
+      // if(!(_Val < *_Mid)) try top half
+      template<char(*CompF)(const D&, const T&, Args...)>
+      BSS_FORCEINLINE static bool _top(const D& data, const T& v, Args... args)
+      {
+        if constexpr(sizeof...(Args) == 0 && std::is_same<KeyCompTag<CompEQ>, KeyCompTag<&CompT_EQ<char>>>::value && CompValue == 1)
+          return KeyGreater<CompF>(data, v);
+        else if constexpr(sizeof...(Args) == 0 && std::is_same<KeyCompTag<CompEQ>, KeyCompTag<&CompT_NEQ<char>>>::value && CompValue == -1)
+          return !KeyLess<CompF>(data, v);
+        else
+          return (*CompEQ)((*CompF)(data, v, args...), CompValue);
       }
     };
   }
@@ -82,28 +121,231 @@ namespace bss {
   template<typename T, typename D, typename CT_, char(*CompF)(const T&, const D&)>
   inline CT_ BinarySearchExact(const T* arr, const D& data, typename std::make_signed<CT_>::type f, typename std::make_signed<CT_>::type l)
   {
-    --l; // Done so l can be an exclusive size parameter even though the algorithm is inclusive.
-    CT_ m; // While f and l must be signed ints or the algorithm breaks, m does not.
-    char r;
+    typename std::make_signed<CT_>::type c = l - f;
+    if(c <= 0)
+      return (CT_)-1;
 
-    while(l >= f) // This only works when l is an inclusive max indice
+    // Branchless lower bound, same as BinarySearchNear, followed by a single equality check.
+    const T* base = arr + f;
+    while(c > 1)
     {
-      m = f + ((l - f) >> 1); // Done to avoid overflow on large numbers. >> 1 is valid because l must be >= f so this can't be negative
-
-      if((r = (*CompF)(arr[m], data)) < 0) // This is faster than a switch statement
-        f = m + 1;
-      else if(r > 0)
-        l = m - 1;
-      else
-        return m;
+      typename std::make_signed<CT_>::type half = c >> 1;
+      base = internal::KeyLess<CompF>(base[half], data) ? base + half : base;
+      c -= half;
     }
-
-    return (CT_)-1;
+    base += internal::KeyLess<CompF>(*base, data);
+    return (base < arr + l && !(*CompF)(*base, data)) ? (CT_)(base - arr) : (CT_)-1;
   }
 
   template<typename T, typename CT_, char(*CompF)(const T&, const T&), CT_ I>
   BSS_FORCEINLINE CT_ BinarySearchExact(const T(&arr)[I], const T& data) { return BinarySearchExact<T, T, CT_, CompF>(arr, data, 0, I); }
 
+  namespace internal {
+    // Counts the keys that are less than (or not greater than) k without branching on each comparison, which beats a binary search
+    // over a handful of keys because nothing has to be predicted.
+    template<class T>
+    struct KeyCount
+    {
+      BSS_FORCEINLINE static uint32_t Less(const T* keys, uint32_t n, const T& k)
+      {
+        uint32_t r = 0;
+        for(uint32_t i = 0; i < n; ++i)
+          r += (keys[i] < k);
+        return r;
+      }
+      BSS_FORCEINLINE static uint32_t LessEq(const T* keys, uint32_t n, const T& k)
+      {
+        uint32_t r = 0;
+        for(uint32_t i = 0; i < n; ++i)
+          r += !(k < keys[i]);
+        return r;
+      }
+    };
+
+#ifdef BSS_SSE_ENABLED
+    // Compares W keys at a time and adds up the lanes that matched, then finishes the last few keys one at a time. OPS provides the
+    // comparisons, which return -1 in each lane that matched, and the matching horizontal sum.
+    template<class T, uint32_t W, class OPS>
+    struct KeyCountSSE
+    {
+      BSS_FORCEINLINE static uint32_t Less(const T* keys, uint32_t n, const T& k)
+      {
+        auto t = OPS::Set(k);
+        __m128i acc = _mm_setzero_si128();
+        uint32_t i = 0;
+        for(; i + W <= n; i += W)
+          acc = OPS::Sub(acc, OPS::Less(OPS::Load(keys + i), t));
+        uint32_t r = OPS::Sum(acc);
+        for(; i < n; ++i)
+          r += (keys[i] < k);
+        return r;
+      }
+      BSS_FORCEINLINE static uint32_t LessEq(const T* keys, uint32_t n, const T& k)
+      {
+        auto t = OPS::Set(k);
+        __m128i acc = _mm_setzero_si128();
+        uint32_t i = 0;
+        for(; i + W <= n; i += W)
+          acc = OPS::Sub(acc, OPS::Greater(OPS::Load(keys + i), t));
+        uint32_t r = OPS::Sum(acc);
+        for(; i < n; ++i)
+          r += (k < keys[i]);
+        return n - r;
+      }
+    };
+
+    BSS_FORCEINLINE uint32_t KeySum32(__m128i v)
+    {
+      v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+      v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+      return (uint32_t)_mm_cvtsi128_si32(v);
+    }
+    BSS_FORCEINLINE uint32_t KeySum64(__m128i v) { return (uint32_t)_mm_cvtsi128_si32(_mm_add_epi64(v, _mm_unpackhi_epi64(v, v))); }
+
+    template<uint32_t FLIP>
+    struct KeyOps32
+    {
+      BSS_FORCEINLINE static __m128i Set(uint32_t k) { return _mm_set1_epi32((int)(k ^ FLIP)); }
+      BSS_FORCEINLINE static __m128i Load(const void* p) { return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_set1_epi32((int)FLIP)); }
+      BSS_FORCEINLINE static __m128i Less(__m128i v, __m128i t) { return _mm_cmplt_epi32(v, t); }
+      BSS_FORCEINLINE static __m128i Greater(__m128i v, __m128i t) { return _mm_cmpgt_epi32(v, t); }
+      BSS_FORCEINLINE static __m128i Sub(__m128i a, __m128i b) { return _mm_sub_epi32(a, b); }
+      BSS_FORCEINLINE static uint32_t Sum(__m128i v) { return KeySum32(v); }
+    };
+    struct KeyOpsFloat
+    {
+      BSS_FORCEINLINE static __m128 Set(float k) { return _mm_set1_ps(k); }
+      BSS_FORCEINLINE static __m128 Load(const float* p) { return _mm_loadu_ps(p); }
+      BSS_FORCEINLINE static __m128i Less(__m128 v, __m128 t) { return _mm_castps_si128(_mm_cmplt_ps(v, t)); }
+      BSS_FORCEINLINE static __m128i Greater(__m128 v, __m128 t) { return _mm_castps_si128(_mm_cmpgt_ps(v, t)); }
+      BSS_FORCEINLINE static __m128i Sub(__m128i a, __m128i b) { return _mm_sub_epi32(a, b); }
+      BSS_FORCEINLINE static uint32_t Sum(__m128i v) { return KeySum32(v); }
+    };
+    struct KeyOpsDouble
+    {
+      BSS_FORCEINLINE static __m128d Set(double k) { return _mm_set1_pd(k); }
+      BSS_FORCEINLINE static __m128d Load(const double* p) { return _mm_loadu_pd(p); }
+      BSS_FORCEINLINE static __m128i Less(__m128d v, __m128d t) { return _mm_castpd_si128(_mm_cmplt_pd(v, t)); }
+      BSS_FORCEINLINE static __m128i Greater(__m128d v, __m128d t) { return _mm_castpd_si128(_mm_cmpgt_pd(v, t)); }
+      BSS_FORCEINLINE static __m128i Sub(__m128i a, __m128i b) { return _mm_sub_epi64(a, b); }
+      BSS_FORCEINLINE static uint32_t Sum(__m128i v) { return KeySum64(v); }
+    };
+
+    template<> struct KeyCount<int32_t> : KeyCountSSE<int32_t, 4, KeyOps32<0>> {};
+    template<> struct KeyCount<uint32_t> : KeyCountSSE<uint32_t, 4, KeyOps32<0x80000000>> {};
+    template<> struct KeyCount<float> : KeyCountSSE<float, 4, KeyOpsFloat> {};
+    template<> struct KeyCount<double> : KeyCountSSE<double, 2, KeyOpsDouble> {};
+
+#ifdef __SSE4_2__
+    template<uint64_t FLIP>
+    struct KeyOps64
+    {
+      BSS_FORCEINLINE static __m128i Set(uint64_t k) { return _mm_set1_epi64x((int64_t)(k ^ FLIP)); }
+      BSS_FORCEINLINE static __m128i Load(const void* p) { return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_set1_epi64x((int64_t)FLIP)); }
+      BSS_FORCEINLINE static __m128i Less(__m128i v, __m128i t) { return _mm_cmpgt_epi64(t, v); }
+      BSS_FORCEINLINE static __m128i Greater(__m128i v, __m128i t) { return _mm_cmpgt_epi64(v, t); }
+      BSS_FORCEINLINE static __m128i Sub(__m128i a, __m128i b) { return _mm_sub_epi64(a, b); }
+      BSS_FORCEINLINE static uint32_t Sum(__m128i v) { return KeySum64(v); }
+    };
+    template<> struct KeyCount<int64_t> : KeyCountSSE<int64_t, 2, KeyOps64<0>> {};
+    template<> struct KeyCount<uint64_t> : KeyCountSSE<uint64_t, 2, KeyOps64<0x8000000000000000ULL>> {};
+#endif
+#endif
+
+    template<typename T, typename CT_>
+    inline void eytzinger_aux(const T* sorted, T* out, CT_ length, CT_ k, CT_& i)
+    {
+      if(k > length)
+        return;
+      eytzinger_aux<T, CT_>(sorted, out, length, k * 2, i);
+      out[k] = sorted[i++];
+      eytzinger_aux<T, CT_>(sorted, out, length, k * 2 + 1, i);
+    }
+    template<typename T, typename CT_, CT_ B>
+    inline void kary_aux(const T* sorted, T* out, CT_ length, CT_ blocks, CT_ k, CT_& i)
+    {
+      if(k >= blocks)
+        return;
+      for(CT_ j = 0; j < B; ++j)
+      {
+        kary_aux<T, CT_, B>(sorted, out, length, blocks, k * (B + 1) + j + 1, i);
+        out[k * B + j] = sorted[(i < length) ? i++ : length - 1]; // Pad with the largest key, which sorts after the real one
+      }
+      kary_aux<T, CT_, B>(sorted, out, length, blocks, k * (B + 1) + B + 1, i);
+    }
+  }
+
+  // Rearranges length sorted elements into the Eytzinger (breadth-first) order of a complete binary search tree, where the children
+  // of out[k] are out[2k] and out[2k+1]. out must hold length + 1 elements, because the tree starts at out[1]. Searching it walks
+  // down from the front of the array, so the top levels stay in cache and the next few levels can be prefetched, which a binary
+  // search over a sorted array can't do. Align out to 64 bytes so the descendants that get prefetched together share a cache line.
+  template<typename T, typename CT_>
+  inline void EytzingerLayout(const T* sorted, T* out, CT_ length)
+  {
+    CT_ i = 0;
+    internal::eytzinger_aux<T, CT_>(sorted, out, length, 1, i);
+  }
+
+  // Returns the position in an Eytzinger layout of the first element that isn't less than data, or 0 if every element is less.
+  template<typename T, typename D, typename CT_, char(*CompF)(const D&, const T&)>
+  inline CT_ EytzingerSearch(const T* arr, CT_ length, const D& data)
+  {
+    constexpr CT_ PREFETCH = (CT_)bssmax(64 / sizeof(T), 1); // Prefetch the line holding the descendants a few levels down
+    CT_ k = 1;
+    while(k <= length)
+    {
+      BSS_PREFETCH(arr + k * PREFETCH);
+      k = 2 * k + internal::KeyGreater<CompF>(data, arr[k]);
+    }
+    return k >> (bssLog2((uint64_t)(~k & (k + 1))) + 1); // Undo every right turn we took after the last left turn
+  }
+
+  // Returns the position in an Eytzinger layout of the element that equals data, or 0 if there isn't one.
+  template<typename T, typename D, typename CT_, char(*CompF)(const D&, const T&)>
+  BSS_FORCEINLINE CT_ EytzingerExact(const T* arr, CT_ length, const D& data)
+  {
+    CT_ k = EytzingerSearch<T, D, CT_, CompF>(arr, length, data);
+    return (k && !(*CompF)(data, arr[k])) ? k : 0;
+  }
+
+  // Number of keys in each node of a k-ary layout, which fills one cache line.
+  template<typename T>
+  constexpr size_t KaryBlock = bssmax(64 / sizeof(T), 2);
+
+  // Number of elements a k-ary layout of length keys needs, including padding.
+  template<typename T, typename CT_>
+  constexpr CT_ KaryLength(CT_ length) { return ((length + KaryBlock<T> - 1) / KaryBlock<T>) * KaryBlock<T>; }
+
+  // Rearranges length sorted keys into a static B-tree whose nodes are B keys, which defaults to one cache line. The children of
+  // node k are nodes k * (B + 1) + 1 through k * (B + 1) + B + 1, so no pointers are stored. out must hold KaryLength<T>(length)
+  // keys and should be aligned to 64 bytes. length must be greater than zero. B can be set to lay out something other than the keys,
+  // like their indices, in the same order the keys would be.
+  template<typename T, typename CT_, size_t B = KaryBlock<T>>
+  inline void KaryLayout(const T* sorted, T* out, CT_ length)
+  {
+    CT_ i = 0;
+    internal::kary_aux<T, CT_, (CT_)B>(sorted, out, length, (length + (CT_)B - 1) / (CT_)B, 0, i);
+  }
+
+  // Returns the position in a k-ary layout of the first key that isn't less than data, or KaryLength<T>(length) if every key is
+  // less. Each level compares data against a whole node with SSE (for 32-bit integers, floats and doubles, and 64-bit integers with
+  // SSE4.2), so it touches one cache line per level and takes log(n)/log(B + 1) steps instead of log(n).
+  template<typename T, typename CT_>
+  inline CT_ KarySearch(const T* arr, CT_ length, const T& data)
+  {
+    static_assert(std::is_arithmetic<T>::value, "KarySearch only works on arithmetic keys");
+    constexpr CT_ B = (CT_)KaryBlock<T>;
+    const CT_ blocks = KaryLength<T, CT_>(length) / B;
+    CT_ r = blocks * B;
+    for(CT_ k = 0; k < blocks;)
+    {
+      CT_ i = (CT_)internal::KeyCount<T>::Less(arr + k * B, (uint32_t)B, data);
+      r = (i < B) ? k * B + i : r;
+      k = k * (B + 1) + i + 1;
+    }
+    return r;
+  }
+
   // Generates a canonical function for the given real type with the maximum number of bits.
   template<typename T, typename ENGINE>
   BSS_FORCEINLINE T bssGenCanonical(ENGINE& e)
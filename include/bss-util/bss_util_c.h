@@ -39,6 +39,7 @@ extern "C" {
   struct tm;
 
   extern BSS_DLLEXPORT struct bssCPUInfo bssGetCPUInfo();
+  extern BSS_DLLEXPORT size_t bssGetProcessorCores(size_t* cores, size_t len); // Fills cores with an ID for the physical core each logical processor belongs to, so SMT siblings share an ID, and inactive processors get (size_t)~0. Returns the number of logical processors.
   extern BSS_DLLEXPORT int itoa_r(int value, char* buffer, int size, unsigned int radix); // For various stupid reasons we must reimplement multiple threadsafe versions of various functions because MinGW doesn't have them.
   extern BSS_DLLEXPORT const char* GetProgramPath();
   extern BSS_DLLEXPORT size_t GetWorkingSet();
@@ -144,6 +144,15 @@
 #define BSS_ALIGNED_CLASS(n) class BSS_ALIGN(n)
 #define BSS_ALIGNED_UNION(n) union BSS_ALIGN(n)
 
+// Hints that the cache line holding p will be read soon. This never faults, so p can point anywhere.
+#if defined(BSS_COMPILER_GCC) || defined(BSS_COMPILER_CLANG)
+#define BSS_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(BSS_SSE_ENABLED)
+#define BSS_PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define BSS_PREFETCH(p)
+#endif
+
 // Platform detection
 #if defined(WIN32) || defined(_WIN32) || defined(_WIN64) || defined(__TOS_WIN__) || defined(__WINDOWS__)
 #define BSS_PLATFORM_WIN32
@@ -11,6 +11,10 @@
 #include <intrin.h>
 #endif
 #include <atomic>
+#include <thread>
+#if defined(BSS_CPU_x86_64) || defined(BSS_CPU_x86)
+#include <emmintrin.h>
+#endif
 
 #ifdef BSS_CPU_x86
 #define BSSASM_PREG ECX
@@ -50,6 +54,9 @@ namespace bss {
   }
 #pragma warning(pop)
 
+  // Tells the CPU we're in a spin-wait loop, which frees up resources for an SMT sibling and avoids a pipeline flush when the loop exits
+  BSS_FORCEINLINE void CPU_Pause() { _mm_pause(); }
+
   namespace internal {
     template<typename T, int size>
     struct ATOMIC_XADDPICK { };
@@ -211,7 +218,7 @@ namespace bss {
       {
         uint8_t retval;
         __asm__ __volatile__(
-          "lock bts %[bit], %[x]\n\t"
+          "lock btsl %[bit], %[x]\n\t"
           "setc     %b[rv]\n\t"
           : [x] "+m" (*pval), [rv] "=rm"(retval)
           : [bit] "ri" (bit));
@@ -223,7 +230,7 @@ namespace bss {
       {
         uint8_t retval;
         __asm__ __volatile__(
-          "lock bts %[bit], %[x]\n\t"
+          "lock btsq %[bit], %[x]\n\t"
           "setc     %b[rv]\n\t"
           : [x] "+m" (*pval), [rv] "=rm"(retval)
           : [bit] "ri" (bit));
@@ -248,7 +255,7 @@ namespace bss {
       {
         uint8_t retval;
         __asm__ __volatile__(
-          "lock btr %[bit], %[x]\n\t"
+          "lock btrl %[bit], %[x]\n\t"
           "setc     %b[rv]\n\t"
           : [x] "+m" (*pval), [rv] "=rm"(retval)
           : [bit] "ri" (bit));
@@ -260,7 +267,7 @@ namespace bss {
       {
         uint8_t retval;
         __asm__ __volatile__(
-          "lock btr %[bit], %[x]\n\t"
+          "lock btrq %[bit], %[x]\n\t"
           "setc     %b[rv]\n\t"
           : [x] "+m" (*pval), [rv] "=rm"(retval)
           : [bit] "ri" (bit));
@@ -428,6 +435,197 @@ namespace bss {
   }*/
 #endif
  //defined(BSS_CPU_x86_64) || defined(BSS_CPU_x86)
+
+  namespace internal {
+    // Spins with a pause instruction, but yields the rest of the timeslice every so often, so a waiter that is queued behind a
+    // preempted thread doesn't burn its whole timeslice when there are more threads than cores.
+    BSS_FORCEINLINE void SpinWait(uint32_t& spins)
+    {
+      if(!(++spins & 0x3FF))
+        std::this_thread::yield();
+      else
+        CPU_Pause();
+    }
+  }
+
+  // Test-and-set spinlock. Cheapest when uncontended, but it isn't fair, and every waiter hammers the same cache line, which bounces
+  // between all of them on each handoff. The spin function passed to Lock() is called once for every failed attempt, which can be
+  // used to record contention.
+  class SpinLock
+  {
+    SpinLock(const SpinLock&) = delete;
+    SpinLock& operator=(const SpinLock&) = delete;
+
+  public:
+    inline SpinLock() { _flag.clear(std::memory_order_relaxed); }
+    BSS_FORCEINLINE bool TryLock() { return !_flag.test_and_set(std::memory_order_acquire); }
+    template<typename F>
+    BSS_FORCEINLINE void Lock(F&& spin)
+    {
+      uint32_t spins = 0;
+      while(_flag.test_and_set(std::memory_order_acquire))
+      {
+        spin();
+        internal::SpinWait(spins);
+      }
+    }
+    BSS_FORCEINLINE void Lock() { Lock([]() {}); }
+    BSS_FORCEINLINE void Unlock() { _flag.clear(std::memory_order_release); }
+
+  protected:
+    std::atomic_flag _flag;
+  };
+
+  // Ticket lock, which hands the lock out in the order it was requested. Waiters only read the shared line while spinning, and back
+  // off in proportion to how far back in line they are, but every handoff still invalidates that line in every waiter's cache.
+  class TicketLock
+  {
+    TicketLock(const TicketLock&) = delete;
+    TicketLock& operator=(const TicketLock&) = delete;
+
+  public:
+    inline TicketLock() : _next(0), _serving(0) {}
+    BSS_FORCEINLINE bool TryLock()
+    {
+      uint32_t t = _serving.load(std::memory_order_relaxed);
+      return _next.compare_exchange_strong(t, t + 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+    template<typename F>
+    BSS_FORCEINLINE void Lock(F&& spin)
+    {
+      uint32_t t = _next.fetch_add(1, std::memory_order_relaxed);
+      uint32_t spins = 0;
+      for(uint32_t s; (s = _serving.load(std::memory_order_acquire)) != t;)
+      {
+        spin();
+        for(uint32_t i = t - s; i > 0; --i)
+          internal::SpinWait(spins);
+      }
+    }
+    BSS_FORCEINLINE void Lock() { Lock([]() {}); }
+    BSS_FORCEINLINE void Unlock() { _serving.store(_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+  protected:
+    std::atomic<uint32_t> _next;
+    std::atomic<uint32_t> _serving;
+  };
+
+  // MCS queue lock. Each waiter links its own node onto the end of a queue and spins on a flag inside that node, which only its
+  // predecessor writes to when handing the lock over. Handoffs are fair and only touch two cache lines no matter how many threads are
+  // waiting. Lock(Node&) and Unlock(Node&) take a node that must stay alive until the lock is released. Lock() and Unlock() take one
+  // from a per-thread cache instead, so the lock can be used like any other, as long as it is unlocked on the thread that locked it.
+  class MCSLock
+  {
+    MCSLock(const MCSLock&) = delete;
+    MCSLock& operator=(const MCSLock&) = delete;
+
+  public:
+    BSS_ALIGNED_STRUCT(64) Node
+    {
+      std::atomic<Node*> next;
+      std::atomic<bool> locked;
+    };
+
+    inline MCSLock() : _tail(0), _holder(0) {}
+    BSS_FORCEINLINE bool TryLock(Node& node)
+    {
+      node.next.store(0, std::memory_order_relaxed);
+      Node* expected = 0;
+      return _tail.compare_exchange_strong(expected, &node, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+    template<typename F>
+    BSS_FORCEINLINE void Lock(Node& node, F&& spin)
+    {
+      node.next.store(0, std::memory_order_relaxed);
+      node.locked.store(true, std::memory_order_relaxed);
+      Node* prev = _tail.exchange(&node, std::memory_order_acq_rel);
+      if(prev)
+      {
+        prev->next.store(&node, std::memory_order_release);
+        uint32_t spins = 0;
+        while(node.locked.load(std::memory_order_acquire))
+        {
+          spin();
+          internal::SpinWait(spins);
+        }
+      }
+    }
+    BSS_FORCEINLINE void Lock(Node& node) { Lock(node, []() {}); }
+    BSS_FORCEINLINE void Unlock(Node& node)
+    {
+      Node* next = node.next.load(std::memory_order_acquire);
+      if(!next)
+      {
+        Node* expected = &node;
+        if(_tail.compare_exchange_strong(expected, 0, std::memory_order_release, std::memory_order_relaxed))
+          return;
+        uint32_t spins = 0;
+        while(!(next = node.next.load(std::memory_order_acquire))) // Someone swapped in behind us but hasn't linked themselves yet
+          internal::SpinWait(spins);
+      }
+      next->locked.store(false, std::memory_order_release);
+    }
+
+    inline bool TryLock()
+    {
+      Node* n = _getNode();
+      if(!TryLock(*n))
+      {
+        _putNode(n);
+        return false;
+      }
+      _holder = n;
+      return true;
+    }
+    template<typename F>
+    inline void Lock(F&& spin)
+    {
+      Node* n = _getNode();
+      Lock(*n, std::forward<F>(spin));
+      _holder = n; // Only the holder ever touches this
+    }
+    inline void Lock() { Lock([]() {}); }
+    inline void Unlock()
+    {
+      Node* n = _holder;
+      Unlock(*n);
+      _putNode(n);
+    }
+
+  protected:
+    struct NodeCache
+    {
+      ~NodeCache()
+      {
+        while(Node* n = free)
+        {
+          free = n->next.load(std::memory_order_relaxed);
+          delete n;
+        }
+      }
+      Node* free = 0;
+    };
+    static inline NodeCache& _cache() { static thread_local NodeCache cache; return cache; }
+    static inline Node* _getNode()
+    {
+      NodeCache& cache = _cache();
+      if(Node* n = cache.free)
+      {
+        cache.free = n->next.load(std::memory_order_relaxed);
+        return n;
+      }
+      return new Node();
+    }
+    static inline void _putNode(Node* n)
+    {
+      NodeCache& cache = _cache();
+      n->next.store(cache.free, std::memory_order_relaxed);
+      cache.free = n;
+    }
+
+    std::atomic<Node*> _tail;
+    Node* _holder;
+  };
 }
 
 #endif
@@ -0,0 +1,294 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/LocklessQueue.h"
+#include "bss-util/RWLock.h"
+#include "bss-util/ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace bss;
+
+// Scalability benchmarks for the concurrency primitives. Every benchmark runs for a fixed time at each thread count from 1 up to
+// twice the number of logical processors, and reports throughput along with latency percentiles. Latency is sampled on one operation
+// out of every SAMPLE on each thread, so timing doesn't dominate the cheaper operations, and includes the overhead of reading the clock.
+namespace {
+  static const uint64_t SAMPLE = 64;
+  static const size_t MAXSAMPLES = 1 << 16; // Per thread
+
+  // HighPrecisionTimer's profiler clock depends on the build. On POSIX it's only process CPU time if _POSIX_CPUTIME is already
+  // defined when HighPrecisionTimer.h is included, and otherwise it falls back to BSS_POSIX_CLOCK, which for the same reason is
+  // usually CLOCK_REALTIME and can jump. Benchmarks need a monotonic wall clock however they're built, so this uses steady_clock.
+  BSS_FORCEINLINE uint64_t bench_now() { return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+  struct BenchResult
+  {
+    const char* name;
+    size_t threads;
+    uint64_t ops;
+    uint64_t ns;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+  };
+
+  struct BenchSamples
+  {
+    BenchSamples() : ops(0) { samples.reserve(MAXSAMPLES); }
+    BSS_FORCEINLINE void Add(uint64_t ns) { if(samples.size() < MAXSAMPLES) samples.push_back((uint32_t)bssmin(ns, (uint64_t)UINT32_MAX)); }
+
+    uint64_t ops;
+    std::vector<uint32_t> samples;
+    char padding[64]; // Keeps the counters of neighbouring threads off the same cache line
+  };
+
+  BenchResult bench_collect(const char* name, size_t nthreads, uint64_t ns, std::vector<BenchSamples>& per)
+  {
+    BenchResult r = { name, nthreads, 0, ns, 0, 0, 0, 0 };
+    std::vector<uint32_t> all;
+    for(auto& s : per)
+    {
+      r.ops += s.ops;
+      all.insert(all.end(), s.samples.begin(), s.samples.end());
+    }
+    if(!all.empty())
+    {
+      std::sort(all.begin(), all.end());
+      auto pct = [&](size_t num, size_t den) { return (uint64_t)all[bssmin((all.size() * num) / den, all.size() - 1)]; };
+      r.p50 = pct(50, 100);
+      r.p99 = pct(99, 100);
+      r.p999 = pct(999, 1000);
+      r.max = all.back();
+    }
+    return r;
+  }
+
+  // Runs op(thread, iteration) on nthreads threads for ms milliseconds. op returns false if it didn't get any work done, such as a
+  // consumer finding an empty queue, in which case it isn't counted or sampled.
+  template<class F>
+  BenchResult bench_run(const char* name, size_t nthreads, uint64_t ms, F&& op)
+  {
+    std::vector<BenchSamples> per(nthreads);
+    std::atomic<bool> stop(false);
+    DynArray<Thread, size_t, ARRAY_MOVE> threads;
+    startflag.store(false);
+    for(size_t t = 0; t < nthreads; ++t)
+      threads.Add(Thread([&](size_t id) {
+      BenchSamples& s = per[id];
+      uint64_t n = 0;
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      while(!stop.load(std::memory_order_relaxed))
+      {
+        if(!(n % SAMPLE))
+        {
+          uint64_t begin = bench_now();
+          if(!op(id, n))
+            continue;
+          s.Add(bench_now() - begin);
+        }
+        else if(!op(id, n))
+          continue;
+        ++n;
+      }
+      s.ops = n;
+    }, t));
+    uint64_t begin = bench_now();
+    startflag.store(true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    stop.store(true);
+    for(auto& t : threads)
+      t.join();
+    return bench_collect(name, nthreads, bench_now() - begin, per);
+  }
+
+  BenchResult bench_xadd(size_t nthreads, uint64_t ms)
+  {
+    BSS_ALIGN(64) volatile uint64_t counter = 0;
+    return bench_run("atomic_xadd", nthreads, ms, [&](size_t, uint64_t) { atomic_xadd<uint64_t>(&counter, 1); return true; });
+  }
+  BenchResult bench_cas(size_t nthreads, uint64_t ms)
+  {
+    BSS_ALIGN(64) volatile uint64_t counter = 0;
+    return bench_run("asmcas", nthreads, ms, [&](size_t, uint64_t) {
+      uint64_t v;
+      do
+      {
+        v = counter;
+      } while(!asmcas<uint64_t>(&counter, v + 1, v));
+      return true;
+    });
+  }
+  // LocklessQueue is single-producer single-consumer, so threads are paired up, each pair with its own queue. An odd thread out
+  // pushes and pops its own queue. Producers back off once their queue holds a few thousand items so memory stays bounded.
+  BenchResult bench_locklessqueue(size_t nthreads, uint64_t ms)
+  {
+    std::unique_ptr<LocklessQueue<uint64_t, size_t>[]> queues(new LocklessQueue<uint64_t, size_t>[(nthreads + 1) / 2]);
+    return bench_run("LocklessQueue", nthreads, ms, [&](size_t id, uint64_t n) {
+      auto& q = queues[id / 2];
+      uint64_t v;
+      if((id & 1) || id + 1 == nthreads)
+      {
+        if(!(id & 1)) // Odd one out
+          q.Push(n);
+        return q.Pop(v);
+      }
+      if(q.Length() > 4096)
+      {
+        std::this_thread::yield();
+        return false;
+      }
+      q.Push(n);
+      return true;
+    });
+  }
+  // Every thread pushes then pops the same shared queue, so one operation is a push and a pop.
+  BenchResult bench_microlockqueue(size_t nthreads, uint64_t ms)
+  {
+    MicroLockQueue<uint64_t> q;
+    return bench_run("MicroLockQueue", nthreads, ms, [&](size_t, uint64_t n) { uint64_t v; q.Push(n); return q.Pop(v); });
+  }
+  BenchResult bench_boundedqueue(size_t nthreads, uint64_t ms)
+  {
+    BoundedQueue<uint64_t> q(4096);
+    return bench_run("BoundedQueue", nthreads, ms, [&](size_t, uint64_t n) { uint64_t v; return q.Push(n) && q.Pop(v); });
+  }
+  // One write for every nine reads, with a short critical section either way.
+  BenchResult bench_rwlock(size_t nthreads, uint64_t ms)
+  {
+    RWLock lock;
+    volatile uint64_t shared[8] = { 0 };
+    return bench_run("RWLock", nthreads, ms, [&](size_t, uint64_t n) {
+      if(!(n % 10))
+      {
+        lock.Lock();
+        for(size_t i = 0; i < 8; ++i)
+          shared[i] = shared[i] + 1;
+        lock.Unlock();
+      }
+      else
+      {
+        lock.RLock();
+        uint64_t sum = 0;
+        for(size_t i = 0; i < 8; ++i)
+          sum += shared[i];
+        lock.RUnlock();
+        (void)sum;
+      }
+      return true;
+    });
+  }
+  // Each thread signals the shared semaphore and then waits on it. Every wait has a matching signal, so nobody blocks forever, but a
+  // thread can be woken by another's signal, which is the cross-thread handoff this measures.
+  BenchResult bench_semaphore(size_t nthreads, uint64_t ms)
+  {
+    Semaphore sem;
+    return bench_run("Semaphore", nthreads, ms, [&](size_t, uint64_t) { sem.Notify(); return sem.Wait(); });
+  }
+  // A pool of nthreads workers runs empty tasks that the main thread submits in batches. Latency is the time from submitting a task
+  // to it starting, so it includes queueing behind the rest of its batch.
+  BenchResult bench_threadpool(size_t nthreads, uint64_t ms)
+  {
+    static const size_t BATCH = 256;
+    ThreadPool pool(nthreads);
+    std::unique_ptr<uint32_t[]> samples(new uint32_t[MAXSAMPLES]);
+    std::atomic<size_t> nsamples(0);
+    std::vector<Task> tasks;
+    tasks.reserve(BATCH);
+    uint64_t ops = 0;
+    uint64_t begin = bench_now();
+    while(bench_now() - begin < ms * 1000000)
+    {
+      for(size_t i = 0; i < BATCH; ++i)
+      {
+        if(!(i % SAMPLE))
+        {
+          uint64_t submit = bench_now();
+          tasks.push_back(Task([submit, &samples, &nsamples]() {
+            size_t k = nsamples.fetch_add(1, std::memory_order_relaxed);
+            if(k < MAXSAMPLES)
+              samples[k] = (uint32_t)bssmin(bench_now() - submit, (uint64_t)UINT32_MAX);
+          }));
+        }
+        else
+          tasks.push_back(Task([]() {}));
+      }
+      pool.AddTasks(Slice<Task>(tasks.data(), tasks.size()));
+      tasks.clear();
+      ops += BATCH;
+      pool.Wait();
+    }
+    std::vector<BenchSamples> per(1);
+    per[0].ops = ops;
+    per[0].samples.assign(samples.get(), samples.get() + bssmin(nsamples.load(), MAXSAMPLES));
+    return bench_collect("ThreadPool", nthreads, bench_now() - begin, per);
+  }
+
+  void bench_write(std::ostream& out, const std::vector<BenchResult>& results, bool json)
+  {
+    if(json)
+      out << "[" << std::endl;
+    else
+      out << "primitive,threads,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns" << std::endl;
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+      const BenchResult& r = results[i];
+      double secs = r.ns / 1000000000.0;
+      double rate = r.ops / bssmax(secs, 1e-9);
+      if(json)
+        out << "  { \"primitive\": \"" << r.name << "\", \"threads\": " << r.threads << ", \"ops\": " << r.ops << ", \"seconds\": " << secs
+        << ", \"ops_per_sec\": " << rate << ", \"p50_ns\": " << r.p50 << ", \"p99_ns\": " << r.p99 << ", \"p999_ns\": " << r.p999
+        << ", \"max_ns\": " << r.max << " }" << ((i + 1 < results.size()) ? "," : "") << std::endl;
+      else
+        out << r.name << "," << r.threads << "," << r.ops << "," << secs << "," << rate << "," << r.p50 << "," << r.p99 << "," << r.p999 << "," << r.max << std::endl;
+    }
+    if(json)
+      out << "]" << std::endl;
+  }
+}
+
+// Usage: test --bench [csv|json] [milliseconds per run] [max threads, or 0 for twice the core count] [output file]
+int benchmark_concurrency(int argc, char** argv)
+{
+  bool json = argc > 0 && !STRICMP(argv[0], "json");
+  uint64_t ms = (argc > 1) ? strtoull(argv[1], 0, 10) : 200;
+  size_t cores = bssmax(std::thread::hardware_concurrency(), 1u);
+  size_t max = (argc > 2) ? strtoull(argv[2], 0, 10) : 0;
+  if(!max)
+    max = cores * 2;
+
+  std::vector<size_t> counts;
+  for(size_t n = 1; n <= max; n *= 2)
+    counts.push_back(n);
+  if(cores <= max)
+    counts.push_back(cores);
+  counts.push_back(max);
+  std::sort(counts.begin(), counts.end());
+  counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+
+  BenchResult(*benches[])(size_t, uint64_t) = { &bench_xadd, &bench_cas, &bench_locklessqueue, &bench_microlockqueue, &bench_boundedqueue,
+    &bench_rwlock, &bench_semaphore, &bench_threadpool };
+  std::vector<BenchResult> results;
+  for(auto bench : benches)
+    for(size_t n : counts)
+    {
+      results.push_back(bench(n, ms));
+      const BenchResult& r = results.back();
+      std::cerr << r.name << " x" << n << ": " << (r.ops / bssmax(r.ns / 1000000000.0, 1e-9)) << " ops/s, p99 " << r.p99 << " ns" << std::endl;
+    }
+
+  if(argc > 3)
+  {
+    std::ofstream out(argv[3], std::ios_base::out | std::ios_base::trunc);
+    if(!out)
+      return 1;
+    bench_write(out, results, json);
+  }
+  else
+    bench_write(std::cout, results, json);
+  return 0;
+}
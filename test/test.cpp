@@ -91,6 +91,18 @@ int main(int argc, char** argv)
   //seed = 1489803649;
   bssRandSeed(seed);
   //profile_ring_alloc();
+  //profile_concurrent_hash();
+  //profile_actor();
+  //profile_spinlocks();
+  //profile_threadpool();
+  //profile_event();
+  //profile_barrier();
+  //profile_perfecthash();
+  //profile_btree();
+  //profile_staticmap();
+
+  if(argc > 1 && !STRICMP(argv[1], "--bench"))
+    return benchmark_concurrency(argc - 2, argv + 2);
 
   for(uint16_t i = 0; i<TESTNUM; ++i)
     testnums[i] = i;
@@ -115,6 +127,7 @@ int main(int argc, char** argv)
     { "stream.h", &test_STREAM },
     { "Graph.h", &test_bss_GRAPH },
     { "vector.h", &test_VECTOR },
+    { "Actor.h", &test_ACTOR },
     { "AliasTable.h", &test_ALIASTABLE },
     { "Animation.h", &test_ANIMATION },
     { "ArrayCircular.h", &test_ARRAYCIRCULAR },
@@ -122,14 +135,19 @@ int main(int argc, char** argv)
     { "ArraySort.h", &test_ARRAYSORT },
     { "AVLtree.h", &test_AVLTREE },
     { "AAtree.h", &test_AA_TREE },
+    { "Barrier.h", &test_BARRIER },
     { "BinaryHeap.h", &test_BINARYHEAP },
     { "BitField.h", &test_BITFIELD },
     { "BitStream.h", &test_BITSTREAM },
+    { "BTree.h", &test_BTREE },
     { "CompactArray.h", &test_COMPACTARRAY },
+    { "ConcurrentHash.h", &test_CONCURRENTHASH },
+    { "ConcurrentSkipList.h", &test_CONCURRENTSKIPLIST },
     { "Queue.h", &test_BSS_QUEUE },
     { "Stack.h", &test_BSS_STACK },
     { "DisjointSet.h", &test_DISJOINTSET },
     { "DynArray.h", &test_DYNARRAY },
+    { "Event.h", &test_EVENT },
     { "HighPrecisionTimer.h", &test_HIGHPRECISIONTIMER },
     { "Scheduler.h", &test_SCHEDULER },
     { "INIstorage.h", &test_INISTORAGE },
@@ -142,17 +160,24 @@ int main(int argc, char** argv)
     { "literals.h", &test_LITERALS },
     { "lockless.h", &test_LOCKLESS },
     { "LocklessQueue.h", &test_LOCKLESSQUEUE },
+    { "LockStats.h", &test_LOCKSTATS },
     { "Map.h", &test_MAP },
+    { "PerfectHash.h", &test_PERFECTHASH },
+    { "Pipeline.h", &test_PIPELINE },
     { "PriorityQueue.h", &test_PRIORITYQUEUE },
     { "Rational.h", &test_RATIONAL },
     { "RandomQueue.h", &test_RANDOMQUEUE },
     { "RefCounter.h", &test_REFCOUNTER },
     { "RWLock.h", &test_RWLOCK },
+    { "SharedRing.h", &test_SHAREDRING },
     { "Singleton.h", &test_SINGLETON },
+    { "SlotMap.h", &test_SLOTMAP },
+    { "StaticMap.h", &test_STATICMAP },
     { "Str.h", &test_STR },
     { "StringTable.h", &test_STRTABLE },
     { "Thread.h", &test_THREAD },
     { "ThreadPool.h", &test_THREADPOOL },
+    { "TimingWheel.h", &test_TIMINGWHEEL },
     { "TOML.h", &test_TOML },
     { "TRBtree.h", &test_TRBTREE },
     { "Trie.h", &test_TRIE },
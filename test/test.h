@@ -31,6 +31,17 @@ extern uint16_t testnums[TESTNUM];
 extern bss::Logger _failedtests;
 extern volatile std::atomic<bool> startflag;
 
+void profile_concurrent_hash();
+void profile_actor();
+void profile_spinlocks();
+void profile_threadpool();
+void profile_event();
+void profile_barrier();
+void profile_perfecthash();
+void profile_btree();
+void profile_staticmap();
+int benchmark_concurrency(int argc, char** argv);
+
 #define BEGINTEST TESTDEF::RETPAIR __testret(0,0); DEBUG_CDT_SAFE::_testret = &__testret; DEBUG_CDT_SAFE::Tracker.Clear();
 #define ENDTEST return __testret
 #define FAILEDTEST(t) BSSLOG(_failedtests,1, "Test #",__testret.first," Failed  < ",TXT(t)," >")
@@ -122,16 +133,21 @@ struct RCounter : bss::RefCounter
 };
 
 TESTDEF::RETPAIR test_AA_TREE();
+TESTDEF::RETPAIR test_ACTOR();
 TESTDEF::RETPAIR test_ALIASTABLE();
 TESTDEF::RETPAIR test_ANIMATION();
 TESTDEF::RETPAIR test_ARRAY();
 TESTDEF::RETPAIR test_ARRAYCIRCULAR();
 TESTDEF::RETPAIR test_ARRAYSORT();
 TESTDEF::RETPAIR test_AVLTREE();
+TESTDEF::RETPAIR test_BARRIER();
 TESTDEF::RETPAIR test_BINARYHEAP();
 TESTDEF::RETPAIR test_BITFIELD();
 TESTDEF::RETPAIR test_BITSTREAM();
+TESTDEF::RETPAIR test_BTREE();
 TESTDEF::RETPAIR test_COMPACTARRAY();
+TESTDEF::RETPAIR test_CONCURRENTHASH();
+TESTDEF::RETPAIR test_CONCURRENTSKIPLIST();
 TESTDEF::RETPAIR test_bss_algo();
 TESTDEF::RETPAIR test_bss_ALLOC_BLOCK();
 TESTDEF::RETPAIR test_bss_ALLOC_BLOCK_LOCKLESS();
@@ -151,6 +167,7 @@ TESTDEF::RETPAIR test_DELEGATE();
 TESTDEF::RETPAIR test_DISJOINTSET();
 TESTDEF::RETPAIR test_bss_DUAL();
 TESTDEF::RETPAIR test_DYNARRAY();
+TESTDEF::RETPAIR test_EVENT();
 TESTDEF::RETPAIR test_bss_FIXEDPT();
 TESTDEF::RETPAIR test_GEOMETRY();
 TESTDEF::RETPAIR test_HASH();
@@ -163,8 +180,11 @@ TESTDEF::RETPAIR test_LINKEDLIST();
 TESTDEF::RETPAIR test_LITERALS();
 TESTDEF::RETPAIR test_LOCKLESS();
 TESTDEF::RETPAIR test_LOCKLESSQUEUE();
+TESTDEF::RETPAIR test_LOCKSTATS();
 TESTDEF::RETPAIR test_MAP();
 TESTDEF::RETPAIR test_OS();
+TESTDEF::RETPAIR test_PERFECTHASH();
+TESTDEF::RETPAIR test_PIPELINE();
 TESTDEF::RETPAIR test_PRIORITYQUEUE();
 TESTDEF::RETPAIR test_PROFILE();
 TESTDEF::RETPAIR test_BSS_QUEUE();
@@ -174,14 +194,18 @@ TESTDEF::RETPAIR test_REFCOUNTER();
 TESTDEF::RETPAIR test_RWLOCK();
 TESTDEF::RETPAIR test_SCHEDULER();
 TESTDEF::RETPAIR test_Serializer();
+TESTDEF::RETPAIR test_SHAREDRING();
 TESTDEF::RETPAIR test_SINGLETON();
+TESTDEF::RETPAIR test_SLOTMAP();
 TESTDEF::RETPAIR test_SMARTPTR();
+TESTDEF::RETPAIR test_STATICMAP();
 TESTDEF::RETPAIR test_BSS_STACK();
 TESTDEF::RETPAIR test_STR();
 TESTDEF::RETPAIR test_STREAM();
 TESTDEF::RETPAIR test_STRTABLE();
 TESTDEF::RETPAIR test_THREAD();
 TESTDEF::RETPAIR test_THREADPOOL();
+TESTDEF::RETPAIR test_TIMINGWHEEL();
 TESTDEF::RETPAIR test_TOML();
 TESTDEF::RETPAIR test_TRBTREE();
 TESTDEF::RETPAIR test_TRIE();
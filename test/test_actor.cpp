@@ -0,0 +1,190 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/Actor.h"
+#include "bss-util/HighPrecisionTimer.h"
+#include <iostream>
+
+using namespace bss;
+
+namespace {
+  struct ActorMsg : MailboxNode
+  {
+    int sender;
+    int seq;
+  };
+
+  struct ActorCounter
+  {
+    static const int NSENDERS = 4;
+    int next[NSENDERS];
+    int received;
+    int misordered;
+    std::atomic<int> running;
+    int overlapped;
+
+    ActorCounter() : received(0), misordered(0), running(0), overlapped(0) { memset(next, 0, sizeof(next)); }
+    void Receive(ActorMsg* msg)
+    {
+      if(running.fetch_add(1, std::memory_order_acquire) != 0)
+        ++overlapped;
+      if(msg->seq != next[msg->sender]++)
+        ++misordered;
+      ++received;
+      running.fetch_sub(1, std::memory_order_release);
+    }
+  };
+}
+
+TESTDEF::RETPAIR test_ACTOR()
+{
+  BEGINTEST;
+
+  {
+    ActorMsg msgs[4];
+    Mailbox<ActorMsg> box;
+    TEST(box.Empty() && box.Untouched());
+    TEST(!box.Pop());
+    for(int i = 0; i < 4; ++i)
+    {
+      msgs[i].seq = i;
+      box.Push(msgs + i);
+    }
+    TEST(!box.Empty() && !box.Untouched());
+    TEST(box.Pop() == msgs + 0);
+    TEST(box.Pop() == msgs + 1);
+    box.Push(msgs + 0);
+    TEST(box.Pop() == msgs + 2);
+    TEST(box.Pop() == msgs + 3);
+    TEST(box.Pop() == msgs + 0);
+    TEST(!box.Pop());
+    TEST(box.Empty());
+    box.Push(msgs + 1);
+    TEST(!box.Untouched());
+    TEST(box.Pop() == msgs + 1);
+    TEST(box.Empty() && box.Untouched());
+  }
+
+  {
+    const int NTHREADS = 4;
+    const int NMSGS = 5000;
+    std::unique_ptr<ActorMsg[]> msgs(new ActorMsg[NTHREADS * NMSGS]);
+    Mailbox<ActorMsg> box;
+    startflag.store(false);
+    Thread threads[NTHREADS];
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t] = Thread([&](int id) {
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      for(int i = 0; i < NMSGS; ++i)
+      {
+        ActorMsg* m = msgs.get() + id * NMSGS + i;
+        m->sender = id;
+        m->seq = i;
+        box.Push(m);
+      }
+    }, t);
+    startflag.store(true);
+
+    int next[NTHREADS] = { 0 };
+    int received = 0;
+    bool ordered = true;
+    while(received < NTHREADS * NMSGS)
+    {
+      if(ActorMsg* m = box.Pop())
+      {
+        ordered = ordered && m->seq == next[m->sender]++;
+        ++received;
+      }
+      else
+        std::this_thread::yield();
+    }
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t].join();
+    TEST(ordered);
+    TEST(!box.Pop());
+    TEST(box.Empty());
+  }
+
+  {
+    const int NMSGS = 5000;
+    ThreadPool pool(3);
+    ActorCounter counter;
+    std::unique_ptr<ActorMsg[]> msgs(new ActorMsg[ActorCounter::NSENDERS * NMSGS]);
+    Actor<ActorMsg> actor(pool, Actor<ActorMsg>::HANDLER::From<ActorCounter, &ActorCounter::Receive>(&counter), 16);
+    startflag.store(false);
+    Thread threads[ActorCounter::NSENDERS];
+    for(int t = 0; t < ActorCounter::NSENDERS; ++t)
+      threads[t] = Thread([&](int id) {
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      for(int i = 0; i < NMSGS; ++i)
+      {
+        ActorMsg* m = msgs.get() + id * NMSGS + i;
+        m->sender = id;
+        m->seq = i;
+        actor.Send(m);
+      }
+    }, t);
+    startflag.store(true);
+    for(int t = 0; t < ActorCounter::NSENDERS; ++t)
+      threads[t].join();
+    pool.Wait();
+
+    TEST(actor.Idle());
+    TEST(counter.received == ActorCounter::NSENDERS * NMSGS);
+    TEST(!counter.misordered);
+    TEST(!counter.overlapped);
+  }
+
+  ENDTEST;
+}
+
+// Compares sending messages to a single consumer through an Actor against pushing them onto a MicroLockQueue drained by a pool task.
+void profile_actor()
+{
+  const int NMSGS = 1 << 18;
+  size_t max = std::thread::hardware_concurrency() * 2;
+  std::unique_ptr<ActorMsg[]> msgs(new ActorMsg[NMSGS]);
+  for(int i = 0; i < NMSGS; ++i)
+  {
+    msgs[i].sender = 0;
+    msgs[i].seq = i;
+  }
+  for(size_t n = 1; n <= max; n *= 2)
+  {
+    ThreadPool pool(1);
+    ActorCounter counter;
+    Actor<ActorMsg> actor(pool, Actor<ActorMsg>::HANDLER::From<ActorCounter, &ActorCounter::Receive>(&counter));
+    std::pair<MicroLockQueue<ActorMsg*>, ActorCounter*> queue;
+    queue.second = &counter;
+
+    auto run = [&](auto&& send) {
+      DynArray<Thread, size_t, ARRAY_MOVE> threads;
+      startflag.store(false);
+      for(size_t t = 0; t < n; ++t)
+        threads.Add(Thread([&](size_t id) {
+        while(!startflag.load(std::memory_order_acquire));
+        for(size_t i = id; i < (size_t)NMSGS; i += n)
+          send(msgs.get() + i);
+      }, t));
+      auto prof = HighPrecisionTimer::OpenProfiler();
+      startflag.store(true);
+      for(auto& t : threads)
+        t.join();
+      pool.Wait();
+      return HighPrecisionTimer::CloseProfiler(prof);
+    };
+
+    uint64_t a = run([&](ActorMsg* m) {
+      queue.first.Push(m);
+      pool.AddTask([](void* p) {
+        auto& q = *reinterpret_cast<std::pair<MicroLockQueue<ActorMsg*>, ActorCounter*>*>(p);
+        ActorMsg* msg;
+        if(q.first.Pop(msg))
+          q.second->Receive(msg);
+      }, &queue);
+    });
+    uint64_t b = run([&](ActorMsg* m) { actor.Send(m); });
+    std::cout << n << " senders: MicroLockQueue+ThreadPool " << a << " ns, Actor " << b << " ns" << std::endl;
+  }
+}
@@ -0,0 +1,208 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/Barrier.h"
+#include "bss-util/ThreadPool.h"
+#include "bss-util/HighPrecisionTimer.h"
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace bss;
+
+TESTDEF::RETPAIR test_BARRIER()
+{
+  BEGINTEST;
+  const uint32_t NTHREADS = 4;
+  const uint32_t NPHASES = 500;
+
+  for(uint32_t spin : { 0u, 4096u }) // 0 forces every waiter to park
+  {
+    {
+      Latch latch(3, spin);
+      TEST(!latch.TryWait());
+      TEST(latch.Count() == 3);
+      latch.CountDown();
+      TEST(!latch.TryWait());
+      latch.CountDown(2);
+      TEST(latch.TryWait());
+      latch.Wait(); // Returns immediately
+    }
+
+    {
+      Latch latch(NTHREADS, spin);
+      std::atomic<uint32_t> before(0);
+      std::atomic<uint32_t> bad(0);
+      DynArray<Thread, size_t, ARRAY_MOVE> threads;
+      for(uint32_t t = 0; t < NTHREADS; ++t)
+        threads.Add(Thread([&]() {
+        before.fetch_add(1, std::memory_order_relaxed);
+        latch.ArriveAndWait();
+        if(before.load(std::memory_order_relaxed) != NTHREADS)
+          bad.fetch_add(1, std::memory_order_relaxed);
+      }));
+      for(auto& t : threads)
+        t.join();
+      TEST(!bad.load());
+      TEST(latch.TryWait());
+    }
+
+    {
+      Latch latch(1, spin);
+      std::atomic<bool> done(false);
+      Thread waiter([&]() { latch.Wait(); done.store(true); });
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      TEST(!done.load());
+      latch.CountDown();
+      waiter.join();
+      TEST(done.load());
+    }
+
+    {
+      Barrier barrier(1, spin);
+      TEST(barrier.Wait());
+      TEST(barrier.Wait());
+      TEST(barrier.Phase() == 2);
+      TEST(barrier.Count() == 1);
+    }
+
+    // Every thread bumps the counter for the current phase, then checks that everyone got there before anyone moved on.
+    {
+      Barrier barrier(NTHREADS, spin);
+      std::unique_ptr<std::atomic<uint32_t>[]> counts(new std::atomic<uint32_t>[NPHASES]);
+      for(uint32_t i = 0; i < NPHASES; ++i)
+        counts[i].store(0, std::memory_order_relaxed);
+      std::atomic<uint32_t> bad(0);
+      std::atomic<uint32_t> serial(0);
+      std::atomic<uint32_t> completions(0);
+      DynArray<Thread, size_t, ARRAY_MOVE> threads;
+      for(uint32_t t = 0; t < NTHREADS; ++t)
+        threads.Add(Thread([&]() {
+        for(uint32_t i = 0; i < NPHASES; ++i)
+        {
+          counts[i].fetch_add(1, std::memory_order_relaxed);
+          bool last = barrier.Wait([&]() {
+            if(counts[i].load(std::memory_order_relaxed) != NTHREADS)
+              bad.fetch_add(1, std::memory_order_relaxed);
+            completions.fetch_add(1, std::memory_order_relaxed);
+          });
+          if(last)
+            serial.fetch_add(1, std::memory_order_relaxed);
+          if(counts[i].load(std::memory_order_relaxed) != NTHREADS)
+            bad.fetch_add(1, std::memory_order_relaxed);
+        }
+      }));
+      for(auto& t : threads)
+        t.join();
+      TEST(!bad.load());
+      TEST(serial.load() == NPHASES);
+      TEST(completions.load() == NPHASES);
+      TEST(barrier.Phase() == NPHASES);
+    }
+
+    {
+      ParallelRegion region(1, spin);
+      TEST(region.Size() == 1);
+      uint32_t calls = 0;
+      region.Run([&](uint32_t index) { calls += 1 + index; region.Sync(); });
+      TEST(calls == 1);
+    }
+
+    // Phases of a Jacobi-style sweep over a shared array, with a reduction in each barrier's completion function.
+    {
+      ParallelRegion region(NTHREADS, spin);
+      TEST(region.Size() == NTHREADS);
+      const size_t N = 1000;
+      std::vector<uint64_t> a(N), b(N);
+      for(size_t i = 0; i < N; ++i)
+        a[i] = i;
+      std::unique_ptr<uint64_t[]> partial(new uint64_t[NTHREADS]);
+      std::vector<uint64_t> sums;
+      std::atomic<uint32_t> members(0);
+
+      for(int run = 0; run < 3; ++run)
+      {
+        members.store(0);
+        region.Run([&](uint32_t index) {
+          members.fetch_add(1 << index, std::memory_order_relaxed);
+          for(uint32_t step = 0; step < 20; ++step)
+          {
+            region.For(index, 0, N, [&](size_t i) { b[i] = a[i] + 1; });
+            size_t lo, hi;
+            region.Chunk(index, 0, N, lo, hi);
+            uint64_t s = 0;
+            for(size_t i = lo; i < hi; ++i)
+              s += (a[i] = b[i]);
+            partial[index] = s;
+            region.Sync([&]() {
+              uint64_t total = 0;
+              for(uint32_t j = 0; j < NTHREADS; ++j)
+                total += partial[j];
+              sums.push_back(total);
+            });
+          }
+        });
+        TEST(members.load() == (1u << NTHREADS) - 1);
+      }
+
+      bool match = sums.size() == 60;
+      for(size_t k = 0; k < sums.size() && match; ++k) // After k + 1 steps every element has gone up by k + 1
+        match = sums[k] == (N * (N - 1)) / 2 + N * (k + 1);
+      TEST(match);
+      TEST(a[N - 1] == N - 1 + 60);
+    }
+
+    {
+      ParallelRegion region(NTHREADS, spin);
+      size_t b, e, total = 0, last = 10;
+      bool contiguous = true;
+      for(uint32_t i = 0; i < NTHREADS; ++i)
+      {
+        region.Chunk(i, 10, 17, b, e);
+        contiguous = contiguous && b == last && e >= b;
+        total += e - b;
+        last = e;
+      }
+      TEST(contiguous);
+      TEST(total == 7);
+    } // Destroying a region that never ran has to stop the parked workers
+  }
+
+  ENDTEST;
+}
+
+// Compares the cost of a phase transition on a ParallelRegion against submitting one task per thread to a ThreadPool and waiting.
+void profile_barrier()
+{
+  const uint32_t NPHASES = 20000;
+  uint32_t max = bssmax(std::thread::hardware_concurrency(), 1u);
+  for(uint32_t n = 1; n <= max; n *= 2)
+  {
+    std::atomic<uint64_t> work(0);
+    uint64_t a, b;
+    {
+      ThreadPool pool(n);
+      auto prof = HighPrecisionTimer::OpenProfiler();
+      for(uint32_t i = 0; i < NPHASES; ++i)
+      {
+        pool.AddTask([](void* p) { reinterpret_cast<std::atomic<uint64_t>*>(p)->fetch_add(1, std::memory_order_relaxed); }, &work, n);
+        pool.Wait();
+      }
+      a = HighPrecisionTimer::CloseProfiler(prof);
+    }
+    {
+      ParallelRegion region(n);
+      auto prof = HighPrecisionTimer::OpenProfiler();
+      region.Run([&](uint32_t) {
+        for(uint32_t i = 0; i < NPHASES; ++i)
+        {
+          work.fetch_add(1, std::memory_order_relaxed);
+          region.Sync();
+        }
+      });
+      b = HighPrecisionTimer::CloseProfiler(prof);
+    }
+    std::cout << n << " threads: ThreadPool " << (a / NPHASES) << " ns/phase, ParallelRegion " << (b / NPHASES) << " ns/phase" << std::endl;
+  }
+}
@@ -5,6 +5,7 @@
 #include "bss-util/algo.h"
 #include "bss-util/vector.h"
 #include <functional>
+#include <vector>
 
 using namespace bss;
 
@@ -36,6 +37,41 @@ TESTDEF::RETPAIR test_bss_algo()
     TEST((BinarySearchExact<int, uint32_t, CompT<int>, 1>(d, 2) == -1));
   }
 
+  { // Every layout has to find the same element as std::lower_bound
+    for(size_t n : { 1, 2, 15, 16, 17, 100, 272, 273, 1000, 5000 })
+    {
+      std::vector<int> sorted(n);
+      for(size_t i = 0; i < n; ++i)
+        sorted[i] = (int)(i * 2) - 500;
+      std::unique_ptr<int[]> eyt(new int[n + 1]);
+      std::unique_ptr<int[]> kary(new int[KaryLength<int>(n)]);
+      EytzingerLayout<int, size_t>(sorted.data(), eyt.get(), n);
+      KaryLayout<int, size_t>(sorted.data(), kary.get(), n);
+      bool near = true, eytzinger = true, exact = true, karyok = true;
+      for(int x = -503; x < (int)(n * 2) - 496; ++x)
+      {
+        size_t lb = std::lower_bound(sorted.begin(), sorted.end(), x) - sorted.begin();
+        near = near && BinarySearchAfter<int, size_t, CompT<int>>(sorted.data(), n, x) == lb;
+        size_t k = EytzingerSearch<int, int, size_t, CompT<int>>(eyt.get(), n, x);
+        eytzinger = eytzinger && (lb == n ? !k : (k > 0 && eyt[k] == sorted[lb]));
+        exact = exact && (EytzingerExact<int, int, size_t, CompT<int>>(eyt.get(), n, x) != 0) == (lb < n && sorted[lb] == x);
+        size_t r = KarySearch<int, size_t>(kary.get(), n, x);
+        karyok = karyok && (lb == n ? r == KaryLength<int>(n) : (r < KaryLength<int>(n) && kary[r] == sorted[lb]));
+      }
+      TEST(near);
+      TEST(eytzinger);
+      TEST(exact);
+      TEST(karyok);
+    }
+
+    double d[] = { -1e300, -2.5, -0.0, 1.0, 3.5, 1e10 };
+    std::unique_ptr<double[]> dk(new double[KaryLength<double>(6)]);
+    KaryLayout<double, size_t>(d, dk.get(), 6);
+    TEST((dk[KarySearch<double, size_t>(dk.get(), 6, 3.5)] == 3.5));
+    TEST((dk[KarySearch<double, size_t>(dk.get(), 6, -3.0)] == -2.5));
+    TEST((KarySearch<double, size_t>(dk.get(), 6, 2e10) == KaryLength<double>(6)));
+  }
+
   {
     NormalZig<128> zig; // TAKE OFF EVERY ZIG!
     float rect[4] = { 0,100,1000,2000 };
@@ -3,6 +3,7 @@
 
 #include "test.h"
 #include "bss-util/Logger.h"
+#include "bss-util/Thread.h"
 #include <sstream>
 #include <fstream>
 
@@ -54,5 +55,65 @@ TESTDEF::RETPAIR test_bss_LOG()
   BSSLOG(lg, 3, 0, "string", 1.0f, 35);
   lg.LogFormat("bss", "\\asfsdbs/dsfs\\ds/main.cpp/", __LINE__, 1, "{1}{0}{4}{{2}} {3}", 0, 1, 2, 3, 4);
   lg.PrintLog("bss2", "\\asfsdbs/dsfs\\ds/main.cpp\\", __LINE__, 0, "%s%i", "test", -28);
+
+  {
+    std::stringstream out;
+    Logger al(&out);
+    al.SetNullFormat("");
+    al.SetAsync(256, Logger::ASYNC_BLOCK, 1);
+    TEST(al.IsAsync());
+    const int NTHREADS = 4;
+    const int NRECORDS = 500;
+    Thread threads[NTHREADS];
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t] = Thread([&](int id) { for(int i = 0; i < NRECORDS; ++i) al.Log(0, __FILE__, __LINE__, 4, id, ' ', i); }, t);
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t].join();
+    al.Flush();
+    TEST(al.GetDropped() == 0);
+
+    int next[NTHREADS] = { 0 };
+    int id, i;
+    bool ordered = true;
+    while(out >> id >> i) // Records from different threads interleave, but each thread's records must stay in order
+    {
+      ordered = ordered && id >= 0 && id < NTHREADS && next[id] == i;
+      if(id >= 0 && id < NTHREADS)
+        ++next[id];
+    }
+    TEST(ordered);
+    for(int t = 0; t < NTHREADS; ++t)
+      TEST(next[t] == NRECORDS);
+
+    al.ClearAsync();
+    TEST(!al.IsAsync());
+    std::stringstream sync;
+    al.AddTarget(sync);
+    al.Log(0, __FILE__, __LINE__, 4, "sync");
+    TEST(sync.str() == "sync\n");
+  }
+
+  {
+    std::stringstream out;
+    Logger al(&out);
+    al.SetNullFormat("");
+    al.SetAsync(64, Logger::ASYNC_DROP, 1000); // Each record only fits in an empty buffer, so most of them get dropped
+    const int NRECORDS = 100;
+    for(int i = 0; i < NRECORDS; ++i)
+      al.Log(0, __FILE__, __LINE__, 4, "0123456789012345678901234567890123456789012345678901234567890123456789");
+    al.Flush();
+    std::string line;
+    uint64_t written = 0;
+    bool truncated = true;
+    while(std::getline(out, line))
+    {
+      if(line.find("[Logger dropped") == 0)
+        continue;
+      truncated = truncated && line.size() < 64;
+      ++written;
+    }
+    TEST(truncated);
+    TEST(written + al.GetDropped() == NRECORDS);
+  }
   ENDTEST;
 }
\ No newline at end of file
@@ -0,0 +1,342 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/BTree.h"
+#include "bss-util/AVLTree.h"
+#include "bss-util/TRBtree.h"
+#include "bss-util/Map.h"
+#include "bss-util/HighPrecisionTimer.h"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace bss;
+
+namespace {
+  // Checks that a tree holds exactly the same elements as the reference, in the same order.
+  template<class T, class M>
+  bool btree_matches(const T& tree, const M& ref)
+  {
+    if(tree.Length() != ref.size() || !tree.DEBUGVERIFY())
+      return false;
+    auto r = ref.begin();
+    for(auto e : tree)
+    {
+      if(r == ref.end() || e.first != r->first || e.second != r->second)
+        return false;
+      ++r;
+    }
+    return r == ref.end();
+  }
+
+  // Runs a random mix of inserts and removes against a std::map over a small key range, so there are plenty of duplicates and misses.
+  template<class T>
+  bool btree_random(T& tree, int range, int ops)
+  {
+    std::map<int, int> ref;
+    for(int i = 0; i < ops; ++i)
+    {
+      int k = bssRandInt(-range, range);
+      if(bssRandInt(0, 3) != 0)
+      {
+        if(tree.Insert(k, i) != ref.insert(std::make_pair(k, i)).second)
+          return false;
+      }
+      else if(tree.Remove(k) != (ref.erase(k) != 0))
+        return false;
+      if(!(i % 997) && !btree_matches(tree, ref))
+        return false;
+    }
+    if(!btree_matches(tree, ref))
+      return false;
+    for(int k = -range - 1; k <= range + 1; ++k) // Every bound has to agree with the reference
+    {
+      auto lo = tree.LowerBound(k);
+      auto hi = tree.UpperBound(k);
+      auto rlo = ref.lower_bound(k);
+      auto rhi = ref.upper_bound(k);
+      if((lo == tree.end()) != (rlo == ref.end()) || (lo != tree.end() && lo.GetKey() != rlo->first))
+        return false;
+      if((hi == tree.end()) != (rhi == ref.end()) || (hi != tree.end() && hi.GetKey() != rhi->first))
+        return false;
+      if(tree.Get(k, -1) != (rlo != ref.end() && rlo->first == k ? rlo->second : -1))
+        return false;
+    }
+    while(!ref.empty()) // Drain it completely so every merge path runs
+    {
+      auto it = ref.begin();
+      std::advance(it, bssRandInt(0, (int64_t)ref.size()));
+      if(!tree.Remove(it->first))
+        return false;
+      ref.erase(it);
+      if(!(ref.size() % 331) && !btree_matches(tree, ref))
+        return false;
+    }
+    return tree.Empty() && tree.Height() == 0 && tree.begin() == tree.end() && tree.DEBUGVERIFY();
+  }
+
+  // Checks the node search for a key type, inserting sorted keys in reverse so every split lands at the front of a node.
+  template<class K>
+  bool btree_keys(const std::vector<K>& keys)
+  {
+    BTree<K, void, CompT<K>, 128> tree;
+    for(size_t i = keys.size(); i-- > 0;)
+      if(!tree.Insert(keys[i]))
+        return false;
+    if(!tree.DEBUGVERIFY() || tree.Length() != keys.size())
+      return false;
+    for(size_t i = 0; i < keys.size(); ++i)
+    {
+      if(!tree.Exists(keys[i]) || *tree.LowerBound(keys[i]) != keys[i])
+        return false;
+      auto up = tree.UpperBound(keys[i]);
+      if((i + 1 < keys.size()) ? (up == tree.end() || *up != keys[i + 1]) : (up != tree.end()))
+        return false;
+    }
+    return true;
+  }
+}
+
+TESTDEF::RETPAIR test_BTREE()
+{
+  BEGINTEST;
+
+  {
+    BTree<int, int> tree;
+    TEST(tree.Empty());
+    TEST(tree.Height() == 0);
+    TEST(tree.GetRef(1) == 0);
+    TEST(!tree.Remove(1));
+    TEST(tree.begin() == tree.end());
+    TEST(tree.LowerBound(0) == tree.end());
+    TEST(tree.DEBUGVERIFY());
+    TEST(tree.Insert(5, 50));
+    TEST(!tree.Insert(5, 51));
+    TEST(tree.Get(5, 0) == 50);
+    TEST(tree.Height() == 1);
+    TEST(tree.Insert(3, 30));
+    TEST(tree.Insert(4));
+    TEST(tree.Get(4, -1) == 0);
+    TEST(tree.Front() == 3);
+    TEST(tree.Back() == 5);
+    *tree.GetRef(4) = 40;
+    TEST(tree.ReplaceKey(4, 7));
+    TEST(!tree.ReplaceKey(4, 8));
+    TEST(!tree.ReplaceKey(3, 5));
+    TEST(!tree.Exists(4));
+    TEST(tree.Get(7, 0) == 40);
+    TEST(tree.Find(7).GetData() == 40);
+    TEST(tree.Find(6) == tree.end());
+    int sum = 0;
+    tree.Traverse([&](std::pair<const int&, int&> e) { sum += e.first * e.second; e.second = 0; });
+    TEST(sum == 3 * 30 + 5 * 50 + 7 * 40);
+    TEST(tree.Get(5, -1) == 0);
+    BTree<int, int> moved(std::move(tree));
+    TEST(tree.Empty());
+    TEST(moved.Length() == 3);
+    tree = std::move(moved);
+    TEST(tree.Length() == 3);
+    TEST(moved.Empty());
+  }
+
+  {
+    BTree<int, int> tree;
+    TEST(btree_random(tree, 4000, 40000));
+    BTree<int, int, CompT<int>, 64> small; // Tiny nodes make the tree deep, so splits and merges cascade all the way up
+    TEST(btree_random(small, 3000, 30000));
+    TEST(btree_random(small, 20, 2000));
+    TEST(tree.Insert(1, 1)); // Still usable after being emptied
+    TEST(small.Insert(1, 2));
+
+    for(size_t i = 0; i < TESTNUM; ++i)
+      small.Insert(testnums[i], testnums[i] * 2);
+    TEST(small.DEBUGVERIFY());
+    TESTCOUNTALL(TESTNUM, small.Get(testnums[i], -1) == testnums[i] * 2);
+    TEST(small.Height() > 4);
+    Shuffle(testnums);
+    for(size_t i = 0; i < TESTNUM; ++i)
+      small.Remove(testnums[i]);
+    TEST(small.Empty());
+    TEST(small.DEBUGVERIFY());
+  }
+
+  {
+    const size_t N = 100000;
+    std::vector<int64_t> keys(N);
+    std::vector<int> vals(N);
+    for(size_t i = 0; i < N; ++i)
+    {
+      keys[i] = (int64_t)i * 3 - 1000;
+      vals[i] = (int)i;
+    }
+    BTree<int64_t, int> tree;
+    tree.Insert(4, 4);
+    TEST(tree.BulkLoad(keys.data(), vals.data(), N));
+    TEST(tree.Length() == N);
+    TEST(tree.DEBUGVERIFY());
+    TEST(!tree.Exists(4));
+    TESTCOUNTALL(N, tree.Get(keys[i], -1) == vals[i]);
+    TEST(tree.Get(keys[7] + 1, -1) == -1);
+    size_t n = 0;
+    bool order = true;
+    for(auto it = tree.LowerBound(keys[N / 2] - 1); it != tree.end(); ++it, ++n)
+      order = order && it.GetKey() == keys[N / 2 + n];
+    TEST(order);
+    TEST(n == N - N / 2);
+    for(size_t i = 0; i < N; i += 3) // A bulk loaded tree can still be modified normally
+      tree.Remove(keys[i]);
+    TEST(tree.Insert(keys[0] + 1, 1));
+    TEST(tree.DEBUGVERIFY());
+
+    for(size_t m : { (size_t)1, (size_t)2, (size_t)30, (size_t)31, (size_t)1000 })
+    {
+      BTree<int64_t, int, CompT<int64_t>, 64> small;
+      TEST(small.BulkLoad(keys.data(), vals.data(), m));
+      TEST(small.Length() == m);
+      TEST(small.DEBUGVERIFY());
+    }
+    TEST(tree.BulkLoad(keys.data(), vals.data(), 0));
+    TEST(tree.Empty());
+    std::swap(keys[10], keys[11]);
+    TEST(!tree.BulkLoad(keys.data(), vals.data(), N));
+    TEST(tree.Empty());
+    keys[11] = keys[10];
+    TEST(!tree.BulkLoad(keys.data(), vals.data(), N));
+  }
+
+  {
+    std::vector<int32_t> i32;
+    std::vector<uint32_t> u32;
+    std::vector<int64_t> i64;
+    std::vector<uint64_t> u64;
+    std::vector<float> f32;
+    std::vector<double> f64;
+    for(int i = -3000; i < 3000; ++i)
+    {
+      i32.push_back(i * 7);
+      u32.push_back(0x7FFFF000u + (uint32_t)(i + 3000) * 3); // Crosses the sign bit
+      i64.push_back((int64_t)i * 0x100000001LL);
+      u64.push_back(0x7FFFFFFFFFFFF000ULL + (uint64_t)(i + 3000) * 5);
+      f32.push_back(i * 0.25f);
+      f64.push_back(i * -0.5);
+    }
+    std::reverse(f64.begin(), f64.end());
+    TEST(btree_keys(i32));
+    TEST(btree_keys(u32));
+    TEST(btree_keys(i64));
+    TEST(btree_keys(u64));
+    TEST(btree_keys(f32));
+    TEST(btree_keys(f64));
+  }
+
+  {
+    BTree<const char*, void, CompStr<const char*>, 64> set;
+    const char* words[] = { "banana", "apple", "cherry", "date", "elderberry", "fig", "grape", "honeydew", "kiwi", "lemon", "mango" };
+    for(auto w : words)
+      TEST(set.Insert(w));
+    TEST(!set.Insert("fig"));
+    TEST(set.DEBUGVERIFY());
+    TEST(set.Get("kiwi", 0) != 0);
+    TEST(set.Get("lime", 0) == 0);
+    TEST(!strcmp(*set.begin(), "apple"));
+    TEST(!strcmp(*set.LowerBound("grapefruit"), "honeydew"));
+    TEST(set.Remove("apple"));
+    TEST(!strcmp(set.Front(), "banana"));
+
+    BTree<int, void, CompTInv<int>> inv;
+    for(int i = 0; i < 1000; ++i)
+      inv.Insert(i);
+    TEST(inv.Front() == 999);
+    TEST(*inv.LowerBound(500) == 500);
+    TEST(*inv.UpperBound(500) == 499);
+  }
+
+  DEBUG_CDT<false>::count = 0;
+  {
+    BTree<int, DEBUG_CDT<false>, CompT<int>, 128> tree;
+    for(size_t i = 0; i < TESTNUM; ++i)
+      tree.Insert(testnums[i], DEBUG_CDT<false>(testnums[i]));
+    Shuffle(testnums);
+    uint32_t c = 0;
+    for(size_t i = 0; i < TESTNUM; ++i)
+    {
+      auto r = tree.GetRef(testnums[i]);
+      c += (r != 0 && *r == testnums[i]);
+    }
+    TEST(c == TESTNUM);
+    for(size_t i = 0; i < TESTNUM; i += 2)
+      tree.Remove(testnums[i]);
+    TEST(tree.DEBUGVERIFY());
+  }
+  TEST(!DEBUG_CDT<false>::count);
+
+  ENDTEST;
+}
+
+// Compares lookups and in-order scans on a BTree against the binary trees and a sorted Map holding the same keys.
+void profile_btree()
+{
+  for(size_t n : { (size_t)1000, (size_t)100000, (size_t)1000000 })
+  {
+    std::vector<int> keys(n);
+    for(size_t i = 0; i < n; ++i)
+      keys[i] = (int)bssRandInt(0, INT32_MAX);
+    std::vector<int> queries(bssmax(n, (size_t)1000000));
+    for(size_t i = 0; i < queries.size(); ++i)
+      queries[i] = keys[bssRandInt(0, (int64_t)n)];
+
+    BTree<int, int> btree;
+    AVLTree<int, int> avl;
+    TRBtree<int> trb;
+    Map<int, int, CompT<int>, size_t> map;
+    auto prof = HighPrecisionTimer::OpenProfiler();
+    for(size_t i = 0; i < n; ++i)
+      btree.Insert(keys[i], (int)i);
+    uint64_t build = HighPrecisionTimer::CloseProfiler(prof);
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(size_t i = 0; i < n; ++i)
+      avl.Insert(keys[i], (int)i);
+    uint64_t buildavl = HighPrecisionTimer::CloseProfiler(prof);
+    for(size_t i = 0; i < n; ++i)
+    {
+      trb.Insert(keys[i]);
+      map.Insert(keys[i], (int)i);
+    }
+
+    uint64_t sum = 0;
+    uint64_t t[4];
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(int q : queries)
+      sum += btree.Get(q, 0);
+    t[0] = HighPrecisionTimer::CloseProfiler(prof);
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(int q : queries)
+      sum += avl.Get(q, 0);
+    t[1] = HighPrecisionTimer::CloseProfiler(prof);
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(int q : queries)
+      sum += trb.Get(q)->value;
+    t[2] = HighPrecisionTimer::CloseProfiler(prof);
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(int q : queries)
+      sum += map.GetData(q);
+    t[3] = HighPrecisionTimer::CloseProfiler(prof);
+
+    uint64_t s[2];
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(auto e : btree)
+      sum += e.second;
+    s[0] = HighPrecisionTimer::CloseProfiler(prof);
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(auto e : trb)
+      sum += e->value;
+    s[1] = HighPrecisionTimer::CloseProfiler(prof);
+
+    double q = (double)queries.size();
+    std::cout << n << " keys: lookup BTree " << (t[0] / q) << " ns, AVLTree " << (t[1] / q) << " ns, TRBtree " << (t[2] / q) << " ns, Map " << (t[3] / q) <<
+      " ns; scan BTree " << ((double)s[0] / n) << " ns, TRBtree " << ((double)s[1] / n) << " ns; insert BTree " << ((double)build / n) << " ns, AVLTree " <<
+      ((double)buildavl / n) << " ns (" << (sum % 2) << ")" << std::endl;
+  }
+}
@@ -0,0 +1,161 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/ConcurrentHash.h"
+#include "bss-util/RWLock.h"
+#include "bss-util/Thread.h"
+#include "bss-util/HighPrecisionTimer.h"
+#include <iostream>
+
+using namespace bss;
+
+TESTDEF::RETPAIR test_CONCURRENTHASH()
+{
+  BEGINTEST;
+
+  {
+    ConcurrentHash<int, int> hash;
+    TEST(hash.Length() == 0);
+    TEST(hash.Capacity() == 32);
+    TEST(hash.Insert(1, 2));
+    TEST(!hash.Insert(1, 3));
+    TEST(hash.Length() == 1);
+    int v = 0;
+    TEST(hash(1, v));
+    TEST(v == 3);
+    TEST(!hash(2, v));
+    TEST(hash.Set(1, 4));
+    TEST(!hash.Set(2, 4));
+    TEST(hash.Get(1, v) && v == 4);
+    TEST(hash.Remove(1));
+    TEST(!hash.Remove(1));
+    TEST(!hash.Exists(1));
+    TEST(hash.Length() == 0);
+
+    Hash<int, int> ref;
+    for(int i = 0; i < 5000; ++i) // Forces several resizes, each of which gets finished by later writers
+    {
+      int k = (int)bssRandInt(0, 2000);
+      if(bssRandInt(0, 3) == 0)
+      {
+        TEST(hash.Remove(k) == ref.Remove(k));
+      }
+      else
+      {
+        TEST(hash.Insert(k, i) == !ref.Exists(k));
+        ref.Insert(k, i);
+      }
+    }
+    TEST(hash.Length() == ref.Length());
+    bool same = true;
+    for(int i = 0; i < 2000; ++i)
+    {
+      bool found = hash(i, v);
+      same = same && (found == ref.Exists(i)) && (!found || v == ref[i]);
+    }
+    TEST(same);
+    hash.Reclaim();
+  }
+
+  {
+    ConcurrentHash<const char*> set;
+    TEST(set.Insert("foo"));
+    TEST(set.Insert("bar"));
+    TEST(!set.Insert("foo"));
+    TEST(set.Exists("foo"));
+    TEST(set("bar"));
+    TEST(!set("baz"));
+    TEST(set.Remove("foo"));
+    TEST(!set.Exists("foo"));
+    TEST(set.Length() == 1);
+  }
+
+  {
+    const int NTHREADS = 4;
+    const int NKEYS = 20000;
+    ConcurrentHash<int, int> hash;
+    std::atomic<int> missing(0);
+    startflag.store(false);
+    Thread threads[NTHREADS];
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t] = Thread([&](int id) {
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      for(int i = id; i < NKEYS; i += NTHREADS)
+        hash.Insert(i, i * 2);
+      for(int i = id; i < NKEYS; i += NTHREADS)
+      {
+        int v;
+        if(!hash(i, v) || v != i * 2) missing.fetch_add(1, std::memory_order_relaxed);
+        if(i % 2) hash.Remove(i);
+      }
+    }, t);
+    startflag.store(true);
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t].join();
+
+    TEST(!missing.load());
+    TEST(hash.Length() == NKEYS / 2);
+    bool same = true;
+    for(int i = 0; i < NKEYS; ++i)
+    {
+      int v = -1;
+      bool found = hash(i, v);
+      same = same && (found == !(i % 2)) && (!found || v == i * 2);
+    }
+    TEST(same);
+    hash.Reclaim();
+  }
+
+  ENDTEST;
+}
+
+// Compares ConcurrentHash against a Hash guarded by an RWLock under a read-heavy workload, for 1 to 2x the hardware thread count.
+void profile_concurrent_hash()
+{
+  const int NKEYS = 1 << 16;
+  const int NOPS = 1 << 20;
+  auto run = [](size_t nthreads, auto&& op) {
+    DynArray<Thread, size_t, ARRAY_MOVE> threads;
+    startflag.store(false);
+    for(size_t t = 0; t < nthreads; ++t)
+      threads.Add(Thread([&](size_t id) {
+      uint64_t seed = id * 0x9E3779B97F4A7C15ULL + 1;
+      while(!startflag.load(std::memory_order_acquire));
+      for(int i = 0; i < NOPS / (int)nthreads; ++i)
+      {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        op((int)(seed % NKEYS), (seed >> 32) % 10 == 0);
+      }
+    }, t));
+    auto prof = HighPrecisionTimer::OpenProfiler();
+    startflag.store(true);
+    for(auto& t : threads)
+      t.join();
+    return HighPrecisionTimer::CloseProfiler(prof);
+  };
+
+  size_t max = std::thread::hardware_concurrency() * 2;
+  for(size_t n = 1; n <= max; n *= 2)
+  {
+    Hash<int, int> locked;
+    RWLock lock;
+    ConcurrentHash<int, int> concurrent;
+    for(int i = 0; i < NKEYS; i += 2)
+    {
+      locked.Insert(i, i);
+      concurrent.Insert(i, i);
+    }
+
+    uint64_t a = run(n, [&](int k, bool write) {
+      if(write) { lock.Lock(); locked.Insert(k, k); lock.Unlock(); }
+      else { lock.RLock(); locked.Get(k); lock.RUnlock(); }
+    });
+    uint64_t b = run(n, [&](int k, bool write) {
+      int v;
+      if(write) concurrent.Insert(k, k);
+      else concurrent(k, v);
+    });
+    std::cout << n << " threads: Hash+RWLock " << a << " ns, ConcurrentHash " << b << " ns" << std::endl;
+  }
+}
@@ -0,0 +1,196 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/ConcurrentSkipList.h"
+#include "bss-util/Thread.h"
+
+using namespace bss;
+
+TESTDEF::RETPAIR test_CONCURRENTSKIPLIST()
+{
+  BEGINTEST;
+
+  {
+    ConcurrentSkipList<int, int> list;
+    TEST(list.Empty());
+    TEST(list.Length() == 0);
+    TEST(!list.begin().IsValid());
+    TEST(list.Insert(5, 50));
+    TEST(list.Insert(1, 10));
+    TEST(list.Insert(3, 30));
+    TEST(!list.Insert(3, 31)); // Doesn't overwrite
+    TEST(list.Length() == 3);
+    int v = 0;
+    TEST(list.Get(3, v) && v == 30);
+    TEST(!list.Get(2, v));
+    TEST(list(1));
+    TEST(!list(4));
+    TEST(list.GetValue(5) && *list.GetValue(5) == 50);
+    TEST(!list.GetValue(6));
+    TEST(list.LowerBound(2).GetKey() == 3);
+    TEST(list.LowerBound(3).GetKey() == 3);
+    TEST(!list.LowerBound(6).IsValid());
+    int sum = 0;
+    for(auto[k, d] : list)
+      sum = sum * 10 + k + (d - k * 10);
+    TEST(sum == 135);
+    TEST(list.Remove(3));
+    TEST(!list.Remove(3));
+    TEST(!list.Exists(3));
+    TEST(list.LowerBound(2).GetKey() == 5);
+    TEST(list.Length() == 2);
+    list.Clear();
+    TEST(list.Empty());
+
+    Hash<int, int> ref;
+    for(int i = 0; i < 5000; ++i)
+    {
+      int k = (int)bssRandInt(0, 2000);
+      if(bssRandInt(0, 3) == 0)
+      {
+        TEST(list.Remove(k) == ref.Remove(k));
+      }
+      else
+      {
+        TEST(list.Insert(k, i) == !ref.Exists(k));
+        if(!ref.Exists(k))
+          ref.Insert(k, i);
+      }
+    }
+    TEST(list.Length() == ref.Length());
+    bool same = true;
+    for(int i = 0; i < 2000; ++i)
+    {
+      bool found = list.Get(i, v);
+      same = same && (found == ref.Exists(i)) && (!found || v == ref[i]);
+    }
+    TEST(same);
+    int last = -1;
+    size_t n = 0;
+    for(auto i = list.begin(); i != list.end(); ++i, ++n)
+    {
+      same = same && i.GetKey() > last;
+      last = i.GetKey();
+    }
+    TEST(same);
+    TEST(n == ref.Length());
+    n = 0;
+    for(int i = 500; i < 1500; ++i)
+      n += ref.Exists(i);
+    TEST(list.Scan(500, 1500, [](int, int) {}) == n);
+    TEST(list.Scan(0, 2000, [](int, int) { return false; }) == 1);
+    list.Reclaim();
+  }
+
+  {
+    DEBUG_CDT<true>::count = 0;
+    {
+      ConcurrentSkipList<std::string, DEBUG_CDT<true>> list;
+      for(int i = 0; i < 100; ++i)
+        list.Insert(std::to_string(i), i);
+      TEST(!list.Insert(std::string("5"), 5));
+      TEST(DEBUG_CDT<true>::count == 100);
+      TEST(list.GetValue("42")->_index == 42);
+      TEST(list.LowerBound("425").GetKey() == "43");
+      for(int i = 0; i < 100; i += 2)
+        list.Remove(std::to_string(i));
+      TEST(DEBUG_CDT<true>::count == 100); // Removed nodes stay around until Reclaim()
+      list.Reclaim();
+      TEST(DEBUG_CDT<true>::count == 50);
+    }
+    TEST(!DEBUG_CDT<true>::count);
+  }
+
+  {
+    const int NTHREADS = 4;
+    const int NKEYS = 20000;
+    ConcurrentSkipList<int, int> list;
+    std::atomic<int> bad(0);
+    std::atomic<bool> writing(true);
+
+    // Writers insert every key and then remove the even ones, while scanners check that they only ever see sorted keys.
+    auto write = [&](int id) {
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      for(int i = id; i < NKEYS; i += NTHREADS)
+        if(!list.Insert(i, -i))
+          bad.fetch_add(1, std::memory_order_relaxed);
+      for(int i = id; i < NKEYS; i += NTHREADS)
+        if(!(i % 2) && !list.Remove(i))
+          bad.fetch_add(1, std::memory_order_relaxed);
+    };
+    auto scan = [&](int) {
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      do
+      {
+        int last = -1;
+        list.Scan(0, NKEYS, [&](int k, int d) {
+          if(k <= last || d != -k)
+            bad.fetch_add(1, std::memory_order_relaxed);
+          last = k;
+        });
+        std::this_thread::yield();
+      } while(writing.load(std::memory_order_acquire));
+    };
+
+    startflag.store(false);
+    Thread threads[NTHREADS + 2];
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t] = Thread(write, t);
+    for(int t = NTHREADS; t < NTHREADS + 2; ++t)
+      threads[t] = Thread(scan, t);
+    startflag.store(true);
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t].join();
+    writing.store(false, std::memory_order_release);
+    for(int t = NTHREADS; t < NTHREADS + 2; ++t)
+      threads[t].join();
+
+    TEST(!bad.load());
+    TEST(list.Length() == NKEYS / 2);
+    bool same = true;
+    for(int i = 0; i < NKEYS; ++i)
+      same = same && (list.Exists(i) == ((i % 2) != 0));
+    TEST(same);
+    int expect = 1;
+    for(auto[k, d] : list)
+    {
+      same = same && k == expect && d == -k;
+      expect += 2;
+    }
+    TEST(same && expect == NKEYS + 1);
+
+    // Every thread races to insert and remove the same small set of keys.
+    startflag.store(false);
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t] = Thread([&](int id) {
+      uint64_t seed = id + 1;
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      for(int i = 0; i < 20000; ++i)
+      {
+        int k = (int)(xorshift64star(seed) % 64) * 2;
+        if(xorshift64star(seed) & 1)
+          list.Insert(k, -k);
+        else
+          list.Remove(k);
+      }
+    }, t);
+    startflag.store(true);
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t].join();
+
+    size_t n = 0;
+    expect = -1;
+    for(auto[k, d] : list)
+    {
+      same = same && k > expect && d == -k;
+      expect = k;
+      ++n;
+    }
+    TEST(same);
+    TEST(n == list.Length());
+    list.Reclaim();
+  }
+
+  ENDTEST;
+}
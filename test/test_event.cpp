@@ -0,0 +1,181 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/Event.h"
+#include "bss-util/Thread.h"
+#include "bss-util/DynArray.h"
+#include "bss-util/HighPrecisionTimer.h"
+#include <iostream>
+#include <vector>
+
+using namespace bss;
+
+namespace {
+  struct EventListener
+  {
+    EventListener() : calls(0), sum(0), order(0), self(0) {}
+    void OnEvent(int x) { calls.fetch_add(1, std::memory_order_relaxed); sum.fetch_add(x, std::memory_order_relaxed); }
+    void Record(int x) { order = order * 10 + x; }
+    void Leave(int x) { ++calls; self->Unsubscribe(Event<int>::FN::From<EventListener, &EventListener::Leave>(this)); }
+
+    std::atomic<int> calls;
+    std::atomic<int64_t> sum;
+    int order;
+    Event<int>* self;
+  };
+
+  int event_static = 0;
+  void event_stateless(int x) { event_static += x; }
+}
+
+TESTDEF::RETPAIR test_EVENT()
+{
+  BEGINTEST;
+
+  {
+    Event<int> e;
+    TEST(e.Empty());
+    TEST(e.Length() == 0);
+    e(1); // Dispatching with no subscribers does nothing
+
+    EventListener a, b, c;
+    auto ia = e.Subscribe(Event<int>::FN::From<EventListener, &EventListener::Record>(&a));
+    auto ib = e.Subscribe(Event<int>::FN::From<EventListener, &EventListener::Record>(&b));
+    auto ic = e.Subscribe(Event<int>::FN::From<EventListener, &EventListener::OnEvent>(&c));
+    e.Subscribe(Event<int>::FN::FromC<&event_stateless>());
+    TEST(!e.Empty());
+    TEST(e.Length() == 4);
+    TEST(ia != ib && ib != ic);
+    e(3);
+    e(4);
+    TEST(a.order == 34 && b.order == 34);
+    TEST(c.calls == 2 && c.sum == 7);
+    TEST(event_static == 7);
+
+    TEST(e.Unsubscribe(ib));
+    TEST(!e.Unsubscribe(ib));
+    TEST(e.Length() == 3);
+    e(5);
+    TEST(a.order == 345 && b.order == 34);
+    TEST(e.Unsubscribe(Event<int>::FN::From<EventListener, &EventListener::OnEvent>(&c)));
+    TEST(!e.Unsubscribe(Event<int>::FN::From<EventListener, &EventListener::OnEvent>(&c)));
+    TEST(e.Unsubscribe(Event<int>::FN::FromC<&event_stateless>()));
+    e(6);
+    TEST(a.order == 3456 && c.calls == 3);
+    TEST(event_static == 12);
+
+    // Handlers can unsubscribe themselves while the event is being dispatched
+    EventListener d;
+    d.self = &e;
+    e.Subscribe(Event<int>::FN::From<EventListener, &EventListener::Leave>(&d));
+    e.Subscribe(Event<int>::FN::From<EventListener, &EventListener::Record>(&b));
+    e(7);
+    TEST(d.calls == 1);
+    TEST(a.order == 34567 && b.order == 347);
+    e(8);
+    TEST(d.calls == 1);
+    TEST(e.Length() == 2);
+
+    e.Clear();
+    TEST(e.Empty());
+    e(9);
+    TEST(a.order == 345678);
+    e.Reclaim();
+  }
+
+  {
+    const int NTHREADS = 4;
+    const int NDISPATCH = 20000;
+    Event<int> e;
+    EventListener always;
+    std::unique_ptr<EventListener[]> churn(new EventListener[8]);
+    e.Subscribe(Event<int>::FN::From<EventListener, &EventListener::OnEvent>(&always));
+
+    startflag.store(false);
+    std::atomic<bool> done(false);
+    Thread writer([&]() {
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      Event<int>::ID ids[8];
+      for(int i = 0; !done.load(std::memory_order_acquire); ++i)
+      {
+        int k = i % 8;
+        if(i >= 8)
+          e.Unsubscribe(ids[k]);
+        ids[k] = e.Subscribe(Event<int>::FN::From<EventListener, &EventListener::OnEvent>(churn.get() + k));
+        if(!(i % 16))
+          std::this_thread::yield();
+      }
+    });
+    Thread threads[NTHREADS];
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t] = Thread([&]() {
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      for(int i = 0; i < NDISPATCH; ++i)
+      {
+        e(1);
+        if(!(i % 256))
+          std::this_thread::yield();
+      }
+    });
+    startflag.store(true);
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t].join();
+    done.store(true);
+    writer.join();
+
+    TEST(always.calls == NTHREADS * NDISPATCH); // Subscribers that never leave see every dispatch
+    TEST(always.sum == NTHREADS * NDISPATCH);
+    TEST(e.Length() == 9);
+  }
+
+  ENDTEST;
+}
+
+// Compares dispatching to a set of subscribers through an Event against copying a vector of delegates under a mutex.
+void profile_event()
+{
+  const int NDISPATCH = 1 << 16;
+  const int NSUBS = 8;
+  size_t max = std::thread::hardware_concurrency() * 2;
+  for(size_t n = 1; n <= max; n *= 2)
+  {
+    EventListener listeners[NSUBS];
+    Event<int> e;
+    std::vector<Event<int>::FN> subs;
+    std::mutex lock;
+    for(int i = 0; i < NSUBS; ++i)
+    {
+      e.Subscribe(Event<int>::FN::From<EventListener, &EventListener::OnEvent>(listeners + i));
+      subs.push_back(Event<int>::FN::From<EventListener, &EventListener::OnEvent>(listeners + i));
+    }
+
+    auto run = [&](auto&& dispatch) {
+      DynArray<Thread, size_t, ARRAY_MOVE> threads;
+      startflag.store(false);
+      for(size_t t = 0; t < n; ++t)
+        threads.Add(Thread([&]() {
+        while(!startflag.load(std::memory_order_acquire));
+        for(size_t i = 0; i < NDISPATCH / n; ++i)
+          dispatch(1);
+      }));
+      auto prof = HighPrecisionTimer::OpenProfiler();
+      startflag.store(true);
+      for(auto& t : threads)
+        t.join();
+      return HighPrecisionTimer::CloseProfiler(prof);
+    };
+
+    uint64_t a = run([&](int x) {
+      std::vector<Event<int>::FN> copy;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        copy = subs;
+      }
+      for(auto& f : copy)
+        f(x);
+    });
+    uint64_t b = run([&](int x) { e(x); });
+    std::cout << n << " threads: locked vector copy " << a << " ns, Event " << b << " ns" << std::endl;
+  }
+}
@@ -3,11 +3,98 @@
 
 #include "test.h"
 #include "bss-util/Hash.h"
+#include <unordered_map>
+#include <vector>
 
 using namespace bss;
 
 static_assert(std::is_member_pointer<void(TESTDEF::*)()>::value, "member failure");
 
+// Runs the same random inserts, lookups and removals against a Hash and std::unordered_map, then checks they agree.
+static khint_t hash_collide(const int& k) { return (khint_t)k & 3; } // Forces Robin Hood distances past what fits in a flag
+
+template<class H>
+void hash_engine_test(TESTDEF::RETPAIR& __testret)
+{
+  H h;
+  std::unordered_map<int, int> ref;
+  bool match = true;
+  for(int i = 0; i < 20000; ++i)
+  {
+    int k = (int)bssRandInt(-3000, 3000);
+    switch(bssRandInt(0, 4))
+    {
+    case 0:
+    case 1:
+      h.Insert(k, i);
+      ref[k] = i;
+      break;
+    case 2:
+      match = match && (h.Remove(k) == (ref.erase(k) > 0));
+      break;
+    case 3:
+      match = match && (h.Exists(k) == (ref.count(k) > 0)) && (!ref.count(k) || h[k] == ref[k]);
+      break;
+    }
+  }
+  TEST(match);
+  TEST(h.Length() == ref.size());
+  size_t count = 0;
+  for(auto [k, v] : h)
+  {
+    match = match && ref.count(k) && ref[k] == v;
+    ++count;
+  }
+  TEST(match);
+  TEST(count == ref.size());
+
+  std::vector<int> batch; // Half of these exist and half don't, and the count isn't a multiple of the batch size
+  for(int k = -4000; k < 4037; ++k)
+    batch.push_back(k);
+  std::unique_ptr<bool[]> exists(new bool[batch.size()]);
+  std::unique_ptr<int[]> values(new int[batch.size()]);
+  std::unique_ptr<khiter_t[]> iters(new khiter_t[batch.size()]);
+  TEST(h.ExistsMany(batch.data(), batch.size(), exists.get()) == ref.size());
+  TEST(h.ExistsMany(batch.data(), batch.size()) == ref.size());
+  h.GetMany(batch.data(), batch.size(), values.get());
+  h.IteratorMany(batch.data(), batch.size(), iters.get());
+  for(size_t i = 0; i < batch.size(); ++i)
+  {
+    auto r = ref.find(batch[i]);
+    match = match && exists[i] == (r != ref.end()) && values[i] == ((r != ref.end()) ? r->second : -1) && iters[i] == h.Iterator(batch[i]);
+  }
+  TEST(match);
+
+  H many;
+  std::vector<int> vals(batch.size());
+  for(size_t i = 0; i < batch.size(); ++i)
+    vals[i] = batch[i] * 3;
+  TEST(many.InsertMany(batch.data(), vals.data(), batch.size(), iters.get()) == batch.size());
+  TEST(many.Length() == batch.size());
+  for(size_t i = 0; i < batch.size(); ++i)
+    match = match && (!H::StableIterators || many.GetKey(iters[i]) == batch[i]) && many[batch[i]] == batch[i] * 3;
+  TEST(match);
+  for(size_t i = 0; i < batch.size(); ++i)
+    vals[i] = -batch[i];
+  TEST(many.InsertMany(batch.data(), vals.data(), 100) == 0); // Existing keys are overwritten, not added
+  TEST(many.Length() == batch.size());
+  TEST(many[batch[0]] == -batch[0]);
+  TEST(many[batch[100]] == batch[100] * 3);
+
+  H copy(h);
+  for(auto& kv : ref)
+    match = match && copy[kv.first] == kv.second;
+  TEST(match);
+  for(auto& kv : ref)
+    copy.Remove(kv.first);
+  TEST(copy.Length() == 0);
+  TEST(copy.begin() == copy.end());
+  TEST(!copy.Exists(ref.empty() ? 0 : ref.begin()->first));
+  h.Clear();
+  TEST(h.Length() == 0);
+  TEST(h[1] == -1);
+}
+
 TESTDEF::RETPAIR test_HASH()
 {
   BEGINTEST;
@@ -244,5 +331,286 @@ TESTDEF::RETPAIR test_HASH()
     TEST(h[2] == 0);
     static_assert(std::is_same<decltype(h[0]), int*>::value, "wrong GET type");
   }
+  hash_engine_test<Hash<int, int>>(__testret);
+  hash_engine_test<Hash<int, int, ARRAY_SIMPLE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_SWISS>>(__testret);
+  hash_engine_test<Hash<int, int, ARRAY_SIMPLE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_KHASH, true>>(__testret);
+  hash_engine_test<Hash<int, int, ARRAY_SIMPLE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_SWISS, true>>(__testret);
+  hash_engine_test<Hash<int, int, ARRAY_SIMPLE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_KHASH, false, true>>(__testret);
+  hash_engine_test<Hash<int, int, ARRAY_SIMPLE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_SWISS, true, true>>(__testret);
+  hash_engine_test<Hash<int, int, ARRAY_SIMPLE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_ROBINHOOD>>(__testret);
+  hash_engine_test<Hash<int, int, ARRAY_SIMPLE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_ROBINHOOD, true>>(__testret);
+  hash_engine_test<Hash<int, int, ARRAY_SIMPLE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_ROBINHOOD, false, true>>(__testret);
+  hash_engine_test<Hash<int, int, ARRAY_SIMPLE, &hash_collide, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_ROBINHOOD>>(__testret);
+  hash_engine_test<Hash<int, int, ARRAY_SIMPLE, &hash_collide, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_ROBINHOOD, true>>(__testret);
+
+  {
+    auto churn = [&](auto& h) { // The live size never changes, so the table shouldn't either
+      for(int i = 0; i < 1000; ++i)
+        h.Insert(Str(std::to_string(i)), i);
+      khint_t capacity = h.Capacity();
+      bool match = true;
+      for(int i = 1000; i < 200000; ++i)
+      {
+        h.Insert(Str(std::to_string(i)), i);
+        match = match && h.Remove(Str(std::to_string(i - 1000)));
+      }
+      TEST(match);
+      TEST(h.Length() == 1000);
+      TEST(h.Capacity() == capacity);
+      for(int i = 199000; i < 200000; ++i)
+        match = match && h.Get(Str(std::to_string(i))) == i;
+      TEST(match);
+    };
+    Hash<Str, int, ARRAY_SAFE, &KH_AUTO_HASH<Str, false>, &KH_AUTO_EQUAL<Str, false>, StandardAllocator<char>, HASH_ROBINHOOD> rh;
+    churn(rh);
+    Hash<Str, int, ARRAY_SAFE, &KH_AUTO_HASH<Str, false>, &KH_AUTO_EQUAL<Str, false>, StandardAllocator<char>, HASH_ROBINHOOD, true, true> rhinc;
+    churn(rhinc);
+  }
+
+  {
+    auto shrink = [&](auto& h) {
+      h.SetMinLoad(1.0f);
+      TEST(h.GetMinLoad() <= h.MAX_LOAD / 4);
+      h.SetMinLoad(0.1f);
+      for(int i = 0; i < 100000; ++i)
+        h.Insert(i, i);
+      khint_t full = h.Capacity();
+      for(int i = 0; i < 99900; ++i)
+        h.Remove(i);
+      h.FinishResize();
+      TEST(h.Length() == 100);
+      TEST(h.Capacity() < full / 64);
+      TEST(h.Capacity() >= 100 / h.MAX_LOAD);
+      bool match = true;
+      for(int i = 99900; i < 100000; ++i)
+        match = match && h.Get(i) == i;
+      TEST(match);
+      khint_t small = h.Capacity(); // Right after a shrink, removing or adding a few keys mustn't resize again
+      for(int i = 99900; i < 99910; ++i)
+        h.Remove(i);
+      for(int i = 0; i < 20; ++i)
+        h.Insert(i, i);
+      TEST(h.Capacity() == small);
+      auto copy = h;
+      TEST(copy.GetMinLoad() == h.GetMinLoad());
+      h.SetMinLoad(0);
+      for(int i = 0; i < 20; ++i)
+        h.Remove(i);
+      for(int i = 99910; i < 100000; ++i)
+        h.Remove(i);
+      TEST(h.Capacity() == small);
+    };
+    Hash<int, int> kh;
+    shrink(kh);
+    Hash<int, int, ARRAY_SIMPLE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_SWISS> swiss;
+    shrink(swiss);
+    Hash<int, int, ARRAY_SIMPLE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_ROBINHOOD, true, true> rhinc;
+    shrink(rhinc);
+
+    auto shrinkkeys = [&](auto& h, auto key) { // Tables that move their keys have to keep every key that survives a shrink
+      h.SetMinLoad(0.1f);
+      for(int i = 0; i < 2000; ++i)
+        h.Insert(key(i), i);
+      khint_t full = h.Capacity();
+      for(int i = 0; i < 1950; ++i)
+        h.Remove(key(i));
+      TEST(h.Capacity() < full);
+      TEST(h.Length() == 50);
+      bool match = true;
+      for(int i = 0; i < 2000; ++i)
+        match = match && (i < 1950 ? !h.Exists(key(i)) : h.Get(key(i)) == i);
+      TEST(match);
+      size_t n = 0;
+      for(auto [k, v] : h)
+        match = match && k == key(v) && ++n;
+      TEST(match);
+      TEST(n == 50);
+    };
+    auto intkey = [](int i) { return i; };
+    auto strkey = [](int i) { return Str(std::to_string(i)); };
+    Hash<int, int, ARRAY_SAFE> safe;
+    shrinkkeys(safe, intkey);
+    Hash<Str, int, ARRAY_SAFE> safestr;
+    shrinkkeys(safestr, strkey);
+    Hash<Str, int, ARRAY_MOVE> movestr;
+    shrinkkeys(movestr, strkey);
+    Hash<Str, int, ARRAY_SAFE, &KH_AUTO_HASH<Str, false>, &KH_AUTO_EQUAL<Str, false>, StandardAllocator<char>, HASH_KHASH, true> safecached;
+    shrinkkeys(safecached, strkey);
+  }
+
+  {
+    auto incremental = [&](auto& h) { // Every key has to stay reachable while the table is halfway between two sizes
+      bool resized = false, found = true, removed = true;
+      khint_t count = 0;
+      for(int i = 0; i < 5000; ++i)
+      {
+        h.Insert(Str(std::to_string(i)), i);
+        ++count;
+        resized = resized || h.Resizing();
+        if(h.Resizing() && !(i % 7))
+        {
+          for(int j = 0; j <= i; j += 13)
+            found = found && (!(j % 7) || h.Get(Str(std::to_string(j))) == j);
+          removed = removed && h.Remove(Str(std::to_string(i))) && !h.Exists(Str(std::to_string(i)));
+          --count;
+        }
+      }
+      TEST(resized);
+      TEST(found);
+      TEST(removed);
+      TEST(h.Length() == count);
+      auto copy = h; // Copying has to finish the resize
+      TEST(!copy.Resizing());
+      TEST(copy.Length() == h.Length());
+      size_t n = 0;
+      for(auto [k, v] : h)
+        found = found && k == std::to_string(v) && ++n;
+      TEST(found);
+      TEST(n == h.Length());
+      TEST(!h.Resizing());
+      while(!h.Resizing())
+        h.Insert(Str(std::to_string(h.Length() + 100000)), 0);
+      h.Clear(); // Destroys whatever hasn't been moved yet
+      TEST(!h.Resizing());
+      TEST(h.Length() == 0);
+      TEST(!h.Exists(Str("1")));
+    };
+    Hash<Str, int, ARRAY_SAFE, &KH_AUTO_HASH<Str, false>, &KH_AUTO_EQUAL<Str, false>, StandardAllocator<char>, HASH_KHASH, false, true> kh;
+    incremental(kh);
+    Hash<Str, int, ARRAY_SAFE, &KH_AUTO_HASH<Str, false>, &KH_AUTO_EQUAL<Str, false>, StandardAllocator<char>, HASH_SWISS, true, true> swiss;
+    incremental(swiss);
+  }
+
+  {
+    Hash<int> set;
+    int keys[] = { 5, 1, 5, 9, 1, 7 };
+    TEST(set.InsertMany(keys, 6) == 4);
+    TEST(set.Length() == 4);
+    TEST(set.ExistsMany(keys, 6) == 6);
+  }
+
+  {
+    Hash<Str, int, ARRAY_SAFE> strs; // Transparent lookups never construct a Str
+    strs.Insert("apple", 1);
+    strs.Insert("banana", 2);
+    strs.Insert("", 3);
+    TEST(strs.Get("apple") == 1);
+    TEST(strs.Get(std::string_view("bananas", 6)) == 2);
+    TEST(strs.Get(std::string("banana")) == 2);
+    TEST(strs.Get("") == 3);
+    TEST(strs.Get("Apple") == -1);
+    TEST(strs.Get(std::string_view("apple", 4)) == -1);
+    TEST(strs.Exists("banana"));
+    TEST(!strs.Exists("banan"));
+    TEST(strs.Iterator("apple") == strs.Iterator(Str("apple")));
+    const char* lookup[] = { "banana", "cherry", "apple", "" };
+    int got[4];
+    strs.GetMany(lookup, 4, got);
+    TEST(got[0] == 2 && got[1] == -1 && got[2] == 1 && got[3] == 3);
+    std::string_view views[] = { "apple", "pear" };
+    TEST(strs.ExistsMany(views, 2) == 1);
+    TEST(strs.Remove("apple"));
+    TEST(!strs.Remove("apple"));
+    TEST(strs.Length() == 2);
+
+    HashIns<Str, int, ARRAY_SAFE, StandardAllocator<char>, HASH_SWISS, true> ins;
+    ins.Insert("Content-Type", 1);
+    TEST(ins.Get("content-type") == 1);
+    TEST(ins.Get(std::string_view("CONTENT-TYPE; charset", 12)) == 1);
+    TEST(ins.Get("content-typ") == -1);
+  }
+  {
+    const char* text = "The Quick Brown Fox Jumps Over The Lazy Dog, Then Runs Back Again.";
+    Str lower(text);
+    for(auto& c : lower)
+      c = tolower(c);
+    Str upper(text);
+    for(auto& c : upper)
+      c = toupper(c);
+    auto hash = [](const char* s) { return KH_STR_HASH<char, false>(s); };
+    auto hashn = [](const char* s, size_t len) { return KH_STR_HASH<char, false>(s, len); };
+    auto hashi = [](const char* s) { return KH_STR_HASH<char, true>(s); };
+    auto hashw = [](const wchar_t* s) { return KH_STR_HASH<wchar_t, true>(s); };
+    TEST(hash(text) == hashn(text, strlen(text)));
+    TEST(hash(text) == KH_AUTO_HASH<Str>(Str(text)));
+    TEST(hash(text) != hashn(text, strlen(text) - 1));
+    TEST(hash(text) != hash(lower.c_str()));
+    TEST(hashi(text) == hashi(lower.c_str()));
+    TEST(hashi(upper.c_str()) == hashi(lower.c_str()));
+    TEST(hashw(L"AbCdEfGhIjKlMnOpQrStUvWxYz") == hashw(L"abcdefghijklmnopqrstuvwxyz"));
+    TEST(hash("") == hashn("", 0));
+
+    std::string big(1000, 'A'); // Longer than the case folding buffer
+    std::string small(1000, 'a');
+    TEST(hashi(big.c_str()) == hashi(small.c_str()));
+    TEST(hash(big.c_str()) != hash(small.c_str()));
+    TEST((KH_AUTO_EQUAL<std::string, true>(big, small)));
+    TEST(!(KH_AUTO_EQUAL<std::string, false>(big, small)));
+
+    std::string nul1("ab\0c", 4), nul2("ab\0d", 4), nul3("ab", 2); // Equality has to agree with the hash past an embedded null
+    TEST(!KH_AUTO_EQUAL<std::string>(nul1, nul2));
+    TEST(!KH_AUTO_EQUAL<std::string>(nul1, nul3));
+    TEST(KH_AUTO_EQUAL<std::string>(nul1, std::string("ab\0c", 4)));
+    TEST(!(KH_AUTO_EQUAL<std::string, true>(std::string("a@"), std::string("A`"))));
+    Hash<std::string, int> nuls;
+    nuls.Insert(nul1, 1);
+    nuls.Insert(nul2, 2);
+    nuls.Insert(nul3, 3);
+    TEST(nuls.Length() == 3);
+    TEST(nuls.Get(nul2) == 2 && nuls.Get(nul3) == 3);
+
+    bool folded = true; // Every byte value, at every length and alignment the SIMD, SWAR and scalar paths handle
+    char in[300], out[300];
+    for(int i = 0; i < 300; ++i)
+      in[i] = (char)(i * 7 + 1);
+    for(size_t len = 0; len < 40; ++len)
+      for(size_t off = 0; off + len < 300; off += 37)
+      {
+        internal::HashLower(in + off, out, len);
+        for(size_t i = 0; i < len; ++i)
+          folded = folded && out[i] == ((in[off + i] >= 'A' && in[off + i] <= 'Z') ? in[off + i] + 32 : in[off + i]);
+      }
+    TEST(folded);
+
+    Hash<khint_t> seen; // Every length from 0 to 300 takes a different path through the hash, and none of them should collide
+    Str s;
+    for(int i = 0; i <= 300; ++i, s += (char)('a' + (i % 26)))
+      seen.Insert(hash(s.c_str()));
+    TEST(seen.Length() == 301);
+  }
+  {
+    HashIns<Str, int, ARRAY_SAFE, StandardAllocator<char>, HASH_KHASH, true> h;
+    for(int i = 0; i < 200; ++i)
+      h.Insert(Str("Key") + std::to_string(i).c_str(), i);
+    bool match = true;
+    for(int i = 0; i < 200; ++i)
+      match = match && h[Str("KEY") + std::to_string(i).c_str()] == i;
+    TEST(match);
+    TEST(!h.Exists(Str("key200")));
+  }
+  {
+    typedef Hash<int, DEBUG_CDT<true>, ARRAY_SAFE, &KH_AUTO_HASH<int, false>, &KH_AUTO_EQUAL<int, false>, StandardAllocator<char>, HASH_SWISS> SWISS;
+    SWISS h;
+    for(int i = 0; i < 1000; ++i)
+      h.Insert(i, DEBUG_CDT<true>());
+    for(int i = 0; i < 1000; i += 2)
+      h.Remove(i);
+    SWISS copy(h);
+    SWISS moved(std::move(h));
+    TEST(moved.Length() == 500);
+    TEST(copy.Length() == 500);
+    TEST(moved(999) && !moved(998) && copy(1) && !copy(0));
+  }
+  TEST(DEBUG_CDT<true>::count == 0);
+  {
+    HashIns<const char*, int, ARRAY_SIMPLE, StandardAllocator<char>, HASH_SWISS> h;
+    h.Insert("Video", 1);
+    h.Insert("physics", 2);
+    TEST(h["VIDEO"] == 1);
+    TEST(h["Physics"] == 2);
+    TEST(h["audio"] == -1);
+    TEST(h.Remove("video"));
+    TEST(!h.Exists("Video"));
+  }
   ENDTEST;
 }
@@ -3,9 +3,37 @@
 
 #include "test.h"
 #include "bss-util/lockless.h"
+#include "bss-util/Thread.h"
+#include "bss-util/HighPrecisionTimer.h"
+#include <iostream>
+#include <mutex>
 
 using namespace bss;
 
+template<class LOCK>
+bool _lockless_exclusion(LOCK& lock)
+{
+  const int NTHREADS = 4;
+  const int NLOCKS = 2000;
+  volatile int counter = 0;
+  startflag.store(false);
+  Thread threads[NTHREADS];
+  for(int t = 0; t < NTHREADS; ++t)
+    threads[t] = Thread([&]() {
+    while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+    for(int i = 0; i < NLOCKS; ++i)
+    {
+      lock.Lock();
+      counter = counter + 1;
+      lock.Unlock();
+    }
+  });
+  startflag.store(true);
+  for(int t = 0; t < NTHREADS; ++t)
+    threads[t].join();
+  return counter == NTHREADS * NLOCKS;
+}
+
 TESTDEF::RETPAIR test_LOCKLESS()
 {
   BEGINTEST;
@@ -67,5 +95,100 @@ TESTDEF::RETPAIR test_LOCKLESS()
     TEST(asmbtr<size_t>((size_t*)&test, MBITS) == true);
     TEST(asmbtr<size_t>((size_t*)&test, MBITS) == false);
   }
+
+  {
+    SpinLock spin;
+    TEST(spin.TryLock());
+    TEST(!spin.TryLock());
+    spin.Unlock();
+    TEST(_lockless_exclusion(spin));
+    TEST(spin.TryLock());
+    spin.Unlock();
+
+    TicketLock ticket;
+    TEST(ticket.TryLock());
+    TEST(!ticket.TryLock());
+    ticket.Unlock();
+    TEST(_lockless_exclusion(ticket));
+    TEST(ticket.TryLock());
+    ticket.Unlock();
+
+    MCSLock mcs;
+    MCSLock::Node a, b;
+    TEST(mcs.TryLock(a));
+    TEST(!mcs.TryLock(b));
+    TEST(!mcs.TryLock());
+    mcs.Unlock(a);
+    TEST(mcs.TryLock());
+    MCSLock other; // Holding two locks at once takes two nodes from the cache, which can be released in any order
+    other.Lock();
+    mcs.Unlock();
+    other.Unlock();
+    TEST(_lockless_exclusion(mcs));
+    mcs.Lock(b);
+    TEST(!mcs.TryLock());
+    mcs.Unlock(b);
+  }
   ENDTEST;
-}
\ No newline at end of file
+}
+
+// Measures how long it takes to hand a lock from one thread to another when every thread is trying to acquire it, for 1 to 2x
+// the hardware thread count. Fairness is the ratio between the fewest and most acquisitions any thread got.
+void profile_spinlocks()
+{
+  static const int DURATION = 200; // milliseconds
+  auto run = [](size_t nthreads, auto& lock) {
+    DynArray<Thread, size_t, ARRAY_MOVE> threads;
+    std::unique_ptr<uint64_t[]> counts(new uint64_t[nthreads]);
+    std::atomic<bool> stop(false);
+    volatile uint64_t shared = 0;
+    startflag.store(false);
+    for(size_t t = 0; t < nthreads; ++t)
+      threads.Add(Thread([&](size_t id) {
+      uint64_t n = 0;
+      while(!startflag.load(std::memory_order_acquire));
+      while(!stop.load(std::memory_order_relaxed))
+      {
+        lock.Lock();
+        shared = shared + 1;
+        lock.Unlock();
+        ++n;
+      }
+      counts[id] = n;
+    }, t));
+    auto prof = HighPrecisionTimer::OpenProfiler();
+    startflag.store(true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(DURATION));
+    stop.store(true);
+    for(auto& t : threads)
+      t.join();
+    uint64_t ns = HighPrecisionTimer::CloseProfiler(prof);
+    uint64_t total = 0, least = ~uint64_t(0), most = 0;
+    for(size_t t = 0; t < nthreads; ++t)
+    {
+      total += counts[t];
+      least = bssmin(least, counts[t]);
+      most = bssmax(most, counts[t]);
+    }
+    std::cout << (double)ns / (double)bssmax(total, (uint64_t)1) << " ns (fairness " << (double)least / (double)bssmax(most, (uint64_t)1) << ")";
+  };
+  struct MutexLock { std::mutex m; void Lock() { m.lock(); } void Unlock() { m.unlock(); } };
+
+  size_t max = std::thread::hardware_concurrency() * 2;
+  for(size_t n = 1; n <= max; n *= 2)
+  {
+    SpinLock spin;
+    TicketLock ticket;
+    MCSLock mcs;
+    MutexLock mutex;
+    std::cout << n << " threads: SpinLock ";
+    run(n, spin);
+    std::cout << ", TicketLock ";
+    run(n, ticket);
+    std::cout << ", MCSLock ";
+    run(n, mcs);
+    std::cout << ", std::mutex ";
+    run(n, mutex);
+    std::cout << std::endl;
+  }
+}
@@ -38,6 +38,28 @@ void _locklessqueue_produce(void* p)
 }
 typedef void(*VOIDFN)(void*);
 
+// Runs j threads, half producing and half consuming, and checks that every value came out exactly once
+template<class T>
+bool _locklessqueue_mcmp(Thread* threads, size_t j)
+{
+  lq_c = 1;
+  lq_pos = 0;
+  bssFill(lq_end, 0);
+  T q;
+  startflag.store(false);
+  for(size_t i = 0; i<j; ++i)
+    threads[i] = Thread((i & 1) ? _locklessqueue_produce<T> : _locklessqueue_consume<T>, &q);
+  startflag.store(true);
+  for(size_t i = 0; i<j; ++i)
+    threads[i].join();
+
+  std::sort(std::begin(lq_end), std::end(lq_end));
+  bool check = true;
+  for(size_t i = 0; i < TESTNUM - 1; ++i)
+    check = check && (lq_end[i] == i + 1);
+  return check;
+}
+
 TESTDEF::RETPAIR test_LOCKLESSQUEUE()
 {
   BEGINTEST;
@@ -93,31 +115,107 @@ TESTDEF::RETPAIR test_LOCKLESSQUEUE()
   {
     typedef MicroLockQueue<uint16_t, size_t> LLQUEUE_MCMP;
     for(size_t j = 2; j <= NUMTHREADS; j = fbnext(j))
+      TEST(_locklessqueue_mcmp<LLQUEUE_MCMP>(threads, j)); // multi consumer multi producer test
+  }
+
+  {
+    typedef PolymorphicAllocator<internal::LQ_QNode<uint16_t>, LocklessBlockPolicy> LLQUEUE_ALLOC;
+    TEST((_locklessqueue_mcmp<MicroLockQueue<uint16_t, size_t, LLQUEUE_ALLOC, TicketLock>>(threads, 4)));
+    TEST((_locklessqueue_mcmp<MicroLockQueue<uint16_t, size_t, LLQUEUE_ALLOC, MCSLock>>(threads, 4)));
+  }
+
+  {
+    BoundedQueue<int> q(5);
+    TEST(q.Capacity() == 8);
+    int c = 0;
+    TEST(!q.Pop(c));
+    for(int i = 0; i < 8; ++i)
+      TEST(q.Push(i));
+    TEST(!q.Push(8));
+    TEST(q.Length() == 8);
+    TEST(q.Pop(c));
+    TEST(c == 0);
+    int batch[4] = { 8, 9, 10, 11 };
+    TEST(q.Push(batch, 4) == 1); // Only one slot is free
+    bool order = true;
+    for(int i = 1; i < 9; ++i)
+      order = q.Pop(c) && c == i && order;
+    TEST(order);
+    TEST(!q.Pop(c));
+    TEST(q.Push(batch + 1, 3) == 3); // Wraps around the end of the ring
+    for(int i = 9; i < 12; ++i)
+      order = q.Pop(c) && c == i && order;
+    TEST(order);
+    TEST(q.Length() == 0);
+  }
+
+  {
+    DEBUG_CDT<true>::count = 0;
     {
-      lq_c = 1;
-      lq_pos = 0;
-      bssFill(lq_end, 0);
-      LLQUEUE_MCMP q;   // multi consumer multi producer test
-      startflag.store(false);
-      //threads[0] = std::thread(_locklessqueue_consume<LLQUEUE_MCMP>, &q);
-      //for(size_t i=1; i<j; ++i)
-      //  threads[i] = std::thread(_locklessqueue_produce<LLQUEUE_MCMP>, &q);
-      for(size_t i = 0; i<j; ++i)
-        threads[i] = Thread((i & 1) ? _locklessqueue_produce<LLQUEUE_MCMP> : _locklessqueue_consume<LLQUEUE_MCMP>, &q);
-      startflag.store(true);
-      for(size_t i = 0; i<j; ++i)
-        threads[i].join();
-
-      std::sort(std::begin(lq_end), std::end(lq_end));
-      bool check = true;
-      for(size_t i = 0; i < TESTNUM - 1; ++i)
+      BoundedQueue<DEBUG_CDT<true>> q(4);
+      DEBUG_CDT<true> items[3] = { 1, 2, 3 };
+      q.Push(DEBUG_CDT<true>(0));
+      TEST(q.Push(items, 3) == 3);
+      DEBUG_CDT<true> c;
+      TEST(q.Pop(c) && c._index == 0);
+      TEST(DEBUG_CDT<true>::count == 4); // Three left in the queue, which has to destroy them, plus c
+    }
+    TEST(!DEBUG_CDT<true>::count);
+  }
+
+  {
+    // Producers push tagged values in batches of varying size into a small ring, and each consumer checks it sees every producer's
+    // values in the order they were pushed.
+    const int NPRODUCERS = 2;
+    const int NCONSUMERS = 2;
+    const uint32_t NVALUES = 20000;
+    BoundedQueue<uint32_t> q(64);
+    std::atomic<uint32_t> popped(0);
+    std::atomic<uint64_t> sum(0);
+    std::atomic<bool> ordered(true);
+    startflag.store(false);
+    for(int t = 0; t < NPRODUCERS; ++t)
+      threads[t] = Thread([&](uint32_t id) {
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      uint32_t buf[16];
+      for(uint32_t i = 0; i < NVALUES;)
       {
-        check = check && (lq_end[i] == i + 1);
+        uint32_t n = bssmin(NVALUES - i, 1 + (i % 16));
+        for(uint32_t j = 0; j < n; ++j)
+          buf[j] = (id << 24) | (i + j);
+        for(uint32_t j = 0; j < n; std::this_thread::yield())
+          j += (uint32_t)q.Push(buf + j, n - j);
+        i += n;
       }
-      TEST(check);
-
-      //std::cout << '\n' << j << " threads: " << q.GetContentions() << std::endl;
-    }
+    }, t);
+    for(int t = NPRODUCERS; t < NPRODUCERS + NCONSUMERS; ++t)
+      threads[t] = Thread([&]() {
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      int64_t last[NPRODUCERS] = { -1, -1 };
+      uint32_t v;
+      while(popped.load(std::memory_order_relaxed) < NPRODUCERS * NVALUES)
+      {
+        if(!q.Pop(v))
+        {
+          std::this_thread::yield();
+          continue;
+        }
+        int64_t seq = v & 0xFFFFFF;
+        if(seq <= last[v >> 24])
+          ordered.store(false);
+        last[v >> 24] = seq;
+        sum.fetch_add(seq, std::memory_order_relaxed);
+        popped.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+    startflag.store(true);
+    for(int t = 0; t < NPRODUCERS + NCONSUMERS; ++t)
+      threads[t].join();
+    TEST(ordered.load());
+    TEST(popped.load() == NPRODUCERS * NVALUES);
+    TEST(sum.load() == (uint64_t)NPRODUCERS * NVALUES * (NVALUES - 1) / 2);
+    uint32_t v;
+    TEST(!q.Pop(v));
   }
 
   ENDTEST;
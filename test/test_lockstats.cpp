@@ -0,0 +1,118 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/RWLock.h"
+#include "bss-util/LocklessQueue.h"
+#include "bss-util/RingAlloc.h"
+#include "bss-util/Profiler.h"
+#include "bss-util/Thread.h"
+#include <sstream>
+
+using namespace bss;
+
+TESTDEF::RETPAIR test_LOCKSTATS()
+{
+  BEGINTEST;
+
+  {
+    RWLock lock;
+    lock.Lock(); // Nothing is recorded until stats are attached
+    lock.Unlock();
+    LockStats stats("lock");
+    TEST(!strcmp(stats.GetName(), "lock"));
+    lock.SetLockStats(&stats);
+    TEST(lock.GetLockStats() == &stats);
+    TEST(stats.Attempts() == 0);
+    lock.Lock();
+    TEST(!lock.AttemptLock());
+    TEST(!lock.AttemptRLock());
+    lock.Unlock();
+    lock.RLock();
+    lock.RUnlock();
+    TEST(stats.Attempts() == 4);
+    TEST(stats.Failed() == 2);
+    TEST(stats.Contended() == 0);
+
+    std::atomic<bool> waiting(false);
+    const uint32_t line = __LINE__; lock.Lock();
+    Thread t([&]() { waiting.store(true); lock.Lock(); lock.Unlock(); });
+    while(!waiting.load()) std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    lock.Unlock();
+    t.join();
+    TEST(stats.Contended() == 1);
+    TEST(stats.Spins() > 0);
+    TEST(stats.WaitNS() > 5000000);
+
+    LockStats::Report r;
+    stats.Get(r);
+    TEST(r.lock == &stats);
+    TEST(r.attempts == 6);
+    TEST(r.blockers[0].waits == 1);
+    TEST(r.blockers[0].line == line);
+    TEST(r.blockers[0].file != 0 && strstr(r.blockers[0].file, "test_lockstats.cpp") != 0);
+    TEST(r.blockers[1].waits == 0);
+
+    size_t n = LockStats::Query(0, 0);
+    TEST(n >= 1);
+    std::unique_ptr<LockStats::Report[]> reports(new LockStats::Report[n]);
+    TEST(LockStats::Query(reports.get(), n) == n);
+    bool found = false;
+    for(size_t i = 0; i < n; ++i)
+      found = found || (reports[i].lock == &stats && reports[i].contended == 1);
+    TEST(found);
+    for(size_t i = 1; i < n; ++i)
+      TEST(reports[i - 1].waitns >= reports[i].waitns);
+
+    std::stringstream ss;
+    Profiler::profiler.WriteToStream(ss, Profiler::OUTPUT_LOCKS);
+    TEST(ss.str().find("BSS Lock Contention Output") != std::string::npos);
+    TEST(ss.str().find("test_lockstats.cpp:") != std::string::npos);
+
+    stats.Clear();
+    TEST(stats.Attempts() == 0 && stats.WaitNS() == 0);
+  }
+
+  {
+    LockStats consumer("consumer");
+    LockStats producer("producer");
+    MicroLockQueue<int> q;
+    q.SetLockStats(&consumer, &producer);
+    q.Push(1);
+    q.Push(2);
+    int v;
+    TEST(q.Pop(v));
+    TEST(producer.Attempts() == 2);
+    TEST(consumer.Attempts() == 1);
+  }
+
+  {
+    LockStats stats("freelist");
+    LocklessBlockPolicy<uint64_t> alloc;
+    alloc.SetLockStats(&stats);
+    uint64_t* p = alloc.allocate(1);
+    alloc.deallocate(p);
+    TEST(stats.Attempts() == 2);
+    TEST(stats.Contended() == 0);
+  }
+
+  {
+    size_t before = LockStats::Query(0, 0);
+    {
+      LockStats current("current");
+      LockStats buckets("buckets");
+      TEST(LockStats::Query(0, 0) == before + 2);
+      RingAlloc<int> ring(16);
+      ring.deallocate(ring.allocate(1)); // Creates a bucket before the stats are attached
+      ring.SetLockStats(&current, &buckets);
+      ring.deallocate(ring.allocate(1));
+      ring.deallocate(ring.allocate(64)); // Forces a new bucket
+      TEST(current.Attempts() > 0);
+      TEST(buckets.Attempts() > 0);
+    }
+    TEST(LockStats::Query(0, 0) == before);
+  }
+
+  ENDTEST;
+}
@@ -0,0 +1,189 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/PerfectHash.h"
+#include "bss-util/Hash.h"
+#include "bss-util/HighPrecisionTimer.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using namespace bss;
+
+namespace {
+  enum PH_OPCODE : uint16_t { OP_NOP = 0x00, OP_LOAD = 0x11, OP_STORE = 0x12, OP_JMP = 0x40, OP_CALL = 0x41, OP_RET = 0x42, OP_HALT = 0xFF };
+
+  constexpr auto ph_colors = MakePerfectHash<std::string_view>({ "red", "green", "blue", "alpha", "cyan", "magenta", "yellow", "black",
+    "a_much_longer_name_that_takes_several_words" });
+  constexpr auto ph_opcodes = MakePerfectHash<PH_OPCODE>({ OP_NOP, OP_LOAD, OP_STORE, OP_JMP, OP_CALL, OP_RET, OP_HALT });
+
+  // Checks that every key got its own index below n
+  template<class F>
+  bool ph_permutation(size_t n, F && index)
+  {
+    std::vector<bool> seen(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+      size_t x = index(i);
+      if(x >= n || seen[x])
+        return false;
+      seen[x] = true;
+    }
+    return true;
+  }
+}
+
+TESTDEF::RETPAIR test_PERFECTHASH()
+{
+  BEGINTEST;
+  TESTSTATIC(ph_colors.Valid());
+  TESTSTATIC(ph_colors.Find("red") == 0);
+  TESTSTATIC(ph_colors.Find("blue") == 2);
+  TESTSTATIC(ph_colors.Find("a_much_longer_name_that_takes_several_words") == 8);
+  TESTSTATIC(ph_colors.Find("a_much_longer_name_that_takes_several_wordz") == (size_t)~0);
+  TESTSTATIC(ph_colors.Find("purple") == (size_t)~0);
+  TESTSTATIC(ph_colors.Find("") == (size_t)~0);
+  TESTSTATIC(ph_colors.Length() == 9);
+  TESTSTATIC(ph_opcodes.Find(OP_CALL) == 4);
+  TESTSTATIC(ph_opcodes.Find(OP_HALT) == 6);
+  TESTSTATIC(ph_opcodes.Find((PH_OPCODE)0x13) == (size_t)~0);
+  TESTCOUNTALL(ph_colors.Length(), ph_colors.Slot(ph_colors[(uint32_t)i]) == i);
+
+  {
+    const size_t N = 300;
+    std::vector<Str> names(N);
+    std::string_view views[N];
+    for(size_t i = 0; i < N; ++i)
+    {
+      names[i] = StrF("field_%zu", i * 7);
+      views[i] = names[i];
+    }
+    std::unique_ptr<StaticPerfectHash<std::string_view, N>> t(new StaticPerfectHash<std::string_view, N>(views));
+    TEST(t->Valid());
+    TESTCOUNTALL(N, t->Find(names[i].c_str()) == i);
+    TEST(t->Find("field_1") == (size_t)~0);
+    TEST(t->Find("field_") == (size_t)~0);
+
+    views[N - 1] = views[0]; // A duplicate can never be placed
+    std::unique_ptr<StaticPerfectHash<std::string_view, N>> d(new StaticPerfectHash<std::string_view, N>(views));
+    TEST(!d->Valid());
+    TEST(d->Find(names[0].c_str()) == (size_t)~0);
+  }
+
+  {
+    const size_t N = 200000;
+    std::vector<uint64_t> keys(N);
+    for(size_t i = 0; i < N; ++i)
+      keys[i] = i * 0x10001 + 3;
+    PerfectHash h;
+    TEST(h.Empty());
+    TEST(h.Get(keys[0]) == 0);
+    TEST(h[keys[1]] == 0);
+    TEST(h.Build(keys.data(), N));
+    TEST(h.Length() == N);
+    TEST(ph_permutation(N, [&](size_t i) { return h.Get(keys[i]); }));
+    std::vector<uint32_t> many(N);
+    for(size_t i = 0; i < N; ++i)
+      many[i] = h[keys[i]];
+
+    std::stringstream ss;
+    TEST(h.Save(ss));
+    std::string blob = ss.str();
+    TEST(blob.size() == h.DataSize());
+    PerfectHash loaded;
+    TEST(loaded.Load(ss));
+    TEST(loaded.Length() == N);
+    TESTCOUNTALL(N, loaded.Get(keys[i]) == many[i]);
+
+    // The block can be used in place, the way a memory mapped file would be
+    std::unique_ptr<uint64_t[]> mapped(new uint64_t[blob.size() / 8 + 1]);
+    memcpy(mapped.get(), blob.data(), blob.size());
+    PerfectHash view(mapped.get(), blob.size());
+    TEST(view.Data() == mapped.get());
+    TEST(view.Length() == N);
+    TESTCOUNTALL(N, view.Get(keys[i]) == many[i]);
+    PerfectHash viewcopy(view);
+    TEST(viewcopy.Data() == mapped.get());
+    PerfectHash owncopy(h);
+    TEST(owncopy.Data() != h.Data());
+    TESTCOUNTALL(N, owncopy.Get(keys[i]) == many[i]);
+    PerfectHash moved(std::move(owncopy));
+    TEST(owncopy.Empty());
+    TEST(moved.Get(keys[N / 2]) == many[N / 2]);
+
+    TEST(PerfectHash(mapped.get(), blob.size() - 4).Empty());
+    TEST(PerfectHash(mapped.get(), blob.size() - 4).Get(keys[0]) == 0);
+    TEST(PerfectHash(reinterpret_cast<char*>(mapped.get()) + 4, blob.size()).Empty());
+    reinterpret_cast<char*>(mapped.get())[0] ^= 1;
+    TEST(PerfectHash(mapped.get(), blob.size()).Empty());
+    std::stringstream bad(std::string(blob.data(), blob.size() / 2));
+    TEST(!loaded.Load(bad));
+    TEST(loaded.Length() == N);
+
+    keys[7] = keys[8];
+    PerfectHash dup;
+    TEST(!dup.Build(keys.data(), N));
+    TEST(dup.Empty());
+  }
+
+  {
+    const size_t N = 50000;
+    std::vector<Str> keys(N);
+    for(size_t i = 0; i < N; ++i)
+      keys[i] = StrF("key/%zu/%zu", i, (i * 2654435761u) % 1000);
+    PerfectHash h;
+    TEST(h.Build(keys.data(), N, 12345));
+    TEST(ph_permutation(N, [&](size_t i) { return h.Get(keys[i]); }));
+    TEST(h.Get(keys[5]) == h.Get(keys[5].c_str()));
+    TEST(h.Get(keys[5]) == h.Get(std::string_view(keys[5])));
+
+    const char* one[] = { "only" };
+    TEST(h.Build(one, 1));
+    TEST(h.Length() == 1);
+    TEST(h.Get("only") == 0);
+    TEST(h.Get("other") == 0);
+    TEST(h.Build(one, 0));
+    TEST(h.Empty());
+    TEST(h.Get("only") == 0);
+  }
+
+  ENDTEST;
+}
+
+// Compares lookups through a PerfectHash against a Hash mapping the same keys to their index.
+void profile_perfecthash()
+{
+  for(size_t n : { (size_t)1000, (size_t)1000000, (size_t)10000000 })
+  {
+    std::vector<uint64_t> keys(n);
+    for(size_t i = 0; i < n; ++i)
+      keys[i] = bssRandInt(0, INT64_MAX);
+    std::vector<uint64_t> queries(bssmax(n, (size_t)1000000));
+    for(size_t i = 0; i < queries.size(); ++i)
+      queries[i] = keys[bssRandInt(0, (int64_t)n)];
+
+    PerfectHash ph;
+    auto prof = HighPrecisionTimer::OpenProfiler();
+    ph.Build(keys.data(), n);
+    uint64_t build = HighPrecisionTimer::CloseProfiler(prof);
+
+    Hash<uint64_t, uint32_t> hash;
+    for(size_t i = 0; i < n; ++i)
+      hash.Insert(keys[i], (uint32_t)i);
+
+    uint64_t sum = 0;
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(uint64_t q : queries)
+      sum += ph.Get(q);
+    uint64_t a = HighPrecisionTimer::CloseProfiler(prof);
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(uint64_t q : queries)
+      sum += hash.Get(q);
+    uint64_t b = HighPrecisionTimer::CloseProfiler(prof);
+
+    double q = (double)queries.size();
+    std::cout << n << " keys: build " << (build / 1000000) << " ms (" << (ph.DataSize() * 8.0 / n) << " bits/key), PerfectHash " << (a / q) <<
+      " ns, Hash " << (b / q) << " ns (" << (sum % 2) << ")" << std::endl;
+  }
+}
@@ -0,0 +1,116 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/Pipeline.h"
+
+using namespace bss;
+
+namespace {
+  struct PipeItem
+  {
+    int value;
+    int64_t result;
+  };
+
+  struct PipeTest
+  {
+    PipeTest(int n) : count(n), produced(0), inflight(0), maxinflight(0), running(0), maxrunning(0), expect(0), misordered(0), total(0), first(0) {}
+    bool Source(PipeItem& item)
+    {
+      if(produced >= count)
+        return false;
+      item.value = produced++;
+      item.result = 0;
+      int f = inflight.fetch_add(1, std::memory_order_relaxed) + 1;
+      if(f > maxinflight) // Only the source raises this, so a plain compare is enough
+        maxinflight = f;
+      return true;
+    }
+    void First(PipeItem& item) { first += (item.value == first); }
+    void Square(PipeItem& item)
+    {
+      int r = running.fetch_add(1, std::memory_order_acquire) + 1;
+      int m = maxrunning.load(std::memory_order_relaxed);
+      while(r > m && !maxrunning.compare_exchange_weak(m, r, std::memory_order_relaxed));
+      if(!(item.value % 16))
+        std::this_thread::yield(); // Lets items overtake each other
+      item.result = (int64_t)item.value * item.value;
+      running.fetch_sub(1, std::memory_order_release);
+    }
+    void Last(PipeItem& item)
+    {
+      if(item.value != expect++ || item.result != (int64_t)item.value * item.value)
+        ++misordered;
+      total += item.result;
+      inflight.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    int count;
+    int produced;
+    std::atomic<int> inflight;
+    int maxinflight;
+    std::atomic<int> running;
+    std::atomic<int> maxrunning;
+    int expect;
+    int misordered;
+    int64_t total;
+    int first;
+  };
+}
+
+TESTDEF::RETPAIR test_PIPELINE()
+{
+  BEGINTEST;
+
+  {
+    const int NITEMS = 5000;
+    ThreadPool pool(3);
+    PipeTest t(NITEMS);
+    Pipeline<PipeItem> pipe(pool, Pipeline<PipeItem>::SOURCE::From<PipeTest, &PipeTest::Source>(&t), 12);
+    TEST(pipe.Tokens() == 16);
+    pipe.AddStage(Pipeline<PipeItem>::STAGE::From<PipeTest, &PipeTest::First>(&t), PIPE_SERIAL);
+    pipe.AddStage(Pipeline<PipeItem>::STAGE::From<PipeTest, &PipeTest::Square>(&t), PIPE_PARALLEL, 2);
+    pipe.AddStage(Pipeline<PipeItem>::STAGE::From<PipeTest, &PipeTest::Last>(&t), PIPE_SERIAL);
+    TEST(pipe.Stages() == 3);
+    TEST(!pipe.Running());
+    pipe.Run();
+    TEST(!pipe.Running());
+    TEST(pipe.Produced() == NITEMS);
+    TEST(t.first == NITEMS);
+    TEST(t.expect == NITEMS);
+    TEST(!t.misordered);
+    int64_t total = 0;
+    for(int64_t i = 0; i < NITEMS; ++i)
+      total += i * i;
+    TEST(t.total == total);
+    TEST(t.maxinflight <= 16);
+    TEST(t.maxrunning.load() <= 2);
+    TEST(!t.inflight.load());
+
+    t.count = NITEMS * 2; // The pipeline can be started again, and serial stages carry on from where they were
+    pipe.Run();
+    TEST(t.expect == NITEMS * 2);
+    TEST(!t.misordered);
+    TEST(pipe.Produced() == NITEMS * 2);
+  }
+
+  {
+    ThreadPool pool(2);
+    PipeTest t(1000);
+    Pipeline<PipeItem> pipe(pool, Pipeline<PipeItem>::SOURCE::From<PipeTest, &PipeTest::Source>(&t), 1);
+    pipe.AddStage(Pipeline<PipeItem>::STAGE::From<PipeTest, &PipeTest::Square>(&t), PIPE_PARALLEL);
+    pipe.AddStage(Pipeline<PipeItem>::STAGE::From<PipeTest, &PipeTest::Last>(&t), PIPE_PARALLEL);
+    pipe.Run();
+    TEST(t.maxinflight <= (int)pipe.Tokens());
+    TEST(t.expect == 1000 && !t.misordered);
+
+    PipeTest empty(0);
+    Pipeline<PipeItem> none(pool, Pipeline<PipeItem>::SOURCE::From<PipeTest, &PipeTest::Source>(&empty));
+    none.Run();
+    TEST(none.Produced() == 0);
+    TEST(!none.Running());
+  }
+
+  ENDTEST;
+}
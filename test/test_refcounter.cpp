@@ -3,6 +3,7 @@
 
 #include "test.h"
 #include "bss-util/RefCounter.h"
+#include "bss-util/Thread.h"
 
 using namespace bss;
 
@@ -15,6 +16,9 @@ struct REF_TEST : DEBUG_CDT<false>, RefCounter
   TESTDEF::RETPAIR& __testret;
 };
 
+template<class BASE>
+struct REF_SHARED : DEBUG_CDT<false>, BASE {};
+
 TESTDEF::RETPAIR test_REFCOUNTER()
 {
   BEGINTEST;
@@ -35,5 +39,110 @@ TESTDEF::RETPAIR test_REFCOUNTER()
     p6 = std::move(p4);
   }
   TEST(!DEBUG_CDT<false>::count);
+
+  {
+    const int NTHREADS = 4;
+    DEBUG_CDT<false>::count = 0;
+    auto p = new REF_SHARED<AtomicRefCounter>();
+    TEST(p->Grab() == 1);
+    startflag.store(false);
+    Thread threads[NTHREADS];
+    for(int t = 0; t < NTHREADS; ++t) // Every thread hammers the count with copies of the same pointer
+      threads[t] = Thread([p]() {
+      ref_ptr<REF_SHARED<AtomicRefCounter>> r(p);
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      for(int i = 0; i < 10000; ++i)
+      {
+        ref_ptr<REF_SHARED<AtomicRefCounter>> copy(r);
+        ref_ptr<REF_SHARED<AtomicRefCounter>> moved(std::move(copy));
+      }
+    });
+    startflag.store(true);
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t].join();
+    TEST(p->Count() == 1);
+    TEST(DEBUG_CDT<false>::count == 1);
+    TEST(!p->Drop());
+    TEST(!DEBUG_CDT<false>::count);
+  }
+
+  {
+    DEBUG_CDT<false>::count = 0;
+    RefCollector collector;
+    TEST(collector.Empty());
+    {
+      ref_ptr<REF_SHARED<AtomicRefCounter>> r1(new REF_SHARED<AtomicRefCounter>());
+      ref_ptr<REF_SHARED<AtomicRefCounter>> r2(new REF_SHARED<AtomicRefCounter>());
+      r1->SetCollector(&collector);
+      r2->SetCollector(&collector);
+      ref_ptr<REF_SHARED<AtomicRefCounter>> r3(new REF_SHARED<AtomicRefCounter>());
+    }
+    TEST(DEBUG_CDT<false>::count == 2); // r3 had no collector
+    TEST(!collector.Empty());
+    TEST(collector.Collect() == 2);
+    TEST(!DEBUG_CDT<false>::count);
+    TEST(!collector.Collect());
+  }
+
+  {
+    DEBUG_CDT<false>::count = 0;
+    auto p = new REF_SHARED<BiasedRefCounter>();
+    TEST(p->IsBiased());
+    TEST(p->Grab() == 1);
+    TEST(p->Grab() == 2);
+    TEST(p->Drop() == 1);
+
+    // Another thread takes its own references, then drops one of ours, which leaves the shared count negative.
+    Thread([p]() {
+      p->Grab();
+      p->Grab();
+      p->Drop();
+      p->Drop();
+      p->Drop();
+    }).join();
+    TEST(DEBUG_CDT<false>::count == 1);
+    TEST(BiasedRefCounter::Merge() == 1); // Only the owner can tell that no references are left
+    TEST(!DEBUG_CDT<false>::count);
+
+    p = new REF_SHARED<BiasedRefCounter>();
+    p->Grab();
+    p->Grab();
+    TEST(p->Drop() == 1);
+    Thread([p]() { p->Grab(); }).join();
+    TEST(p->Drop() == 1); // The owner's side is gone, so it merges and the object now lives on the other thread's reference
+    TEST(!p->IsBiased());
+    TEST(DEBUG_CDT<false>::count == 1);
+    Thread([p]() { p->Drop(); }).join();
+    TEST(!DEBUG_CDT<false>::count);
+    TEST(!BiasedRefCounter::Merge());
+
+    const int NTHREADS = 4;
+    p = new REF_SHARED<BiasedRefCounter>();
+    p->Grab();
+    startflag.store(false);
+    Thread threads[NTHREADS];
+    for(int t = 0; t < NTHREADS; ++t) // Workers copy and drop references while the owner does the same locally
+      threads[t] = Thread([p]() {
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      for(int i = 0; i < 10000; ++i)
+      {
+        p->Grab();
+        p->Drop();
+      }
+    });
+    startflag.store(true);
+    for(int i = 0; i < 10000; ++i)
+    {
+      ref_ptr<REF_SHARED<BiasedRefCounter>> r(p);
+      if(!(i % 100))
+        BiasedRefCounter::Merge();
+    }
+    for(int t = 0; t < NTHREADS; ++t)
+      threads[t].join();
+    TEST(DEBUG_CDT<false>::count == 1);
+    p->Drop();
+    BiasedRefCounter::Merge(); // The workers may have queued it when their side of the count hit zero
+    TEST(!DEBUG_CDT<false>::count);
+  }
   ENDTEST;
 }
\ No newline at end of file
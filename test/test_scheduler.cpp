@@ -3,6 +3,7 @@
 
 #include "test.h"
 #include "bss-util/Scheduler.h"
+#include "bss-util/Thread.h"
 #include <functional>
 
 using namespace bss;
@@ -21,5 +22,36 @@ TESTDEF::RETPAIR test_SCHEDULER()
   TEST(ret[1]);
   TEST(ret[2]);
   TEST(s.Length() == 2);
+  TEST(s.NextEvent() > 0.0);
+
+  {
+    Scheduler<std::function<double()>> loop;
+    TEST(loop.NextEvent() == std::numeric_limits<double>::infinity());
+    std::atomic<int> fired(0);
+    uint64_t start = HighPrecisionTimer::OpenProfiler();
+    Thread t([&]() { loop.Run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(5)); // Let the loop go to sleep with nothing scheduled
+    loop.Post(0.0, [&]()->double { return (fired.fetch_add(1) < 2) ? 10.0 : 0.0; });
+    loop.Post(50.0, [&]()->double { loop.Stop(); return 0.0; });
+    t.join();
+    TEST(fired.load() == 3);
+    TEST(HighPrecisionTimer::CloseProfiler(start) >= 50000000ULL);
+  }
+
+  {
+    int fired = 0; // Events posted before a copy or move that haven't been picked up yet still have to fire
+    Scheduler<std::function<double()>> src;
+    src.Post(0.0, [&]()->double { ++fired; return 0.0; });
+    Scheduler<std::function<double()>> copy(src);
+    Scheduler<std::function<double()>> moved(std::move(src));
+    Scheduler<std::function<double()>> assigned;
+    assigned = moved;
+    src.Update();
+    copy.Update();
+    moved.Update();
+    assigned.Update();
+    TEST(fired == 3);
+    TEST(src.Length() == 0);
+  }
   ENDTEST;
 }
\ No newline at end of file
@@ -0,0 +1,253 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/SharedRing.h"
+#include "bss-util/Thread.h"
+#include <string>
+#ifdef BSS_PLATFORM_POSIX
+#include <sys/wait.h>
+#endif
+
+using namespace bss;
+
+namespace {
+  // Messages are filled with a pattern derived from their sender and sequence number, so a torn or misplaced one is caught.
+  struct RingMsg
+  {
+    uint32_t sender;
+    uint32_t seq;
+    uint32_t len;
+  };
+  inline size_t ringmsg_len(uint32_t seq) { return sizeof(RingMsg) + (seq * 7) % 301; }
+  inline void ringmsg_fill(void* p, uint32_t sender, uint32_t seq)
+  {
+    RingMsg m = { sender, seq, (uint32_t)ringmsg_len(seq) };
+    memcpy(p, &m, sizeof(m));
+    uint8_t* b = reinterpret_cast<uint8_t*>(p);
+    for(size_t i = sizeof(m); i < m.len; ++i)
+      b[i] = (uint8_t)(seq + i);
+  }
+  inline bool ringmsg_check(const void* p, size_t len, uint32_t sender, uint32_t seq)
+  {
+    RingMsg m;
+    memcpy(&m, p, sizeof(m));
+    if(m.sender != sender || m.seq != seq || m.len != len || len != ringmsg_len(seq))
+      return false;
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+    for(size_t i = sizeof(m); i < len; ++i)
+      if(b[i] != (uint8_t)(seq + i))
+        return false;
+    return true;
+  }
+  inline std::string ringname(const char* suffix)
+  {
+#ifdef BSS_PLATFORM_POSIX
+    return std::string("/bss_test_ring_") + std::to_string(getpid()) + suffix;
+#else
+    return std::string("bss_test_ring_") + suffix;
+#endif
+  }
+}
+
+TESTDEF::RETPAIR test_SHAREDRING()
+{
+  BEGINTEST;
+
+  {
+    std::string name = ringname("basic");
+    SharedRing<>::Unlink(name.c_str());
+    SharedRing<> producer, consumer;
+    TEST(!consumer.Open(name.c_str()));
+    TEST(!consumer.IsOpen());
+    TEST(producer.Create(name.c_str(), 1000));
+    TEST(producer.Capacity() == 1024);
+    TEST(!SharedRing<>().Create(name.c_str(), 1000)); // Already exists
+    TEST(!SharedRing<true>().Open(name.c_str())); // Wrong mode
+    TEST(consumer.Open(name.c_str()));
+    TEST(consumer.Capacity() == 1024);
+
+    size_t len;
+    TEST(!consumer.Peek(len));
+    TEST(!consumer.Wait(0));
+
+    // Exactly filling the ring mustn't make Consume() wrap around onto the records it's consuming
+    int filled = 0;
+    bool full = true;
+    while(void* m = producer.Reserve(56))
+    {
+      memset(m, filled, 56);
+      producer.Commit(m, 56);
+      ++filled;
+    }
+    TEST(filled == 16);
+    TEST(producer.Used() == producer.Capacity());
+    filled = 0;
+    TEST(consumer.Consume([&](const void* data, size_t l) { full = full && l == 56 && *reinterpret_cast<const uint8_t*>(data) == filled++; }) == 16);
+    TEST(full);
+    TEST(!producer.Used());
+
+    TEST(producer.Push("abc", 4));
+    TEST(consumer.Wait(0));
+    const char* s = reinterpret_cast<const char*>(consumer.Peek(len));
+    TEST(s != 0 && len == 4 && !strcmp(s, "abc"));
+    consumer.Release();
+    TEST(!consumer.Peek(len));
+    TEST(!producer.Used());
+
+    // Reserving more than we end up writing
+    char* p = reinterpret_cast<char*>(producer.Reserve(100));
+    TEST(p != 0);
+    TEST(!consumer.Peek(len)); // Not committed yet
+    strcpy(p, "hi");
+    producer.Commit(p, 3);
+    s = reinterpret_cast<const char*>(consumer.Peek(len));
+    TEST(s != 0 && len == 3 && !strcmp(s, "hi"));
+    consumer.Release();
+
+    // Fill it up, then drain it, many times over so the records wrap around the end
+    uint32_t sent = 0, received = 0;
+    bool valid = true;
+    for(int round = 0; round < 50; ++round)
+    {
+      void* m;
+      while((m = producer.Reserve(ringmsg_len(sent))) != 0)
+      {
+        ringmsg_fill(m, 0, sent);
+        producer.Commit(m, ringmsg_len(sent++));
+      }
+      TEST(producer.Used() > 0);
+      if(round & 1)
+        consumer.Consume([&](const void* data, size_t n) { valid = valid && ringmsg_check(data, n, 0, received++); });
+      else
+        while(const void* d = consumer.Peek(len))
+        {
+          valid = valid && ringmsg_check(d, len, 0, received++);
+          consumer.Release();
+        }
+      TEST(!producer.Used());
+    }
+    TEST(valid);
+    TEST(sent == received);
+    TEST(sent > 100);
+    TEST(consumer.Consume([](const void*, size_t) {}) == 0);
+
+    TEST(consumer.MaxMessage() == 504);
+    TEST(producer.Reserve(504) != 0);
+
+    TEST(SharedRing<>::Unlink(name.c_str()));
+    TEST(consumer.IsOpen()); // Still mapped after the name is gone
+    TEST(!SharedRing<>().Open(name.c_str()));
+  }
+
+  {
+    const uint32_t NMSGS = 20000;
+    std::string name = ringname("spsc");
+    SharedRing<>::Unlink(name.c_str());
+    SharedRing<> consumer;
+    TEST(consumer.Create(name.c_str(), 4096));
+    Thread producer([&]() {
+      SharedRing<> ring;
+      if(!ring.Open(name.c_str()))
+        return;
+      for(uint32_t i = 0; i < NMSGS; ++i)
+      {
+        void* m = ring.Reserve(ringmsg_len(i), SharedRing<>::FOREVER);
+        ringmsg_fill(m, 1, i);
+        ring.Commit(m, ringmsg_len(i));
+      }
+    });
+    uint32_t received = 0;
+    bool valid = true;
+    while(received < NMSGS && consumer.Wait(1000000000))
+      consumer.Consume([&](const void* data, size_t n) { valid = valid && ringmsg_check(data, n, 1, received++); }, 64);
+    producer.join();
+    TEST(received == NMSGS);
+    TEST(valid);
+    SharedRing<>::Unlink(name.c_str());
+  }
+
+  {
+    const int NPRODUCERS = 3;
+    const uint32_t NMSGS = 10000;
+    std::string name = ringname("mpsc");
+    SharedRing<true>::Unlink(name.c_str());
+    SharedRing<true> consumer;
+    TEST(consumer.Create(name.c_str(), 2048));
+    startflag.store(false);
+    Thread threads[NPRODUCERS];
+    for(int t = 0; t < NPRODUCERS; ++t)
+      threads[t] = Thread([&](uint32_t id) {
+      SharedRing<true> ring;
+      if(!ring.Open(name.c_str()))
+        return;
+      while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+      for(uint32_t i = 0; i < NMSGS; ++i)
+      {
+        void* m = ring.Reserve(ringmsg_len(i), SharedRing<true>::FOREVER);
+        ringmsg_fill(m, id, i);
+        ring.Commit(m, ringmsg_len(i));
+      }
+    }, (uint32_t)t);
+    startflag.store(true);
+
+    uint32_t next[NPRODUCERS] = { 0 };
+    uint32_t received = 0;
+    bool valid = true;
+    while(received < NPRODUCERS * NMSGS && consumer.Wait(1000000000))
+    {
+      size_t len;
+      while(const void* d = consumer.Peek(len))
+      {
+        RingMsg m;
+        memcpy(&m, d, sizeof(m));
+        valid = valid && m.sender < NPRODUCERS && ringmsg_check(d, len, m.sender, next[m.sender]++); // Each producer's messages stay in order
+        ++received;
+        consumer.Release();
+      }
+    }
+    for(int t = 0; t < NPRODUCERS; ++t)
+      threads[t].join();
+    TEST(received == NPRODUCERS * NMSGS);
+    TEST(valid);
+    SharedRing<true>::Unlink(name.c_str());
+  }
+
+#ifdef BSS_PLATFORM_POSIX
+  {
+    const uint32_t NMSGS = 20000;
+    std::string name = ringname("fork");
+    SharedRing<>::Unlink(name.c_str());
+    SharedRing<> consumer;
+    TEST(consumer.Create(name.c_str(), 4096));
+    pid_t child = fork();
+    if(!child)
+    {
+      SharedRing<> ring;
+      if(!ring.Open(name.c_str()))
+        _exit(1);
+      for(uint32_t i = 0; i < NMSGS; ++i)
+      {
+        void* m = ring.Reserve(ringmsg_len(i), SharedRing<>::FOREVER);
+        ringmsg_fill(m, 2, i);
+        ring.Commit(m, ringmsg_len(i));
+      }
+      _exit(0);
+    }
+    TEST(child > 0);
+    uint32_t received = 0;
+    bool valid = true;
+    while(child > 0 && received < NMSGS && consumer.Wait(2000000000))
+      consumer.Consume([&](const void* data, size_t n) { valid = valid && ringmsg_check(data, n, 2, received++); });
+    int status = -1;
+    if(child > 0)
+      waitpid(child, &status, 0);
+    TEST(status == 0);
+    TEST(received == NMSGS);
+    TEST(valid);
+    SharedRing<>::Unlink(name.c_str());
+  }
+#endif
+
+  ENDTEST;
+}
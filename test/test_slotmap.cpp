@@ -0,0 +1,173 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/SlotMap.h"
+#include "bss-util/Thread.h"
+
+using namespace bss;
+
+TESTDEF::RETPAIR test_SLOTMAP()
+{
+  BEGINTEST;
+
+  {
+    SlotMap<int> map;
+    TEST(map.Empty());
+    TEST(!map.Exists(0));
+    TEST(!map.Get(0));
+    uint32_t a = map.Insert(1);
+    uint32_t b = map.Insert(2);
+    uint32_t c = map.Insert(3);
+    TEST(a != 0 && a != b && b != c);
+    TEST(map.Length() == 3);
+    TEST(map[a] == 1 && map[b] == 2 && map[c] == 3);
+    TEST(map.Remove(a));
+    TEST(!map.Remove(a));
+    TEST(!map.Exists(a));
+    TEST(!map.Get(a));
+    TEST(map.Length() == 2);
+    TEST(map.IndexOf(c) == 0); // The last value was moved into the hole
+    TEST(map.GetID(0) == c);
+    TEST(map.GetID(1) == b);
+    uint32_t d = map.Insert(4);
+    TEST((d & SlotMap<int>::INDEX_MASK) == (a & SlotMap<int>::INDEX_MASK)); // Reuses the slot with a new generation
+    TEST(d != a);
+    TEST(!map.Exists(a));
+    TEST(*map.Get(d) == 4);
+    int sum = 0;
+    for(auto& v : map)
+      sum += v;
+    TEST(sum == 9);
+    map.Clear();
+    TEST(map.Empty());
+    TEST(!map.Exists(b) && !map.Exists(c) && !map.Exists(d));
+    TEST(map.Insert(5) != 0);
+  }
+
+  {
+    SlotMap<int, uint64_t> map;
+    Hash<uint64_t, int> ref;
+    DynArray<uint64_t, uint32_t> ids;
+    DynArray<uint64_t, uint32_t> dead;
+    for(int i = 0; i < 5000; ++i)
+    {
+      if(ids.Length() > 0 && bssRandInt(0, 3) == 0)
+      {
+        uint32_t k = (uint32_t)bssRandInt(0, ids.Length());
+        TEST(map.Remove(ids[k]));
+        ref.Remove(ids[k]);
+        dead.Add(ids[k]);
+        ids[k] = ids.Back();
+        ids.RemoveLast();
+      }
+      else
+      {
+        uint64_t id = map.Insert(i);
+        TEST(!ref.Exists(id));
+        ref.Insert(id, i);
+        ids.Add(id);
+      }
+    }
+    TEST(map.Length() == ref.Length());
+    bool same = true;
+    for(auto id : ids)
+      same = same && map.Exists(id) && map[id] == ref[id];
+    for(auto id : dead)
+      same = same && !map.Exists(id);
+    for(uint32_t i = 0; i < map.Length(); ++i)
+      same = same && map.IndexOf(map.GetID(i)) == i;
+    TEST(same);
+  }
+
+  {
+    SlotMap<int, uint32_t, ARRAY_SIMPLE, StandardAllocator<int>, 2> tiny; // 3 slots, each with 2^30 generations
+    uint32_t ids[3];
+    for(int i = 0; i < 3; ++i)
+      ids[i] = tiny.Insert(i);
+    TEST(tiny.Insert(3) == 0);
+    TEST(tiny.Remove(ids[1]));
+    TEST(tiny.Insert(3) != 0);
+  }
+
+  {
+    DEBUG_CDT<true>::count = 0;
+    {
+      SlotMap<DEBUG_CDT<true>, uint32_t, ARRAY_SAFE> map;
+      uint32_t ids[10];
+      for(int i = 0; i < 10; ++i)
+        ids[i] = map.Emplace(i);
+      TEST(DEBUG_CDT<true>::count == 10);
+      for(int i = 0; i < 10; i += 2)
+        map.Remove(ids[i]);
+      TEST(DEBUG_CDT<true>::count == 5);
+      bool same = true;
+      for(int i = 1; i < 10; i += 2)
+        same = same && map[ids[i]]._index == i;
+      TEST(same);
+    }
+    TEST(!DEBUG_CDT<true>::count);
+  }
+
+  {
+    const int NTHREADS = 4;
+    const int NKEYS = 4000;
+    DEBUG_CDT<true>::count = 0;
+    {
+      ConcurrentSlotMap<DEBUG_CDT<true>> map(NKEYS);
+      uint32_t ids[NKEYS];
+      std::atomic<int> missing(0);
+
+      auto fill = [&](int id) {
+        while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+        for(int i = id; i < NKEYS; i += NTHREADS)
+        {
+          ids[i] = map.Emplace(i);
+          DEBUG_CDT<true>* p = map.Get(ids[i]);
+          if(!p || p->_index != i) missing.fetch_add(1, std::memory_order_relaxed);
+        }
+      };
+      startflag.store(false);
+      Thread threads[NTHREADS];
+      for(int t = 0; t < NTHREADS; ++t)
+        threads[t] = Thread(fill, t);
+      startflag.store(true);
+      for(int t = 0; t < NTHREADS; ++t)
+        threads[t].join();
+
+      TEST(!missing.load());
+      TEST(map.Length() == NKEYS);
+      TEST(DEBUG_CDT<true>::count == NKEYS);
+      TEST(map.Emplace(-1) == 0);
+      for(int i = 0; i < NKEYS; i += 2)
+        TEST(map.Remove(ids[i]));
+      TEST(map.Length() == NKEYS / 2);
+      bool same = true;
+      for(int i = 0; i < NKEYS; ++i)
+        same = same && (map.Exists(ids[i]) == ((i % 2) != 0)) && (!(i % 2) || map[ids[i]]._index == i);
+      TEST(same);
+
+      uint32_t old[NKEYS];
+      memcpy(old, ids, sizeof(ids));
+      startflag.store(false);
+      for(int t = 0; t < NTHREADS; ++t) // Refills the holes concurrently from the freelist
+        threads[t] = Thread([&](int id) {
+        while(!startflag.load(std::memory_order_acquire)) std::this_thread::yield();
+        for(int i = id * 2; i < NKEYS; i += NTHREADS * 2)
+          ids[i] = map.Emplace(i);
+      }, t);
+      startflag.store(true);
+      for(int t = 0; t < NTHREADS; ++t)
+        threads[t].join();
+
+      TEST(map.Length() == NKEYS);
+      same = true;
+      for(int i = 0; i < NKEYS; ++i)
+        same = same && map.Exists(ids[i]) && map[ids[i]]._index == i && (!(i % 2) ? !map.Exists(old[i]) : ids[i] == old[i]);
+      TEST(same);
+    }
+    TEST(!DEBUG_CDT<true>::count);
+  }
+
+  ENDTEST;
+}
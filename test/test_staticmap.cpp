@@ -0,0 +1,190 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/StaticMap.h"
+#include "bss-util/Map.h"
+#include "bss-util/HighPrecisionTimer.h"
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace bss;
+
+namespace {
+  // Builds a map from shuffled keys and checks every lookup, bound and the iteration order against a std::map.
+  template<class K, char(*CFunc)(const K&, const K&), class LESS>
+  bool staticmap_check(const std::vector<K>& keys)
+  {
+    std::vector<int> vals(keys.size());
+    std::map<K, int, LESS> ref;
+    for(size_t i = 0; i < keys.size(); ++i)
+      ref[keys[i]] = vals[i] = (int)i * 3;
+    StaticMap<K, int, CFunc> map(keys.data(), vals.data(), keys.size());
+    if(map.Length() != keys.size() || (keys.size() > 0 && (map.Front() != ref.begin()->first || map.Back() != ref.rbegin()->first)))
+      return false;
+    for(size_t i = 0; i < keys.size(); ++i)
+      if(map.Get(keys[i], -1) != vals[i] || map.Find(keys[i]).GetKey() != keys[i])
+        return false;
+    auto r = ref.begin();
+    for(auto e : map)
+    {
+      if(r == ref.end() || e.first != r->first || e.second != r->second)
+        return false;
+      ++r;
+    }
+    if(r != ref.end())
+      return false;
+    for(auto& e : ref) // Lower bounds of existing keys are trivial, so also look between them
+    {
+      for(const K& k : { e.first, (K)(e.first - 1), (K)(e.first + 1) })
+      {
+        auto lo = map.LowerBound(k);
+        auto rlo = ref.lower_bound(k);
+        if((lo == map.end()) != (rlo == ref.end()) || (lo != map.end() && lo.GetKey() != rlo->first))
+          return false;
+        if(map.Exists(k) != (ref.find(k) != ref.end()))
+          return false;
+      }
+    }
+    return true;
+  }
+}
+
+TESTDEF::RETPAIR test_STATICMAP()
+{
+  BEGINTEST;
+
+  {
+    StaticMap<int, int> empty;
+    TEST(empty.Empty());
+    TEST(empty.GetRef(3) == 0);
+    TEST(empty.Get(3, -1) == -1);
+    TEST(empty.begin() == empty.end());
+    TEST(empty.LowerBound(3) == empty.end());
+    TEST(empty.Build(0, 0, 0));
+
+    StaticMap<int, int> small = { { 5, 50 }, { -2, 20 }, { 9, 90 } };
+    TEST(small.Length() == 3);
+    TEST(small.Get(-2, 0) == 20);
+    TEST(small.Get(9, 0) == 90);
+    TEST(!small.Exists(4));
+    TEST(*small.LowerBound(4) == (std::pair<const int&, const int&>(5, 50)));
+    TEST(small.Front() == -2);
+    TEST(small.Back() == 9);
+    StaticMap<int, int> copy(small);
+    TEST(copy.Get(5, 0) == 50);
+    StaticMap<int, int> moved(std::move(copy));
+    TEST(moved.Get(5, 0) == 50);
+    TEST(copy.Empty());
+    moved.Clear();
+    TEST(moved.Empty());
+    TEST(moved.begin() == moved.end());
+
+    int dup[] = { 1, 2, 3, 2 };
+    int vals[] = { 1, 2, 3, 4 };
+    TEST(!small.Build(dup, vals, 4));
+    TEST(small.Empty());
+    TEST(!small.Exists(1));
+  }
+
+  {
+    for(size_t n : { 1, 2, 15, 16, 17, 100, 272, 273, 290, 5000, 50000 })
+    {
+      std::vector<int> keys(n);
+      for(size_t i = 0; i < n; ++i)
+        keys[i] = (int)(i * 3) - 10000;
+      Shuffle(keys.data(), (int)n);
+      TEST((staticmap_check<int, CompT<int>, std::less<int>>(keys)));
+      TEST((staticmap_check<int, CompTInv<int>, std::greater<int>>(keys))); // Not the default comparison, so this uses the Eytzinger layout
+    }
+    std::vector<uint32_t> u32;
+    std::vector<int64_t> i64;
+    std::vector<double> f64;
+    for(int i = 0; i < 3000; ++i)
+    {
+      u32.push_back(0x7FFFF000u + (uint32_t)i * 3); // Crosses the sign bit
+      i64.push_back((int64_t)(i - 1500) * 0x100000001LL);
+      f64.push_back((i - 1500) * 4.0);
+    }
+    Shuffle(u32.data(), (int)u32.size());
+    TEST((staticmap_check<uint32_t, CompT<uint32_t>, std::less<uint32_t>>(u32)));
+    TEST((staticmap_check<int64_t, CompT<int64_t>, std::less<int64_t>>(i64)));
+    TEST((staticmap_check<double, CompT<double>, std::less<double>>(f64)));
+  }
+
+  {
+    const size_t N = 2000;
+    std::vector<Str> names(N);
+    for(size_t i = 0; i < N; ++i)
+      names[i] = StrF("name%zu", (i * 7919) % N);
+    StaticMap<Str, void> set(names.data(), N);
+    TEST(set.Length() == N);
+    TESTCOUNTALL(N, set.Exists(names[i]));
+    TEST(!set.Exists("name"));
+    TEST(set.Get("name12", "") == "name12");
+    TEST(set.Front() == "name0");
+    TEST(set.Back() == "name999");
+    size_t count = 0;
+    bool sorted = true;
+    const Str* prev = 0;
+    for(auto& k : set)
+    {
+      sorted = sorted && (!prev || *prev < k);
+      prev = &k;
+      ++count;
+    }
+    TEST(sorted);
+    TEST(count == N);
+
+    StaticMap<const char*, int, CompStr<const char*>> words = { { "red", 1 }, { "green", 2 }, { "blue", 3 } };
+    TEST(words.Get("green", 0) == 2);
+    TEST(words.Get("purple", 0) == 0);
+    TEST(!strcmp(words.Front(), "blue"));
+  }
+
+  ENDTEST;
+}
+
+// Compares lookups in a StaticMap against a Map, which binary searches a sorted array, for integer and string keys.
+void profile_staticmap()
+{
+  for(size_t n : { (size_t)1000, (size_t)100000, (size_t)1000000 })
+  {
+    std::vector<int> keys(n);
+    std::vector<int> vals(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+      keys[i] = (int)(i * 7);
+      vals[i] = (int)i;
+    }
+    std::vector<int> queries(bssmax(n, (size_t)1000000));
+    for(size_t i = 0; i < queries.size(); ++i)
+      queries[i] = keys[bssRandInt(0, (int64_t)n)];
+
+    StaticMap<int, int> smap(keys.data(), vals.data(), n);
+    StaticMap<int, int, CompTInv<int>> emap(keys.data(), vals.data(), n);
+    Map<int, int> map;
+    for(size_t i = 0; i < n; ++i)
+      map.Insert(keys[i], vals[i]);
+
+    uint64_t sum = 0;
+    uint64_t t[3];
+    auto prof = HighPrecisionTimer::OpenProfiler();
+    for(int q : queries)
+      sum += map.GetData(q);
+    t[0] = HighPrecisionTimer::CloseProfiler(prof);
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(int q : queries)
+      sum += smap.Get(q, 0);
+    t[1] = HighPrecisionTimer::CloseProfiler(prof);
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(int q : queries)
+      sum += emap.Get(q, 0);
+    t[2] = HighPrecisionTimer::CloseProfiler(prof);
+
+    double q = (double)queries.size();
+    std::cout << n << " int keys: Map " << (t[0] / q) << " ns, StaticMap (k-ary) " << (t[1] / q) << " ns, StaticMap (Eytzinger) " << (t[2] / q) <<
+      " ns (" << (sum % 2) << ")" << std::endl;
+  }
+}
@@ -5,6 +5,7 @@
 #include "bss-util/Thread.h"
 #include "bss-util/algo.h"
 #include "bss-util/HighPrecisionTimer.h"
+#include "bss-util/bss_util_c.h"
 
 using namespace bss;
 
@@ -19,6 +20,34 @@ TESTDEF::RETPAIR test_THREAD()
   m = HighPrecisionTimer::OpenProfiler();
   s.Notify();
   TEST(t.join(1000) != (size_t)~0);
+
+  {
+    size_t n = bssGetProcessorCores(0, 0);
+    TEST(n >= 1);
+    std::unique_ptr<size_t[]> cpus(new size_t[n]);
+    for(size_t i = 0; i < n; ++i)
+      cpus[i] = i;
+    Thread w([](Semaphore& sem) { sem.Wait(); }, std::ref(s));
+#if defined(BSS_PLATFORM_WIN32) || defined(BSS_PLATFORM_LINUX)
+    TEST(w.SetName("bss-test-thread"));
+    TEST(w.SetAffinity(cpus.get(), n));
+#endif
+#ifdef BSS_PLATFORM_LINUX
+    cpu_set_t allowed; // Pin the thread to the last processor we're allowed to run on, then check the OS actually did it
+    TEST(!sched_getaffinity(0, sizeof(cpu_set_t), &allowed));
+    size_t last = 0;
+    for(size_t i = 0; i < n && i < CPU_SETSIZE; ++i)
+      if(CPU_ISSET(i, &allowed))
+        last = i;
+    TEST(w.SetAffinity(last));
+    cpu_set_t set;
+    TEST(!pthread_getaffinity_np(w.native_handle(), sizeof(cpu_set_t), &set));
+    TEST(CPU_COUNT(&set) == 1 && CPU_ISSET(last, &set));
+#endif
+    TEST(w.SetPriority(PRIORITY_NORMAL));
+    s.Notify();
+    w.join();
+  }
   //std::cout << "\n" << m << std::endl;
   //while(i > 0)
   //{
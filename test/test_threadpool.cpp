@@ -3,7 +3,9 @@
 
 #include "test.h"
 #include "bss-util/ThreadPool.h"
+#include "bss-util/HighPrecisionTimer.h"
 #include <algorithm>
+#include <iostream>
 
 using namespace bss;
 
@@ -44,5 +46,176 @@ TESTDEF::RETPAIR test_THREADPOOL()
     TEST(check);
   }
 
+  {
+    ThreadPool pool(2);
+    size_t cores = bssGetProcessorCores(0, 0);
+    size_t pinned = pool.PinWorkers();
+    TEST(pinned <= 2 && pinned <= cores);
+    size_t reserved = 0;
+    TEST(pool.PinWorkers(&reserved, 1) <= pinned);
+    pool.NameWorkers("bss-worker");
+    pq_c = 0;
+    startflag.store(true, std::memory_order_release);
+    for(int i = 0; i < 100; ++i)
+      pool.AddFunc(pooltest, i);
+    pool.Wait();
+    TEST(pq_c == 100);
+  }
+
+#ifdef BSS_PLATFORM_LINUX
+  {
+    ThreadPool pool(1); // A pinned worker has to see exactly one processor in its own mask
+    TEST(pool.PinWorkers() == 1);
+    std::atomic<int> count(-1);
+    pool.AddTask(Task([&count]() {
+      cpu_set_t set;
+      count.store(!pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) ? CPU_COUNT(&set) : 0, std::memory_order_release);
+    }));
+    while(count.load(std::memory_order_acquire) < 0) {} // Wait() would run the task on this thread, so let the worker take it
+    TEST(count.load(std::memory_order_acquire) == 1);
+    pool.Wait();
+  }
+#endif
+
+  {
+    int calls = 0;
+    Task a([&calls]() { ++calls; });
+    TEST(a);
+    a();
+    TEST(calls == 1);
+    Task b(std::move(a));
+    TEST(!a);
+    b();
+    TEST(calls == 2);
+    a = std::move(b);
+    a();
+    TEST(calls == 3 && !b);
+    Task c(+[](void* p) { *reinterpret_cast<int*>(p) += 10; }, &calls);
+    c();
+    TEST(calls == 13);
+
+    DEBUG_CDT<true>::count = 0;
+    {
+      int big[32] = { 0 };
+      big[31] = 5;
+      Task d([big, &calls]() { calls += big[31]; }); // Too big to store inline
+      Task e([cdt = DEBUG_CDT<true>(7), &calls]() { calls += cdt._index; }); // Can't be moved without throwing
+      TEST(DEBUG_CDT<true>::count == 1);
+      Task f(std::move(e));
+      TEST(DEBUG_CDT<true>::count == 1);
+      d();
+      f();
+      TEST(calls == 25);
+      f = std::move(d);
+      TEST(!DEBUG_CDT<true>::count);
+      f();
+      TEST(calls == 30);
+    }
+    TEST(!DEBUG_CDT<true>::count);
+  }
+
+  {
+    const int NTASKS = 5000;
+    ThreadPool pool(3, 1024);
+    std::atomic<int> sum(0);
+    std::unique_ptr<Task[]> tasks(new Task[NTASKS]);
+    for(int i = 0; i < NTASKS; ++i)
+      tasks[i] = Task([&sum, i]() { sum.fetch_add(i, std::memory_order_relaxed); });
+    pool.AddTasks(Slice<Task>(tasks.get(), NTASKS)); // More than the queue holds, so it has to grow
+    pool.Wait();
+    TEST(pool.Capacity() >= NTASKS);
+    TEST(sum.load() == NTASKS * (NTASKS - 1) / 2);
+    bool empty = true;
+    for(int i = 0; i < NTASKS; ++i)
+      empty = empty && !tasks[i];
+    TEST(empty);
+
+    sum.store(0);
+    for(int i = 0; i < 1000; ++i)
+      tasks[i] = Task([&sum, i]() { sum.fetch_add(i, std::memory_order_relaxed); });
+    pool.AddTasks(Slice<Task>(tasks.get(), 1000));
+    for(int i = 0; i < 1000; ++i)
+      pool.AddTask([&sum, i]() { sum.fetch_add(i, std::memory_order_relaxed); });
+    pool.Wait();
+    TEST(sum.load() == 999 * 1000);
+  }
+
+  {
+    const int NTASKS = 20000; // With the default capacity, only the first batch this big should make the queue grow
+    ThreadPool pool(2);
+    std::atomic<int> sum(0);
+    std::unique_ptr<Task[]> tasks(new Task[NTASKS]);
+    size_t capacity = 0;
+    bool grew = false;
+    for(int k = 0; k < 3; ++k)
+    {
+      for(int i = 0; i < NTASKS; ++i)
+        tasks[i] = Task([&sum]() { sum.fetch_add(1, std::memory_order_relaxed); });
+      pool.AddTasks(Slice<Task>(tasks.get(), NTASKS));
+      pool.Wait();
+      grew = grew || (k > 0 && pool.Capacity() != capacity);
+      capacity = pool.Capacity();
+    }
+    TEST(sum.load() == NTASKS * 3);
+    TEST(capacity >= NTASKS);
+    TEST(!grew);
+  }
+
+  {
+    ThreadPool pool(1, 8); // A single worker runs tasks in the order it pops them, which has to stay FIFO after the queue grows
+    std::atomic<bool> gate(false);
+    std::atomic<int> done(0);
+    int order[64];
+    pool.AddTask([&gate]() { while(!gate.load(std::memory_order_acquire)) {} });
+    for(int i = 0; i < 64; ++i)
+      pool.AddTask([&order, &done, i]() { order[done.load(std::memory_order_relaxed)] = i; done.fetch_add(1, std::memory_order_release); });
+    TEST(pool.Capacity() > 8);
+    gate.store(true, std::memory_order_release);
+    while(done.load(std::memory_order_acquire) < 64) {}
+    bool fifo = true;
+    for(int i = 0; i < 64; ++i)
+      fifo = fifo && order[i] == i;
+    TEST(fifo);
+    pool.Wait();
+
+    ThreadPool idle(0, 8);
+    ThreadPool moved(std::move(idle));
+    TEST(!idle.Capacity());
+    TEST(moved.Capacity() >= 8);
+  }
+
   ENDTEST;
 }
+
+// Compares submitting lots of tiny tasks one at a time with AddFunc, one at a time as inline tasks, and as a single batch.
+void profile_threadpool()
+{
+  const int NTASKS = 100000;
+  ThreadPool pool(ThreadPool::IdealWorkerCount()); // The default capacity, which grows to fit the first batch
+  std::atomic<int> sum(0);
+  std::unique_ptr<Task[]> tasks(new Task[NTASKS]);
+  void(*add)(std::atomic<int>*) = [](std::atomic<int>* s) { s->fetch_add(1, std::memory_order_relaxed); };
+
+  for(int k = 0; k < 3; ++k)
+  {
+    auto prof = HighPrecisionTimer::OpenProfiler();
+    for(int i = 0; i < NTASKS; ++i)
+      pool.AddFunc(add, &sum);
+    pool.Wait();
+    uint64_t a = HighPrecisionTimer::CloseProfiler(prof);
+
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(int i = 0; i < NTASKS; ++i)
+      pool.AddTask([&sum]() { sum.fetch_add(1, std::memory_order_relaxed); });
+    pool.Wait();
+    uint64_t b = HighPrecisionTimer::CloseProfiler(prof);
+
+    prof = HighPrecisionTimer::OpenProfiler();
+    for(int i = 0; i < NTASKS; ++i)
+      tasks[i] = Task([&sum]() { sum.fetch_add(1, std::memory_order_relaxed); });
+    pool.AddTasks(Slice<Task>(tasks.get(), NTASKS));
+    pool.Wait();
+    uint64_t c = HighPrecisionTimer::CloseProfiler(prof);
+    std::cout << NTASKS << " tasks: AddFunc " << a << " ns, AddTask " << b << " ns, AddTasks " << c << " ns (capacity " << pool.Capacity() << ")" << std::endl;
+  }
+}
@@ -0,0 +1,88 @@
+// Copyright 2018 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in "bss_util.h"
+
+#include "test.h"
+#include "bss-util/TimingWheel.h"
+#include <functional>
+
+using namespace bss;
+
+TESTDEF::RETPAIR test_TIMINGWHEEL()
+{
+  BEGINTEST;
+  {
+    bool ret[3] = { false,false,true };
+    TimingWheel<std::function<double()>> s;
+    s.Add(0.0, [&]()->double { ret[0] = true; return 0.0; });
+    auto repeat = s.Add(0.0, [&]()->double { ret[1] = true; return 10000000.0; });
+    auto never = s.Add(10000000.0, [&]()->double { ret[2] = false; return 0.0; });
+    TEST(s.Length() == 3);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    s.Update();
+    TEST(ret[0]);
+    TEST(ret[1]);
+    TEST(ret[2]);
+    TEST(s.Length() == 2);
+    TEST(s.Exists(repeat));
+    TEST(s.Cancel(never));
+    TEST(!s.Cancel(never));
+    TEST(!s.Exists(never));
+    TEST(s.Length() == 1);
+    TEST(s.Reschedule(repeat, 0.0));
+    ret[1] = false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    s.Update();
+    TEST(ret[1]);
+  }
+
+  {
+    // With a 1 microsecond resolution these delays land on three different levels, so they have to be cascaded down before firing.
+    TimingWheel<std::function<double()>> s(0.001);
+    int order[4] = { 0 };
+    int count = 0;
+    s.Add(70.0, [&]()->double { order[count++] = 3; return 0.0; });
+    s.Add(0.1, [&]()->double { order[count++] = 1; return 0.0; });
+    s.Add(1.0, [&]()->double { order[count++] = 2; return 0.0; });
+    auto cancelled = s.Add(0.5, [&]()->double { order[count++] = -1; return 0.0; });
+    s.Add(0.2, [&]()->double { s.Cancel(cancelled); return 0.0; });
+    for(int i = 0; i < 100 && count < 3; ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      s.Update();
+    }
+    TEST(count == 3);
+    TEST(order[0] == 1);
+    TEST(order[1] == 2);
+    TEST(order[2] == 3);
+    TEST(s.Length() == 0);
+  }
+
+  {
+    TimingWheel<std::function<double()>> s;
+    int fired = 0;
+    TimingWheel<std::function<double()>>::ID ids[1000];
+    for(int i = 0; i < 1000; ++i)
+      ids[i] = s.Add(0.0, [&]()->double { ++fired; return 0.0; });
+    for(int i = 0; i < 1000; i += 2)
+      s.Cancel(ids[i]);
+    TEST(s.Length() == 500);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    s.Update();
+    TEST(fired == 500);
+    TEST(s.Length() == 0);
+  }
+
+  {
+    ThreadPool pool(1);
+    std::atomic<int> fired(0);
+    TimingWheel<std::function<double()>> s(1.0, &pool);
+    for(int i = 0; i < 10; ++i)
+      s.Add(0.0, [&]()->double { fired.fetch_add(1); return 5.0; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    s.Update();
+    pool.Wait();
+    TEST(fired.load() == 10);
+    TEST(s.Length() == 0);
+  }
+  ENDTEST;
+}